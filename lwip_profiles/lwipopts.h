@@ -0,0 +1,138 @@
+/******************************************************************************
+* File Name:   lwipopts.h
+*
+* Description: This file contains the project-owned lwIP tuning profiles. It
+* includes the lwipopts.h of the wifi-core-freertos-lwip-mbedtls library and
+* overrides the TCP window, send buffer, MSS, PBUF pool and mailbox sizes for
+* the profile selected with LWIP_PROFILE in the Makefile.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef LWIP_PROFILES_LWIPOPTS_H_
+#define LWIP_PROFILES_LWIPOPTS_H_
+
+/* Start from the options of the wifi-core-freertos-lwip-mbedtls library. The
+ * Makefile passes its path in LWIP_LIBRARY_OPTS_FILE.
+ */
+#include LWIP_LIBRARY_OPTS_FILE
+
+/* Remove the library values of every option set by a profile. The low
+ * watermarks and the window update threshold are derived from the new sizes
+ * by lwIP's opt.h.
+ */
+#undef TCP_MSS
+#undef TCP_WND
+#undef TCP_SND_BUF
+#undef TCP_SND_QUEUELEN
+#undef TCP_SNDLOWAT
+#undef TCP_SNDQUEUELOWAT
+#undef TCP_WND_UPDATE_THRESHOLD
+#undef MEMP_NUM_TCP_SEG
+#undef PBUF_POOL_SIZE
+#undef TCPIP_MBOX_SIZE
+#undef DEFAULT_TCP_RECVMBOX_SIZE
+#undef DEFAULT_UDP_RECVMBOX_SIZE
+#undef DEFAULT_RAW_RECVMBOX_SIZE
+#undef DEFAULT_ACCEPTMBOX_SIZE
+
+#if defined(LWIP_PROFILE_LOW_MEMORY)
+
+/* Small segments and a four-segment window. Lowest RAM use; throughput is
+ * bounded by one round trip per window.
+ */
+#define TCP_MSS                         (536)
+#define TCP_WND                         (4 * TCP_MSS)
+#define TCP_SND_BUF                     (4 * TCP_MSS)
+#define TCP_SND_QUEUELEN                (8)
+#define MEMP_NUM_TCP_SEG                (8)
+#define PBUF_POOL_SIZE                  (8)
+#define TCPIP_MBOX_SIZE                 (8)
+#define DEFAULT_TCP_RECVMBOX_SIZE       (6)
+#define DEFAULT_UDP_RECVMBOX_SIZE       (6)
+#define DEFAULT_RAW_RECVMBOX_SIZE       (6)
+#define DEFAULT_ACCEPTMBOX_SIZE         (4)
+
+#elif defined(LWIP_PROFILE_BALANCED)
+
+/* Full-size segments with an eight-segment window in both directions. */
+#define TCP_MSS                         (1460)
+#define TCP_WND                         (8 * TCP_MSS)
+#define TCP_SND_BUF                     (8 * TCP_MSS)
+#define TCP_SND_QUEUELEN                (16)
+#define MEMP_NUM_TCP_SEG                (16)
+#define PBUF_POOL_SIZE                  (16)
+#define TCPIP_MBOX_SIZE                 (16)
+#define DEFAULT_TCP_RECVMBOX_SIZE       (12)
+#define DEFAULT_UDP_RECVMBOX_SIZE       (12)
+#define DEFAULT_RAW_RECVMBOX_SIZE       (12)
+#define DEFAULT_ACCEPTMBOX_SIZE         (8)
+
+#elif defined(LWIP_PROFILE_HIGH_THROUGHPUT)
+
+/* Large send buffer for uplink-heavy use, so that the application can keep
+ * the link busy while earlier segments wait for acknowledgment. The window
+ * stays below 64 KB so that window scaling is not needed.
+ */
+#define TCP_MSS                         (1460)
+#define TCP_WND                         (16 * TCP_MSS)
+#define TCP_SND_BUF                     (32 * TCP_MSS)
+#define TCP_SND_QUEUELEN                (64)
+#define MEMP_NUM_TCP_SEG                (64)
+#define PBUF_POOL_SIZE                  (24)
+#define TCPIP_MBOX_SIZE                 (32)
+#define DEFAULT_TCP_RECVMBOX_SIZE       (24)
+#define DEFAULT_UDP_RECVMBOX_SIZE       (24)
+#define DEFAULT_RAW_RECVMBOX_SIZE       (24)
+#define DEFAULT_ACCEPTMBOX_SIZE         (8)
+
+#else
+#error "No lwIP profile selected. Set LWIP_PROFILE in the Makefile."
+#endif
+
+/* The send buffer is copied into the lwIP heap; keep room for it on top of
+ * the other heap users when the heap is not taken from the C library.
+ */
+#if !defined(MEM_LIBC_MALLOC) || !MEM_LIBC_MALLOC
+#if defined(MEM_SIZE) && (MEM_SIZE < (TCP_SND_BUF + (4 * 1024)))
+#undef MEM_SIZE
+#define MEM_SIZE                        (TCP_SND_BUF + (4 * 1024))
+#endif
+#endif
+
+/* Lets the application check that this file is the lwipopts.h in use. */
+#define LWIP_PROFILE_APPLIED            (1)
+
+#endif /* LWIP_PROFILES_LWIPOPTS_H_ */
@@ -0,0 +1,363 @@
+/******************************************************************************
+* File Name:   lwip_zero_copy_rx.c
+*
+* Description: This file contains the zero-copy receive path for FreeRTOS/lwIP
+* builds. A native lwIP netconn is used instead of a secure socket so that
+* received pbuf chains can be walked in place by the command parser. The
+* receive window is re-opened and the pbufs are freed only after the commands
+* are processed.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdbool.h>
+#include <stdio.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* lwIP header files. */
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+
+/* Zero-copy receive header file. */
+#include "lwip_zero_copy_rx.h"
+
+/* When an lwIP profile is selected in the Makefile, lwip_profiles/lwipopts.h
+ * must take precedence over the lwipopts.h of the library.
+ */
+#if (defined(LWIP_PROFILE_LOW_MEMORY) || defined(LWIP_PROFILE_BALANCED) || \
+     defined(LWIP_PROFILE_HIGH_THROUGHPUT)) && !defined(LWIP_PROFILE_APPLIED)
+#error "The selected lwIP profile is not in effect; check the include path order."
+#endif
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static void lwip_zc_rx_thread(cy_thread_arg_t arg);
+static void lwip_zc_rx_process(const uint8_t *data, uint32_t length);
+static cy_rslt_t lwip_zc_err_to_result(err_t err);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Connection to the TCP server, and the mutex that serializes its deletion
+ * by the receive thread with lwip_zc_rx_disconnect and lwip_zc_rx_send.
+ */
+static struct netconn *zc_conn;
+static cy_mutex_t zc_conn_mutex;
+static bool zc_conn_mutex_created;
+
+/* Thread that receives the pbuf chains. */
+static cy_thread_t zc_rx_thread;
+static bool zc_rx_thread_created;
+
+/* Consumer of the received data and disconnection notification. */
+static cmd_stream_t *zc_stream;
+static lwip_zc_rx_disconnect_fn_t zc_disconnect_fn;
+static void *zc_disconnect_arg;
+
+/*******************************************************************************
+ * Function Name: lwip_zc_rx_connect
+ *******************************************************************************
+ * Summary:
+ *  Connects to the TCP server and starts the receive thread that feeds the
+ *  received data to the command parser without copying it.
+ *
+ * Parameters:
+ *  const cy_socket_sockaddr_t *address: Address of the TCP server socket
+ *  cmd_stream_t *stream: Command stream that consumes the received data
+ *  lwip_zc_rx_disconnect_fn_t disconnect_fn: Called when the connection is lost
+ *  void *disconnect_arg: Argument passed on to disconnect_fn
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t lwip_zc_rx_connect(const cy_socket_sockaddr_t *address, cmd_stream_t *stream,
+                             lwip_zc_rx_disconnect_fn_t disconnect_fn, void *disconnect_arg)
+{
+    struct netconn *conn;
+    ip_addr_t server_ip;
+    uint32_t ip_v4;
+    err_t err;
+    cy_rslt_t result;
+
+    if ((address == NULL) || (stream == NULL))
+    {
+        return CY_RSLT_MODULE_SECURE_SOCKETS_BADARG;
+    }
+
+    if (!zc_conn_mutex_created)
+    {
+        result = cy_rtos_mutex_init(&zc_conn_mutex, false);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        zc_conn_mutex_created = true;
+    }
+
+    /* Wait for the thread of the previous connection to finish. */
+    if (zc_rx_thread_created)
+    {
+        cy_rtos_thread_join(&zc_rx_thread);
+        zc_rx_thread_created = false;
+    }
+
+    zc_stream = stream;
+    zc_disconnect_fn = disconnect_fn;
+    zc_disconnect_arg = disconnect_arg;
+
+    /* Secure sockets stores the first octet in the least significant byte. */
+    ip_v4 = address->ip_address.ip.v4;
+    IP_ADDR4(&server_ip, (u8_t)(ip_v4), (u8_t)(ip_v4 >> 8),
+             (u8_t)(ip_v4 >> 16), (u8_t)(ip_v4 >> 24));
+
+    conn = netconn_new(NETCONN_TCP);
+    if (conn == NULL)
+    {
+        return CY_RSLT_MODULE_SECURE_SOCKETS_NOMEM;
+    }
+
+    err = netconn_connect(conn, &server_ip, address->port);
+    if (err != ERR_OK)
+    {
+        netconn_delete(conn);
+        return lwip_zc_err_to_result(err);
+    }
+
+    /* Published only once connected, so that no send uses it before. */
+    cy_rtos_mutex_get(&zc_conn_mutex, CY_RTOS_NEVER_TIMEOUT);
+    zc_conn = conn;
+    cy_rtos_mutex_set(&zc_conn_mutex);
+
+    result = cy_rtos_thread_create(&zc_rx_thread, lwip_zc_rx_thread, "Zero-copy RX",
+                                   NULL, LWIP_ZC_RX_THREAD_STACK_SIZE,
+                                   LWIP_ZC_RX_THREAD_PRIORITY, NULL);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        cy_rtos_mutex_get(&zc_conn_mutex, CY_RTOS_NEVER_TIMEOUT);
+        netconn_close(zc_conn);
+        netconn_delete(zc_conn);
+        zc_conn = NULL;
+        cy_rtos_mutex_set(&zc_conn_mutex);
+        return result;
+    }
+
+    zc_rx_thread_created = true;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: lwip_zc_rx_send
+ *******************************************************************************
+ * Summary:
+ *  Sends data to the TCP server on the zero-copy connection. The connection
+ *  is held for the whole write, so the receive thread deletes it only after
+ *  a send that races a disconnection.
+ *
+ * Parameters:
+ *  const uint8_t *data: Data to be sent
+ *  uint32_t length: Number of bytes to be sent
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t lwip_zc_rx_send(const uint8_t *data, uint32_t length)
+{
+    cy_rslt_t result = CY_RSLT_MODULE_SECURE_SOCKETS_NOT_CONNECTED;
+
+    if (!zc_conn_mutex_created)
+    {
+        return result;
+    }
+
+    cy_rtos_mutex_get(&zc_conn_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (zc_conn != NULL)
+    {
+        result = lwip_zc_err_to_result(netconn_write(zc_conn, data, length, NETCONN_COPY));
+    }
+    cy_rtos_mutex_set(&zc_conn_mutex);
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: lwip_zc_rx_disconnect
+ *******************************************************************************
+ * Summary:
+ *  Closes the zero-copy connection and waits for the receive thread to exit.
+ *  The disconnection callback is still called from the receive thread.
+ *
+ *******************************************************************************/
+void lwip_zc_rx_disconnect(void)
+{
+    if (!zc_rx_thread_created)
+    {
+        return;
+    }
+
+    /* Shutting down the receive side wakes the receive thread, which then
+     * closes and deletes the connection.
+     */
+    cy_rtos_mutex_get(&zc_conn_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (zc_conn != NULL)
+    {
+        netconn_shutdown(zc_conn, 1, 1);
+    }
+    cy_rtos_mutex_set(&zc_conn_mutex);
+
+    cy_rtos_thread_join(&zc_rx_thread);
+    zc_rx_thread_created = false;
+}
+
+/*******************************************************************************
+ * Function Name: lwip_zc_rx_thread
+ *******************************************************************************
+ * Summary:
+ *  Receives pbuf chains from the connection and passes each pbuf payload to
+ *  the command parser as a borrowed segment. The received bytes are reported
+ *  to lwIP and the chain is freed only after the parser returns, so the data
+ *  is never copied and the receive window reflects unprocessed commands.
+ *  While the flash download buffers are full, the thread waits for them, so
+ *  the receive window closes until the flash catches up.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void lwip_zc_rx_thread(cy_thread_arg_t arg)
+{
+    struct pbuf *chain;
+    struct pbuf *segment;
+    err_t err;
+
+    (void)arg;
+
+    for(;;)
+    {
+        err = netconn_recv_tcp_pbuf_flags(zc_conn, &chain, NETCONN_NOAUTORCVD);
+        if (err != ERR_OK)
+        {
+            break;
+        }
+
+        for (segment = chain; segment != NULL; segment = segment->next)
+        {
+            lwip_zc_rx_process((const uint8_t *)segment->payload, segment->len);
+        }
+
+        netconn_tcp_recvd(zc_conn, chain->tot_len);
+        pbuf_free(chain);
+    }
+
+    cy_rtos_mutex_get(&zc_conn_mutex, CY_RTOS_NEVER_TIMEOUT);
+    netconn_close(zc_conn);
+    netconn_delete(zc_conn);
+    zc_conn = NULL;
+    cy_rtos_mutex_set(&zc_conn_mutex);
+
+    if (zc_disconnect_fn != NULL)
+    {
+        zc_disconnect_fn(zc_disconnect_arg);
+    }
+
+    cy_rtos_thread_exit();
+}
+
+/*******************************************************************************
+ * Function Name: lwip_zc_rx_process
+ *******************************************************************************
+ * Summary:
+ *  Passes a pbuf payload to the command parser in segments that the stream
+ *  can hold if it stalls on a full flash download buffer, and waits for a
+ *  free buffer whenever it does.
+ *
+ *******************************************************************************/
+static void lwip_zc_rx_process(const uint8_t *data, uint32_t length)
+{
+    uint32_t chunk;
+
+    while (length > 0)
+    {
+        chunk = (length < CMD_STREAM_HOLD_SIZE) ? length : CMD_STREAM_HOLD_SIZE;
+        cmd_stream_process(zc_stream, data, chunk);
+        while (zc_stream->stalled)
+        {
+            cmd_stream_resume(zc_stream, CY_RTOS_NEVER_TIMEOUT);
+        }
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: lwip_zc_err_to_result
+ *******************************************************************************
+ * Summary:
+ *  Maps an lwIP error code to the equivalent secure sockets result code.
+ *
+ *******************************************************************************/
+static cy_rslt_t lwip_zc_err_to_result(err_t err)
+{
+    switch (err)
+    {
+        case ERR_OK:
+            return CY_RSLT_SUCCESS;
+
+        case ERR_MEM:
+        case ERR_BUF:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_NOMEM;
+
+        case ERR_TIMEOUT:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_TIMEOUT;
+
+        case ERR_CONN:
+        case ERR_CLSD:
+        case ERR_RST:
+        case ERR_ABRT:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_NOT_CONNECTED;
+
+        default:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_TCPIP_ERROR;
+    }
+}
+
+
+/* [] END OF FILE */
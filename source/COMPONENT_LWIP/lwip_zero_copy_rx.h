@@ -0,0 +1,82 @@
+/******************************************************************************
+* File Name:   lwip_zero_copy_rx.h
+*
+* Description: This file contains declarations of the zero-copy receive path
+* for FreeRTOS/lwIP builds. Received pbuf chains are handed to the command
+* parser in place and released only after the commands are processed.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef LWIP_ZERO_COPY_RX_H_
+#define LWIP_ZERO_COPY_RX_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include "cy_result.h"
+
+/* Cypress secure socket header file. */
+#include "cy_secure_sockets.h"
+
+/* Command parser header file. */
+#include "cmd_parser.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Stack size and priority of the receive thread. */
+#ifndef LWIP_ZC_RX_THREAD_STACK_SIZE
+#define LWIP_ZC_RX_THREAD_STACK_SIZE              (4u * 1024u)
+#endif
+
+#ifndef LWIP_ZC_RX_THREAD_PRIORITY
+#define LWIP_ZC_RX_THREAD_PRIORITY                (CY_RTOS_PRIORITY_NORMAL)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Function called from the receive thread when the connection is lost. */
+typedef void (*lwip_zc_rx_disconnect_fn_t)(void *arg);
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t lwip_zc_rx_connect(const cy_socket_sockaddr_t *address, cmd_stream_t *stream,
+                             lwip_zc_rx_disconnect_fn_t disconnect_fn, void *disconnect_arg);
+cy_rslt_t lwip_zc_rx_send(const uint8_t *data, uint32_t length);
+void lwip_zc_rx_disconnect(void);
+
+#endif /* LWIP_ZERO_COPY_RX_H_ */
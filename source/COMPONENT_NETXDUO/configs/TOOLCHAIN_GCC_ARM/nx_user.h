@@ -652,11 +652,11 @@
 */
 #define NX_DISABLE_IGMP_INFO
 
-/* Defined, packet information gathering is disabled.  */
+/* Defined, packet information gathering is disabled.  Packet information is kept
+   enabled so that the zero-copy transmit path can report pool exhaustion.  */
 /*
 #define NX_DISABLE_PACKET_INFO
 */
-#define NX_DISABLE_PACKET_INFO
 
 /* Defined, RARP information gathering is disabled.  */
 /*
@@ -719,10 +719,11 @@
 #define NX_DISABLE_PACKET_CHAIN
 */
 
-/* Defined, the IP instance manages two packet pools. */
-/*
+/* Defined, the IP instance manages two packet pools. The zero-copy transmit
+ * path installs its small packet pool as the auxiliary pool, so that TCP ACK
+ * and control packets do not take MTU-sized packets from the default pool.
+ */
 #define NX_ENABLE_DUAL_PACKET_POOL
-*/
 
 /* Configuration options for Others */
 
@@ -804,5 +805,33 @@ UINT cy_rand( void );
 #define NX_RAND                         cy_rand
 #endif
 
+/* Lean client profile.  Selected with NETXDUO_PROFILE=lean in the application Makefile, this
+   profile removes the features that a single-socket TCP client over Wi-Fi does not use and turns
+   on the TCP fast-path options.  Run-time error checking is removed as well, so the profile is
+   meant for release builds.  Packet information stays enabled, as the pool statistics of the
+   zero-copy path rely on it.  IPv6, IPsec, NAT, the raw packet filter and static routing are
+   already disabled in the default profile above.  */
+#ifdef NX_USER_PROFILE_LEAN
+
+/* Loopback interface and IP fragmentation; TCP segments are sized by the MSS.  */
+#define NX_DISABLE_LOOPBACK_INTERFACE
+#define NX_DISABLE_FRAGMENTATION
+#undef  NX_FRAGMENT_IMMEDIATE_ASSEMBLY
+
+/* The Wi-Fi link already checks every frame; TCP keeps its end-to-end checksum.  */
+#define NX_DISABLE_IP_RX_CHECKSUM
+#define NX_DISABLE_RX_SIZE_CHECKING
+
+/* Acknowledge every second segment right away instead of waiting for the delayed ACK timer.  */
+#define NX_TCP_IMMEDIATE_ACK
+#undef  NX_TCP_ACK_EVERY_N_PACKETS
+#define NX_TCP_ACK_EVERY_N_PACKETS  2
+
+/* Argument checking and asserts.  */
+#define NX_DISABLE_ERROR_CHECKING
+#define NX_DISABLE_ASSERT
+
+#endif /* NX_USER_PROFILE_LEAN */
+
 #endif
 
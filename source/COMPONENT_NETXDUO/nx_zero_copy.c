@@ -0,0 +1,536 @@
+/******************************************************************************
+* File Name:   nx_zero_copy.c
+*
+* Description: This file contains the zero-copy transmit path for ThreadX/NetX
+* Duo builds. Packets are allocated straight from the packet pools of the Wi-Fi
+* IP instance and sent on a native NetX Duo TCP socket, so the payload is
+* written only once. Small payloads are served from a dedicated small packet
+* pool, which is also the auxiliary pool NetX Duo uses for TCP control packets.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* Zero-copy transmit header file. */
+#include "nx_zero_copy.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Converts a timeout in milliseconds to NetX Duo timer ticks. */
+#define NX_ZC_MS_TO_TICKS(ms)                     (((ms) == CY_RTOS_NEVER_TIMEOUT) ? \
+                                                  NX_WAIT_FOREVER : \
+                                                  ((((ULONG)(ms)) * NX_IP_PERIODIC_RATE + 999u) / 1000u))
+
+/* Secure sockets stores the first octet of an IPv4 address in the least
+ * significant byte, while NetX Duo expects it in the most significant byte.
+ */
+#define NX_ZC_IPV4_TO_HOST_ORDER(v4)              ((((uint32_t)(v4) & 0x000000FFu) << 24) | \
+                                                  (((uint32_t)(v4) & 0x0000FF00u) << 8) | \
+                                                  (((uint32_t)(v4) & 0x00FF0000u) >> 8) | \
+                                                  (((uint32_t)(v4) & 0xFF000000u) >> 24))
+
+/* Payload of a small pool packet: the TCP/IP and link headers reserved by
+ * NX_TCP_PACKET plus NX_ZC_SMALL_DATA_SIZE bytes of data.
+ */
+#define NX_ZC_SMALL_POOL_PAYLOAD_SIZE             (NX_TCP_PACKET + NX_ZC_SMALL_DATA_SIZE)
+
+/* Memory for the small pool, including the packet headers and the alignment
+ * padding added by nx_packet_pool_create.
+ */
+#define NX_ZC_SMALL_POOL_MEMORY_SIZE              (NX_ZC_SMALL_POOL_PACKETS * \
+                                                  (sizeof(NX_PACKET) + NX_ZC_SMALL_POOL_PAYLOAD_SIZE + \
+                                                  (2u * sizeof(ULONG))))
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Packet pool and the statistics kept for it by this file. */
+typedef struct
+{
+    NX_PACKET_POOL *nx_pool;
+    uint32_t high_water_mark;
+    uint32_t allocations;
+    uint32_t fallbacks;
+    uint32_t waits;
+    uint32_t total_wait_ms;
+    uint32_t max_wait_ms;
+    uint32_t drops;
+} nx_zc_pool_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static void nx_zc_update_high_water_mark(nx_zc_pool_t *pool);
+static cy_rslt_t nx_zc_status_to_result(UINT status);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* IP instance of the Wi-Fi interface. */
+static NX_IP *zc_ip;
+
+/* Small packet pool and its memory. */
+static NX_PACKET_POOL zc_small_pool;
+static ULONG zc_small_pool_memory[NX_ZC_SMALL_POOL_MEMORY_SIZE / sizeof(ULONG)];
+static bool zc_small_pool_created;
+
+/* Small and large packet pools, indexed by nx_zc_pool_id_t. */
+static nx_zc_pool_t zc_pools[NX_ZC_POOL_COUNT];
+
+/* Native NetX Duo socket used for the zero-copy bulk uplink. */
+static NX_TCP_SOCKET zc_socket;
+static bool zc_connected;
+
+/*******************************************************************************
+ * Function Name: nx_zc_init
+ *******************************************************************************
+ * Summary:
+ *  Looks up the NetX Duo IP instance of the given Wi-Fi interface, creates the
+ *  small packet pool and the TCP socket used for the zero-copy bulk uplink.
+ *  The small pool is also installed as the auxiliary packet pool of the IP
+ *  instance, so that NetX Duo sends TCP ACK and control packets from it
+ *  instead of from the MTU-sized default pool. Must be called after the Wi-Fi
+ *  interface is up.
+ *
+ * Parameters:
+ *  cy_network_hw_interface_type_t iface_type: Wi-Fi interface (STA or AP)
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t nx_zc_init(cy_network_hw_interface_type_t iface_type)
+{
+    UINT status;
+
+    zc_ip = (NX_IP *)cy_network_get_nw_interface(iface_type, 0);
+    if ((zc_ip == NX_NULL) || (zc_ip->nx_ip_default_packet_pool == NX_NULL))
+    {
+        printf("Zero-copy: network interface is not up\n");
+        return CY_RSLT_MODULE_SECURE_SOCKETS_NOT_CONNECTED;
+    }
+
+    if (!zc_small_pool_created)
+    {
+        status = nx_packet_pool_create(&zc_small_pool, "zero-copy small pool",
+                                       NX_ZC_SMALL_POOL_PAYLOAD_SIZE, zc_small_pool_memory,
+                                       sizeof(zc_small_pool_memory));
+        if (status != NX_SUCCESS)
+        {
+            return nx_zc_status_to_result(status);
+        }
+        zc_small_pool_created = true;
+    }
+
+    status = nx_ip_auxiliary_packet_pool_set(zc_ip, &zc_small_pool);
+    if (status != NX_SUCCESS)
+    {
+        return nx_zc_status_to_result(status);
+    }
+
+    memset(zc_pools, 0, sizeof(zc_pools));
+    zc_pools[NX_ZC_POOL_SMALL].nx_pool = &zc_small_pool;
+    zc_pools[NX_ZC_POOL_LARGE].nx_pool = zc_ip->nx_ip_default_packet_pool;
+    nx_zc_update_high_water_mark(&zc_pools[NX_ZC_POOL_SMALL]);
+    nx_zc_update_high_water_mark(&zc_pools[NX_ZC_POOL_LARGE]);
+
+    status = nx_tcp_socket_create(zc_ip, &zc_socket, "zero-copy tx", NX_IP_NORMAL,
+                                  NX_DONT_FRAGMENT, NX_IP_TIME_TO_LIVE,
+                                  NX_ZC_TCP_WINDOW_SIZE, NX_NULL, NX_NULL);
+
+    return nx_zc_status_to_result(status);
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_connect
+ *******************************************************************************
+ * Summary:
+ *  Connects the zero-copy socket to the given TCP server.
+ *
+ * Parameters:
+ *  const cy_socket_sockaddr_t *address: Address of the TCP server socket
+ *  uint32_t timeout_ms: Time to wait for the connection to complete
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t nx_zc_connect(const cy_socket_sockaddr_t *address, uint32_t timeout_ms)
+{
+    UINT status;
+
+    if ((zc_ip == NX_NULL) || (address == NULL))
+    {
+        return CY_RSLT_MODULE_SECURE_SOCKETS_BADARG;
+    }
+
+    status = nx_tcp_client_socket_bind(&zc_socket, NX_ANY_PORT, NX_ZC_MS_TO_TICKS(timeout_ms));
+    if (status != NX_SUCCESS)
+    {
+        return nx_zc_status_to_result(status);
+    }
+
+    status = nx_tcp_client_socket_connect(&zc_socket,
+                                          NX_ZC_IPV4_TO_HOST_ORDER(address->ip_address.ip.v4),
+                                          address->port, NX_ZC_MS_TO_TICKS(timeout_ms));
+    if (status != NX_SUCCESS)
+    {
+        nx_tcp_client_socket_unbind(&zc_socket);
+        return nx_zc_status_to_result(status);
+    }
+
+    zc_connected = true;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_disconnect
+ *******************************************************************************
+ * Summary:
+ *  Disconnects and unbinds the zero-copy socket. The socket can be connected
+ *  again with nx_zc_connect.
+ *
+ *******************************************************************************/
+void nx_zc_disconnect(void)
+{
+    if (zc_connected)
+    {
+        nx_tcp_socket_disconnect(&zc_socket, NX_NO_WAIT);
+        nx_tcp_client_socket_unbind(&zc_socket);
+        zc_connected = false;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_packet_alloc
+ *******************************************************************************
+ * Summary:
+ *  Allocates a TCP packet for the given payload length and returns a pointer
+ *  to its payload area, with the TCP/IP and link headers already reserved.
+ *  Payloads of up to NX_ZC_SMALL_DATA_SIZE bytes are served from the small
+ *  pool, falling back to the large pool when the small pool is empty. The
+ *  capacity is limited to the MSS of the connection so that one packet maps
+ *  to one TCP segment.
+ *
+ * Parameters:
+ *  uint32_t length: Number of payload bytes the caller intends to write
+ *  NX_PACKET **packet: Allocated packet
+ *  uint8_t **payload: Start of the payload area to be filled in place
+ *  uint32_t *capacity: Number of payload bytes that can be written
+ *  uint32_t timeout_ms: Time to wait for a free packet
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t nx_zc_packet_alloc(uint32_t length, NX_PACKET **packet, uint8_t **payload,
+                             uint32_t *capacity, uint32_t timeout_ms)
+{
+    UINT status;
+    uint32_t room;
+    nx_zc_pool_t *pool;
+    cy_time_t wait_start;
+    cy_time_t wait_end;
+    uint32_t wait_ms;
+
+    if ((zc_ip == NX_NULL) || (packet == NULL) || (payload == NULL) || (capacity == NULL))
+    {
+        return CY_RSLT_MODULE_SECURE_SOCKETS_BADARG;
+    }
+
+    pool = (length <= NX_ZC_SMALL_DATA_SIZE) ? &zc_pools[NX_ZC_POOL_SMALL] :
+                                               &zc_pools[NX_ZC_POOL_LARGE];
+
+    status = nx_packet_allocate(pool->nx_pool, packet, NX_TCP_PACKET, NX_NO_WAIT);
+
+    /* A small payload fits any packet: try the large pool before waiting. */
+    if ((status == NX_NO_PACKET) && (pool == &zc_pools[NX_ZC_POOL_SMALL]))
+    {
+        status = nx_packet_allocate(zc_pools[NX_ZC_POOL_LARGE].nx_pool, packet,
+                                    NX_TCP_PACKET, NX_NO_WAIT);
+        if (status == NX_SUCCESS)
+        {
+            pool->fallbacks++;
+            pool = &zc_pools[NX_ZC_POOL_LARGE];
+        }
+    }
+
+    if ((status == NX_NO_PACKET) && (timeout_ms != 0))
+    {
+        pool->waits++;
+        cy_rtos_get_time(&wait_start);
+
+        status = nx_packet_allocate(pool->nx_pool, packet, NX_TCP_PACKET,
+                                    NX_ZC_MS_TO_TICKS(timeout_ms));
+
+        cy_rtos_get_time(&wait_end);
+        wait_ms = (uint32_t)(wait_end - wait_start);
+        pool->total_wait_ms += wait_ms;
+        if (wait_ms > pool->max_wait_ms)
+        {
+            pool->max_wait_ms = wait_ms;
+        }
+    }
+
+    if (status != NX_SUCCESS)
+    {
+        pool->drops++;
+        return nx_zc_status_to_result(status);
+    }
+
+    pool->allocations++;
+    nx_zc_update_high_water_mark(pool);
+
+    room = (uint32_t)((*packet)->nx_packet_data_end - (*packet)->nx_packet_prepend_ptr);
+    if (zc_connected && (zc_socket.nx_tcp_socket_connect_mss < room))
+    {
+        room = zc_socket.nx_tcp_socket_connect_mss;
+    }
+
+    *payload = (*packet)->nx_packet_prepend_ptr;
+    *capacity = room;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_packet_send
+ *******************************************************************************
+ * Summary:
+ *  Sends a packet obtained from nx_zc_packet_alloc. The packet is always
+ *  consumed: on success NetX Duo releases it once the data is acknowledged,
+ *  on failure it is released here.
+ *
+ * Parameters:
+ *  NX_PACKET *packet: Packet filled in place by the application
+ *  uint32_t length: Number of payload bytes written
+ *  uint32_t timeout_ms: Time to wait for room in the transmit queue
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t nx_zc_packet_send(NX_PACKET *packet, uint32_t length, uint32_t timeout_ms)
+{
+    UINT status;
+
+    if (packet == NX_NULL)
+    {
+        return CY_RSLT_MODULE_SECURE_SOCKETS_BADARG;
+    }
+
+    if ((!zc_connected) ||
+        (length > (uint32_t)(packet->nx_packet_data_end - packet->nx_packet_prepend_ptr)))
+    {
+        nx_packet_release(packet);
+        return zc_connected ? CY_RSLT_MODULE_SECURE_SOCKETS_BADARG :
+                              CY_RSLT_MODULE_SECURE_SOCKETS_NOT_CONNECTED;
+    }
+
+    packet->nx_packet_append_ptr = packet->nx_packet_prepend_ptr + length;
+    packet->nx_packet_length = length;
+
+    status = nx_tcp_socket_send(&zc_socket, packet, NX_ZC_MS_TO_TICKS(timeout_ms));
+    if (status != NX_SUCCESS)
+    {
+        nx_packet_release(packet);
+    }
+
+    return nx_zc_status_to_result(status);
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_packet_release
+ *******************************************************************************
+ * Summary:
+ *  Returns an allocated but unsent packet to its packet pool.
+ *
+ * Parameters:
+ *  NX_PACKET *packet: Packet obtained from nx_zc_packet_alloc
+ *
+ *******************************************************************************/
+void nx_zc_packet_release(NX_PACKET *packet)
+{
+    if (packet != NX_NULL)
+    {
+        nx_packet_release(packet);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_get_pool_stats
+ *******************************************************************************
+ * Summary:
+ *  Reads the usage statistics of a packet pool. The high-water mark is
+ *  sampled on every zero-copy allocation and on every call to this function.
+ *  The empty pool counters cover every user of the pool, including the
+ *  network stack, and are only maintained when NX_DISABLE_PACKET_INFO is not
+ *  defined in nx_user.h.
+ *
+ * Parameters:
+ *  nx_zc_pool_id_t pool_id: Pool to be read
+ *  nx_zc_pool_stats_t *stats: Filled with the current statistics
+ *
+ *******************************************************************************/
+void nx_zc_get_pool_stats(nx_zc_pool_id_t pool_id, nx_zc_pool_stats_t *stats)
+{
+    ULONG total = 0;
+    ULONG free_packets = 0;
+    ULONG empty_requests = 0;
+    ULONG empty_suspensions = 0;
+    ULONG invalid_releases = 0;
+    nx_zc_pool_t *pool;
+
+    if ((stats == NULL) || (pool_id >= NX_ZC_POOL_COUNT))
+    {
+        return;
+    }
+
+    memset(stats, 0, sizeof(nx_zc_pool_stats_t));
+    pool = &zc_pools[pool_id];
+
+    if (pool->nx_pool == NX_NULL)
+    {
+        return;
+    }
+
+    nx_zc_update_high_water_mark(pool);
+    nx_packet_pool_info_get(pool->nx_pool, &total, &free_packets, &empty_requests,
+                            &empty_suspensions, &invalid_releases);
+
+    stats->total_packets = total;
+    stats->free_packets = free_packets;
+    stats->high_water_mark = pool->high_water_mark;
+    stats->allocations = pool->allocations;
+    stats->fallbacks = pool->fallbacks;
+    stats->waits = pool->waits;
+    stats->total_wait_ms = pool->total_wait_ms;
+    stats->max_wait_ms = pool->max_wait_ms;
+    stats->drops = pool->drops;
+    stats->empty_pool_requests = empty_requests;
+    stats->empty_pool_suspensions = empty_suspensions;
+    stats->invalid_releases = invalid_releases;
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_print_pool_stats
+ *******************************************************************************
+ * Summary:
+ *  Prints the statistics of the small and large packet pools. A high-water
+ *  mark well below the pool size with no waits or drops means the pool can
+ *  be made smaller.
+ *
+ *******************************************************************************/
+void nx_zc_print_pool_stats(void)
+{
+    static const char *pool_names[NX_ZC_POOL_COUNT] = { "small", "large" };
+    nx_zc_pool_stats_t stats;
+
+    for (uint32_t pool_id = 0; pool_id < NX_ZC_POOL_COUNT; pool_id++)
+    {
+        nx_zc_get_pool_stats((nx_zc_pool_id_t)pool_id, &stats);
+        printf("Packet pool %s: %"PRIu32"/%"PRIu32" free, high-water mark %"PRIu32", "
+               "%"PRIu32" allocations, %"PRIu32" fallbacks, %"PRIu32" waits "
+               "(total %"PRIu32" ms, max %"PRIu32" ms), %"PRIu32" drops, "
+               "%"PRIu32" empty pool requests\n",
+               pool_names[pool_id], stats.free_packets, stats.total_packets,
+               stats.high_water_mark, stats.allocations, stats.fallbacks, stats.waits,
+               stats.total_wait_ms, stats.max_wait_ms, stats.drops,
+               stats.empty_pool_requests);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_update_high_water_mark
+ *******************************************************************************
+ * Summary:
+ *  Records the number of packets in use if it is the highest seen so far.
+ *
+ *******************************************************************************/
+static void nx_zc_update_high_water_mark(nx_zc_pool_t *pool)
+{
+    uint32_t in_use = (uint32_t)(pool->nx_pool->nx_packet_pool_total -
+                                 pool->nx_pool->nx_packet_pool_available);
+
+    if (in_use > pool->high_water_mark)
+    {
+        pool->high_water_mark = in_use;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: nx_zc_status_to_result
+ *******************************************************************************
+ * Summary:
+ *  Maps a NetX Duo status code to the equivalent secure sockets result code.
+ *
+ *******************************************************************************/
+static cy_rslt_t nx_zc_status_to_result(UINT status)
+{
+    switch (status)
+    {
+        case NX_SUCCESS:
+            return CY_RSLT_SUCCESS;
+
+        case NX_NO_PACKET:
+        case NX_WINDOW_OVERFLOW:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_NOMEM;
+
+        case NX_NOT_CONNECTED:
+        case NX_NOT_BOUND:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_NOT_CONNECTED;
+
+        case NX_WAIT_ABORTED:
+        case NX_IN_PROGRESS:
+        case NX_TX_QUEUE_DEPTH:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_TIMEOUT;
+
+        default:
+            return CY_RSLT_MODULE_SECURE_SOCKETS_TCPIP_ERROR;
+    }
+}
+
+
+/* [] END OF FILE */
@@ -0,0 +1,121 @@
+/******************************************************************************
+* File Name:   nx_zero_copy.h
+*
+* Description: This file contains declarations of the zero-copy transmit API
+* for ThreadX/NetX Duo builds. The application allocates a packet from the
+* NetX Duo packet pool, fills the payload in place and hands the packet to the
+* TCP socket without an intermediate copy.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef NX_ZERO_COPY_H_
+#define NX_ZERO_COPY_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include "cy_result.h"
+
+/* Cypress secure socket header file. */
+#include "cy_secure_sockets.h"
+
+/* Network interface header file. */
+#include "cy_network_mw_core.h"
+
+/* NetX Duo header file. */
+#include "nx_api.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Receive window advertised by the zero-copy bulk uplink socket. */
+#ifndef NX_ZC_TCP_WINDOW_SIZE
+#define NX_ZC_TCP_WINDOW_SIZE                     (8u * 1024u)
+#endif
+
+/* Largest payload served from the small packet pool. Larger allocations use
+ * the MTU-sized default pool of the IP instance.
+ */
+#ifndef NX_ZC_SMALL_DATA_SIZE
+#define NX_ZC_SMALL_DATA_SIZE                     (64u)
+#endif
+
+/* Number of packets in the small packet pool. */
+#ifndef NX_ZC_SMALL_POOL_PACKETS
+#define NX_ZC_SMALL_POOL_PACKETS                  (16u)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Packet pools managed by the zero-copy transmit path. */
+typedef enum
+{
+    NX_ZC_POOL_SMALL,               /* Command, ack and TCP control packets. */
+    NX_ZC_POOL_LARGE,               /* MTU-sized default pool of the IP instance. */
+    NX_ZC_POOL_COUNT
+} nx_zc_pool_id_t;
+
+/* Usage statistics of one packet pool. */
+typedef struct
+{
+    uint32_t total_packets;          /* Number of packets in the pool. */
+    uint32_t free_packets;           /* Number of packets free right now. */
+    uint32_t high_water_mark;        /* Most packets in use at once. */
+    uint32_t allocations;            /* Zero-copy allocations served. */
+    uint32_t fallbacks;              /* Small allocations served by the large pool. */
+    uint32_t waits;                  /* Zero-copy allocations that had to wait. */
+    uint32_t total_wait_ms;          /* Time spent waiting for a free packet. */
+    uint32_t max_wait_ms;            /* Longest wait for a free packet. */
+    uint32_t drops;                  /* Zero-copy allocations that failed. */
+    uint32_t empty_pool_requests;    /* Allocations, by any user, that found the pool empty. */
+    uint32_t empty_pool_suspensions; /* Allocations, by any user, that waited for a packet. */
+    uint32_t invalid_releases;       /* Invalid packet releases. */
+} nx_zc_pool_stats_t;
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t nx_zc_init(cy_network_hw_interface_type_t iface_type);
+cy_rslt_t nx_zc_connect(const cy_socket_sockaddr_t *address, uint32_t timeout_ms);
+void nx_zc_disconnect(void);
+cy_rslt_t nx_zc_packet_alloc(uint32_t length, NX_PACKET **packet, uint8_t **payload,
+                             uint32_t *capacity, uint32_t timeout_ms);
+cy_rslt_t nx_zc_packet_send(NX_PACKET *packet, uint32_t length, uint32_t timeout_ms);
+void nx_zc_packet_release(NX_PACKET *packet);
+void nx_zc_get_pool_stats(nx_zc_pool_id_t pool_id, nx_zc_pool_stats_t *stats);
+void nx_zc_print_pool_stats(void);
+
+#endif /* NX_ZERO_COPY_H_ */
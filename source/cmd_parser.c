@@ -0,0 +1,1773 @@
+/******************************************************************************
+* File Name:   cmd_parser.c
+*
+* Description: This file contains the parser for commands received from the
+* TCP server. Each received segment is read in place. Single-byte commands
+* are applied at once; sequenced commands are queued per priority lane and
+* applied by the lane workers. The LED is updated and an acknowledgment is
+* sent back for the commands. A download frame switches the stream to the raw
+* or compressed bytes of an image, which are handed to the flash download.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include "cyhal.h"
+#include "cybsp.h"
+
+/* Standard C header files. */
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* Command parser header file. */
+#include "cmd_parser.h"
+
+/* CRC-32C header file, for the checked bulk transfers. */
+#include "crc32c.h"
+
+/* Throughput test header file. */
+#include "throughput_test.h"
+
+/* Sample codec and LZ stream header files, for their benchmarks. */
+#include "sample_codec.h"
+#include "lz_stream.h"
+
+/* Flash download, event log and XIP upload header files. */
+#include "flash_download.h"
+#include "event_log.h"
+#include "xip_upload.h"
+
+/* Secure sockets header file, for the error codes. */
+#include "cy_secure_sockets.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* LED ON/OFF commands issued from the TCP server. */
+#define LED_ON_CMD                                '1'
+#define LED_OFF_CMD                               '0'
+#define ACK_LED_ON                                "LED ON ACK"
+#define ACK_LED_OFF                               "LED OFF ACK"
+#define MSG_INVALID_CMD                           "Invalid command"
+
+/* Stop command: turns every output OFF. Sent on the urgent lane. */
+#define ALL_OFF_CMD                               '!'
+#define ACK_ALL_OFF                               "ALL OFF ACK"
+
+/* Size of an acknowledgment that covers several coalesced commands. */
+#define ACK_BUFFER_SIZE                           (32u)
+
+/* Uplink throughput test command issued from tcp_throughput_server.py. */
+#define UPLINK_TEST_CMD                           'U'
+#define ACK_UPLINK_TEST                           "UPLINK DONE"
+
+/* Event log benchmark command, on kits with external flash. */
+#define EVENT_LOG_BENCHMARK_CMD                   'L'
+#define ACK_EVENT_LOG_BENCHMARK                   "EVENT LOG BENCHMARK DONE"
+#define ACK_EVENT_LOG_BENCHMARK_FAILED            "EVENT LOG BENCHMARK FAILED"
+
+/* Sample codec benchmark command. */
+#define CODEC_BENCHMARK_CMD                       'E'
+#define ACK_CODEC_BENCHMARK                       "CODEC BENCHMARK DONE"
+#define ACK_CODEC_BENCHMARK_FAILED                "CODEC BENCHMARK FAILED"
+
+/* LZ compression benchmark command. */
+#define LZ_BENCHMARK_CMD                          'Z'
+#define ACK_LZ_BENCHMARK                          "LZ BENCHMARK DONE"
+#define ACK_LZ_BENCHMARK_FAILED                   "LZ BENCHMARK FAILED"
+
+/* CRC-32C benchmark command. */
+#define CRC_BENCHMARK_CMD                         'R'
+#define ACK_CRC_BENCHMARK                         "CRC BENCHMARK DONE"
+#define ACK_CRC_BENCHMARK_FAILED                  "CRC BENCHMARK FAILED"
+
+/* Acknowledgment of a diagnostic command received while others wait. */
+#define ACK_DIAG_BUSY                             "DIAGNOSTICS BUSY"
+
+/* Acknowledgment of a command that was applied before it was resent. */
+#define ACK_ALREADY_APPLIED                       "ALREADY APPLIED"
+
+/* Acknowledgment of a command that cannot be applied out of order. */
+#define ACK_NOT_IDEMPOTENT                        "NOT IDEMPOTENT"
+
+/* Length of the payload of a sequenced command frame: lane, sequence number
+ * and one command byte.
+ */
+#define CMD_FRAME_COMMAND_LENGTH                  (6u)
+
+/* Length of the payload of a download frame: image size and digest. */
+#define CMD_FRAME_DOWNLOAD_LENGTH                 (4u + FLASH_DOWNLOAD_DIGEST_SIZE)
+
+/* Length of the payload of a download frame of a compressed image: the
+ * compressed size follows.
+ */
+#define CMD_FRAME_DOWNLOAD_LZ_LENGTH              (CMD_FRAME_DOWNLOAD_LENGTH + 4u)
+
+/* Length of the payload of an upload frame: offset and length. */
+#define CMD_FRAME_UPLOAD_LENGTH                   (8u)
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Sequenced command waiting for the worker of its lane. */
+typedef struct
+{
+    uint32_t session_id;
+    uint32_t seq;
+    uint8_t command;
+    cmd_stream_t *stream;           /* Stream that receives the acknowledgment. */
+} cmd_queue_entry_t;
+
+/* Diagnostic command waiting for the diagnostics thread. */
+typedef struct
+{
+    cmd_lane_t *lane;               /* Lane of a sequenced command; NULL if single-byte. */
+    uint32_t session_id;
+    uint32_t seq;
+    uint8_t command;
+    cmd_stream_t *stream;           /* Stream that receives the data and the acknowledgment. */
+} cmd_diag_entry_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static cy_rslt_t process_command(cmd_stream_t *stream, uint8_t command);
+static cy_rslt_t apply_command(cmd_stream_t *stream, uint8_t command, const char **ack);
+static cy_rslt_t process_frame(cmd_stream_t *stream);
+static cy_rslt_t open_session(cmd_stream_t *stream);
+static cy_rslt_t queue_command_frame(cmd_stream_t *stream);
+static cy_rslt_t start_download(cmd_stream_t *stream);
+static cy_rslt_t enable_features(cmd_stream_t *stream);
+static cy_rslt_t process_bulk(cmd_stream_t *stream, const uint8_t *data, uint32_t length,
+                              uint32_t *taken);
+static cy_rslt_t bulk_received(cmd_stream_t *stream, uint32_t length);
+static cy_rslt_t check_block(cmd_stream_t *stream);
+static cy_rslt_t finish_bulk(cmd_stream_t *stream);
+static cy_rslt_t send_download_ack(cmd_stream_t *stream, uint8_t status, const char *text);
+#if (FLASH_DOWNLOAD_SUPPORTED)
+static void download_report(void *arg, cy_rslt_t result, const char *report);
+#endif
+static cy_rslt_t start_upload(cmd_stream_t *stream);
+static cy_rslt_t send_frame(cmd_stream_t *stream, uint8_t type, const uint8_t *payload,
+                            uint32_t length, bool checked);
+static cy_rslt_t send_credit(cmd_lane_t *lane);
+static void cmd_worker_thread(cy_thread_arg_t arg);
+static cy_rslt_t process_queued_command(cmd_lane_t *lane, cmd_coalesce_t *coalesce,
+                                        const cmd_queue_entry_t *entry);
+static cy_rslt_t send_command_ack(cmd_stream_t *stream, cmd_lane_t *lane, uint32_t session_id,
+                                  uint32_t seq, const char *ack);
+static cy_rslt_t send_command_nack(cmd_stream_t *stream, cmd_lane_t *lane, uint32_t seq);
+static bool is_state_command(uint8_t command);
+static bool is_diag_command(uint8_t command);
+static cy_rslt_t start_diag_command(cmd_stream_t *stream, cmd_lane_t *lane, uint32_t session_id,
+                                    uint32_t seq, uint8_t command);
+static void cmd_diag_thread(cy_thread_arg_t arg);
+static cy_rslt_t coalesce_command(cmd_lane_t *lane, cmd_coalesce_t *coalesce, cmd_stream_t *stream,
+                                  uint8_t command, uint32_t session_id, uint32_t seq);
+static cy_rslt_t flush_coalesced(cmd_lane_t *lane, cmd_coalesce_t *coalesce);
+static void put_be32(uint8_t *buffer, uint32_t value);
+static uint32_t get_be32(const uint8_t *buffer);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Queue depth and worker priority of each lane. */
+static const uint32_t lane_depth[CMD_LANE_COUNT] =
+{
+    CMD_URGENT_QUEUE_DEPTH, CMD_NORMAL_QUEUE_DEPTH
+};
+static const cy_thread_priority_t lane_priority[CMD_LANE_COUNT] =
+{
+    CMD_URGENT_WORKER_PRIORITY, CMD_NORMAL_WORKER_PRIORITY
+};
+
+/*******************************************************************************
+ * Function Name: cmd_parser_init
+ *******************************************************************************
+ * Summary:
+ *  Initializes the command parser and starts the thread that applies the
+ *  sequenced commands of each lane, and the diagnostics thread if any
+ *  diagnostic command is enabled.
+ *
+ * Parameters:
+ *  cmd_parser_t *parser: Parser context
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an RTOS error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_parser_init(cmd_parser_t *parser)
+{
+    cy_rslt_t result;
+
+    memset(parser, 0, sizeof(cmd_parser_t));
+
+    result = cy_rtos_mutex_init(&parser->credit_mutex, false);
+
+    for (uint32_t id = 0; (id < CMD_LANE_COUNT) && (result == CY_RSLT_SUCCESS); id++)
+    {
+        cmd_lane_t *lane = &parser->lanes[id];
+
+        lane->parser = parser;
+        lane->id = id;
+        lane->depth = lane_depth[id];
+
+        result = cy_rtos_queue_init(&lane->queue, lane->depth, sizeof(cmd_queue_entry_t));
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = cy_rtos_thread_create(&lane->worker_thread, cmd_worker_thread,
+                                           (id == CMD_LANE_URGENT) ? "Urgent commands" : "Commands",
+                                           NULL, CMD_WORKER_THREAD_STACK_SIZE,
+                                           lane_priority[id], lane);
+        }
+    }
+
+    if ((CMD_PARSER_DIAGNOSTICS) && (result == CY_RSLT_SUCCESS))
+    {
+        result = cy_rtos_queue_init(&parser->diag_queue, CMD_DIAG_QUEUE_DEPTH, sizeof(cmd_diag_entry_t));
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = cy_rtos_thread_create(&parser->diag_thread, cmd_diag_thread, "Diagnostics",
+                                           NULL, CMD_WORKER_THREAD_STACK_SIZE,
+                                           CMD_DIAG_WORKER_PRIORITY, parser);
+        }
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: cmd_parser_start_session
+ *******************************************************************************
+ * Summary:
+ *  Asks the TCP server to open a session, or to resume the current one, on a
+ *  new connection. The last received sequence number of each lane tells the
+ *  server which commands to send again, so nothing but the missing commands
+ *  is resent. Received commands are never lost with the connection: they wait
+ *  in the lane queues until applied.
+ *
+ * Parameters:
+ *  cmd_parser_t *parser: Parser context
+ *  cmd_stream_t *stream: Stream that carries the session frames
+ *
+ * Return:
+ *  cy_rslt_t: Result of the send function
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_parser_start_session(cmd_parser_t *parser, cmd_stream_t *stream)
+{
+    uint8_t payload[4u + (4u * CMD_LANE_COUNT)];
+
+    cy_rtos_mutex_get(&parser->credit_mutex, CY_RTOS_NEVER_TIMEOUT);
+    parser->session_stream = stream;
+    put_be32(&payload[0], parser->session_id);
+    for (uint32_t id = 0; id < CMD_LANE_COUNT; id++)
+    {
+        put_be32(&payload[4u + (4u * id)], parser->lanes[id].last_received_seq);
+    }
+    cy_rtos_mutex_set(&parser->credit_mutex);
+
+    return cmd_stream_send_frame(stream, CMD_FRAME_SESSION, payload, sizeof(payload));
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_init
+ *******************************************************************************
+ * Summary:
+ *  Initializes the stream of one connection to the TCP server.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  cmd_parser_t *parser: Parser that holds the session
+ *  cmd_parser_send_fn_t send_fn: Function used to send on the connection
+ *  void *send_arg: Argument passed on to send_fn
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an RTOS error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_init(cmd_stream_t *stream, cmd_parser_t *parser,
+                          cmd_parser_send_fn_t send_fn, void *send_arg)
+{
+    memset(stream, 0, sizeof(cmd_stream_t));
+    stream->parser = parser;
+    stream->send_fn = send_fn;
+    stream->send_arg = send_arg;
+    cmd_stream_reset(stream);
+
+    return cy_rtos_mutex_init(&stream->send_mutex, false);
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_reset
+ *******************************************************************************
+ * Summary:
+ *  Prepares the stream for a new connection. A frame left incomplete by the
+ *  previous connection is discarded, and the new connection counts as having
+ *  just received data. The session is kept, so that it can be resumed on the
+ *  new connection.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *
+ *******************************************************************************/
+void cmd_stream_reset(cmd_stream_t *stream)
+{
+    cy_time_t now;
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    if ((stream->state == CMD_PARSER_STATE_BULK) || (stream->state == CMD_PARSER_STATE_BULK_CRC))
+    {
+        flash_download_abort();
+    }
+    flash_download_cancel_report(stream);
+    xip_upload_cancel(stream);
+#endif
+
+    stream->state = CMD_PARSER_STATE_COMMAND;
+    stream->header_length = 0;
+    stream->payload_length = 0;
+    stream->payload_received = 0;
+    stream->bulk_remaining = 0;
+    stream->bulk_compressed = false;
+    stream->bulk_checked = false;
+    stream->features = 0;
+    stream->held_length = 0;
+    stream->stalled = false;
+
+    cy_rtos_get_time(&now);
+    stream->last_rx_time = now;
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_process
+ *******************************************************************************
+ * Summary:
+ *  Processes one segment of the receive stream. The segment is only borrowed
+ *  for the duration of the call; it is never copied or modified, so the caller
+ *  may pass network stack buffers directly and release them afterwards. The
+ *  time of reception is recorded for the heartbeat. LED commands coalesced
+ *  within the segment are applied before the call returns. Image bytes of a
+ *  bulk download are copied to the flash download buffers, and the CRC of
+ *  each block of the image, if it has them, is computed on the way.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  const uint8_t *data: Start of the segment
+ *  uint32_t length: Number of bytes in the segment
+ *
+ * Return:
+ *  cy_rslt_t: Result of the last acknowledgment sent
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_process(cmd_stream_t *stream, const uint8_t *data, uint32_t length)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    cy_time_t now;
+    uint32_t chunk;
+
+    cy_rtos_get_time(&now);
+    stream->last_rx_time = now;
+
+    for (uint32_t index = 0; index < length; index++)
+    {
+        uint8_t byte = data[index];
+
+        switch (stream->state)
+        {
+        case CMD_PARSER_STATE_COMMAND:
+            if (byte == CMD_FRAME_MAGIC)
+            {
+                stream->header[0] = byte;
+                stream->header_length = 1;
+                stream->state = CMD_PARSER_STATE_HEADER;
+            }
+            else if (is_state_command(byte))
+            {
+                result = coalesce_command(NULL, &stream->coalesce, stream, byte, 0, 0);
+            }
+            else
+            {
+                result = flush_coalesced(NULL, &stream->coalesce);
+                if (result == CY_RSLT_SUCCESS)
+                {
+                    result = process_command(stream, byte);
+                }
+            }
+            break;
+
+        case CMD_PARSER_STATE_HEADER:
+            stream->header[stream->header_length++] = byte;
+            if (stream->header_length == CMD_FRAME_HEADER_SIZE)
+            {
+                stream->payload_length = ((uint32_t)stream->header[2] << 8) | stream->header[3];
+                stream->payload_received = 0;
+                stream->state = CMD_PARSER_STATE_PAYLOAD;
+            }
+            break;
+
+        case CMD_PARSER_STATE_PAYLOAD:
+            /* The payload of an oversized frame is skipped. */
+            if (stream->payload_received < CMD_FRAME_MAX_PAYLOAD)
+            {
+                stream->payload[stream->payload_received] = byte;
+            }
+            stream->payload_received++;
+            break;
+
+        case CMD_PARSER_STATE_BULK:
+            /* The image is taken in runs rather than byte by byte, each up to
+             * the end of the block if the blocks have a CRC.
+             */
+            chunk = length - index;
+            if (chunk > (stream->bulk_checked ? stream->block_remaining : stream->bulk_remaining))
+            {
+                chunk = stream->bulk_checked ? stream->block_remaining : stream->bulk_remaining;
+            }
+            result = process_bulk(stream, &data[index], chunk, &chunk);
+            if (stream->stalled)
+            {
+                /* Held until a flash download buffer is free. */
+                stream->held_length = length - index - chunk;
+                memmove(stream->held, &data[index + chunk], stream->held_length);
+                index = length - 1u;
+                break;
+            }
+            index += chunk - 1u;
+            break;
+
+        case CMD_PARSER_STATE_BULK_CRC:
+            stream->crc_value = (stream->crc_value << 8) | byte;
+            stream->crc_received++;
+            if (stream->crc_received == CMD_CRC_SIZE)
+            {
+                result = check_block(stream);
+            }
+            break;
+        }
+
+        if ((stream->state == CMD_PARSER_STATE_PAYLOAD) &&
+            (stream->payload_received == stream->payload_length))
+        {
+            /* The frame may start a bulk download. */
+            stream->state = CMD_PARSER_STATE_COMMAND;
+            if (stream->payload_length <= CMD_FRAME_MAX_PAYLOAD)
+            {
+                result = process_frame(stream);
+            }
+            else
+            {
+                printf("Frame of %"PRIu32" bytes ignored\n", stream->payload_length);
+            }
+        }
+    }
+
+    if (stream->coalesce.count > 0)
+    {
+        result = flush_coalesced(NULL, &stream->coalesce);
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_get_bulk_buffer
+ *******************************************************************************
+ * Summary:
+ *  During a bulk download, returns the free space of the flash download
+ *  buffer, so that the caller can receive the image straight into it instead
+ *  of passing it through cmd_stream_process. A compressed image is passed
+ *  through cmd_stream_process, which decompresses it into the buffers. The
+ *  space ends with the block if the blocks have a CRC, so that the CRC after
+ *  it is passed through cmd_stream_process.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  uint8_t **buffer: Set to the free space of the buffer
+ *  uint32_t *length: Set to the number of image bytes that fit
+ *
+ * Return:
+ *  bool: true if the stream is receiving an image, false otherwise. If no
+ *  buffer is free, the length is 0 and the stream is stalled: nothing is to
+ *  be received until cmd_stream_resume.
+ *
+ *******************************************************************************/
+bool cmd_stream_get_bulk_buffer(cmd_stream_t *stream, uint8_t **buffer, uint32_t *length)
+{
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    cy_rslt_t result;
+
+    if ((stream->state != CMD_PARSER_STATE_BULK) || stream->bulk_compressed)
+    {
+        return false;
+    }
+
+    result = flash_download_get_buffer(buffer, length);
+    if (result == FLASH_DOWNLOAD_NO_BUFFER)
+    {
+        stream->held_length = 0;
+        stream->stalled = true;
+        *length = 0;
+        return true;
+    }
+
+    if ((result == CY_RSLT_SUCCESS) && (*length > 0))
+    {
+        if (*length > stream->bulk_remaining)
+        {
+            *length = stream->bulk_remaining;
+        }
+        if (stream->bulk_checked && (*length > stream->block_remaining))
+        {
+            *length = stream->block_remaining;
+        }
+        stream->bulk_buffer = *buffer;
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_commit_bulk
+ *******************************************************************************
+ * Summary:
+ *  Accounts for image bytes received into the buffer returned by
+ *  cmd_stream_get_bulk_buffer, and reports the outcome after the last byte.
+ *  The CRC of the block is continued over the bytes while they are still in
+ *  the cache.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  uint32_t length: Number of bytes received
+ *
+ * Return:
+ *  cy_rslt_t: Result of the report sent after the last byte
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_commit_bulk(cmd_stream_t *stream, uint32_t length)
+{
+    cy_time_t now;
+
+    cy_rtos_get_time(&now);
+    stream->last_rx_time = now;
+
+    if (length == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (stream->bulk_checked)
+    {
+        stream->block_crc = crc32c_update(stream->block_crc, stream->bulk_buffer, length);
+    }
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    flash_download_commit(length);
+#endif
+
+    return bulk_received(stream, length);
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_resume
+ *******************************************************************************
+ * Summary:
+ *  Continues a stream that stalled because no flash download buffer was free.
+ *  The bytes held from the stalled segment are processed once a buffer is
+ *  free. Receive callbacks pass a timeout of 0 when the flash download
+ *  resume callback tells them a buffer was freed; receive threads of their
+ *  own may wait.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  uint32_t timeout_ms: Maximum time to wait for a free buffer
+ *
+ * Return:
+ *  cy_rslt_t: Result of processing the held bytes. The stream is still
+ *  stalled if no buffer was free in time.
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_resume(cmd_stream_t *stream, uint32_t timeout_ms)
+{
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    uint32_t length;
+
+    if (!stream->stalled || (flash_download_wait_buffer(timeout_ms) == FLASH_DOWNLOAD_NO_BUFFER))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* Processing may stall again and hold the rest, in place. */
+    length = stream->held_length;
+    stream->held_length = 0;
+    stream->stalled = false;
+    if (length > 0)
+    {
+        return cmd_stream_process(stream, stream->held, length);
+    }
+#else
+    (void)timeout_ms;
+    stream->stalled = false;
+#endif
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_offer_features
+ *******************************************************************************
+ * Summary:
+ *  Offers optional features to the TCP server on a new connection. They are
+ *  used once the server enables them in its answer.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  uint8_t features: CMD_FEATURE_* bits supported by the client
+ *
+ * Return:
+ *  cy_rslt_t: Result of the send function
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_offer_features(cmd_stream_t *stream, uint8_t features)
+{
+    return cmd_stream_send_frame(stream, CMD_FRAME_FEATURES, &features, 1u);
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_send_frame
+ *******************************************************************************
+ * Summary:
+ *  Sends one frame to the TCP server. The send mutex keeps frames sent from
+ *  different threads from interleaving. A short frame is sent in a single
+ *  call; the payload of a longer one is sent from where it is, after the
+ *  header, so that it is not copied.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  uint8_t type: Frame type
+ *  const uint8_t *payload: Frame payload, may be NULL if length is 0
+ *  uint32_t length: Number of bytes in the payload
+ *
+ * Return:
+ *  cy_rslt_t: Result of the send function
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_send_frame(cmd_stream_t *stream, uint8_t type,
+                                const uint8_t *payload, uint32_t length)
+{
+    return send_frame(stream, type, payload, length, false);
+}
+
+/*******************************************************************************
+ * Function Name: cmd_stream_send_data_frame
+ *******************************************************************************
+ * Summary:
+ *  Sends one frame of bulk data to the TCP server, like
+ *  cmd_stream_send_frame. If CMD_FEATURE_CRC32C is enabled on the
+ *  connection, the CRC-32C of the payload is added at the end of the frame.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *  uint8_t type: Frame type
+ *  const uint8_t *payload: Frame payload, may be NULL if length is 0
+ *  uint32_t length: Number of bytes in the payload, without the CRC
+ *
+ * Return:
+ *  cy_rslt_t: Result of the send function
+ *
+ *******************************************************************************/
+cy_rslt_t cmd_stream_send_data_frame(cmd_stream_t *stream, uint8_t type,
+                                     const uint8_t *payload, uint32_t length)
+{
+    return send_frame(stream, type, payload, length,
+                      ((stream->features & CMD_FEATURE_CRC32C) != 0));
+}
+
+/*******************************************************************************
+ * Function Name: cmd_parser_apply_idempotent
+ *******************************************************************************
+ * Summary:
+ *  Applies a command that arrived without the ordering of a connection, such
+ *  as over UDP. Only the commands that set the LED state are applied: the
+ *  state after one of them does not depend on what was applied before, so
+ *  a repeated command changes nothing. Any other command is refused.
+ *
+ * Parameters:
+ *  uint8_t command: Command byte
+ *  const char **ack: Acknowledgment text
+ *
+ * Return:
+ *  bool: true if the command was applied
+ *
+ *******************************************************************************/
+bool cmd_parser_apply_idempotent(uint8_t command, const char **ack)
+{
+    if ((command != LED_ON_CMD) && (command != LED_OFF_CMD) && (command != ALL_OFF_CMD))
+    {
+        *ack = ACK_NOT_IDEMPOTENT;
+        return false;
+    }
+
+    /* The LED commands neither use the stream nor fail. */
+    (void)apply_command(NULL, command, ack);
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: process_frame
+ *******************************************************************************
+ * Summary:
+ *  Handles a complete frame. A heartbeat from the TCP server is acknowledged;
+ *  a heartbeat acknowledgment needs no action because its reception has
+ *  already been recorded. Frames of unknown type are ignored.
+ *
+ *******************************************************************************/
+static cy_rslt_t process_frame(cmd_stream_t *stream)
+{
+    switch (stream->header[1])
+    {
+    case CMD_FRAME_HEARTBEAT:
+        return cmd_stream_send_frame(stream, CMD_FRAME_HEARTBEAT_ACK, NULL, 0);
+
+    case CMD_FRAME_SESSION_ACK:
+        return open_session(stream);
+
+    case CMD_FRAME_FEATURES_ACK:
+        return enable_features(stream);
+
+    case CMD_FRAME_COMMAND:
+        return queue_command_frame(stream);
+
+    case CMD_FRAME_DOWNLOAD:
+        return start_download(stream);
+
+    case CMD_FRAME_UPLOAD:
+        return start_upload(stream);
+
+    default:
+        break;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: open_session
+ *******************************************************************************
+ * Summary:
+ *  Handles the answer of the TCP server to the session frame and grants the
+ *  first credits of every lane.
+ *
+ *******************************************************************************/
+static cy_rslt_t open_session(cmd_stream_t *stream)
+{
+    cmd_parser_t *parser = stream->parser;
+    uint32_t session_id;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if (stream->payload_length < 4u)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    session_id = get_be32(stream->payload);
+
+    cy_rtos_mutex_get(&parser->credit_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (session_id == parser->session_id)
+    {
+        printf("Session 0x%08"PRIx32" resumed after commands %"PRIu32" (urgent) and %"PRIu32"\n",
+               session_id, parser->lanes[CMD_LANE_URGENT].last_received_seq,
+               parser->lanes[CMD_LANE_NORMAL].last_received_seq);
+    }
+    else
+    {
+        /* The server does not know the session; start counting again.
+         * Queued commands of the old session are still applied, but
+         * not acknowledged.
+         */
+        parser->session_id = session_id;
+        for (uint32_t id = 0; id < CMD_LANE_COUNT; id++)
+        {
+            parser->lanes[id].last_received_seq = 0;
+            parser->lanes[id].last_applied_seq = 0;
+        }
+        printf("Session 0x%08"PRIx32" opened\n", session_id);
+    }
+    cy_rtos_mutex_set(&parser->credit_mutex);
+
+    for (uint32_t id = 0; (id < CMD_LANE_COUNT) && (result == CY_RSLT_SUCCESS); id++)
+    {
+        result = send_credit(&parser->lanes[id]);
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: enable_features
+ *******************************************************************************
+ * Summary:
+ *  Records the features that the TCP server enabled on the connection.
+ *
+ *******************************************************************************/
+static cy_rslt_t enable_features(cmd_stream_t *stream)
+{
+    if (stream->payload_length >= 1u)
+    {
+        stream->features = stream->payload[0] & CMD_FEATURES_KNOWN;
+        printf("Bulk compression %s, bulk CRC-32C %s on this connection\n",
+               ((stream->features & CMD_FEATURE_LZ) != 0) ? "enabled" : "disabled",
+               ((stream->features & CMD_FEATURE_CRC32C) != 0) ? "enabled" : "disabled");
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: queue_command_frame
+ *******************************************************************************
+ * Summary:
+ *  Queues a sequenced command for the worker of its lane. A command that was
+ *  applied before, but whose acknowledgment was lost with the previous
+ *  connection, is acknowledged again without being applied twice. Only the
+ *  command that follows the last received one is queued, so that no command
+ *  is ever skipped. After a gap, or if the queue overflows because the server
+ *  ignored the credits, the command is refused with a negative
+ *  acknowledgment, and the server sends it again.
+ *
+ *******************************************************************************/
+static cy_rslt_t queue_command_frame(cmd_stream_t *stream)
+{
+    cmd_parser_t *parser = stream->parser;
+    cmd_queue_entry_t entry;
+    cmd_lane_t *lane;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t last_applied_seq;
+    uint32_t last_received_seq;
+
+    if ((stream->payload_length != CMD_FRAME_COMMAND_LENGTH) ||
+        (stream->payload[0] >= CMD_LANE_COUNT))
+    {
+        printf("Malformed command frame ignored\n");
+        return CY_RSLT_SUCCESS;
+    }
+
+    lane = &parser->lanes[stream->payload[0]];
+    entry.session_id = parser->session_id;
+    entry.seq = get_be32(&stream->payload[1]);
+    entry.command = stream->payload[5];
+    entry.stream = stream;
+
+    cy_rtos_mutex_get(&parser->credit_mutex, CY_RTOS_NEVER_TIMEOUT);
+    last_applied_seq = lane->last_applied_seq;
+    last_received_seq = lane->last_received_seq;
+    if (entry.seq == (last_received_seq + 1u))
+    {
+        result = cy_rtos_queue_put(&lane->queue, &entry, 0);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            lane->last_received_seq = entry.seq;
+        }
+    }
+    cy_rtos_mutex_set(&parser->credit_mutex);
+
+    if (entry.seq <= last_applied_seq)
+    {
+        printf("Command %"PRIu32" already applied\n", entry.seq);
+        return send_command_ack(stream, lane, entry.session_id, entry.seq, ACK_ALREADY_APPLIED);
+    }
+
+    if (entry.seq <= last_received_seq)
+    {
+        /* Still queued; acknowledged once applied. */
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (entry.seq > (last_received_seq + 1u))
+    {
+        printf("Command %"PRIu32" out of order, %"PRIu32" expected\n",
+               entry.seq, last_received_seq + 1u);
+        return send_command_nack(stream, lane, last_received_seq);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Command queue full, command %"PRIu32" refused\n", entry.seq);
+        return send_command_nack(stream, lane, last_received_seq);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: start_download
+ *******************************************************************************
+ * Summary:
+ *  Prepares the flash for the image announced by the TCP server and tells the
+ *  server whether to send it. The stream then takes the image bytes until the
+ *  announced size, or the compressed size of a compressed image, is reached,
+ *  and the CRC after each block if CMD_FEATURE_CRC32C is enabled.
+ *
+ *******************************************************************************/
+static cy_rslt_t start_download(cmd_stream_t *stream)
+{
+    bool compressed = (stream->payload_length == CMD_FRAME_DOWNLOAD_LZ_LENGTH);
+
+    if ((stream->payload_length != CMD_FRAME_DOWNLOAD_LENGTH) &&
+        !(compressed && ((stream->features & CMD_FEATURE_LZ) != 0) &&
+          (get_be32(&stream->payload[CMD_FRAME_DOWNLOAD_LENGTH]) != 0)))
+    {
+        return send_download_ack(stream, CMD_DOWNLOAD_FAILED, "DOWNLOAD FAILED: bad request");
+    }
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    uint32_t size = get_be32(stream->payload);
+
+    if (flash_download_begin(size, &stream->payload[4], compressed) != CY_RSLT_SUCCESS)
+    {
+        return send_download_ack(stream, CMD_DOWNLOAD_FAILED, "DOWNLOAD FAILED: busy or too large");
+    }
+
+    stream->bulk_remaining = compressed ? get_be32(&stream->payload[CMD_FRAME_DOWNLOAD_LENGTH]) : size;
+    stream->bulk_compressed = compressed;
+    stream->bulk_checked = ((stream->features & CMD_FEATURE_CRC32C) != 0);
+    stream->block_remaining = (stream->bulk_remaining < CMD_DOWNLOAD_BLOCK_SIZE) ?
+                              stream->bulk_remaining : CMD_DOWNLOAD_BLOCK_SIZE;
+    stream->block_crc = 0;
+    stream->block_count = 0;
+    stream->bad_block = 0;
+    stream->state = CMD_PARSER_STATE_BULK;
+
+    return send_download_ack(stream, CMD_DOWNLOAD_READY, "");
+#else
+    return send_download_ack(stream, CMD_DOWNLOAD_FAILED, "DOWNLOAD NOT SUPPORTED");
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: process_bulk
+ *******************************************************************************
+ * Summary:
+ *  Copies image bytes that arrived through cmd_stream_process to the flash
+ *  download buffers, or decompresses them into the buffers. The bytes are
+ *  consumed even if the download has failed, so that the stream stays in
+ *  step with the server. If no buffer is free, the stream stalls and only the
+ *  bytes taken so far are counted. The CRC of the block is continued over the
+ *  bytes taken, rather than in a pass of its own.
+ *
+ *******************************************************************************/
+static cy_rslt_t process_bulk(cmd_stream_t *stream, const uint8_t *data, uint32_t length,
+                              uint32_t *taken)
+{
+    *taken = length;
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    cy_rslt_t result;
+
+    if (stream->bulk_compressed)
+    {
+        result = flash_download_decompress(data, length, taken);
+    }
+    else
+    {
+        result = flash_download_write(data, length, taken);
+    }
+
+    if ((result == FLASH_DOWNLOAD_NO_BUFFER) && (*taken < length))
+    {
+        stream->stalled = true;
+    }
+    else if (result != CY_RSLT_SUCCESS)
+    {
+        *taken = length;
+    }
+
+    if (*taken == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+#endif
+
+    if (stream->bulk_checked)
+    {
+        stream->block_crc = crc32c_update(stream->block_crc, data, *taken);
+    }
+
+    return bulk_received(stream, *taken);
+}
+
+/*******************************************************************************
+ * Function Name: bulk_received
+ *******************************************************************************
+ * Summary:
+ *  Counts received image bytes, or compressed bytes of a compressed image.
+ *  At the end of a block with a CRC, the CRC is received next. After the
+ *  last byte, the download is finished.
+ *
+ *******************************************************************************/
+static cy_rslt_t bulk_received(cmd_stream_t *stream, uint32_t length)
+{
+    stream->bulk_remaining -= length;
+
+    if (stream->bulk_checked)
+    {
+        stream->block_remaining -= length;
+        if (stream->block_remaining == 0)
+        {
+            stream->crc_received = 0;
+            stream->crc_value = 0;
+            stream->state = CMD_PARSER_STATE_BULK_CRC;
+        }
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (stream->bulk_remaining > 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return finish_bulk(stream);
+}
+
+/*******************************************************************************
+ * Function Name: check_block
+ *******************************************************************************
+ * Summary:
+ *  Compares the CRC received after a block with the one computed over it.
+ *  On the first mismatch the download is abandoned, so that no more of the
+ *  image is programmed; the rest of the image is still consumed. The last
+ *  block finishes the download.
+ *
+ *******************************************************************************/
+static cy_rslt_t check_block(cmd_stream_t *stream)
+{
+    stream->block_count++;
+
+    if ((stream->crc_value != stream->block_crc) && (stream->bad_block == 0))
+    {
+        printf("CRC error in block %"PRIu32" of the image: 0x%08"PRIx32" received, 0x%08"PRIx32" computed\n",
+               stream->block_count, stream->crc_value, stream->block_crc);
+        stream->bad_block = stream->block_count;
+#if (FLASH_DOWNLOAD_SUPPORTED)
+        flash_download_abort();
+#endif
+    }
+
+    if (stream->bulk_remaining == 0)
+    {
+        return finish_bulk(stream);
+    }
+
+    stream->block_crc = 0;
+    stream->block_remaining = (stream->bulk_remaining < CMD_DOWNLOAD_BLOCK_SIZE) ?
+                              stream->bulk_remaining : CMD_DOWNLOAD_BLOCK_SIZE;
+    stream->state = CMD_PARSER_STATE_BULK;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: finish_bulk
+ *******************************************************************************
+ * Summary:
+ *  Finishes the download after the last byte. The download thread reports
+ *  its outcome and throughput to the TCP server once the flash is done, so
+ *  that the receive path does not wait for the flash.
+ *
+ *******************************************************************************/
+static cy_rslt_t finish_bulk(cmd_stream_t *stream)
+{
+    char report[CMD_FRAME_MAX_PAYLOAD - 1u] = "DOWNLOAD FAILED";
+
+    stream->state = CMD_PARSER_STATE_COMMAND;
+    stream->bulk_compressed = false;
+    stream->bulk_checked = false;
+
+    if (stream->bad_block != 0)
+    {
+        snprintf(report, sizeof(report), "DOWNLOAD FAILED: CRC error in block %"PRIu32,
+                 stream->bad_block);
+        stream->bad_block = 0;
+    }
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    else if (flash_download_finish(download_report, stream) == CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    else
+    {
+        snprintf(report, sizeof(report), "DOWNLOAD FAILED: incomplete");
+    }
+#endif
+
+    return send_download_ack(stream, CMD_DOWNLOAD_FAILED, report);
+}
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+/*******************************************************************************
+ * Function Name: download_report
+ *******************************************************************************
+ * Summary:
+ *  Sends the outcome of a finished download, from the download thread.
+ *
+ *******************************************************************************/
+static void download_report(void *arg, cy_rslt_t result, const char *report)
+{
+    send_download_ack((cmd_stream_t *)arg,
+                      (result == CY_RSLT_SUCCESS) ? CMD_DOWNLOAD_DONE : CMD_DOWNLOAD_FAILED, report);
+}
+#endif
+
+/*******************************************************************************
+ * Function Name: send_download_ack
+ *******************************************************************************
+ * Summary:
+ *  Sends the status of a bulk download, followed by its text.
+ *
+ *******************************************************************************/
+static cy_rslt_t send_download_ack(cmd_stream_t *stream, uint8_t status, const char *text)
+{
+    uint8_t payload[CMD_FRAME_MAX_PAYLOAD];
+    uint32_t text_length = strlen(text);
+
+    if (text_length > (CMD_FRAME_MAX_PAYLOAD - 1u))
+    {
+        text_length = CMD_FRAME_MAX_PAYLOAD - 1u;
+    }
+
+    payload[0] = status;
+    memcpy(&payload[1], text, text_length);
+
+    return cmd_stream_send_frame(stream, CMD_FRAME_DOWNLOAD_ACK, payload, 1u + text_length);
+}
+
+/*******************************************************************************
+ * Function Name: start_upload
+ *******************************************************************************
+ * Summary:
+ *  Hands a request for a range of the download region over to the upload
+ *  thread, which sends it straight from the XIP-mapped flash. A request that
+ *  cannot be served is declined at once.
+ *
+ *******************************************************************************/
+static cy_rslt_t start_upload(cmd_stream_t *stream)
+{
+    uint8_t payload[CMD_FRAME_MAX_PAYLOAD];
+    const char *text = "UPLOAD NOT SUPPORTED";
+    uint32_t text_length;
+
+    if (stream->payload_length != CMD_FRAME_UPLOAD_LENGTH)
+    {
+        text = "UPLOAD FAILED: bad request";
+    }
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    else if (xip_upload_request(stream, get_be32(stream->payload),
+                                get_be32(&stream->payload[4])) == CY_RSLT_SUCCESS)
+    {
+        /* The upload thread answers. */
+        return CY_RSLT_SUCCESS;
+    }
+    else
+    {
+        text = "UPLOAD FAILED: busy or out of range";
+    }
+#endif
+
+    text_length = strlen(text);
+    payload[0] = CMD_DOWNLOAD_FAILED;
+    memcpy(&payload[1], text, text_length);
+
+    return cmd_stream_send_frame(stream, CMD_FRAME_UPLOAD_ACK, payload, 1u + text_length);
+}
+
+/*******************************************************************************
+ * Function Name: send_frame
+ *******************************************************************************
+ * Summary:
+ *  Sends one frame, with the CRC-32C of its payload at the end if checked.
+ *  A short frame is sent in a single call. The payload of a longer one is
+ *  sent from where it is, between the header and the CRC.
+ *
+ *******************************************************************************/
+static cy_rslt_t send_frame(cmd_stream_t *stream, uint8_t type, const uint8_t *payload,
+                            uint32_t length, bool checked)
+{
+    uint8_t frame[CMD_FRAME_HEADER_SIZE + CMD_FRAME_MAX_PAYLOAD + CMD_CRC_SIZE];
+    uint8_t crc[CMD_CRC_SIZE];
+    uint32_t crc_length = 0;
+    cy_rslt_t result;
+
+    if (checked)
+    {
+        put_be32(crc, crc32c_update(0, payload, length));
+        crc_length = CMD_CRC_SIZE;
+    }
+
+    if ((length + crc_length) > UINT16_MAX)
+    {
+        return CY_RSLT_MODULE_SECURE_SOCKETS_BADARG;
+    }
+
+    frame[0] = CMD_FRAME_MAGIC;
+    frame[1] = type;
+    frame[2] = (uint8_t)((length + crc_length) >> 8);
+    frame[3] = (uint8_t)(length + crc_length);
+
+    cy_rtos_mutex_get(&stream->send_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (length <= CMD_FRAME_MAX_PAYLOAD)
+    {
+        if (length > 0)
+        {
+            memcpy(&frame[CMD_FRAME_HEADER_SIZE], payload, length);
+        }
+        memcpy(&frame[CMD_FRAME_HEADER_SIZE + length], crc, crc_length);
+        result = stream->send_fn(frame, CMD_FRAME_HEADER_SIZE + length + crc_length, stream->send_arg);
+    }
+    else
+    {
+        result = stream->send_fn(frame, CMD_FRAME_HEADER_SIZE, stream->send_arg);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = stream->send_fn(payload, length, stream->send_arg);
+        }
+        if ((result == CY_RSLT_SUCCESS) && (crc_length > 0))
+        {
+            result = stream->send_fn(crc, crc_length, stream->send_arg);
+        }
+    }
+    cy_rtos_mutex_set(&stream->send_mutex);
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: send_credit
+ *******************************************************************************
+ * Summary:
+ *  Tells the TCP server the highest sequence number of the lane it may send:
+ *  the last received command plus the free entries of the lane queue. The
+ *  limit never goes down within a session, since each queued command uses up
+ *  one credit and each applied command frees one. Credits are sent on the
+ *  stream that carries the session.
+ *
+ *******************************************************************************/
+static cy_rslt_t send_credit(cmd_lane_t *lane)
+{
+    cmd_parser_t *parser = lane->parser;
+    cmd_stream_t *stream;
+    uint8_t payload[5];
+    size_t queued = 0;
+
+    cy_rtos_mutex_get(&parser->credit_mutex, CY_RTOS_NEVER_TIMEOUT);
+    stream = parser->session_stream;
+    cy_rtos_queue_count(&lane->queue, &queued);
+    payload[0] = (uint8_t)lane->id;
+    put_be32(&payload[1], lane->last_received_seq + (lane->depth - (uint32_t)queued));
+    cy_rtos_mutex_set(&parser->credit_mutex);
+
+    if ((stream == NULL) || (parser->session_id == 0))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return cmd_stream_send_frame(stream, CMD_FRAME_CREDIT, payload, sizeof(payload));
+}
+
+/*******************************************************************************
+ * Function Name: cmd_worker_thread
+ *******************************************************************************
+ * Summary:
+ *  Applies the sequenced commands of one lane. Every command waiting in the
+ *  queue is taken at once, so that LED commands queued behind a slow command
+ *  are coalesced. New credits are granted after each batch.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Lane context
+ *
+ *******************************************************************************/
+static void cmd_worker_thread(cy_thread_arg_t arg)
+{
+    cmd_lane_t *lane = (cmd_lane_t *)arg;
+    cmd_coalesce_t coalesce = { 0 };
+    cmd_queue_entry_t entry;
+
+    for (;;)
+    {
+        if (cy_rtos_queue_get(&lane->queue, &entry, CY_RTOS_NEVER_TIMEOUT) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+
+        do
+        {
+            process_queued_command(lane, &coalesce, &entry);
+        } while (cy_rtos_queue_get(&lane->queue, &entry, 0) == CY_RSLT_SUCCESS);
+
+        flush_coalesced(lane, &coalesce);
+        send_credit(lane);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: process_queued_command
+ *******************************************************************************
+ * Summary:
+ *  Applies one sequenced command, or holds it for coalescing, and
+ *  acknowledges it.
+ *
+ *******************************************************************************/
+static cy_rslt_t process_queued_command(cmd_lane_t *lane, cmd_coalesce_t *coalesce,
+                                        const cmd_queue_entry_t *entry)
+{
+    const char *ack;
+    cy_rslt_t result;
+
+    if (is_state_command(entry->command))
+    {
+        return coalesce_command(lane, coalesce, entry->stream, entry->command,
+                                entry->session_id, entry->seq);
+    }
+
+    /* Keep the commands in order. */
+    result = flush_coalesced(lane, coalesce);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (is_diag_command(entry->command))
+    {
+        return start_diag_command(entry->stream, lane, entry->session_id, entry->seq, entry->command);
+    }
+
+    result = apply_command(entry->stream, entry->command, &ack);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    return send_command_ack(entry->stream, lane, entry->session_id, entry->seq, ack);
+}
+
+/*******************************************************************************
+ * Function Name: send_command_ack
+ *******************************************************************************
+ * Summary:
+ *  Acknowledges a command on the stream it was received on. With a lane, the
+ *  command is recorded as applied before the acknowledgment is sent, so that
+ *  a resumed session does not get it again, and the acknowledgment is a frame
+ *  that covers every command of the lane up to its sequence number. Without
+ *  a lane, it is plain text. Commands of a session that has since been
+ *  replaced are not acknowledged.
+ *
+ *******************************************************************************/
+static cy_rslt_t send_command_ack(cmd_stream_t *stream, cmd_lane_t *lane, uint32_t session_id,
+                                  uint32_t seq, const char *ack)
+{
+    uint8_t ack_payload[CMD_FRAME_MAX_PAYLOAD];
+    uint32_t ack_length = strlen(ack);
+    cy_rslt_t result;
+    bool current = false;
+
+    if (lane != NULL)
+    {
+        /* Checked and recorded together, so that a new session is never
+         * given the sequence number of the old one.
+         */
+        cy_rtos_mutex_get(&lane->parser->credit_mutex, CY_RTOS_NEVER_TIMEOUT);
+        current = (session_id == lane->parser->session_id);
+        if (current && (seq > lane->last_applied_seq))
+        {
+            lane->last_applied_seq = seq;
+        }
+        cy_rtos_mutex_set(&lane->parser->credit_mutex);
+    }
+
+    if (lane == NULL)
+    {
+        cy_rtos_mutex_get(&stream->send_mutex, CY_RTOS_NEVER_TIMEOUT);
+        result = stream->send_fn((const uint8_t *)ack, ack_length, stream->send_arg);
+        cy_rtos_mutex_set(&stream->send_mutex);
+    }
+    else if (!current)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    else
+    {
+        if (ack_length > (CMD_FRAME_MAX_PAYLOAD - 5u))
+        {
+            ack_length = CMD_FRAME_MAX_PAYLOAD - 5u;
+        }
+        ack_payload[0] = (uint8_t)lane->id;
+        put_be32(&ack_payload[1], seq);
+        memcpy(&ack_payload[5], ack, ack_length);
+
+        result = cmd_stream_send_frame(stream, CMD_FRAME_COMMAND_ACK, ack_payload, 5u + ack_length);
+    }
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        printf("Acknowledgment sent to TCP server\n");
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: send_command_nack
+ *******************************************************************************
+ * Summary:
+ *  Refuses a sequenced command, and tells the server the last command of the
+ *  lane received in order, so that it sends the commands after it again.
+ *
+ *******************************************************************************/
+static cy_rslt_t send_command_nack(cmd_stream_t *stream, cmd_lane_t *lane, uint32_t seq)
+{
+    uint8_t payload[5];
+
+    payload[0] = (uint8_t)lane->id;
+    put_be32(&payload[1], seq);
+
+    return cmd_stream_send_frame(stream, CMD_FRAME_COMMAND_NACK, payload, sizeof(payload));
+}
+
+/*******************************************************************************
+ * Function Name: is_state_command
+ *******************************************************************************
+ * Summary:
+ *  Returns true for the commands that only set the LED state. Applying the
+ *  last of several such commands gives the same result as applying all.
+ *
+ *******************************************************************************/
+static bool is_state_command(uint8_t command)
+{
+    return (CMD_PARSER_COALESCE) && ((command == LED_ON_CMD) || (command == LED_OFF_CMD));
+}
+
+/*******************************************************************************
+ * Function Name: is_diag_command
+ *******************************************************************************
+ * Summary:
+ *  Returns true for the enabled diagnostic commands, which run for seconds
+ *  and are handed to the diagnostics thread.
+ *
+ *******************************************************************************/
+static bool is_diag_command(uint8_t command)
+{
+    return ((USE_UPLINK_TEST) && (command == UPLINK_TEST_CMD)) ||
+           ((USE_CODEC_BENCHMARK) && (command == CODEC_BENCHMARK_CMD)) ||
+           ((USE_LZ_BENCHMARK) && (command == LZ_BENCHMARK_CMD)) ||
+           ((USE_CRC_BENCHMARK) && (command == CRC_BENCHMARK_CMD)) ||
+           ((USE_EVENT_LOG_BENCHMARK) && (FLASH_DOWNLOAD_SUPPORTED) &&
+            (command == EVENT_LOG_BENCHMARK_CMD));
+}
+
+/*******************************************************************************
+ * Function Name: start_diag_command
+ *******************************************************************************
+ * Summary:
+ *  Hands a diagnostic command to the diagnostics thread, which acknowledges
+ *  it once done. A sequenced command is then acknowledged by its own
+ *  acknowledgment or by that of a later command of its lane, whichever comes
+ *  first. If the queue of the thread is full, the command is answered as
+ *  busy at once.
+ *
+ *******************************************************************************/
+static cy_rslt_t start_diag_command(cmd_stream_t *stream, cmd_lane_t *lane, uint32_t session_id,
+                                    uint32_t seq, uint8_t command)
+{
+    cmd_diag_entry_t entry =
+    {
+        .lane = lane,
+        .session_id = session_id,
+        .seq = seq,
+        .command = command,
+        .stream = stream
+    };
+
+    if (cy_rtos_queue_put(&stream->parser->diag_queue, &entry, 0) != CY_RSLT_SUCCESS)
+    {
+        printf("Diagnostics busy, command '%c' not run\n", (char)command);
+        return send_command_ack(stream, lane, session_id, seq, ACK_DIAG_BUSY);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: cmd_diag_thread
+ *******************************************************************************
+ * Summary:
+ *  Runs the diagnostic commands one at a time, at low priority, and
+ *  acknowledges each on the stream it came from.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Parser context
+ *
+ *******************************************************************************/
+static void cmd_diag_thread(cy_thread_arg_t arg)
+{
+    cmd_parser_t *parser = (cmd_parser_t *)arg;
+    cmd_diag_entry_t entry;
+    const char *ack;
+
+    for (;;)
+    {
+        if (cy_rtos_queue_get(&parser->diag_queue, &entry, CY_RTOS_NEVER_TIMEOUT) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+
+        if (apply_command(entry.stream, entry.command, &ack) == CY_RSLT_SUCCESS)
+        {
+            send_command_ack(entry.stream, entry.lane, entry.session_id, entry.seq, ack);
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: coalesce_command
+ *******************************************************************************
+ * Summary:
+ *  Holds an LED command until the end of the segment or batch, or the next
+ *  command of another kind, replacing the LED command held before. Commands
+ *  of different sessions or streams are not coalesced with each other.
+ *  Single-byte commands have no lane.
+ *
+ *******************************************************************************/
+static cy_rslt_t coalesce_command(cmd_lane_t *lane, cmd_coalesce_t *coalesce, cmd_stream_t *stream,
+                                  uint8_t command, uint32_t session_id, uint32_t seq)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if ((coalesce->count > 0) &&
+        ((coalesce->session_id != session_id) || (coalesce->stream != stream)))
+    {
+        result = flush_coalesced(lane, coalesce);
+    }
+
+    coalesce->command = command;
+    coalesce->session_id = session_id;
+    coalesce->seq = seq;
+    coalesce->stream = stream;
+    coalesce->count++;
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: flush_coalesced
+ *******************************************************************************
+ * Summary:
+ *  Applies the LED command held by coalesce_command, if any, and sends one
+ *  acknowledgment for all the commands it replaces.
+ *
+ *******************************************************************************/
+static cy_rslt_t flush_coalesced(cmd_lane_t *lane, cmd_coalesce_t *coalesce)
+{
+    char ack_buffer[ACK_BUFFER_SIZE];
+    const char *ack;
+    uint32_t count = coalesce->count;
+    cy_rslt_t result;
+
+    if (count == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    coalesce->count = 0;
+
+    result = apply_command(coalesce->stream, coalesce->command, &ack);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (count > 1u)
+    {
+        printf("%"PRIu32" LED commands coalesced\n", count);
+        snprintf(ack_buffer, sizeof(ack_buffer), "%s x%"PRIu32, ack, count);
+        ack = ack_buffer;
+    }
+
+    return send_command_ack(coalesce->stream, lane, coalesce->session_id, coalesce->seq, ack);
+}
+
+/*******************************************************************************
+ * Function Name: put_be32
+ *******************************************************************************
+ * Summary:
+ *  Stores a 32-bit value in big-endian byte order.
+ *
+ *******************************************************************************/
+static void put_be32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)(value >> 24);
+    buffer[1] = (uint8_t)(value >> 16);
+    buffer[2] = (uint8_t)(value >> 8);
+    buffer[3] = (uint8_t)value;
+}
+
+/*******************************************************************************
+ * Function Name: get_be32
+ *******************************************************************************
+ * Summary:
+ *  Reads a 32-bit value stored in big-endian byte order.
+ *
+ *******************************************************************************/
+static uint32_t get_be32(const uint8_t *buffer)
+{
+    return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) |
+           ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+/*******************************************************************************
+ * Function Name: process_command
+ *******************************************************************************
+ * Summary:
+ *  Applies a single-byte command that cannot be coalesced and sends the
+ *  acknowledgment as plain text. Diagnostic commands are handed to the
+ *  diagnostics thread instead, which sends the acknowledgment once done.
+ *
+ *******************************************************************************/
+static cy_rslt_t process_command(cmd_stream_t *stream, uint8_t command)
+{
+    const char *ack;
+    cy_rslt_t result;
+
+    if (is_diag_command(command))
+    {
+        return start_diag_command(stream, NULL, 0, 0, command);
+    }
+
+    result = apply_command(stream, command, &ack);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    /* Send acknowledgment to the TCP server in receipt of the message received. */
+    return send_command_ack(stream, NULL, 0, 0, ack);
+}
+
+/*******************************************************************************
+ * Function Name: apply_command
+ *******************************************************************************
+ * Summary:
+ *  Turns the LED ON or OFF, turns every output OFF, or runs one of the
+ *  diagnostic commands enabled in cmd_parser.h, based on the command, and
+ *  returns the acknowledgment text. The test data is sent on the stream the
+ *  command came from.
+ *
+ *******************************************************************************/
+static cy_rslt_t apply_command(cmd_stream_t *stream, uint8_t command, const char **ack)
+{
+    printf("============================================================\n");
+
+    if(command == LED_ON_CMD)
+    {
+        /* Turn the LED ON. */
+        cyhal_gpio_write(CYBSP_USER_LED, CYBSP_LED_STATE_ON);
+        printf("LED turned ON\n");
+        *ack = ACK_LED_ON;
+    }
+    else if(command == LED_OFF_CMD)
+    {
+        /* Turn the LED OFF. */
+        cyhal_gpio_write(CYBSP_USER_LED, CYBSP_LED_STATE_OFF);
+        printf("LED turned OFF\n");
+        *ack = ACK_LED_OFF;
+    }
+    else if(command == ALL_OFF_CMD)
+    {
+        /* The LED is the only output of this example. */
+        cyhal_gpio_write(CYBSP_USER_LED, CYBSP_LED_STATE_OFF);
+        printf("All outputs turned OFF\n");
+        *ack = ACK_ALL_OFF;
+    }
+#if (USE_UPLINK_TEST)
+    else if(command == UPLINK_TEST_CMD)
+    {
+        cy_rslt_t result = throughput_test_uplink(stream->send_fn, stream->send_arg);
+
+
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        *ack = ACK_UPLINK_TEST;
+    }
+#endif
+#if (USE_CODEC_BENCHMARK)
+    else if(command == CODEC_BENCHMARK_CMD)
+    {
+        *ack = sample_codec_benchmark() ? ACK_CODEC_BENCHMARK : ACK_CODEC_BENCHMARK_FAILED;
+    }
+#endif
+#if (USE_LZ_BENCHMARK)
+    else if(command == LZ_BENCHMARK_CMD)
+    {
+        *ack = lz_stream_benchmark() ? ACK_LZ_BENCHMARK : ACK_LZ_BENCHMARK_FAILED;
+    }
+#endif
+#if (USE_CRC_BENCHMARK)
+    else if(command == CRC_BENCHMARK_CMD)
+    {
+        *ack = crc32c_benchmark() ? ACK_CRC_BENCHMARK : ACK_CRC_BENCHMARK_FAILED;
+    }
+#endif
+#if (FLASH_DOWNLOAD_SUPPORTED) && (USE_EVENT_LOG_BENCHMARK)
+    else if(command == EVENT_LOG_BENCHMARK_CMD)
+    {
+        *ack = (event_log_benchmark() == CY_RSLT_SUCCESS) ?
+               ACK_EVENT_LOG_BENCHMARK : ACK_EVENT_LOG_BENCHMARK_FAILED;
+    }
+#endif
+    else
+    {
+        printf("Invalid command\n");
+        *ack = MSG_INVALID_CMD;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+
+/* [] END OF FILE */
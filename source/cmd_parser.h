@@ -0,0 +1,390 @@
+/******************************************************************************
+* File Name:   cmd_parser.h
+*
+* Description: This file contains declarations of the parser for commands
+* received from the TCP server. The parser reads borrowed, read-only segments
+* of the receive stream so that the network stack buffers can be processed in
+* place. Single-byte commands and frames that start with CMD_FRAME_MAGIC can
+* be mixed in the same stream. LED commands received together are coalesced.
+* Sequenced commands are applied by one worker thread per priority lane, so
+* that a slow command never holds up heartbeats or urgent commands; the server
+* is given credits for the free entries of each lane's queue. Each connection
+* to the server has its own stream, and all streams share the session.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef CMD_PARSER_H_
+#define CMD_PARSER_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* First byte of a frame. The single-byte commands never use this value.
+ * A frame is the magic byte, the frame type, and the payload length (16-bit,
+ * big-endian), followed by the payload.
+ */
+#define CMD_FRAME_MAGIC                           (0xA5u)
+#define CMD_FRAME_HEADER_SIZE                     (4u)
+
+/* Largest payload that is received. Longer received frames are ignored.
+ * Longer frames can be sent, without being copied.
+ */
+#define CMD_FRAME_MAX_PAYLOAD                     (64u)
+
+/* Frame types. A heartbeat is answered with a heartbeat acknowledgment. */
+#define CMD_FRAME_HEARTBEAT                       ('H')
+#define CMD_FRAME_HEARTBEAT_ACK                   ('h')
+
+/* Session frames. The client opens or resumes a session with
+ * CMD_FRAME_SESSION (session ID, then the last received sequence number of
+ * each lane). The server answers with CMD_FRAME_SESSION_ACK (session ID); a
+ * different ID means a new session. The client then grants credits with
+ * CMD_FRAME_CREDIT (lane, highest sequence number the server may send), and
+ * the server sends CMD_FRAME_COMMAND (lane, sequence number, one command
+ * byte) within that limit. The client answers with CMD_FRAME_COMMAND_ACK
+ * (lane, sequence number, acknowledgment text), which covers every command of
+ * the lane up to that number. A command is queued only if it follows the last
+ * received one; otherwise the client answers with CMD_FRAME_COMMAND_NACK
+ * (lane, last received sequence number), and the server sends the commands
+ * after that number again. Lanes are one byte; all other numbers are 32-bit,
+ * big-endian. Every lane has its own sequence numbers.
+ */
+#define CMD_FRAME_SESSION                         ('S')
+#define CMD_FRAME_SESSION_ACK                     ('s')
+#define CMD_FRAME_COMMAND                         ('C')
+#define CMD_FRAME_COMMAND_ACK                     ('c')
+#define CMD_FRAME_COMMAND_NACK                    ('n')
+#define CMD_FRAME_CREDIT                          ('K')
+
+/* Feature frames, exchanged once per connection. The client offers the
+ * features it supports with CMD_FRAME_FEATURES (one byte of CMD_FEATURE_*
+ * bits), and the server answers with CMD_FRAME_FEATURES_ACK (the bits it
+ * enables on the connection). A feature is used only once enabled.
+ */
+#define CMD_FRAME_FEATURES                        ('F')
+#define CMD_FRAME_FEATURES_ACK                    ('f')
+#define CMD_FEATURE_LZ                            (0x01u)
+#define CMD_FEATURE_CRC32C                        (0x02u)
+#define CMD_FEATURES_KNOWN                        (CMD_FEATURE_LZ | CMD_FEATURE_CRC32C)
+
+/* With CMD_FEATURE_CRC32C, the image bytes of a bulk download are sent in
+ * blocks of CMD_DOWNLOAD_BLOCK_SIZE, the last one shorter, each followed by
+ * its CRC-32C (4 bytes, big-endian). Each upload data frame ends with the
+ * CRC-32C of the rest of its payload. The CRCs cover the bytes as sent, that
+ * is the compressed bytes when the transfer is compressed.
+ */
+#define CMD_DOWNLOAD_BLOCK_SIZE                   (4096u)
+#define CMD_CRC_SIZE                              (4u)
+
+/* Bulk download frames. The server announces an image with
+ * CMD_FRAME_DOWNLOAD (size, then its SHA-256 digest, then the compressed size
+ * if CMD_FEATURE_LZ is enabled and the image is sent compressed). The client answers with
+ * CMD_FRAME_DOWNLOAD_ACK (status, then text): CMD_DOWNLOAD_READY, after which
+ * the server sends the image as raw bytes, in blocks with a CRC if
+ * CMD_FEATURE_CRC32C is enabled, or CMD_DOWNLOAD_FAILED. After the
+ * last byte, the client reports CMD_DOWNLOAD_DONE or CMD_DOWNLOAD_FAILED. The
+ * server sends nothing else on the connection while the image is sent.
+ */
+#define CMD_FRAME_DOWNLOAD                        ('D')
+#define CMD_FRAME_DOWNLOAD_ACK                    ('d')
+#define CMD_DOWNLOAD_READY                        (0u)
+#define CMD_DOWNLOAD_DONE                         (1u)
+#define CMD_DOWNLOAD_FAILED                       (2u)
+
+/* Upload frames. The server asks for a range of the download region with
+ * CMD_FRAME_UPLOAD (offset, length). The client answers with
+ * CMD_FRAME_UPLOAD_ACK (status, then the length and the encoding for
+ * CMD_DOWNLOAD_READY or text for CMD_DOWNLOAD_FAILED), sends the range in
+ * CMD_FRAME_UPLOAD_DATA frames, and ends with CMD_FRAME_UPLOAD_ACK
+ * (CMD_DOWNLOAD_DONE, then text). The data frames carry one compressed
+ * stream if the encoding is CMD_UPLOAD_ENCODING_LZ, and end with a CRC if
+ * CMD_FEATURE_CRC32C is enabled.
+ * Upload data frames are longer than CMD_FRAME_MAX_PAYLOAD; only the client
+ * sends them.
+ */
+#define CMD_FRAME_UPLOAD                          ('G')
+#define CMD_FRAME_UPLOAD_ACK                      ('g')
+#define CMD_FRAME_UPLOAD_DATA                     ('B')
+#define CMD_UPLOAD_ENCODING_RAW                   (0u)
+#define CMD_UPLOAD_ENCODING_LZ                    (1u)
+
+/* Telemetry frame, sent by the client only: the number of records dropped so
+ * far (4), then records of timestamp (4), type (1), length (1) and data.
+ */
+#define CMD_FRAME_TELEMETRY                       ('T')
+
+/* Sample frame, sent by the client only: the sequence number of the first
+ * sample (4), the sample period in microseconds (4), then one 32-bit value per
+ * sample, in order and without gaps.
+ */
+#define CMD_FRAME_SAMPLES                         ('M')
+
+/* Compact sample frame, sent by the client only: the first sequence number
+ * and the period as varints, then the difference of each value from the one
+ * before it as a zigzag varint. See sample_codec.c.
+ */
+#define CMD_FRAME_SAMPLES_COMPACT                 ('m')
+
+/* UDP command frames, one per datagram. The client opens the UDP path with
+ * CMD_FRAME_UDP_OPEN (epoch, then the group epoch and the highest group
+ * sequence number received if the client is in the command group), repeated
+ * while connected. The server sends CMD_FRAME_UDP_COMMAND (epoch, sequence
+ * number, one command byte) and the client answers with
+ * CMD_FRAME_UDP_COMMAND_ACK (epoch, sequence number, highest sequence number
+ * received, acknowledgment text). The client picks a new epoch on every
+ * connection; the sequence numbers of an epoch start at 1. Only the
+ * idempotent commands are sent over UDP. See udp_command.c.
+ */
+#define CMD_FRAME_UDP_OPEN                        ('O')
+#define CMD_FRAME_UDP_COMMAND                     ('Q')
+#define CMD_FRAME_UDP_COMMAND_ACK                 ('q')
+
+/* Group command frames, with the same payloads as the UDP command frames but
+ * an epoch chosen by the server. The server multicasts
+ * CMD_FRAME_UDP_GROUP_COMMAND to every client in the group, or sends it to
+ * one client to repair a loss, and each client answers with its own
+ * CMD_FRAME_UDP_GROUP_ACK. A command of a new epoch starts that epoch; one
+ * of an epoch the client already left is dropped.
+ */
+#define CMD_FRAME_UDP_GROUP_COMMAND               ('X')
+#define CMD_FRAME_UDP_GROUP_ACK                   ('x')
+
+/* Priority lanes of the sequenced commands. Urgent commands are applied by a
+ * higher-priority worker and never wait behind normal commands.
+ */
+#define CMD_LANE_URGENT                           (0u)
+#define CMD_LANE_NORMAL                           (1u)
+#define CMD_LANE_COUNT                            (2u)
+
+/* When several LED commands arrive in the same receive segment, only the
+ * last one is applied and one acknowledgment covers all of them. Set to 0 to
+ * apply and acknowledge every command.
+ */
+#ifndef CMD_PARSER_COALESCE
+#define CMD_PARSER_COALESCE                       (1)
+#endif
+
+/* Largest segment passed to cmd_stream_process. The rest of a segment that
+ * reaches a bulk download while no flash download buffer is free is held in
+ * the stream until cmd_stream_resume.
+ */
+#ifndef CMD_STREAM_HOLD_SIZE
+#define CMD_STREAM_HOLD_SIZE                      (256u)
+#endif
+
+/* Number of sequenced commands that can wait for the worker of each lane.
+ * This is the credit granted to the TCP server.
+ */
+#ifndef CMD_URGENT_QUEUE_DEPTH
+#define CMD_URGENT_QUEUE_DEPTH                    (4u)
+#endif
+#ifndef CMD_NORMAL_QUEUE_DEPTH
+#define CMD_NORMAL_QUEUE_DEPTH                    (8u)
+#endif
+
+/* Stack size of the threads that apply the sequenced commands, and their
+ * priorities.
+ */
+#ifndef CMD_WORKER_THREAD_STACK_SIZE
+#define CMD_WORKER_THREAD_STACK_SIZE              (2u * 1024u)
+#endif
+#ifndef CMD_URGENT_WORKER_PRIORITY
+#define CMD_URGENT_WORKER_PRIORITY                (CY_RTOS_PRIORITY_ABOVENORMAL)
+#endif
+#ifndef CMD_NORMAL_WORKER_PRIORITY
+#define CMD_NORMAL_WORKER_PRIORITY                (CY_RTOS_PRIORITY_BELOWNORMAL)
+#endif
+
+/* To accept the uplink throughput test command of tcp_throughput_server.py,
+ * set this macro as '1'. Without it, the command is answered as invalid.
+ */
+#ifndef USE_UPLINK_TEST
+#define USE_UPLINK_TEST                           (0)
+#endif
+
+/* To accept the command that runs the sample codec benchmark ('E'),
+ * set this macro as '1'. Without it, the command is answered as invalid.
+ */
+#ifndef USE_CODEC_BENCHMARK
+#define USE_CODEC_BENCHMARK                       (0)
+#endif
+
+/* To accept the command that runs the LZ stream benchmark ('Z'),
+ * set this macro as '1'. Without it, the command is answered as invalid.
+ */
+#ifndef USE_LZ_BENCHMARK
+#define USE_LZ_BENCHMARK                          (0)
+#endif
+
+/* To accept the command that runs the CRC-32C benchmark ('R'),
+ * set this macro as '1'. Without it, the command is answered as invalid.
+ */
+#ifndef USE_CRC_BENCHMARK
+#define USE_CRC_BENCHMARK                         (0)
+#endif
+
+/* To accept the command that runs the event log benchmark ('L'), set this
+ * macro as '1'. The benchmark appends and erases records in the external
+ * flash, so leave it disabled in production builds. Without it, the command
+ * is answered as invalid.
+ */
+#ifndef USE_EVENT_LOG_BENCHMARK
+#define USE_EVENT_LOG_BENCHMARK                   (0)
+#endif
+
+/* The diagnostic commands enabled above run one at a time on a thread of
+ * their own, so that they hold up neither the receive path nor the lanes.
+ * Diagnostic commands received while CMD_DIAG_QUEUE_DEPTH are waiting are
+ * answered as busy.
+ */
+#define CMD_PARSER_DIAGNOSTICS                    ((USE_UPLINK_TEST) || (USE_CODEC_BENCHMARK) || \
+                                                   (USE_LZ_BENCHMARK) || (USE_CRC_BENCHMARK) || \
+                                                   (USE_EVENT_LOG_BENCHMARK))
+#ifndef CMD_DIAG_QUEUE_DEPTH
+#define CMD_DIAG_QUEUE_DEPTH                      (1u)
+#endif
+#ifndef CMD_DIAG_WORKER_PRIORITY
+#define CMD_DIAG_WORKER_PRIORITY                  (CY_RTOS_PRIORITY_LOW)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Function used by the parser to send acknowledgments to the TCP server. */
+typedef cy_rslt_t (*cmd_parser_send_fn_t)(const uint8_t *data, uint32_t length, void *arg);
+
+/* Position of the parser in the receive stream. */
+typedef enum
+{
+    CMD_PARSER_STATE_COMMAND,       /* Between commands and frames. */
+    CMD_PARSER_STATE_HEADER,        /* Inside a frame header. */
+    CMD_PARSER_STATE_PAYLOAD,       /* Inside a frame payload. */
+    CMD_PARSER_STATE_BULK,          /* Inside the image of a bulk download. */
+    CMD_PARSER_STATE_BULK_CRC       /* Inside the CRC after a block of the image. */
+} cmd_parser_state_t;
+
+/* LED command held back until the commands it replaces are known. */
+typedef struct
+{
+    uint8_t command;                /* Last LED command not yet applied. */
+    uint32_t count;                 /* Number of LED commands it replaces. */
+    uint32_t session_id;            /* Session of the command, if framed. */
+    uint32_t seq;                   /* Its sequence number; 0 if not framed. */
+    struct cmd_stream *stream;      /* Stream that receives the acknowledgment. */
+} cmd_coalesce_t;
+
+struct cmd_parser;
+
+/* Receive and send state of one connection to the TCP server. */
+typedef struct cmd_stream
+{
+    struct cmd_parser *parser;      /* Session shared by all streams. */
+    cmd_parser_send_fn_t send_fn;
+    void *send_arg;
+    cy_mutex_t send_mutex;          /* Keeps frames from different threads whole. */
+    cmd_parser_state_t state;
+    uint8_t header[CMD_FRAME_HEADER_SIZE];
+    uint32_t header_length;         /* Header bytes received so far. */
+    uint8_t payload[CMD_FRAME_MAX_PAYLOAD];
+    uint32_t payload_length;        /* Length of the current frame payload. */
+    uint32_t payload_received;      /* Payload bytes received so far. */
+    uint32_t bulk_remaining;        /* Image bytes still to be received. */
+    bool bulk_compressed;           /* The image is sent compressed. */
+    bool bulk_checked;              /* The image is sent in blocks with a CRC. */
+    uint8_t *bulk_buffer;           /* Buffer returned by cmd_stream_get_bulk_buffer. */
+    uint32_t block_remaining;       /* Image bytes still to be received in the block. */
+    uint32_t block_crc;             /* CRC-32C of the block so far. */
+    uint32_t block_count;           /* Blocks received so far. */
+    uint32_t bad_block;             /* Number of the first block with a wrong CRC; 0 if none. */
+    uint32_t crc_received;          /* Bytes of the CRC after the block received so far. */
+    uint32_t crc_value;             /* CRC after the block, as received so far. */
+    uint8_t held[CMD_STREAM_HOLD_SIZE]; /* Rest of the segment that stalled. */
+    uint32_t held_length;           /* Bytes in held. */
+    volatile bool stalled;          /* No flash download buffer was free; see cmd_stream_resume. */
+    volatile uint8_t features;      /* CMD_FEATURE_* bits enabled on the connection. */
+    volatile cy_time_t last_rx_time; /* Time at which data was last received. */
+    cmd_coalesce_t coalesce;        /* Single-byte LED commands of the segment. */
+} cmd_stream_t;
+
+/* Sequenced commands of one priority. */
+typedef struct
+{
+    struct cmd_parser *parser;
+    uint32_t id;                    /* CMD_LANE_URGENT or CMD_LANE_NORMAL. */
+    uint32_t depth;                 /* Size of the queue. */
+    uint32_t last_received_seq;     /* Last command queued in the session. */
+    uint32_t last_applied_seq;      /* Last command applied in the session. */
+    cy_queue_t queue;               /* Commands waiting for the worker. */
+    cy_thread_t worker_thread;
+} cmd_lane_t;
+
+/* Command parser context: the session and the lanes. */
+typedef struct cmd_parser
+{
+    uint32_t session_id;            /* Assigned by the server; 0 if none. */
+    cmd_stream_t *session_stream;   /* Stream that carries the session frames. */
+    cmd_lane_t lanes[CMD_LANE_COUNT];
+    cy_mutex_t credit_mutex;        /* Guards the sequence numbers and the queue counts. */
+    cy_queue_t diag_queue;          /* Diagnostic commands waiting for their thread. */
+    cy_thread_t diag_thread;
+} cmd_parser_t;
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t cmd_parser_init(cmd_parser_t *parser);
+cy_rslt_t cmd_parser_start_session(cmd_parser_t *parser, cmd_stream_t *stream);
+cy_rslt_t cmd_stream_init(cmd_stream_t *stream, cmd_parser_t *parser,
+                          cmd_parser_send_fn_t send_fn, void *send_arg);
+void cmd_stream_reset(cmd_stream_t *stream);
+cy_rslt_t cmd_stream_process(cmd_stream_t *stream, const uint8_t *data, uint32_t length);
+bool cmd_stream_get_bulk_buffer(cmd_stream_t *stream, uint8_t **buffer, uint32_t *length);
+cy_rslt_t cmd_stream_commit_bulk(cmd_stream_t *stream, uint32_t length);
+cy_rslt_t cmd_stream_resume(cmd_stream_t *stream, uint32_t timeout_ms);
+cy_rslt_t cmd_stream_offer_features(cmd_stream_t *stream, uint8_t features);
+cy_rslt_t cmd_stream_send_frame(cmd_stream_t *stream, uint8_t type,
+                                const uint8_t *payload, uint32_t length);
+cy_rslt_t cmd_stream_send_data_frame(cmd_stream_t *stream, uint8_t type,
+                                     const uint8_t *payload, uint32_t length);
+bool cmd_parser_apply_idempotent(uint8_t command, const char **ack);
+
+#endif /* CMD_PARSER_H_ */
@@ -0,0 +1,99 @@
+/******************************************************************************
+* File Name:   crc32c.h
+*
+* Description: This file contains the declarations of the CRC-32C that checks
+* the bulk transfers, computed with tables or with the CRC hardware.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* CRC-32C (Castagnoli): reflected polynomial 0x82F63B78, initial value and
+ * final XOR 0xFFFFFFFF. The CRC of "123456789" is CRC32C_CHECK_VALUE.
+ */
+#define CRC32C_POLYNOMIAL                         (0x1EDC6F41u)
+#define CRC32C_POLYNOMIAL_REFLECTED               (0x82F63B78u)
+#define CRC32C_CHECK_VALUE                        (0xE3069283u)
+
+/* Bytes taken by each step of the table lookups: 8 (slicing-by-8), 4
+ * (slicing-by-4) or 1. The tables of all three are kept in flash, 8 KB in
+ * total, so that the benchmark can compare them.
+ */
+#ifndef CRC32C_SLICES
+#define CRC32C_SLICES                             (8u)
+#endif
+
+/* To compute long runs with the CRC hardware of the device, when it has one,
+ * set this macro as '1'. The hardware is used only after crc32c_init has
+ * checked that it gives the same result as the tables.
+ */
+#ifndef CRC32C_USE_HARDWARE
+#define CRC32C_USE_HARDWARE                       (1)
+#endif
+
+/* Shortest run given to the hardware; shorter ones cost less with the tables
+ * than the setup of the hardware.
+ */
+#ifndef CRC32C_HARDWARE_MIN_LENGTH
+#define CRC32C_HARDWARE_MIN_LENGTH                (256u)
+#endif
+
+/* Bytes of the internal flash that the benchmark computes the CRC of, and
+ * the number of times it does so for each implementation.
+ */
+#ifndef CRC32C_BENCHMARK_SIZE
+#define CRC32C_BENCHMARK_SIZE                     (64u * 1024u)
+#endif
+#ifndef CRC32C_BENCHMARK_ROUNDS
+#define CRC32C_BENCHMARK_ROUNDS                   (64u)
+#endif
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+void crc32c_init(void);
+uint32_t crc32c_update(uint32_t crc, const uint8_t *data, uint32_t length);
+bool crc32c_benchmark(void);
+
+#endif /* CRC32C_H_ */
@@ -0,0 +1,778 @@
+/******************************************************************************
+* File Name:   event_log.c
+*
+* Description: This file contains the append-only log of telemetry records on
+* the external serial flash, for outages longer than the RAM buffer covers.
+* The log is a ring of segments, one erase sector each, at the top of the
+* flash. Records are appended to the newest segment; when it is full, the
+* next segment in the ring is erased and takes its place, so every sector is
+* erased equally often. A small index in RAM holds the sequence number and
+* erase count of each segment and the append and replay positions, so an
+* append is one program operation and a replay reads the flash in order.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* Flash download and event log header files. */
+#include "flash_download.h"
+#include "event_log.h"
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+
+/* Serial flash library header file. */
+#include "cy_serial_flash_qspi.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Segment header: magic, sequence number, erase count and consumed flag. The
+ * consumed flag stays erased until every record of the segment is replayed.
+ */
+#define EVENT_LOG_SEGMENT_MAGIC                   (0x474F4C45u)   /* "ELOG" */
+#define EVENT_LOG_SEGMENT_HEADER_SIZE             (16u)
+#define EVENT_LOG_CONSUMED_OFFSET                 (12u)
+#define EVENT_LOG_ERASED_WORD                     (0xFFFFFFFFu)
+
+/* Record in the flash: length (1), mark (1), type (1), timestamp (4), data
+ * and a check byte over all but the mark. An erased length byte marks the end
+ * of the records of a segment. The mark is programmed on the last record of
+ * each replayed batch, so that the replay resumes after it after a reset.
+ */
+#define EVENT_LOG_RECORD_OVERHEAD                 (8u)
+#define EVENT_LOG_MARK_INDEX                      (1u)
+#define EVENT_LOG_REPLAYED_MARK                   (0x00u)
+#define EVENT_LOG_RECORD_MAX_SIZE                 (EVENT_LOG_RECORD_OVERHEAD + EVENT_LOG_RECORD_DATA_SIZE)
+#define EVENT_LOG_ERASED_BYTE                     (0xFFu)
+
+/* Size of the blocks in which a segment is read back. */
+#define EVENT_LOG_READ_SIZE                       (256u)
+
+/* No segment. */
+#define EVENT_LOG_NO_SEGMENT                      (EVENT_LOG_SEGMENT_COUNT)
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Index entry of a segment. A sequence number of zero marks a segment that is
+ * erased or holds no valid header.
+ */
+typedef struct
+{
+    uint32_t address;
+    uint32_t size;
+    uint32_t sequence;
+    uint32_t erase_count;
+} event_log_segment_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static void event_log_layout(void);
+static cy_rslt_t event_log_rotate(void);
+static uint32_t event_log_scan(const event_log_segment_t *segment, uint32_t *resume);
+static uint32_t event_log_next(uint32_t index);
+static uint8_t record_check(const uint8_t *record, uint32_t length);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static cy_mutex_t event_log_mutex;
+static bool event_log_ready;
+
+/* Number of event_log_suspend calls not yet resumed. The mutex is only held
+ * for one operation on the log, never while it is suspended.
+ */
+static uint32_t event_log_suspended;
+static event_log_segment_t event_log_segments[EVENT_LOG_SEGMENT_COUNT];
+
+/* Segment and offset of the next append, and of the next record to replay. */
+static uint32_t event_log_head = EVENT_LOG_NO_SEGMENT;
+static uint32_t event_log_head_offset;
+static event_log_position_t event_log_cursor;
+
+/* Segments that were overwritten before they were replayed. */
+static uint32_t event_log_dropped_segments;
+
+/* Block of a segment being read back. */
+static uint8_t event_log_block[EVENT_LOG_READ_SIZE];
+
+/*******************************************************************************
+ * Function Name: event_log_get_region_start
+ *******************************************************************************
+ * Summary:
+ *  Returns the offset in the external flash where the log starts. The space
+ *  below it is left to the download region.
+ *
+ *******************************************************************************/
+uint32_t event_log_get_region_start(void)
+{
+    uint32_t address = (uint32_t)cy_serial_flash_qspi_get_size();
+
+    for (uint32_t index = 0; index < EVENT_LOG_SEGMENT_COUNT; index++)
+    {
+        address -= (uint32_t)cy_serial_flash_qspi_get_erase_size(address - 1u);
+    }
+
+    return address;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_init
+ *******************************************************************************
+ * Summary:
+ *  Mounts the log: reads the header of every segment into the index, finds
+ *  the end of the newest segment, and resumes the replay in the oldest
+ *  segment that was not replayed completely, after its last marked record.
+ *  Records sent after the last mark and before a reset are sent again.
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t event_log_init(void)
+{
+    uint32_t header[EVENT_LOG_SEGMENT_HEADER_SIZE / sizeof(uint32_t)];
+    uint32_t oldest = EVENT_LOG_NO_SEGMENT;
+    uint32_t erase_min = UINT32_MAX;
+    uint32_t erase_max = 0;
+    uint32_t resume;
+    cy_rslt_t result;
+
+    result = cy_rtos_mutex_init(&event_log_mutex, false);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    event_log_layout();
+
+    for (uint32_t index = 0; index < EVENT_LOG_SEGMENT_COUNT; index++)
+    {
+        event_log_segment_t *segment = &event_log_segments[index];
+
+        result = cy_serial_flash_qspi_read(segment->address, sizeof(header), (uint8_t *)header);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+
+        segment->sequence = 0;
+        segment->erase_count = 0;
+        if ((header[0] == EVENT_LOG_SEGMENT_MAGIC) && (header[1] != 0) &&
+            (header[1] != EVENT_LOG_ERASED_WORD))
+        {
+            segment->sequence = header[1];
+            segment->erase_count = header[2];
+
+            if ((event_log_head == EVENT_LOG_NO_SEGMENT) ||
+                (segment->sequence > event_log_segments[event_log_head].sequence))
+            {
+                event_log_head = index;
+            }
+            if ((header[3] == EVENT_LOG_ERASED_WORD) &&
+                ((oldest == EVENT_LOG_NO_SEGMENT) ||
+                 (segment->sequence < event_log_segments[oldest].sequence)))
+            {
+                oldest = index;
+            }
+        }
+
+        erase_min = (segment->erase_count < erase_min) ? segment->erase_count : erase_min;
+        erase_max = (segment->erase_count > erase_max) ? segment->erase_count : erase_max;
+    }
+
+    if (event_log_head != EVENT_LOG_NO_SEGMENT)
+    {
+        event_log_head_offset = event_log_scan(&event_log_segments[event_log_head], &resume);
+        if ((oldest != EVENT_LOG_NO_SEGMENT) && (oldest != event_log_head))
+        {
+            event_log_scan(&event_log_segments[oldest], &resume);
+        }
+        else
+        {
+            oldest = event_log_head;
+        }
+        event_log_cursor.segment = oldest;
+        event_log_cursor.sequence = event_log_segments[oldest].sequence;
+        event_log_cursor.offset = resume;
+    }
+
+    event_log_ready = true;
+
+    printf("Event log: %"PRIu32" segments of %"PRIu32" bytes at 0x%08"PRIx32", erase counts %"PRIu32"..%"PRIu32"\n",
+           (uint32_t)EVENT_LOG_SEGMENT_COUNT, event_log_segments[0].size,
+           event_log_segments[EVENT_LOG_SEGMENT_COUNT - 1u].address, erase_min, erase_max);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_append
+ *******************************************************************************
+ * Summary:
+ *  Appends a record to the newest segment, moving on to the next segment of
+ *  the ring when it is full. If that segment still holds records that were
+ *  not replayed, they are dropped. The append fails at once, without
+ *  waiting, while the log is suspended. Moving on erases a segment, so the
+ *  telemetry buffer appends from a thread of its own.
+ *
+ * Parameters:
+ *  uint32_t timestamp_ms: Time of the record
+ *  uint8_t type: Record type
+ *  const uint8_t *data: Record data
+ *  uint32_t length: Length of the data, up to EVENT_LOG_RECORD_DATA_SIZE
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t event_log_append(uint32_t timestamp_ms, uint8_t type, const uint8_t *data,
+                           uint32_t length)
+{
+    uint8_t record[EVENT_LOG_RECORD_MAX_SIZE];
+    uint32_t record_size = EVENT_LOG_RECORD_OVERHEAD + length;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if (!event_log_ready || (length > EVENT_LOG_RECORD_DATA_SIZE))
+    {
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    record[0] = (uint8_t)length;
+    record[EVENT_LOG_MARK_INDEX] = EVENT_LOG_ERASED_BYTE;
+    record[2] = type;
+    record[3] = (uint8_t)(timestamp_ms >> 24);
+    record[4] = (uint8_t)(timestamp_ms >> 16);
+    record[5] = (uint8_t)(timestamp_ms >> 8);
+    record[6] = (uint8_t)timestamp_ms;
+    if (length > 0)
+    {
+        memcpy(&record[7], data, length);
+    }
+    record[record_size - 1u] = record_check(record, record_size - 1u);
+
+    cy_rtos_mutex_get(&event_log_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (event_log_suspended > 0)
+    {
+        cy_rtos_mutex_set(&event_log_mutex);
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    if ((event_log_head == EVENT_LOG_NO_SEGMENT) ||
+        ((event_log_head_offset + record_size) > event_log_segments[event_log_head].size))
+    {
+        result = event_log_rotate();
+    }
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_serial_flash_qspi_write(event_log_segments[event_log_head].address +
+                                            event_log_head_offset, record_size, record);
+
+        /* A failed program leaves an unknown record behind; start afresh in
+         * the next segment.
+         */
+        event_log_head_offset = (result == CY_RSLT_SUCCESS) ?
+                                (event_log_head_offset + record_size) :
+                                event_log_segments[event_log_head].size;
+    }
+
+    cy_rtos_mutex_set(&event_log_mutex);
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_read
+ *******************************************************************************
+ * Summary:
+ *  Reads records from the replay position into a buffer, in the record
+ *  format of the telemetry frame, without consuming them. The segments are
+ *  read in order in blocks of EVENT_LOG_READ_SIZE bytes. Nothing is read
+ *  while the log is suspended.
+ *
+ * Parameters:
+ *  uint8_t *buffer: Buffer for the records
+ *  uint32_t size: Size of the buffer
+ *  uint32_t *records: Set to the number of records read
+ *  event_log_position_t *next: Set to the position after the last record
+ *  read, to be passed on to event_log_consume
+ *
+ * Return:
+ *  uint32_t: Number of bytes written to the buffer.
+ *
+ *******************************************************************************/
+uint32_t event_log_read(uint8_t *buffer, uint32_t size, uint32_t *records,
+                        event_log_position_t *next)
+{
+    event_log_position_t position;
+    const event_log_segment_t *segment;
+    uint32_t block_offset = 0;
+    uint32_t block_length = 0;
+    uint32_t length = 0;
+    uint32_t data_length;
+    uint32_t record_size;
+    const uint8_t *record;
+
+    *records = 0;
+    if (!event_log_ready)
+    {
+        return 0;
+    }
+
+    cy_rtos_mutex_get(&event_log_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (event_log_suspended > 0)
+    {
+        cy_rtos_mutex_set(&event_log_mutex);
+        return 0;
+    }
+
+    position = event_log_cursor;
+    position.last_record = 0;
+
+    while (event_log_head != EVENT_LOG_NO_SEGMENT)
+    {
+        segment = &event_log_segments[position.segment];
+
+        /* The records of the newest segment end at the append position. */
+        if ((position.segment == event_log_head) && (position.offset >= event_log_head_offset))
+        {
+            break;
+        }
+
+        /* Read the block that holds the next record, if not read yet. */
+        if ((position.offset < block_offset) ||
+            ((position.offset + EVENT_LOG_RECORD_MAX_SIZE) > (block_offset + block_length)))
+        {
+            block_offset = position.offset;
+            block_length = segment->size - block_offset;
+            if (block_length > EVENT_LOG_READ_SIZE)
+            {
+                block_length = EVENT_LOG_READ_SIZE;
+            }
+            if (cy_serial_flash_qspi_read(segment->address + block_offset, block_length,
+                                          event_log_block) != CY_RSLT_SUCCESS)
+            {
+                break;
+            }
+        }
+
+        record = &event_log_block[position.offset - block_offset];
+        data_length = record[0];
+        record_size = EVENT_LOG_RECORD_OVERHEAD + data_length;
+
+        if ((data_length > EVENT_LOG_RECORD_DATA_SIZE) ||
+            ((position.offset + record_size) > (block_offset + block_length)) ||
+            (record[record_size - 1u] != record_check(record, record_size - 1u)))
+        {
+            /* End of the records of this segment; go on with the next. */
+            if (position.segment == event_log_head)
+            {
+                break;
+            }
+            position.segment = event_log_next(position.segment);
+            position.sequence = event_log_segments[position.segment].sequence;
+            position.offset = EVENT_LOG_SEGMENT_HEADER_SIZE;
+            position.last_record = 0;
+            block_length = 0;
+            continue;
+        }
+
+        if ((length + EVENT_LOG_RECORD_HEADER_SIZE + data_length) > size)
+        {
+            break;
+        }
+
+        /* Timestamp, type, length and data. */
+        memcpy(&buffer[length], &record[3], 4u);
+        buffer[length + 4u] = record[2];
+        buffer[length + 5u] = record[0];
+        memcpy(&buffer[length + EVENT_LOG_RECORD_HEADER_SIZE], &record[7], data_length);
+        length += EVENT_LOG_RECORD_HEADER_SIZE + data_length;
+        position.last_record = position.offset;
+        position.offset += record_size;
+        (*records)++;
+    }
+
+    cy_rtos_mutex_set(&event_log_mutex);
+
+    *next = position;
+
+    return length;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_consume
+ *******************************************************************************
+ * Summary:
+ *  Moves the replay position to a position returned by event_log_read once
+ *  the records read are sent. Segments left behind are marked as consumed in
+ *  the flash, and the last record read is marked, so that they are not
+ *  replayed after a reset. While the log is suspended, only the position in
+ *  RAM moves. A position that was overtaken by dropped segments meanwhile is
+ *  ignored.
+ *
+ * Parameters:
+ *  const event_log_position_t *next: Position returned by event_log_read
+ *
+ *******************************************************************************/
+void event_log_consume(const event_log_position_t *next)
+{
+    static const uint32_t consumed = 0;
+    static const uint8_t replayed = EVENT_LOG_REPLAYED_MARK;
+
+    if (!event_log_ready)
+    {
+        return;
+    }
+
+    cy_rtos_mutex_get(&event_log_mutex, CY_RTOS_NEVER_TIMEOUT);
+
+    if ((next->sequence > event_log_cursor.sequence) ||
+        ((next->sequence == event_log_cursor.sequence) && (next->offset > event_log_cursor.offset)))
+    {
+        while ((event_log_cursor.segment != next->segment) &&
+               (event_log_segments[event_log_cursor.segment].sequence == event_log_cursor.sequence))
+        {
+            if (event_log_suspended == 0)
+            {
+                cy_serial_flash_qspi_write(event_log_segments[event_log_cursor.segment].address +
+                                           EVENT_LOG_CONSUMED_OFFSET, sizeof(consumed),
+                                           (const uint8_t *)&consumed);
+            }
+            event_log_cursor.segment = event_log_next(event_log_cursor.segment);
+            event_log_cursor.sequence = event_log_segments[event_log_cursor.segment].sequence;
+        }
+        event_log_cursor = *next;
+
+        if ((next->last_record != 0) && (event_log_suspended == 0))
+        {
+            cy_serial_flash_qspi_write(event_log_segments[next->segment].address + next->last_record +
+                                       EVENT_LOG_MARK_INDEX, sizeof(replayed), &replayed);
+        }
+    }
+
+    cy_rtos_mutex_set(&event_log_mutex);
+}
+
+/*******************************************************************************
+ * Function Name: event_log_suspend
+ *******************************************************************************
+ * Summary:
+ *  Keeps the log from using the flash, while it is read through XIP or
+ *  programmed by a download. Waits for the operation in progress, if any. Appends then fail and reads return
+ *  nothing at once, without waiting, until event_log_resume is called.
+ *
+ *******************************************************************************/
+void event_log_suspend(void)
+{
+    if (event_log_ready)
+    {
+        cy_rtos_mutex_get(&event_log_mutex, CY_RTOS_NEVER_TIMEOUT);
+        event_log_suspended++;
+        cy_rtos_mutex_set(&event_log_mutex);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: event_log_resume
+ *******************************************************************************
+ * Summary:
+ *  Lets the log use the flash again after event_log_suspend.
+ *
+ *******************************************************************************/
+void event_log_resume(void)
+{
+    if (event_log_ready)
+    {
+        cy_rtos_mutex_get(&event_log_mutex, CY_RTOS_NEVER_TIMEOUT);
+        if (event_log_suspended > 0)
+        {
+            event_log_suspended--;
+        }
+        cy_rtos_mutex_set(&event_log_mutex);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: event_log_benchmark
+ *******************************************************************************
+ * Summary:
+ *  Appends EVENT_LOG_BENCHMARK_RECORDS records of 8 data bytes, replays them
+ *  and prints both rates. The records are consumed afterwards, so the log
+ *  must hold no records that are still to be sent.
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t event_log_benchmark(void)
+{
+    static uint8_t buffer[EVENT_LOG_READ_SIZE];
+    uint8_t data[EVENT_LOG_RECORD_DATA_SIZE] = { 0 };
+    event_log_position_t next;
+    uint32_t records;
+    uint32_t replayed = 0;
+    uint32_t bytes = 0;
+    uint32_t length;
+    uint32_t append_ms;
+    uint32_t replay_ms;
+    cy_time_t start_time;
+    cy_time_t end_time;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if (!event_log_ready || (event_log_read(buffer, sizeof(buffer), &records, &next) != 0))
+    {
+        printf("Event log benchmark needs an empty log\n");
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    cy_rtos_get_time(&start_time);
+    for (uint32_t index = 0; (index < EVENT_LOG_BENCHMARK_RECORDS) && (result == CY_RSLT_SUCCESS); index++)
+    {
+        data[0] = (uint8_t)index;
+        result = event_log_append((uint32_t)start_time, 0, data, sizeof(data));
+    }
+    cy_rtos_get_time(&end_time);
+    append_ms = (uint32_t)(end_time - start_time);
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Event log benchmark append failed! Error: 0x%08"PRIx32"\n", (uint32_t)result);
+        return result;
+    }
+
+    cy_rtos_get_time(&start_time);
+    do
+    {
+        length = event_log_read(buffer, sizeof(buffer), &records, &next);
+        event_log_consume(&next);
+        replayed += records;
+        bytes += length;
+    } while (records > 0);
+    cy_rtos_get_time(&end_time);
+    replay_ms = (uint32_t)(end_time - start_time);
+
+    append_ms = (append_ms == 0) ? 1u : append_ms;
+    replay_ms = (replay_ms == 0) ? 1u : replay_ms;
+
+    /* Bytes per ms are kB/s. */
+    printf("Event log benchmark: %"PRIu32" appends in %"PRIu32" ms (%"PRIu32" records/s), "
+           "%"PRIu32" records (%"PRIu32" bytes) replayed in %"PRIu32" ms (%"PRIu32" kB/s)\n",
+           (uint32_t)EVENT_LOG_BENCHMARK_RECORDS, append_ms,
+           (uint32_t)(((uint64_t)EVENT_LOG_BENCHMARK_RECORDS * 1000u) / append_ms),
+           replayed, bytes, replay_ms, bytes / replay_ms);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_layout
+ *******************************************************************************
+ * Summary:
+ *  Places the segments in the top EVENT_LOG_SEGMENT_COUNT erase sectors of
+ *  the flash, which can be of different sizes on hybrid-sector parts.
+ *
+ *******************************************************************************/
+static void event_log_layout(void)
+{
+    uint32_t address = (uint32_t)cy_serial_flash_qspi_get_size();
+
+    for (uint32_t index = 0; index < EVENT_LOG_SEGMENT_COUNT; index++)
+    {
+        event_log_segments[index].size = (uint32_t)cy_serial_flash_qspi_get_erase_size(address - 1u);
+        address -= event_log_segments[index].size;
+        event_log_segments[index].address = address;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: event_log_rotate
+ *******************************************************************************
+ * Summary:
+ *  Erases the next segment of the ring and makes it the newest one. The
+ *  replay position moves past it if it held records not yet replayed.
+ *  Called with the mutex held.
+ *
+ *******************************************************************************/
+static cy_rslt_t event_log_rotate(void)
+{
+    uint32_t header[EVENT_LOG_SEGMENT_HEADER_SIZE / sizeof(uint32_t)];
+    uint32_t next = (event_log_head == EVENT_LOG_NO_SEGMENT) ? 0u : event_log_next(event_log_head);
+    event_log_segment_t *segment = &event_log_segments[next];
+    cy_rslt_t result;
+
+    header[0] = EVENT_LOG_SEGMENT_MAGIC;
+    header[1] = (event_log_head == EVENT_LOG_NO_SEGMENT) ? 1u :
+                (event_log_segments[event_log_head].sequence + 1u);
+    header[2] = segment->erase_count + 1u;
+    header[3] = EVENT_LOG_ERASED_WORD;
+
+    if (event_log_head == EVENT_LOG_NO_SEGMENT)
+    {
+        event_log_cursor.segment = next;
+        event_log_cursor.sequence = header[1];
+        event_log_cursor.offset = EVENT_LOG_SEGMENT_HEADER_SIZE;
+    }
+    else if (event_log_cursor.segment == next)
+    {
+        /* The oldest segment is overwritten: replay from the one after it. */
+        if (segment->sequence != 0)
+        {
+            event_log_dropped_segments++;
+            printf("Event log full, %"PRIu32" segments dropped\n", event_log_dropped_segments);
+        }
+        event_log_cursor.segment = event_log_next(next);
+        event_log_cursor.sequence = event_log_segments[event_log_cursor.segment].sequence;
+        event_log_cursor.offset = EVENT_LOG_SEGMENT_HEADER_SIZE;
+    }
+
+    segment->sequence = 0;
+    result = cy_serial_flash_qspi_erase(segment->address, segment->size);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_serial_flash_qspi_write(segment->address, sizeof(header), (const uint8_t *)header);
+    }
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Event log rotation failed! Error: 0x%08"PRIx32"\n", (uint32_t)result);
+        return result;
+    }
+
+    segment->sequence = header[1];
+    segment->erase_count = header[2];
+    event_log_head = next;
+    event_log_head_offset = EVENT_LOG_SEGMENT_HEADER_SIZE;
+    if (event_log_cursor.segment == next)
+    {
+        event_log_cursor.sequence = segment->sequence;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_scan
+ *******************************************************************************
+ * Summary:
+ *  Walks the records of a segment. Returns the offset after the last valid
+ *  record, and sets resume to the offset after the last marked record. A
+ *  record cut short by a reset ends the segment; it is then treated as full.
+ *
+ *******************************************************************************/
+static uint32_t event_log_scan(const event_log_segment_t *segment, uint32_t *resume)
+{
+    uint8_t record[EVENT_LOG_RECORD_MAX_SIZE];
+    uint32_t offset = EVENT_LOG_SEGMENT_HEADER_SIZE;
+    uint32_t record_size;
+
+    *resume = offset;
+
+    while ((offset + EVENT_LOG_RECORD_OVERHEAD) <= segment->size)
+    {
+        if (cy_serial_flash_qspi_read(segment->address + offset, 1u, record) != CY_RSLT_SUCCESS)
+        {
+            return segment->size;
+        }
+        if (record[0] == EVENT_LOG_ERASED_BYTE)
+        {
+            return offset;
+        }
+
+        record_size = EVENT_LOG_RECORD_OVERHEAD + record[0];
+        if ((record[0] > EVENT_LOG_RECORD_DATA_SIZE) || ((offset + record_size) > segment->size) ||
+            (cy_serial_flash_qspi_read(segment->address + offset, record_size, record) != CY_RSLT_SUCCESS) ||
+            (record[record_size - 1u] != record_check(record, record_size - 1u)))
+        {
+            return segment->size;
+        }
+        offset += record_size;
+
+        if (record[EVENT_LOG_MARK_INDEX] == EVENT_LOG_REPLAYED_MARK)
+        {
+            *resume = offset;
+        }
+    }
+
+    return offset;
+}
+
+/*******************************************************************************
+ * Function Name: event_log_next
+ *******************************************************************************
+ * Summary:
+ *  Returns the index of the segment after the given one in the ring.
+ *
+ *******************************************************************************/
+static uint32_t event_log_next(uint32_t index)
+{
+    return (index + 1u) % EVENT_LOG_SEGMENT_COUNT;
+}
+
+/*******************************************************************************
+ * Function Name: record_check
+ *******************************************************************************
+ * Summary:
+ *  Returns the check byte of a record: the inverted sum of its bytes but the
+ *  mark, so that neither erased nor cleared bytes pass the check.
+ *
+ *******************************************************************************/
+static uint8_t record_check(const uint8_t *record, uint32_t length)
+{
+    uint8_t sum = 0x5Au;
+
+    for (uint32_t index = 0; index < length; index++)
+    {
+        if (index != EVENT_LOG_MARK_INDEX)
+        {
+            sum += record[index];
+        }
+    }
+
+    return (uint8_t)~sum;
+}
+
+#endif /* FLASH_DOWNLOAD_SUPPORTED */
+
+
+/* [] END OF FILE */
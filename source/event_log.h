@@ -0,0 +1,99 @@
+/******************************************************************************
+* File Name:   event_log.h
+*
+* Description: This file contains declarations of the append-only log of
+* telemetry records on the external serial flash.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of erase sectors at the top of the external flash that hold the log.
+ * Each sector is one segment of the log; at least two are needed.
+ */
+#ifndef EVENT_LOG_SEGMENT_COUNT
+#define EVENT_LOG_SEGMENT_COUNT                   (4u)
+#endif
+
+/* Largest data of a record. */
+#define EVENT_LOG_RECORD_DATA_SIZE                (8u)
+
+/* Size of a record when read back, without its data: timestamp (4), type (1)
+ * and length (1). This is the record format of the telemetry frame.
+ */
+#define EVENT_LOG_RECORD_HEADER_SIZE              (6u)
+
+/* Number of records appended and replayed by the benchmark. */
+#ifndef EVENT_LOG_BENCHMARK_RECORDS
+#define EVENT_LOG_BENCHMARK_RECORDS               (512u)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Position in the log, returned by event_log_read. */
+typedef struct
+{
+    uint32_t segment;               /* Index of the segment. */
+    uint32_t sequence;              /* Sequence number of the segment. */
+    uint32_t offset;                /* Offset in the segment. */
+    uint32_t last_record;           /* Offset of the last record read, or 0. */
+} event_log_position_t;
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+uint32_t event_log_get_region_start(void);
+cy_rslt_t event_log_init(void);
+cy_rslt_t event_log_append(uint32_t timestamp_ms, uint8_t type, const uint8_t *data,
+                           uint32_t length);
+uint32_t event_log_read(uint8_t *buffer, uint32_t size, uint32_t *records,
+                        event_log_position_t *next);
+void event_log_consume(const event_log_position_t *next);
+void event_log_suspend(void);
+void event_log_resume(void);
+cy_rslt_t event_log_benchmark(void);
+
+#endif /* EVENT_LOG_H_ */
@@ -0,0 +1,1025 @@
+/******************************************************************************
+* File Name:   flash_download.c
+*
+* Description: This file contains the bulk download of an image from the TCP
+* server to the external serial flash. The image is received into one of two
+* buffers while the other is erased and programmed by the download thread, so
+* network receive and flash programming overlap. A SHA-256 digest is computed
+* as the data is programmed and checked against the digest sent by the server.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* HAL header file, for the critical sections. */
+#include "cyhal.h"
+
+/* Flash download and event log header files. */
+#include "flash_download.h"
+#include "event_log.h"
+
+/* LZ stream header file, for compressed images. */
+#include "lz_stream.h"
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+
+/* Serial flash library header file. */
+#include "cy_serial_flash_qspi.h"
+
+/* SHA-256 of the crypto library of the network stack. */
+#if defined (COMPONENT_MBEDTLS)
+#include "mbedtls/sha256.h"
+#elif defined (COMPONENT_NETXSECURE)
+#include "nx_crypto_sha2.h"
+#else
+#error "The flash download needs the SHA-256 of mbed TLS or NetX Secure"
+#endif
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of buffers between the network and the flash. */
+#define FLASH_DOWNLOAD_BUFFER_COUNT               (2u)
+
+/* Queued after the last buffer of a download, finished or aborted, in place
+ * of a buffer index.
+ */
+#define FLASH_DOWNLOAD_END                        (FLASH_DOWNLOAD_BUFFER_COUNT)
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Buffer of received data waiting to be programmed. */
+typedef struct
+{
+    uint8_t data[FLASH_DOWNLOAD_BUFFER_SIZE];
+    uint32_t length;
+} download_buffer_t;
+
+#if defined (COMPONENT_MBEDTLS)
+typedef mbedtls_sha256_context download_hash_t;
+#else
+typedef NX_CRYPTO_SHA256 download_hash_t;
+#endif
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static cy_rslt_t flash_download_init(void);
+static cy_rslt_t flash_download_fill(uint8_t **buffer, uint32_t *length, uint32_t timeout_ms);
+static cy_rslt_t flash_download_decode(const uint8_t *data, uint32_t length, uint32_t *taken,
+                                       uint32_t timeout_ms);
+static void flash_download_thread(cy_thread_arg_t arg);
+static void flash_download_program(const download_buffer_t *buffer);
+static void flash_download_complete(void);
+static void flash_download_end(void);
+#if (FLASH_DOWNLOAD_VERIFY_READBACK)
+static cy_rslt_t flash_download_verify(uint8_t *buffer, bool *match);
+#endif
+static void hash_start(download_hash_t *hash);
+static void hash_update(download_hash_t *hash, const uint8_t *data, uint32_t length);
+static void hash_finish(download_hash_t *hash, uint8_t *digest);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Buffers between the network and the flash. The free buffers are counted by
+ * download_free_buffers; the filled ones are queued for the download thread
+ * by index, and programmed in the order they were filled. All of them are
+ * free whenever the region is not claimed.
+ */
+static download_buffer_t download_buffers[FLASH_DOWNLOAD_BUFFER_COUNT];
+static cy_semaphore_t download_free_buffers;
+static cy_queue_t download_full_buffers;
+static cy_thread_t download_thread;
+static bool download_initialized;
+
+/* Set when the receive side found no free buffer, until the download thread
+ * frees one and calls the resume callback.
+ */
+static volatile bool download_starved;
+static flash_download_resume_fn_t download_resume_fn;
+static void *download_resume_arg;
+
+/* Set while a download or an upload uses the download region. */
+static bool download_region_claimed;
+
+/* Set while the download thread keeps the event log off the flash, from the
+ * first buffer of a download to its end.
+ */
+static bool download_log_suspended;
+
+/* Receive side: the buffer being filled and the progress of the download.
+ * Once the last byte is received, the download is finishing until the
+ * download thread has checked it and called the report callback.
+ */
+static volatile bool download_active;
+static volatile bool download_finishing;
+static flash_download_report_fn_t download_report_fn;
+static void *download_report_arg;
+static volatile bool download_report_cancelled;
+static uint32_t download_fill_buffer;
+static bool download_fill_acquired;
+static uint32_t download_size;
+static uint32_t download_received;
+static uint8_t download_expected[FLASH_DOWNLOAD_DIGEST_SIZE];
+static cy_time_t download_start_time;
+
+/* Decompressor of a compressed image, and the compressed bytes received. */
+static lz_stream_decoder_t download_decoder;
+static bool download_compressed;
+static uint32_t download_compressed_bytes;
+
+/* Flash side: where the image goes, how far it is programmed and erased, and
+ * the digest of the programmed data.
+ */
+static uint32_t download_address;
+static uint32_t download_written;
+static uint32_t download_erased_end;
+static cy_rslt_t download_result;
+static download_hash_t download_hash;
+static uint8_t download_digest[FLASH_DOWNLOAD_DIGEST_SIZE];
+static cy_time_t download_end_time;
+
+/*******************************************************************************
+ * Function Name: flash_download_set_resume_callback
+ *******************************************************************************
+ * Summary:
+ *  Sets the function called by the download thread when it frees a buffer
+ *  after flash_download_get_buffer returned FLASH_DOWNLOAD_NO_BUFFER, so that
+ *  the receive side can read from the socket again.
+ *
+ * Parameters:
+ *  flash_download_resume_fn_t resume_fn: Function to be called
+ *  void *arg: Argument passed on to the function
+ *
+ *******************************************************************************/
+void flash_download_set_resume_callback(flash_download_resume_fn_t resume_fn, void *arg)
+{
+    download_resume_arg = arg;
+    download_resume_fn = resume_fn;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_begin
+ *******************************************************************************
+ * Summary:
+ *  Prepares the download of an image into the upper half of the external
+ *  flash, below the event log. The lower half holds the Wi-Fi firmware. The flash is erased
+ *  just ahead of the data as it arrives. Never waits: the region stays
+ *  claimed until the download thread is done with the previous download.
+ *
+ * Parameters:
+ *  uint32_t size: Size of the image in bytes
+ *  const uint8_t *digest: SHA-256 digest of the image
+ *  bool compressed: true if the image is received compressed, through
+ *  flash_download_decompress
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_begin(uint32_t size, const uint8_t *digest, bool compressed)
+{
+    cy_rslt_t result;
+    uint32_t region_offset;
+    uint32_t region_size;
+
+    if (!flash_download_claim_region(&region_offset, &region_size))
+    {
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    if ((size == 0) || (size > region_size))
+    {
+        flash_download_release_region();
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    if (!download_initialized)
+    {
+        result = flash_download_init();
+        if (result != CY_RSLT_SUCCESS)
+        {
+            flash_download_release_region();
+            return result;
+        }
+        download_initialized = true;
+    }
+
+    download_address = region_offset;
+    download_written = 0;
+    download_erased_end = download_address;
+    download_result = CY_RSLT_SUCCESS;
+    hash_start(&download_hash);
+
+    download_size = size;
+    download_received = 0;
+    download_fill_buffer = FLASH_DOWNLOAD_BUFFER_COUNT - 1u;
+    download_fill_acquired = false;
+    memcpy(download_expected, digest, FLASH_DOWNLOAD_DIGEST_SIZE);
+    download_compressed = compressed;
+    download_compressed_bytes = 0;
+    lz_stream_decoder_init(&download_decoder);
+    cy_rtos_get_time(&download_start_time);
+    download_active = true;
+
+    printf("Downloading %"PRIu32" bytes%s to the external flash at 0x%08"PRIx32"\n",
+           size, compressed ? " compressed" : "", download_address);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_get_buffer
+ *******************************************************************************
+ * Summary:
+ *  Returns the free space of the buffer being filled, so that the caller can
+ *  receive straight into it. Never waits: while both buffers wait for the
+ *  flash, it returns FLASH_DOWNLOAD_NO_BUFFER, and the resume callback is
+ *  called once the download thread frees one. The caller holds back the
+ *  network until then.
+ *
+ * Parameters:
+ *  uint8_t **buffer: Set to the free space of the buffer
+ *  uint32_t *length: Set to the number of bytes that can be received
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, FLASH_DOWNLOAD_NO_BUFFER if no
+ *  buffer is free, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_get_buffer(uint8_t **buffer, uint32_t *length)
+{
+    return flash_download_fill(buffer, length, 0);
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_wait_buffer
+ *******************************************************************************
+ * Summary:
+ *  Waits for a free buffer, for receive threads of their own that may wait
+ *  for the flash instead of using the resume callback.
+ *
+ * Parameters:
+ *  uint32_t timeout_ms: Maximum time to wait
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS once a buffer is being filled,
+ *  FLASH_DOWNLOAD_NO_BUFFER on timeout, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_wait_buffer(uint32_t timeout_ms)
+{
+    uint8_t *buffer;
+    uint32_t length;
+
+    return flash_download_fill(&buffer, &length, timeout_ms);
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_commit
+ *******************************************************************************
+ * Summary:
+ *  Accounts for data received into the buffer returned by
+ *  flash_download_get_buffer. A full buffer, or the last one, is handed over
+ *  to the download thread.
+ *
+ * Parameters:
+ *  uint32_t length: Number of bytes received
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_commit(uint32_t length)
+{
+    download_buffer_t *fill = &download_buffers[download_fill_buffer];
+
+    if (!download_active || !download_fill_acquired ||
+        (length > (FLASH_DOWNLOAD_BUFFER_SIZE - fill->length)))
+    {
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    fill->length += length;
+    download_received += length;
+
+    if ((fill->length == FLASH_DOWNLOAD_BUFFER_SIZE) || (download_received == download_size))
+    {
+        download_fill_acquired = false;
+        return cy_rtos_queue_put(&download_full_buffers, &download_fill_buffer,
+                                 CY_RTOS_NEVER_TIMEOUT);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_write
+ *******************************************************************************
+ * Summary:
+ *  Copies received data into the buffers, for data that was not received
+ *  straight into them. Stops without waiting when no buffer is free.
+ *
+ * Parameters:
+ *  const uint8_t *data: Received data
+ *  uint32_t length: Number of bytes received
+ *  uint32_t *taken: Set to the number of bytes copied
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, FLASH_DOWNLOAD_NO_BUFFER if the
+ *  rest of the data has to wait for a free buffer, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_write(const uint8_t *data, uint32_t length, uint32_t *taken)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint8_t *buffer;
+    uint32_t space;
+
+    *taken = 0;
+    while ((length > 0) && (result == CY_RSLT_SUCCESS))
+    {
+        result = flash_download_get_buffer(&buffer, &space);
+        if ((result == CY_RSLT_SUCCESS) && (space == 0))
+        {
+            result = CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+        }
+        if (result == CY_RSLT_SUCCESS)
+        {
+            if (space > length)
+            {
+                space = length;
+            }
+            memcpy(buffer, data, space);
+            result = flash_download_commit(space);
+            data += space;
+            length -= space;
+            *taken += space;
+        }
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_decompress
+ *******************************************************************************
+ * Summary:
+ *  Decompresses received bytes of a compressed image straight into the
+ *  buffers. The bytes may end anywhere in the compressed stream; the rest of
+ *  a match is output with the next bytes, or by flash_download_finish. Stops
+ *  without waiting when no buffer is free.
+ *
+ * Parameters:
+ *  const uint8_t *data: Received compressed bytes
+ *  uint32_t length: Number of bytes received
+ *  uint32_t *taken: Set to the number of bytes decompressed
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, FLASH_DOWNLOAD_NO_BUFFER if the
+ *  output has to wait for a free buffer, an error code otherwise, also if
+ *  the bytes stand for more than the size of the image.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_decompress(const uint8_t *data, uint32_t length, uint32_t *taken)
+{
+    download_compressed_bytes += length;
+
+    return flash_download_decode(data, length, taken, 0);
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_finish
+ *******************************************************************************
+ * Summary:
+ *  Hands the download over to the download thread after the last byte is
+ *  received. Never waits: the thread outputs the rest of a compressed image,
+ *  waits for the flash, checks the digest, and then calls the report
+ *  function with the outcome and the sustained throughput from the first
+ *  received byte to the last programmed one.
+ *
+ * Parameters:
+ *  flash_download_report_fn_t report_fn: Function to be called with the
+ *  outcome, from the download thread
+ *  void *arg: Argument passed on to the function
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS if the outcome will be reported, an error code
+ *  if no download is in progress.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_download_finish(flash_download_report_fn_t report_fn, void *arg)
+{
+    uint32_t end = FLASH_DOWNLOAD_END;
+
+    if (!download_active || download_finishing)
+    {
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    download_report_fn = report_fn;
+    download_report_arg = arg;
+    download_report_cancelled = false;
+    download_finishing = true;
+
+    return cy_rtos_queue_put(&download_full_buffers, &end, CY_RTOS_NEVER_TIMEOUT);
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_cancel_report
+ *******************************************************************************
+ * Summary:
+ *  Drops the report of a finishing download for the given argument, for
+ *  example when the connection that asked for it is lost, so that the report
+ *  is not sent on the next connection.
+ *
+ * Parameters:
+ *  void *arg: Argument passed to flash_download_finish
+ *
+ *******************************************************************************/
+void flash_download_cancel_report(void *arg)
+{
+    if (download_finishing && (download_report_arg == arg))
+    {
+        download_report_cancelled = true;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_abort
+ *******************************************************************************
+ * Summary:
+ *  Abandons the download being received, for example when the connection is
+ *  lost. Buffers already handed over are released by the download thread
+ *  without being programmed, and the thread releases the region after them.
+ *  Never waits.
+ *
+ *******************************************************************************/
+void flash_download_abort(void)
+{
+    uint32_t end = FLASH_DOWNLOAD_END;
+
+    if (!download_active || download_finishing)
+    {
+        return;
+    }
+
+    download_active = false;
+    if (download_fill_acquired)
+    {
+        download_fill_acquired = false;
+        cy_rtos_semaphore_set(&download_free_buffers);
+    }
+
+    cy_rtos_queue_put(&download_full_buffers, &end, CY_RTOS_NEVER_TIMEOUT);
+
+    printf("Download aborted after %"PRIu32" of %"PRIu32" bytes\n",
+           download_received, download_size);
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_claim_region
+ *******************************************************************************
+ * Summary:
+ *  Claims the download region of the external flash, the upper half below
+ *  the event log, for a download or an upload. The flash cannot be read through XIP while it is
+ *  being erased or programmed, so only one of them can run at a time.
+ *
+ * Parameters:
+ *  uint32_t *offset: Set to the offset of the region in the flash
+ *  uint32_t *size: Set to the size of the region
+ *
+ * Return:
+ *  bool: true if the region was claimed, false if it is in use.
+ *
+ *******************************************************************************/
+bool flash_download_claim_region(uint32_t *offset, uint32_t *size)
+{
+    uint32_t flash_size = (uint32_t)cy_serial_flash_qspi_get_size();
+    uint32_t critical_state;
+    bool claimed = false;
+
+    critical_state = cyhal_system_critical_section_enter();
+    if (!download_region_claimed)
+    {
+        download_region_claimed = true;
+        claimed = true;
+    }
+    cyhal_system_critical_section_exit(critical_state);
+
+    *offset = flash_size / 2u;
+    *size = event_log_get_region_start() - *offset;
+
+    return claimed;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_release_region
+ *******************************************************************************
+ * Summary:
+ *  Releases the download region claimed by flash_download_claim_region.
+ *
+ *******************************************************************************/
+void flash_download_release_region(void)
+{
+    download_region_claimed = false;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_init
+ *******************************************************************************
+ * Summary:
+ *  Creates the buffer pool and the download thread on the first download.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_download_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_semaphore_init(&download_free_buffers, FLASH_DOWNLOAD_BUFFER_COUNT,
+                                    FLASH_DOWNLOAD_BUFFER_COUNT);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        /* Every buffer and the end of the download. */
+        result = cy_rtos_queue_init(&download_full_buffers, FLASH_DOWNLOAD_BUFFER_COUNT + 1u,
+                                    sizeof(uint32_t));
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_thread_create(&download_thread, flash_download_thread, "Flash download",
+                                       NULL, FLASH_DOWNLOAD_THREAD_STACK_SIZE,
+                                       FLASH_DOWNLOAD_THREAD_PRIORITY, NULL);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Flash download initialization failed!\n");
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_thread
+ *******************************************************************************
+ * Summary:
+ *  Programs the filled buffers in order and returns them to the pool, and
+ *  completes each download after its last buffer.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void flash_download_thread(cy_thread_arg_t arg)
+{
+    uint32_t index;
+
+    for (;;)
+    {
+        if (cy_rtos_queue_get(&download_full_buffers, &index, CY_RTOS_NEVER_TIMEOUT) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+
+        if (index == FLASH_DOWNLOAD_END)
+        {
+            flash_download_complete();
+            continue;
+        }
+
+        if (download_active)
+        {
+            flash_download_program(&download_buffers[index]);
+        }
+
+        cy_rtos_semaphore_set(&download_free_buffers);
+
+        if (download_starved)
+        {
+            download_starved = false;
+            if (download_resume_fn != NULL)
+            {
+                download_resume_fn(download_resume_arg);
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_fill
+ *******************************************************************************
+ * Summary:
+ *  Returns the free space of the buffer being filled, taking the next free
+ *  buffer first if needed. A failed attempt is recorded, so that the download
+ *  thread calls the resume callback when it frees a buffer.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_download_fill(uint8_t **buffer, uint32_t *length, uint32_t timeout_ms)
+{
+    download_buffer_t *fill;
+    uint32_t space;
+    cy_rslt_t result;
+
+    if (!download_active)
+    {
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    if (!download_fill_acquired)
+    {
+        /* Recorded first, so that a buffer freed meanwhile is not missed. */
+        download_starved = true;
+        result = cy_rtos_semaphore_get(&download_free_buffers, timeout_ms);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        download_starved = false;
+
+        /* An abort may have freed the buffer while this waited. */
+        if (!download_active)
+        {
+            cy_rtos_semaphore_set(&download_free_buffers);
+            return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+        }
+
+        /* The buffers are programmed in order, so the free one is the next. */
+        download_fill_buffer = (download_fill_buffer + 1u) % FLASH_DOWNLOAD_BUFFER_COUNT;
+        download_buffers[download_fill_buffer].length = 0;
+        download_fill_acquired = true;
+    }
+
+    fill = &download_buffers[download_fill_buffer];
+    space = FLASH_DOWNLOAD_BUFFER_SIZE - fill->length;
+    if (space > (download_size - download_received))
+    {
+        space = download_size - download_received;
+    }
+
+    *buffer = &fill->data[fill->length];
+    *length = space;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_decode
+ *******************************************************************************
+ * Summary:
+ *  Decompresses bytes into the buffers until the bytes and the match they
+ *  end in are output, waiting up to the given time for each free buffer.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_download_decode(const uint8_t *data, uint32_t length, uint32_t *taken,
+                                       uint32_t timeout_ms)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t remaining = length;
+    uint8_t *buffer;
+    uint32_t space;
+    uint32_t produced;
+
+    for (;;)
+    {
+        /* No buffer is taken once the whole image is out. */
+        if (download_received == download_size)
+        {
+            if (remaining > 0)
+            {
+                result = CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+            }
+            break;
+        }
+
+        result = flash_download_fill(&buffer, &space, timeout_ms);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            break;
+        }
+
+        produced = lz_stream_decode(&download_decoder, &data, &remaining, buffer, space);
+        result = flash_download_commit(produced);
+
+        /* Less output than room: the input is used up and no match is left. */
+        if ((result != CY_RSLT_SUCCESS) || (produced < space))
+        {
+            break;
+        }
+    }
+
+    *taken = length - remaining;
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_program
+ *******************************************************************************
+ * Summary:
+ *  Erases the flash ahead of a buffer, programs the buffer and adds it to the
+ *  digest. After the first flash error, the remaining data is only hashed.
+ *  The time of the last buffer is recorded for the throughput. The event
+ *  log is kept off the flash until the download ends.
+ *
+ *******************************************************************************/
+static void flash_download_program(const download_buffer_t *buffer)
+{
+    uint32_t address = download_address + download_written;
+    size_t erase_size;
+
+    if (!download_log_suspended)
+    {
+        event_log_suspend();
+        download_log_suspended = true;
+    }
+
+    while ((download_result == CY_RSLT_SUCCESS) &&
+           (download_erased_end < (address + buffer->length)))
+    {
+        erase_size = cy_serial_flash_qspi_get_erase_size(download_erased_end);
+        download_result = cy_serial_flash_qspi_erase(download_erased_end, erase_size);
+        download_erased_end += (uint32_t)erase_size;
+    }
+
+    if (download_result == CY_RSLT_SUCCESS)
+    {
+        download_result = cy_serial_flash_qspi_write(address, buffer->length, buffer->data);
+    }
+
+    hash_update(&download_hash, buffer->data, buffer->length);
+    download_written += buffer->length;
+
+    if (download_written == download_size)
+    {
+        hash_finish(&download_hash, download_digest);
+        cy_rtos_get_time(&download_end_time);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_complete
+ *******************************************************************************
+ * Summary:
+ *  Completes a download once the thread reaches its end. After an abort,
+ *  only the region is released. Otherwise the rest of a compressed image is
+ *  output and programmed here, as this thread is the one that frees the
+ *  buffers, then the digest is checked and the image read back, and the
+ *  outcome is reported.
+ *
+ *******************************************************************************/
+static void flash_download_complete(void)
+{
+    char report[FLASH_DOWNLOAD_REPORT_SIZE];
+    cy_rslt_t result;
+    bool match = false;
+    uint32_t elapsed_ms;
+    uint32_t rate;
+    uint32_t taken;
+    uint32_t index;
+
+    if (!download_finishing)
+    {
+        flash_download_end();
+        return;
+    }
+
+    /* Output the rest of the last match, if no buffer was free for it. Both
+     * buffers are then queued, so one can be programmed to make room.
+     */
+    while (download_compressed && (download_received < download_size) &&
+           (flash_download_decode(NULL, 0, &taken, 0) == FLASH_DOWNLOAD_NO_BUFFER) &&
+           (cy_rtos_queue_get(&download_full_buffers, &index, 0) == CY_RSLT_SUCCESS))
+    {
+        flash_download_program(&download_buffers[index]);
+        cy_rtos_semaphore_set(&download_free_buffers);
+    }
+    while (cy_rtos_queue_get(&download_full_buffers, &index, 0) == CY_RSLT_SUCCESS)
+    {
+        flash_download_program(&download_buffers[index]);
+        cy_rtos_semaphore_set(&download_free_buffers);
+    }
+    download_starved = false;
+
+    /* A buffer left partly filled by an incomplete image is not programmed. */
+    if (download_fill_acquired)
+    {
+        download_fill_acquired = false;
+        cy_rtos_semaphore_set(&download_free_buffers);
+    }
+
+    elapsed_ms = (uint32_t)(download_end_time - download_start_time);
+    if (elapsed_ms == 0)
+    {
+        elapsed_ms = 1;
+    }
+
+    result = download_result;
+    if (download_received != download_size)
+    {
+        result = CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+        snprintf(report, sizeof(report), "DOWNLOAD FAILED: incomplete");
+    }
+    else
+    {
+        if (result == CY_RSLT_SUCCESS)
+        {
+            match = (memcmp(download_digest, download_expected, FLASH_DOWNLOAD_DIGEST_SIZE) == 0);
+        }
+#if (FLASH_DOWNLOAD_VERIFY_READBACK)
+        /* Every buffer is free, and stays so while the region is claimed. */
+        if ((result == CY_RSLT_SUCCESS) && match)
+        {
+            result = flash_download_verify(download_buffers[0].data, &match);
+        }
+#endif
+
+        if (result != CY_RSLT_SUCCESS)
+        {
+            snprintf(report, sizeof(report), "DOWNLOAD FAILED: flash error 0x%08"PRIx32,
+                     (uint32_t)result);
+        }
+        else if (!match)
+        {
+            result = CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+            snprintf(report, sizeof(report), "DOWNLOAD FAILED: digest mismatch");
+        }
+        else
+        {
+            /* Hundredths of MB/s: bytes per ms are thousands of bytes per s. */
+            rate = (uint32_t)(((uint64_t)download_size * 100u) / ((uint64_t)elapsed_ms * 1000u));
+            if (download_compressed)
+            {
+                snprintf(report, sizeof(report), "DOWNLOAD OK %"PRIu32" bytes (%"PRIu32" compressed) %"PRIu32".%02"PRIu32" MB/s",
+                         download_size, download_compressed_bytes, rate / 100u, rate % 100u);
+            }
+            else
+            {
+                snprintf(report, sizeof(report), "DOWNLOAD OK %"PRIu32" bytes %"PRIu32".%02"PRIu32" MB/s",
+                         download_size, rate / 100u, rate % 100u);
+            }
+        }
+    }
+
+    printf("%s (%"PRIu32" ms)\n", report, elapsed_ms);
+
+    download_active = false;
+    download_finishing = false;
+    if (!download_report_cancelled && (download_report_fn != NULL))
+    {
+        download_report_fn(download_report_arg, result, report);
+    }
+    flash_download_end();
+}
+
+/*******************************************************************************
+ * Function Name: flash_download_end
+ *******************************************************************************
+ * Summary:
+ *  Lets the event log use the flash again and releases the region once the
+ *  download thread is done with a download.
+ *
+ *******************************************************************************/
+static void flash_download_end(void)
+{
+    if (download_log_suspended)
+    {
+        download_log_suspended = false;
+        event_log_resume();
+    }
+    flash_download_release_region();
+}
+
+#if (FLASH_DOWNLOAD_VERIFY_READBACK)
+/*******************************************************************************
+ * Function Name: flash_download_verify
+ *******************************************************************************
+ * Summary:
+ *  Reads the image back from the flash and compares its digest with the
+ *  digest sent by the TCP server.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_download_verify(uint8_t *buffer, bool *match)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t offset = 0;
+    uint32_t chunk;
+    uint8_t digest[FLASH_DOWNLOAD_DIGEST_SIZE];
+
+    hash_start(&download_hash);
+
+    while ((offset < download_size) && (result == CY_RSLT_SUCCESS))
+    {
+        chunk = download_size - offset;
+        if (chunk > FLASH_DOWNLOAD_BUFFER_SIZE)
+        {
+            chunk = FLASH_DOWNLOAD_BUFFER_SIZE;
+        }
+
+        result = cy_serial_flash_qspi_read(download_address + offset, chunk, buffer);
+        hash_update(&download_hash, buffer, chunk);
+        offset += chunk;
+    }
+
+    hash_finish(&download_hash, digest);
+    *match = (memcmp(digest, download_expected, FLASH_DOWNLOAD_DIGEST_SIZE) == 0);
+
+    return result;
+}
+#endif /* FLASH_DOWNLOAD_VERIFY_READBACK */
+
+/*******************************************************************************
+ * Function Name: hash_start
+ *******************************************************************************
+ * Summary:
+ *  Starts a SHA-256 digest.
+ *
+ *******************************************************************************/
+static void hash_start(download_hash_t *hash)
+{
+#if defined (COMPONENT_MBEDTLS)
+    mbedtls_sha256_init(hash);
+    mbedtls_sha256_starts(hash, 0);
+#else
+    _nx_crypto_sha256_initialize(hash, NX_CRYPTO_HASH_SHA256);
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: hash_update
+ *******************************************************************************
+ * Summary:
+ *  Adds data to a SHA-256 digest.
+ *
+ *******************************************************************************/
+static void hash_update(download_hash_t *hash, const uint8_t *data, uint32_t length)
+{
+#if defined (COMPONENT_MBEDTLS)
+    mbedtls_sha256_update(hash, data, length);
+#else
+    _nx_crypto_sha256_update(hash, (UCHAR *)data, length);
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: hash_finish
+ *******************************************************************************
+ * Summary:
+ *  Completes a SHA-256 digest.
+ *
+ *******************************************************************************/
+static void hash_finish(download_hash_t *hash, uint8_t *digest)
+{
+#if defined (COMPONENT_MBEDTLS)
+    mbedtls_sha256_finish(hash, digest);
+    mbedtls_sha256_free(hash);
+#else
+    _nx_crypto_sha256_digest_calculate(hash, digest, NX_CRYPTO_HASH_SHA256);
+#endif
+}
+
+#endif /* FLASH_DOWNLOAD_SUPPORTED */
+
+
+/* [] END OF FILE */
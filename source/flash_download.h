@@ -0,0 +1,126 @@
+/******************************************************************************
+* File Name:   flash_download.h
+*
+* Description: This file contains declarations of the bulk download of an
+* image from the TCP server to the external serial flash.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef FLASH_DOWNLOAD_H_
+#define FLASH_DOWNLOAD_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* The download needs the external serial flash, which is only initialized on
+ * the kits that load the Wi-Fi firmware from it. See main.c.
+ */
+#if defined(CY_DEVICE_PSOC6A512K)
+#define FLASH_DOWNLOAD_SUPPORTED                  (1)
+#else
+#define FLASH_DOWNLOAD_SUPPORTED                  (0)
+#endif
+
+/* Size of each of the two buffers between the network and the flash. One is
+ * filled from the socket while the other is programmed.
+ */
+#ifndef FLASH_DOWNLOAD_BUFFER_SIZE
+#define FLASH_DOWNLOAD_BUFFER_SIZE                (4096u)
+#endif
+
+/* Result of flash_download_get_buffer while both buffers wait for the flash.
+ * The receive side stops reading from the socket until the resume callback.
+ */
+#define FLASH_DOWNLOAD_NO_BUFFER                  (CY_RTOS_TIMEOUT)
+
+/* Size of the SHA-256 digest that verifies the image. */
+#define FLASH_DOWNLOAD_DIGEST_SIZE                (32u)
+
+/* To read the image back from the flash and check its digest again after
+ * programming, set this macro as '1'.
+ */
+#ifndef FLASH_DOWNLOAD_VERIFY_READBACK
+#define FLASH_DOWNLOAD_VERIFY_READBACK            (1)
+#endif
+
+/* Size of the report passed to the report callback, with the terminating
+ * null character.
+ */
+#define FLASH_DOWNLOAD_REPORT_SIZE                (64u)
+
+/* Stack size and priority of the thread that erases and programs the flash. */
+#ifndef FLASH_DOWNLOAD_THREAD_STACK_SIZE
+#define FLASH_DOWNLOAD_THREAD_STACK_SIZE          (2u * 1024u)
+#endif
+#ifndef FLASH_DOWNLOAD_THREAD_PRIORITY
+#define FLASH_DOWNLOAD_THREAD_PRIORITY            (CY_RTOS_PRIORITY_NORMAL)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Called by the download thread when it frees a buffer after the receive
+ * side found none free.
+ */
+typedef void (*flash_download_resume_fn_t)(void *arg);
+
+/* Called by the download thread with the outcome of a finished download and
+ * its report.
+ */
+typedef void (*flash_download_report_fn_t)(void *arg, cy_rslt_t result, const char *report);
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+void flash_download_set_resume_callback(flash_download_resume_fn_t resume_fn, void *arg);
+cy_rslt_t flash_download_begin(uint32_t size, const uint8_t *digest, bool compressed);
+cy_rslt_t flash_download_get_buffer(uint8_t **buffer, uint32_t *length);
+cy_rslt_t flash_download_wait_buffer(uint32_t timeout_ms);
+cy_rslt_t flash_download_commit(uint32_t length);
+cy_rslt_t flash_download_write(const uint8_t *data, uint32_t length, uint32_t *taken);
+cy_rslt_t flash_download_decompress(const uint8_t *data, uint32_t length, uint32_t *taken);
+cy_rslt_t flash_download_finish(flash_download_report_fn_t report_fn, void *arg);
+void flash_download_cancel_report(void *arg);
+void flash_download_abort(void);
+bool flash_download_claim_region(uint32_t *offset, uint32_t *size);
+void flash_download_release_region(void);
+
+#endif /* FLASH_DOWNLOAD_H_ */
@@ -0,0 +1,613 @@
+/******************************************************************************
+* File Name:   lz_stream.c
+*
+* Description: This file contains a streaming LZ compressor and decompressor
+* for the bulk transfers. The window is 2 KB, so that the compressor needs
+* about 3.5 KB and the decompressor about 2 KB of RAM. The compressor finds
+* matches through a hash table of the last position of every three bytes.
+* Both sides take and give any number of bytes per call, so the compressed
+* stream can be cut at any segment boundary of the connection.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* HAL header file, for the address of the internal flash. */
+#include "cyhal.h"
+
+/* RTOS header file, for the benchmark timing. */
+#include "cyabs_rtos.h"
+
+/* LZ stream header file. */
+#include "lz_stream.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#if (LZ_STREAM_INPUT_SIZE <= LZ_STREAM_MAX_MATCH)
+#error "LZ_STREAM_INPUT_SIZE must be larger than LZ_STREAM_MAX_MATCH"
+#endif
+
+/* Length field of a match that is followed by an extra length byte. */
+#define LZ_STREAM_LENGTH_EXTENDED                 (31u)
+
+/* Decompressor states: the next byte is a flag byte, the first byte of an
+ * item, the second byte of a match, or the extra length byte of a match.
+ */
+#define LZ_STREAM_STATE_FLAGS                     (0u)
+#define LZ_STREAM_STATE_ITEM                      (1u)
+#define LZ_STREAM_STATE_DISTANCE                  (2u)
+#define LZ_STREAM_STATE_LENGTH                    (3u)
+
+/* Payloads of the benchmark: the application code in the internal flash,
+ * and text like the log of this application. Each is read in chunks of
+ * LZ_STREAM_BENCHMARK_CHUNK bytes, the payload of one TCP segment.
+ */
+#define LZ_STREAM_BENCHMARK_FIRMWARE              (0u)
+#define LZ_STREAM_BENCHMARK_LOG                   (1u)
+#define LZ_STREAM_BENCHMARK_CHUNK                 (1456u)
+#define LZ_STREAM_BENCHMARK_LINE_SIZE             (96u)
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Sequential reader of one benchmark payload. */
+typedef struct
+{
+    uint32_t kind;
+    uint32_t offset;
+    char line[LZ_STREAM_BENCHMARK_LINE_SIZE];
+    uint32_t line_length;
+    uint32_t line_offset;
+    uint32_t random;
+} benchmark_source_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static void encode_item(lz_stream_encoder_t *encoder);
+static uint32_t hash_bytes(const uint8_t *data);
+static void decoder_next_item(lz_stream_decoder_t *decoder);
+static bool benchmark_payload(const char *name, uint32_t kind);
+static void benchmark_source_start(benchmark_source_t *source, uint32_t kind);
+static void benchmark_read(benchmark_source_t *source, uint8_t *buffer, uint32_t length);
+
+/*******************************************************************************
+ * Function Name: lz_stream_encoder_init
+ *******************************************************************************
+ * Summary:
+ *  Starts a new compressed stream.
+ *
+ * Parameters:
+ *  lz_stream_encoder_t *encoder: Compressor state
+ *
+ *******************************************************************************/
+void lz_stream_encoder_init(lz_stream_encoder_t *encoder)
+{
+    memset(encoder->hash, 0, sizeof(encoder->hash));
+    encoder->base = 0;
+    encoder->next = 0;
+    encoder->end = 0;
+    encoder->group[0] = 0;
+    encoder->group_length = 1;
+    encoder->group_items = 0;
+    encoder->group_sent = 0;
+}
+
+/*******************************************************************************
+ * Function Name: lz_stream_encode
+ *******************************************************************************
+ * Summary:
+ *  Takes input and outputs compressed bytes. A group is output once it is
+ *  complete, so the input is held back by at most one group and one longest
+ *  match until the stream is flushed. The data need not stay valid after the
+ *  call: the compressor copies what it takes.
+ *
+ * Parameters:
+ *  lz_stream_encoder_t *encoder: Compressor state
+ *  const uint8_t **data: Input; advanced past the bytes taken
+ *  uint32_t *length: Number of input bytes; reduced by the bytes taken
+ *  uint8_t *out: Buffer of the compressed bytes
+ *  uint32_t out_size: Size of the buffer
+ *  bool flush: true if the input ends the stream
+ *
+ * Return:
+ *  uint32_t: Number of compressed bytes output. Fewer than out_size once
+ *  all input is taken and, when flushing, all of it is output.
+ *
+ *******************************************************************************/
+uint32_t lz_stream_encode(lz_stream_encoder_t *encoder, const uint8_t **data, uint32_t *length,
+                          uint8_t *out, uint32_t out_size, bool flush)
+{
+    uint32_t produced = 0;
+    uint32_t copy;
+    uint32_t shift;
+
+    for (;;)
+    {
+        /* Output a complete group, or the last one of a flushed stream. */
+        if ((encoder->group_items == 8u) ||
+            ((encoder->group_items > 0) && flush && (*length == 0) && (encoder->next == encoder->end)))
+        {
+            copy = encoder->group_length - encoder->group_sent;
+            if (copy > (out_size - produced))
+            {
+                copy = out_size - produced;
+            }
+            memcpy(&out[produced], &encoder->group[encoder->group_sent], copy);
+            produced += copy;
+            encoder->group_sent += copy;
+            if (encoder->group_sent < encoder->group_length)
+            {
+                break;
+            }
+            encoder->group[0] = 0;
+            encoder->group_length = 1;
+            encoder->group_items = 0;
+            encoder->group_sent = 0;
+        }
+
+        copy = sizeof(encoder->buffer) - encoder->end;
+        if (copy > *length)
+        {
+            copy = *length;
+        }
+        memcpy(&encoder->buffer[encoder->end], *data, copy);
+        encoder->end += copy;
+        *data += copy;
+        *length -= copy;
+
+        /* A match is looked for only with a longest match of input ahead,
+         * until the stream is flushed.
+         */
+        if ((encoder->next == encoder->end) ||
+            (((encoder->end - encoder->next) < LZ_STREAM_MAX_MATCH) && !(flush && (*length == 0))))
+        {
+            if (*length == 0)
+            {
+                break;
+            }
+
+            /* The buffer is full: keep one window before the next byte. */
+            shift = encoder->next - LZ_STREAM_WINDOW_SIZE;
+            memmove(encoder->buffer, &encoder->buffer[shift], encoder->end - shift);
+            encoder->base += shift;
+            encoder->next -= shift;
+            encoder->end -= shift;
+            continue;
+        }
+
+        encode_item(encoder);
+    }
+
+    return produced;
+}
+
+/*******************************************************************************
+ * Function Name: lz_stream_decoder_init
+ *******************************************************************************
+ * Summary:
+ *  Starts decompressing a new stream.
+ *
+ * Parameters:
+ *  lz_stream_decoder_t *decoder: Decompressor state
+ *
+ *******************************************************************************/
+void lz_stream_decoder_init(lz_stream_decoder_t *decoder)
+{
+    decoder->position = 0;
+    decoder->state = LZ_STREAM_STATE_FLAGS;
+    decoder->flags = 0;
+    decoder->items = 0;
+    decoder->token = 0;
+    decoder->distance = 0;
+    decoder->match_length = 0;
+}
+
+/*******************************************************************************
+ * Function Name: lz_stream_decode
+ *******************************************************************************
+ * Summary:
+ *  Takes compressed bytes and outputs the bytes they stand for, until the
+ *  input is used up or the output is full. The input may end anywhere, even
+ *  inside a match.
+ *
+ * Parameters:
+ *  lz_stream_decoder_t *decoder: Decompressor state
+ *  const uint8_t **data: Compressed bytes; advanced past the bytes taken
+ *  uint32_t *length: Number of compressed bytes; reduced by the bytes taken
+ *  uint8_t *out: Buffer of the output
+ *  uint32_t out_size: Size of the buffer
+ *
+ * Return:
+ *  uint32_t: Number of bytes output
+ *
+ *******************************************************************************/
+uint32_t lz_stream_decode(lz_stream_decoder_t *decoder, const uint8_t **data, uint32_t *length,
+                          uint8_t *out, uint32_t out_size)
+{
+    uint32_t produced = 0;
+    uint8_t byte;
+
+    while (produced < out_size)
+    {
+        if (decoder->match_length > 0)
+        {
+            byte = decoder->window[(decoder->position - decoder->distance) & (LZ_STREAM_WINDOW_SIZE - 1u)];
+            decoder->match_length--;
+        }
+        else if (*length == 0)
+        {
+            break;
+        }
+        else
+        {
+            byte = *(*data)++;
+            (*length)--;
+
+            switch (decoder->state)
+            {
+            case LZ_STREAM_STATE_FLAGS:
+                decoder->flags = byte;
+                decoder->items = 8;
+                decoder->state = LZ_STREAM_STATE_ITEM;
+                continue;
+
+            case LZ_STREAM_STATE_ITEM:
+                if ((decoder->flags & 1u) != 0)
+                {
+                    decoder->token = byte;
+                    decoder->state = LZ_STREAM_STATE_DISTANCE;
+                    continue;
+                }
+                decoder_next_item(decoder);
+                break;
+
+            case LZ_STREAM_STATE_DISTANCE:
+                decoder->distance = (((decoder->token & 7u) << 8) | byte) + 1u;
+                if ((decoder->token >> 3) == LZ_STREAM_LENGTH_EXTENDED)
+                {
+                    decoder->state = LZ_STREAM_STATE_LENGTH;
+                }
+                else
+                {
+                    decoder->match_length = (decoder->token >> 3) + LZ_STREAM_MIN_MATCH;
+                    decoder_next_item(decoder);
+                }
+                continue;
+
+            default:
+                decoder->match_length = LZ_STREAM_MIN_MATCH + LZ_STREAM_LENGTH_EXTENDED + byte;
+                decoder_next_item(decoder);
+                continue;
+            }
+        }
+
+        decoder->window[decoder->position & (LZ_STREAM_WINDOW_SIZE - 1u)] = byte;
+        decoder->position++;
+        out[produced++] = byte;
+    }
+
+    return produced;
+}
+
+/*******************************************************************************
+ * Function Name: lz_stream_benchmark
+ *******************************************************************************
+ * Summary:
+ *  Compresses and decompresses representative payloads, checks that they
+ *  round-trip, and prints the compression ratio and both throughputs.
+ *
+ * Return:
+ *  bool: true if every payload round-tripped
+ *
+ *******************************************************************************/
+bool lz_stream_benchmark(void)
+{
+    return benchmark_payload("firmware", LZ_STREAM_BENCHMARK_FIRMWARE) &&
+           benchmark_payload("log", LZ_STREAM_BENCHMARK_LOG);
+}
+
+/*******************************************************************************
+ * Function Name: encode_item
+ *******************************************************************************
+ * Summary:
+ *  Adds the next item to the group: a match with the last position of the
+ *  same three bytes if it is long enough, a literal otherwise. The positions
+ *  inside a match are added to the hash table as well.
+ *
+ *******************************************************************************/
+static void encode_item(lz_stream_encoder_t *encoder)
+{
+    const uint8_t *current = &encoder->buffer[encoder->next];
+    uint32_t available = encoder->end - encoder->next;
+    uint32_t position = encoder->base + encoder->next;
+    uint32_t longest = (available < LZ_STREAM_MAX_MATCH) ? available : LZ_STREAM_MAX_MATCH;
+    uint32_t match_length = 0;
+    uint32_t distance = 0;
+    uint32_t slot;
+    uint32_t code;
+
+    if (available >= LZ_STREAM_MIN_MATCH)
+    {
+        /* The table holds 16-bit positions. An old entry can alias a recent
+         * one, which at worst gives a shorter match; the bytes are compared.
+         */
+        slot = hash_bytes(current);
+        distance = (position - encoder->hash[slot]) & 0xFFFFu;
+        encoder->hash[slot] = (uint16_t)position;
+        if ((distance > 0) && (distance <= LZ_STREAM_WINDOW_SIZE) && (distance <= position))
+        {
+            while ((match_length < longest) && ((current - distance)[match_length] == current[match_length]))
+            {
+                match_length++;
+            }
+        }
+    }
+
+    if (match_length >= LZ_STREAM_MIN_MATCH)
+    {
+        code = match_length - LZ_STREAM_MIN_MATCH;
+        encoder->group[0] |= (uint8_t)(1u << encoder->group_items);
+        if (code < LZ_STREAM_LENGTH_EXTENDED)
+        {
+            encoder->group[encoder->group_length++] = (uint8_t)((code << 3) | ((distance - 1u) >> 8));
+            encoder->group[encoder->group_length++] = (uint8_t)(distance - 1u);
+        }
+        else
+        {
+            encoder->group[encoder->group_length++] = (uint8_t)((LZ_STREAM_LENGTH_EXTENDED << 3) | ((distance - 1u) >> 8));
+            encoder->group[encoder->group_length++] = (uint8_t)(distance - 1u);
+            encoder->group[encoder->group_length++] = (uint8_t)(code - LZ_STREAM_LENGTH_EXTENDED);
+        }
+
+        for (uint32_t index = 1; (index < match_length) && ((index + LZ_STREAM_MIN_MATCH) <= available); index++)
+        {
+            encoder->hash[hash_bytes(&current[index])] = (uint16_t)(position + index);
+        }
+        encoder->next += match_length;
+    }
+    else
+    {
+        encoder->group[encoder->group_length++] = current[0];
+        encoder->next++;
+    }
+
+    encoder->group_items++;
+}
+
+/*******************************************************************************
+ * Function Name: hash_bytes
+ *******************************************************************************
+ * Summary:
+ *  Returns the hash table slot of three bytes.
+ *
+ *******************************************************************************/
+static uint32_t hash_bytes(const uint8_t *data)
+{
+    uint32_t value = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+
+    return (value * 2654435761u) >> (32u - LZ_STREAM_HASH_BITS);
+}
+
+/*******************************************************************************
+ * Function Name: decoder_next_item
+ *******************************************************************************
+ * Summary:
+ *  Moves the decompressor to the next item of the group, or to the next flag
+ *  byte after the eighth.
+ *
+ *******************************************************************************/
+static void decoder_next_item(lz_stream_decoder_t *decoder)
+{
+    decoder->flags >>= 1;
+    decoder->items--;
+    decoder->state = (decoder->items == 0) ? LZ_STREAM_STATE_FLAGS : LZ_STREAM_STATE_ITEM;
+}
+
+/*******************************************************************************
+ * Function Name: benchmark_payload
+ *******************************************************************************
+ * Summary:
+ *  Times three passes over a payload: reading it, reading and compressing
+ *  it, and reading, compressing and decompressing it while the output is
+ *  compared with a second reader. The differences give the time of each
+ *  step.
+ *
+ *******************************************************************************/
+static bool benchmark_payload(const char *name, uint32_t kind)
+{
+    static lz_stream_encoder_t encoder;
+    static lz_stream_decoder_t decoder;
+    static uint8_t input[LZ_STREAM_BENCHMARK_CHUNK];
+    static uint8_t compressed[LZ_STREAM_BENCHMARK_CHUNK];
+    static uint8_t output[LZ_STREAM_BENCHMARK_CHUNK];
+    static uint8_t expected[LZ_STREAM_BENCHMARK_CHUNK];
+    benchmark_source_t source;
+    benchmark_source_t check;
+    const uint8_t *data;
+    const uint8_t *packed;
+    uint32_t length;
+    uint32_t packed_length;
+    uint32_t produced;
+    uint32_t decoded;
+    uint32_t compressed_size = 0;
+    uint32_t elapsed_ms[3];
+    uint32_t encode_ms;
+    uint32_t decode_ms;
+    bool last;
+    cy_time_t start_time;
+    cy_time_t end_time;
+
+    for (uint32_t pass = 0; pass < 3u; pass++)
+    {
+        benchmark_source_start(&source, kind);
+        benchmark_source_start(&check, kind);
+        lz_stream_encoder_init(&encoder);
+        lz_stream_decoder_init(&decoder);
+        compressed_size = 0;
+
+        cy_rtos_get_time(&start_time);
+        for (uint32_t offset = 0; offset < LZ_STREAM_BENCHMARK_SIZE; offset += LZ_STREAM_BENCHMARK_CHUNK)
+        {
+            length = LZ_STREAM_BENCHMARK_SIZE - offset;
+            length = (length < LZ_STREAM_BENCHMARK_CHUNK) ? length : LZ_STREAM_BENCHMARK_CHUNK;
+            last = ((offset + length) == LZ_STREAM_BENCHMARK_SIZE);
+            benchmark_read(&source, input, length);
+            data = input;
+
+            while (pass > 0)
+            {
+                produced = lz_stream_encode(&encoder, &data, &length, compressed, sizeof(compressed), last);
+                compressed_size += produced;
+
+                /* Less output than room means that the input is used up and
+                 * no match is left to copy.
+                 */
+                packed = compressed;
+                packed_length = produced;
+                do
+                {
+                    decoded = (pass > 1) ? lz_stream_decode(&decoder, &packed, &packed_length, output, sizeof(output)) : 0u;
+                    benchmark_read(&check, expected, decoded);
+                    if (memcmp(output, expected, decoded) != 0)
+                    {
+                        printf("LZ benchmark %s: data does not round-trip at %"PRIu32"\n",
+                               name, check.offset - decoded);
+                        return false;
+                    }
+                } while (decoded == sizeof(output));
+
+                if (produced < sizeof(compressed))
+                {
+                    break;
+                }
+            }
+        }
+        cy_rtos_get_time(&end_time);
+        elapsed_ms[pass] = (uint32_t)(end_time - start_time);
+    }
+
+    if (check.offset != LZ_STREAM_BENCHMARK_SIZE)
+    {
+        printf("LZ benchmark %s: %"PRIu32" bytes decompressed\n", name, check.offset);
+        return false;
+    }
+
+    encode_ms = (elapsed_ms[1] > elapsed_ms[0]) ? (elapsed_ms[1] - elapsed_ms[0]) : 1u;
+    decode_ms = (elapsed_ms[2] > elapsed_ms[1]) ? (elapsed_ms[2] - elapsed_ms[1]) : 1u;
+
+    /* Bytes per ms are kB/s. */
+    printf("LZ benchmark %s: %"PRIu32" -> %"PRIu32" bytes (%"PRIu32" %%), "
+           "compress %"PRIu32" kB/s, decompress %"PRIu32" kB/s\n",
+           name, (uint32_t)LZ_STREAM_BENCHMARK_SIZE, compressed_size,
+           (uint32_t)(((uint64_t)compressed_size * 100u) / LZ_STREAM_BENCHMARK_SIZE),
+           (uint32_t)LZ_STREAM_BENCHMARK_SIZE / encode_ms, (uint32_t)LZ_STREAM_BENCHMARK_SIZE / decode_ms);
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: benchmark_source_start
+ *******************************************************************************
+ * Summary:
+ *  Starts reading a benchmark payload from its beginning.
+ *
+ *******************************************************************************/
+static void benchmark_source_start(benchmark_source_t *source, uint32_t kind)
+{
+    source->kind = kind;
+    source->offset = 0;
+    source->line_length = 0;
+    source->line_offset = 0;
+    source->random = 0x12345678u;
+}
+
+/*******************************************************************************
+ * Function Name: benchmark_read
+ *******************************************************************************
+ * Summary:
+ *  Reads the next bytes of a benchmark payload. The log payload is made of
+ *  lines of the kind this application prints, with numbers that change from
+ *  line to line.
+ *
+ *******************************************************************************/
+static void benchmark_read(benchmark_source_t *source, uint8_t *buffer, uint32_t length)
+{
+    uint32_t copy;
+    uint32_t value;
+
+    if (source->kind == LZ_STREAM_BENCHMARK_FIRMWARE)
+    {
+        memcpy(buffer, (const uint8_t *)CY_FLASH_BASE + source->offset, length);
+        source->offset += length;
+        return;
+    }
+
+    source->offset += length;
+    while (length > 0)
+    {
+        if (source->line_offset == source->line_length)
+        {
+            source->random = (source->random * 1103515245u) + 12345u;
+            value = source->random >> 16;
+            if ((value % 8u) == 0)
+            {
+                source->line_length = (uint32_t)snprintf(source->line, sizeof(source->line),
+                    "Connected to TCP server in %"PRIu32" ms\n", 20u + (value % 200u));
+            }
+            else
+            {
+                source->line_length = (uint32_t)snprintf(source->line, sizeof(source->line),
+                    "LED turned %s, ACK sent to TCP server, RSSI -%"PRIu32" dBm, RTT %"PRIu32" ms\n",
+                    ((value & 0x100u) != 0) ? "ON" : "OFF", 40u + (value % 40u), 2u + ((value >> 3) % 30u));
+            }
+            source->line_offset = 0;
+        }
+
+        copy = source->line_length - source->line_offset;
+        copy = (copy < length) ? copy : length;
+        memcpy(buffer, &source->line[source->line_offset], copy);
+        source->line_offset += copy;
+        buffer += copy;
+        length -= copy;
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,126 @@
+/******************************************************************************
+* File Name:   lz_stream.h
+*
+* Description: This file contains the declarations of the streaming LZ
+* compressor and decompressor of the bulk transfers.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef LZ_STREAM_H_
+#define LZ_STREAM_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Compressed format: groups of one flag byte and up to eight items, the first
+ * item in the least significant flag bit. A 0 bit is a literal byte. A 1 bit
+ * is a match of two bytes: the length minus 3 in the top 5 bits, then the
+ * distance minus 1 in 11 bits. A length field of 31 is followed by one more
+ * byte, which adds to a length of 34. A match may overlap the bytes it
+ * produces. The stream has no end marker; the receiver knows its size.
+ */
+#define LZ_STREAM_WINDOW_SIZE                     (2048u)
+#define LZ_STREAM_MIN_MATCH                       (3u)
+#define LZ_STREAM_MAX_MATCH                       (LZ_STREAM_MIN_MATCH + 31u + 255u)
+#define LZ_STREAM_GROUP_SIZE                      (1u + (8u * 3u))
+
+/* Input taken by the compressor ahead of the window. It must hold more than
+ * one longest match.
+ */
+#ifndef LZ_STREAM_INPUT_SIZE
+#define LZ_STREAM_INPUT_SIZE                      (512u)
+#endif
+
+/* Number of bits of the match-finder hash table. */
+#ifndef LZ_STREAM_HASH_BITS
+#define LZ_STREAM_HASH_BITS                       (9u)
+#endif
+
+/* Bytes of each payload of the benchmark. */
+#ifndef LZ_STREAM_BENCHMARK_SIZE
+#define LZ_STREAM_BENCHMARK_SIZE                  (64u * 1024u)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Compressor state: the window followed by the input not yet encoded, the
+ * last position of each hash of three bytes, and the group being built.
+ */
+typedef struct
+{
+    uint8_t buffer[LZ_STREAM_WINDOW_SIZE + LZ_STREAM_INPUT_SIZE];
+    uint16_t hash[1u << LZ_STREAM_HASH_BITS];
+    uint32_t base;                  /* Stream offset of buffer[0]. */
+    uint32_t next;                  /* Next byte of the buffer to encode. */
+    uint32_t end;                   /* End of the input in the buffer. */
+    uint8_t group[LZ_STREAM_GROUP_SIZE];
+    uint32_t group_length;
+    uint32_t group_items;
+    uint32_t group_sent;            /* Bytes of a full group already output. */
+} lz_stream_encoder_t;
+
+/* Decompressor state: the window of the last output bytes, and the position
+ * in the compressed stream, which may stop anywhere.
+ */
+typedef struct
+{
+    uint8_t window[LZ_STREAM_WINDOW_SIZE];
+    uint32_t position;              /* Bytes output so far. */
+    uint32_t state;
+    uint32_t flags;
+    uint32_t items;                 /* Items left in the group. */
+    uint32_t token;                 /* First byte of the current match. */
+    uint32_t distance;
+    uint32_t match_length;          /* Bytes of the match still to output. */
+} lz_stream_decoder_t;
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+void lz_stream_encoder_init(lz_stream_encoder_t *encoder);
+uint32_t lz_stream_encode(lz_stream_encoder_t *encoder, const uint8_t **data, uint32_t *length,
+                          uint8_t *out, uint32_t out_size, bool flush);
+void lz_stream_decoder_init(lz_stream_decoder_t *decoder);
+uint32_t lz_stream_decode(lz_stream_decoder_t *decoder, const uint8_t **data, uint32_t *length,
+                          uint8_t *out, uint32_t out_size);
+bool lz_stream_benchmark(void);
+
+#endif /* LZ_STREAM_H_ */
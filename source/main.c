@@ -76,6 +76,11 @@
 #define TCP_CLIENT_TASK_PRIORITY          (1)
 #endif
 
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static void init_serial_flash(void);
+
 /*******************************************************************************
 * Global Variables
 ********************************************************************************/
@@ -125,16 +130,6 @@ int main()
     cyhal_gpio_init(CYBSP_USER_LED, CYHAL_GPIO_DIR_OUTPUT,
                         CYHAL_GPIO_DRIVE_STRONG, CYBSP_LED_STATE_OFF);
 
-#if defined(CY_DEVICE_PSOC6A512K)
-    const uint32_t bus_frequency = 50000000lu;
-    cy_serial_flash_qspi_init(smifMemConfigs[0], CYBSP_QSPI_D0, CYBSP_QSPI_D1,
-                                  CYBSP_QSPI_D2, CYBSP_QSPI_D3, NC, NC, NC, NC,
-                                  CYBSP_QSPI_SCK, CYBSP_QSPI_SS, bus_frequency);
-
-    /* Enable the XIP mode to get the Wi-Fi firmware from the external flash. */
-    cy_serial_flash_qspi_enable_xip(true);
-#endif
-
     /* \x1b[2J\x1b[;H - ANSI ESC sequence to clear screen */
     printf("\x1b[2J\x1b[;H");
     printf("============================================================\n");
@@ -142,6 +137,8 @@ int main()
     printf("============================================================\n\n");
 
 #if defined (COMPONENT_FREERTOS)
+    init_serial_flash();
+
     /* Create the tasks. */
     xTaskCreate(tcp_client_task, "Network task", TCP_CLIENT_TASK_STACK_SIZE, NULL,
                 TCP_CLIENT_TASK_PRIORITY, NULL);
@@ -165,9 +162,36 @@ int main()
 #endif
 }
 
+/*******************************************************************************
+ * Function Name: init_serial_flash
+ *******************************************************************************
+ * Summary:
+ *  Initializes the external QSPI flash on the kits that load the Wi-Fi
+ *  firmware from it, and maps it through XIP. Called before the Wi-Fi is
+ *  started.
+ *
+ *******************************************************************************/
+static void init_serial_flash(void)
+{
+#if defined(CY_DEVICE_PSOC6A512K)
+    const uint32_t bus_frequency = 50000000lu;
+    cy_serial_flash_qspi_init(smifMemConfigs[0], CYBSP_QSPI_D0, CYBSP_QSPI_D1,
+                                  CYBSP_QSPI_D2, CYBSP_QSPI_D3, NC, NC, NC, NC,
+                                  CYBSP_QSPI_SCK, CYBSP_QSPI_SS, bus_frequency);
+
+    /* Enable the XIP mode to get the Wi-Fi firmware from the external flash. */
+    cy_serial_flash_qspi_enable_xip(true);
+#endif
+}
+
 #if defined (COMPONENT_THREADX)
 void application_start(void)
 {
+    /* The thread-safe serial flash library creates a mutex, which ThreadX
+     * only allows once the kernel runs.
+     */
+    init_serial_flash();
+
     tcp_client_task(NULL);
 }
 #endif
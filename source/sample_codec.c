@@ -0,0 +1,372 @@
+/******************************************************************************
+* File Name:   sample_codec.c
+*
+* Description: This file contains the compact encoding of the sample frames.
+* Consecutive samples of a sensor differ little, so each value is sent as its
+* difference from the one before it. The difference is zigzag-mapped, so that
+* small negative and positive differences both become small numbers, and
+* written as a varint of 7 bits per byte. The timestamps are not sent per
+* sample: the first sequence number and the period of the batch give them.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* RTOS header file, for the benchmark timing. */
+#include "cyabs_rtos.h"
+
+/* Sample codec header file. */
+#include "sample_codec.h"
+
+/* Sample uplink header file, for the benchmark batch size and source. */
+#include "sample_uplink.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Samples per batch in the benchmark: those taken during the longest
+ * batching delay of the sample uplink, which is the batch sent at its rate.
+ */
+#define SAMPLE_CODEC_DELAY_SAMPLES                ((SAMPLE_UPLINK_RATE_HZ * SAMPLE_UPLINK_MAX_DELAY_MS) / 1000u)
+#define SAMPLE_CODEC_BENCHMARK_BATCH              ((SAMPLE_CODEC_DELAY_SAMPLES == 0u) ? 1u : \
+                                                   (SAMPLE_CODEC_DELAY_SAMPLES > SAMPLE_CODEC_BENCHMARK_BLOCK) ? \
+                                                   SAMPLE_CODEC_BENCHMARK_BLOCK : SAMPLE_CODEC_DELAY_SAMPLES)
+
+/* Fixed-width sample frame: frame header, first sequence number and period,
+ * then 4 bytes per sample.
+ */
+#define SAMPLE_CODEC_FRAME_OVERHEAD               (4u)
+#define SAMPLE_CODEC_FIXED_HEADER_SIZE            (8u)
+
+/* Encoded block of the benchmark. A frame holds at least one sample, so the
+ * two varints of each frame header add at most twice the size of a sample.
+ */
+#define SAMPLE_CODEC_BENCHMARK_ENCODED_SIZE       (SAMPLE_CODEC_BENCHMARK_BLOCK * SAMPLE_CODEC_VARINT_MAX_SIZE * 3u)
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static uint32_t put_varint(uint8_t *buffer, uint32_t value);
+static bool get_varint(const uint8_t *frame, uint32_t length, uint32_t *offset, uint32_t *value);
+
+/*******************************************************************************
+ * Function Name: sample_codec_begin
+ *******************************************************************************
+ * Summary:
+ *  Starts a compact sample frame with the timestamp base of its batch.
+ *
+ * Parameters:
+ *  sample_codec_t *codec: Frame being built
+ *  uint8_t *buffer: Buffer of the frame payload
+ *  uint32_t size: Size of the buffer, at least two varints and one sample
+ *  uint32_t first_sequence: Sequence number of the first sample
+ *  uint32_t period_us: Sample period in microseconds
+ *
+ *******************************************************************************/
+void sample_codec_begin(sample_codec_t *codec, uint8_t *buffer, uint32_t size,
+                        uint32_t first_sequence, uint32_t period_us)
+{
+    codec->buffer = buffer;
+    codec->size = size;
+    codec->length = put_varint(buffer, first_sequence);
+    codec->length += put_varint(&buffer[codec->length], period_us);
+    codec->count = 0;
+    codec->previous = 0;
+}
+
+/*******************************************************************************
+ * Function Name: sample_codec_add
+ *******************************************************************************
+ * Summary:
+ *  Appends the next sample to a compact sample frame. The difference is
+ *  taken modulo 2^32, so any two values round-trip exactly.
+ *
+ * Parameters:
+ *  sample_codec_t *codec: Frame being built
+ *  int32_t value: Sample value
+ *
+ * Return:
+ *  bool: false if the frame is full and the sample was not added
+ *
+ *******************************************************************************/
+bool sample_codec_add(sample_codec_t *codec, int32_t value)
+{
+    uint32_t delta = (uint32_t)value - codec->previous;
+
+    /* A sample is added only if a varint of any size fits, which keeps the
+     * check out of the encoding loop.
+     */
+    if ((codec->size - codec->length) < SAMPLE_CODEC_VARINT_MAX_SIZE)
+    {
+        return false;
+    }
+
+    codec->length += put_varint(&codec->buffer[codec->length], (delta << 1) ^ (0u - (delta >> 31)));
+    codec->previous = (uint32_t)value;
+    codec->count++;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: sample_codec_decode
+ *******************************************************************************
+ * Summary:
+ *  Decodes a compact sample frame.
+ *
+ * Parameters:
+ *  const uint8_t *frame: Frame payload
+ *  uint32_t length: Length of the payload
+ *  uint32_t *first_sequence: Sequence number of the first sample
+ *  uint32_t *period_us: Sample period in microseconds
+ *  int32_t *values: Decoded sample values
+ *  uint32_t *count: Capacity of values; set to the number of samples
+ *
+ * Return:
+ *  bool: false if the frame is malformed or holds more than the capacity
+ *
+ *******************************************************************************/
+bool sample_codec_decode(const uint8_t *frame, uint32_t length, uint32_t *first_sequence,
+                         uint32_t *period_us, int32_t *values, uint32_t *count)
+{
+    uint32_t offset = 0;
+    uint32_t decoded = 0;
+    uint32_t previous = 0;
+    uint32_t zigzag;
+
+    if (!get_varint(frame, length, &offset, first_sequence) ||
+        !get_varint(frame, length, &offset, period_us))
+    {
+        return false;
+    }
+
+    while (offset < length)
+    {
+        if ((decoded == *count) || !get_varint(frame, length, &offset, &zigzag))
+        {
+            return false;
+        }
+        previous += (zigzag >> 1) ^ (0u - (zigzag & 1u));
+        values[decoded++] = (int32_t)previous;
+    }
+
+    *count = decoded;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: sample_codec_benchmark
+ *******************************************************************************
+ * Summary:
+ *  Encodes and decodes a block of samples of SAMPLE_UPLINK_SOURCE in batches
+ *  of the size sent at SAMPLE_UPLINK_RATE_HZ, checks that they round-trip,
+ *  and prints the bytes per sample of both encodings and the encode and
+ *  decode rates.
+ *
+ * Return:
+ *  bool: true if every sample round-tripped
+ *
+ *******************************************************************************/
+bool sample_codec_benchmark(void)
+{
+    static int32_t values[SAMPLE_CODEC_BENCHMARK_BLOCK];
+    static int32_t decoded[SAMPLE_CODEC_BENCHMARK_BLOCK];
+    static uint8_t encoded[SAMPLE_CODEC_BENCHMARK_ENCODED_SIZE];
+    static uint16_t lengths[SAMPLE_CODEC_BENCHMARK_BLOCK];
+    sample_codec_t codec;
+    uint32_t period_us = 1000000u / SAMPLE_UPLINK_RATE_HZ;
+    uint32_t frames = 0;
+    uint32_t offset = 0;
+    uint32_t first;
+    uint32_t period;
+    uint32_t count;
+    uint32_t checked = 0;
+    uint32_t fixed_bytes;
+    uint32_t compact_bytes;
+    uint32_t encode_ms;
+    uint32_t decode_ms;
+    uint32_t encode_rate;
+    uint32_t decode_rate;
+    uint32_t encode_load;
+    uint64_t total = (uint64_t)SAMPLE_CODEC_BENCHMARK_BLOCK * SAMPLE_CODEC_BENCHMARK_ROUNDS;
+    cy_time_t start_time;
+    cy_time_t end_time;
+
+    for (uint32_t index = 0; index < SAMPLE_CODEC_BENCHMARK_BLOCK; index++)
+    {
+        values[index] = SAMPLE_UPLINK_SOURCE(index);
+    }
+
+    cy_rtos_get_time(&start_time);
+    for (uint32_t round = 0; round < SAMPLE_CODEC_BENCHMARK_ROUNDS; round++)
+    {
+        frames = 0;
+        offset = 0;
+        for (uint32_t index = 0; index < SAMPLE_CODEC_BENCHMARK_BLOCK; )
+        {
+            sample_codec_begin(&codec, &encoded[offset], SAMPLE_UPLINK_FRAME_SIZE, index, period_us);
+            while ((index < SAMPLE_CODEC_BENCHMARK_BLOCK) && (codec.count < SAMPLE_CODEC_BENCHMARK_BATCH) &&
+                   sample_codec_add(&codec, values[index]))
+            {
+                index++;
+            }
+            lengths[frames++] = (uint16_t)codec.length;
+            offset += codec.length;
+        }
+    }
+    cy_rtos_get_time(&end_time);
+    encode_ms = (uint32_t)(end_time - start_time);
+
+    cy_rtos_get_time(&start_time);
+    for (uint32_t round = 0; round < SAMPLE_CODEC_BENCHMARK_ROUNDS; round++)
+    {
+        offset = 0;
+        checked = 0;
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            count = SAMPLE_CODEC_BENCHMARK_BLOCK;
+            if (!sample_codec_decode(&encoded[offset], lengths[frame], &first, &period, decoded, &count) ||
+                (first != checked) || (period != period_us) ||
+                (memcmp(decoded, &values[checked], count * sizeof(decoded[0])) != 0))
+            {
+                printf("Sample codec benchmark: frame %"PRIu32" does not round-trip\n", frame);
+                return false;
+            }
+            offset += lengths[frame];
+            checked += count;
+        }
+    }
+    cy_rtos_get_time(&end_time);
+    decode_ms = (uint32_t)(end_time - start_time);
+
+    encode_ms = (encode_ms == 0) ? 1u : encode_ms;
+    decode_ms = (decode_ms == 0) ? 1u : decode_ms;
+    encode_rate = (uint32_t)(total / encode_ms);
+    decode_rate = (uint32_t)(total / decode_ms);
+    encode_load = (encode_rate == 0) ? 0u : ((SAMPLE_UPLINK_RATE_HZ * 100u) / encode_rate);
+
+    /* Both sizes include the frame header, as sent on the connection. */
+    fixed_bytes = (frames * (SAMPLE_CODEC_FRAME_OVERHEAD + SAMPLE_CODEC_FIXED_HEADER_SIZE)) +
+                  (SAMPLE_CODEC_BENCHMARK_BLOCK * 4u);
+    compact_bytes = (frames * SAMPLE_CODEC_FRAME_OVERHEAD) + offset;
+
+    /* Hundredths of bytes per sample and of the ratio. The rates are samples
+     * per ms, that is, thousands of samples per s, and the encoder load, in
+     * thousandths of a percent, is the share of the CPU that encoding takes
+     * at SAMPLE_UPLINK_RATE_HZ.
+     */
+    printf("Sample codec: %"PRIu32" samples in batches of %"PRIu32": fixed %"PRIu32".%02"PRIu32" bytes/sample, "
+           "compact %"PRIu32".%02"PRIu32" bytes/sample (%"PRIu32".%02"PRIu32"x smaller)\n",
+           (uint32_t)SAMPLE_CODEC_BENCHMARK_BLOCK, (uint32_t)SAMPLE_CODEC_BENCHMARK_BATCH,
+           (fixed_bytes * 100u / SAMPLE_CODEC_BENCHMARK_BLOCK) / 100u,
+           (fixed_bytes * 100u / SAMPLE_CODEC_BENCHMARK_BLOCK) % 100u,
+           (compact_bytes * 100u / SAMPLE_CODEC_BENCHMARK_BLOCK) / 100u,
+           (compact_bytes * 100u / SAMPLE_CODEC_BENCHMARK_BLOCK) % 100u,
+           (fixed_bytes * 100u / compact_bytes) / 100u, (fixed_bytes * 100u / compact_bytes) % 100u);
+    printf("Sample codec: encode %"PRIu32" ksamples/s, decode %"PRIu32" ksamples/s, "
+           "encoder load at %"PRIu32" Hz %"PRIu32".%03"PRIu32" %%\n",
+           encode_rate, decode_rate, (uint32_t)SAMPLE_UPLINK_RATE_HZ,
+           encode_load / 1000u, encode_load % 1000u);
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: put_varint
+ *******************************************************************************
+ * Summary:
+ *  Writes a varint: 7 bits per byte, least significant first, with the top
+ *  bit set on every byte but the last.
+ *
+ * Parameters:
+ *  uint8_t *buffer: Buffer with room for SAMPLE_CODEC_VARINT_MAX_SIZE bytes
+ *  uint32_t value: Value to write
+ *
+ * Return:
+ *  uint32_t: Number of bytes written
+ *
+ *******************************************************************************/
+static uint32_t put_varint(uint8_t *buffer, uint32_t value)
+{
+    uint32_t length = 0;
+
+    while (value >= 0x80u)
+    {
+        buffer[length++] = (uint8_t)(value | 0x80u);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+
+    return length;
+}
+
+/*******************************************************************************
+ * Function Name: get_varint
+ *******************************************************************************
+ * Summary:
+ *  Reads a varint of at most SAMPLE_CODEC_VARINT_MAX_SIZE bytes.
+ *
+ * Parameters:
+ *  const uint8_t *frame: Frame payload
+ *  uint32_t length: Length of the payload
+ *  uint32_t *offset: Offset of the varint; advanced past it
+ *  uint32_t *value: Value read
+ *
+ * Return:
+ *  bool: false if the varint is truncated or too long
+ *
+ *******************************************************************************/
+static bool get_varint(const uint8_t *frame, uint32_t length, uint32_t *offset, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    for (uint32_t shift = 0; (shift < (7u * SAMPLE_CODEC_VARINT_MAX_SIZE)) && (*offset < length); shift += 7u)
+    {
+        result |= (uint32_t)(frame[*offset] & 0x7Fu) << shift;
+        if ((frame[(*offset)++] & 0x80u) == 0)
+        {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* [] END OF FILE */
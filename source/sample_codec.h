@@ -0,0 +1,92 @@
+/******************************************************************************
+* File Name:   sample_codec.h
+*
+* Description: This file contains the declarations of the compact encoding
+* of the sample frames.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SAMPLE_CODEC_H_
+#define SAMPLE_CODEC_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Largest encoded size of one 32-bit varint. */
+#define SAMPLE_CODEC_VARINT_MAX_SIZE              (5u)
+
+/* Samples encoded by the benchmark: one block, encoded and decoded
+ * SAMPLE_CODEC_BENCHMARK_ROUNDS times.
+ */
+#ifndef SAMPLE_CODEC_BENCHMARK_BLOCK
+#define SAMPLE_CODEC_BENCHMARK_BLOCK              (256u)
+#endif
+#ifndef SAMPLE_CODEC_BENCHMARK_ROUNDS
+#define SAMPLE_CODEC_BENCHMARK_ROUNDS             (4000u)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Compact sample frame being built: the sequence number of the first sample
+ * and the sample period as varints, which give the timestamp of every sample
+ * of the batch, then the difference of each value from the one before it,
+ * zigzag-mapped and varint-encoded.
+ */
+typedef struct
+{
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t length;
+    uint32_t count;
+    uint32_t previous;
+} sample_codec_t;
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+void sample_codec_begin(sample_codec_t *codec, uint8_t *buffer, uint32_t size,
+                        uint32_t first_sequence, uint32_t period_us);
+bool sample_codec_add(sample_codec_t *codec, int32_t value);
+bool sample_codec_decode(const uint8_t *frame, uint32_t length, uint32_t *first_sequence,
+                         uint32_t *period_us, int32_t *values, uint32_t *count);
+bool sample_codec_benchmark(void);
+
+#endif /* SAMPLE_CODEC_H_ */
@@ -0,0 +1,483 @@
+/******************************************************************************
+* File Name:   sample_uplink.c
+*
+* Description: This file contains the periodic sample uplink. A hardware timer
+* reads one sample per period in its interrupt and puts it in a lock-free
+* ring. A sender thread takes the samples out of the ring and sends them in
+* frames of up to one TCP segment. A frame that does not fill is sent once
+* its oldest sample has waited SAMPLE_UPLINK_MAX_DELAY_MS, which bounds the
+* latency without one send per sample.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* HAL header file, for the sampler timer. */
+#include "cyhal.h"
+
+/* Sample uplink header file. */
+#include "sample_uplink.h"
+
+/* Sample codec header file, for the compact frames. */
+#include "sample_codec.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#if ((SAMPLE_UPLINK_RING_SIZE & (SAMPLE_UPLINK_RING_SIZE - 1u)) != 0)
+#error "SAMPLE_UPLINK_RING_SIZE must be a power of two"
+#endif
+
+/* Clock of the sampler timer. */
+#define SAMPLE_UPLINK_TIMER_HZ                    (1000000u)
+#define SAMPLE_UPLINK_PERIOD_US                   (SAMPLE_UPLINK_TIMER_HZ / SAMPLE_UPLINK_RATE_HZ)
+#define SAMPLE_UPLINK_TIMER_PRIORITY              (3u)
+
+/* Sample frame: first sequence number and period, then the values. */
+#define SAMPLE_FRAME_HEADER_SIZE                  (8u)
+#if (SAMPLE_UPLINK_COMPACT)
+/* A compact frame holds as many samples as their differences leave room for.
+ * The sender is woken once the samples would fill it at two bytes each, or
+ * once half the ring is used.
+ */
+#define SAMPLE_FRAME_MAX_SAMPLES                  (((SAMPLE_UPLINK_FRAME_SIZE / 2u) < (SAMPLE_UPLINK_RING_SIZE / 2u)) ? \
+                                                   (SAMPLE_UPLINK_FRAME_SIZE / 2u) : (SAMPLE_UPLINK_RING_SIZE / 2u))
+#else
+#define SAMPLE_FRAME_MAX_SAMPLES                  ((SAMPLE_UPLINK_FRAME_SIZE - SAMPLE_FRAME_HEADER_SIZE) / 4u)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+typedef struct
+{
+    uint32_t sequence;
+    int32_t value;
+} uplink_sample_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static void sample_timer_callback(void *callback_arg, cyhal_timer_event_t event);
+static void sample_uplink_thread(cy_thread_arg_t arg);
+static uint32_t sample_uplink_send(uint32_t count);
+static void sample_uplink_print_stats(void);
+#if !(SAMPLE_UPLINK_COMPACT)
+static void put_be32(uint8_t *buffer, uint32_t value);
+#endif
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Ring between the timer interrupt and the sender thread. Only the interrupt
+ * writes uplink_head and only the sender writes uplink_tail; each reads the
+ * other's index with acquire ordering and publishes its own with release
+ * ordering, so no lock is needed.
+ */
+static uplink_sample_t uplink_ring[SAMPLE_UPLINK_RING_SIZE];
+static uint32_t uplink_head;
+static uint32_t uplink_tail;
+static uint32_t uplink_sequence;
+static uint32_t uplink_overruns;
+
+static cyhal_timer_t uplink_timer;
+static cy_semaphore_t uplink_ready;
+static cy_mutex_t uplink_mutex;
+static cy_thread_t uplink_thread;
+
+/* Stream that the samples are sent on, or NULL while stopped. */
+static cmd_stream_t *volatile uplink_stream;
+
+/* Frame being built. Only the sender uses it. */
+static uint8_t uplink_frame[SAMPLE_UPLINK_FRAME_SIZE];
+
+/* Statistics of the current interval. */
+static uint32_t stats_samples;
+static uint32_t stats_frames;
+static uint32_t stats_bytes;
+static uint32_t stats_lost;
+static uint32_t stats_max_latency_ms;
+static cy_time_t stats_start;
+
+/*******************************************************************************
+ * Function Name: sample_uplink_init
+ *******************************************************************************
+ * Summary:
+ *  Creates the sender thread and sets up the sampler timer. Sampling starts
+ *  with sample_uplink_start.
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t sample_uplink_init(void)
+{
+    const cyhal_timer_cfg_t timer_cfg =
+    {
+        .compare_value = 0,
+        .period = SAMPLE_UPLINK_PERIOD_US - 1u,
+        .direction = CYHAL_TIMER_DIR_UP,
+        .is_compare = false,
+        .is_continuous = true,
+        .value = 0
+    };
+    cy_rslt_t result;
+
+    result = cy_rtos_semaphore_init(&uplink_ready, 1u, 0u);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_mutex_init(&uplink_mutex, false);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cyhal_timer_init(&uplink_timer, NC, NULL);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cyhal_timer_configure(&uplink_timer, &timer_cfg);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cyhal_timer_set_frequency(&uplink_timer, SAMPLE_UPLINK_TIMER_HZ);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        cyhal_timer_register_callback(&uplink_timer, sample_timer_callback, NULL);
+        cyhal_timer_enable_event(&uplink_timer, CYHAL_TIMER_IRQ_TERMINAL_COUNT,
+                                 SAMPLE_UPLINK_TIMER_PRIORITY, true);
+        result = cy_rtos_thread_create(&uplink_thread, sample_uplink_thread, "Sample uplink",
+                                       NULL, SAMPLE_UPLINK_THREAD_STACK_SIZE,
+                                       SAMPLE_UPLINK_THREAD_PRIORITY, NULL);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Sample uplink initialization failed!\n");
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_start
+ *******************************************************************************
+ * Summary:
+ *  Starts sampling and sending the samples on a connection.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream of the connection to the TCP server
+ *
+ *******************************************************************************/
+void sample_uplink_start(cmd_stream_t *stream)
+{
+    cy_rtos_mutex_get(&uplink_mutex, CY_RTOS_NEVER_TIMEOUT);
+    uplink_stream = stream;
+    cy_rtos_get_time(&stats_start);
+    cy_rtos_mutex_set(&uplink_mutex);
+
+    cyhal_timer_start(&uplink_timer);
+    cy_rtos_semaphore_set(&uplink_ready);
+    printf("Sample uplink started at %"PRIu32" Hz\n", (uint32_t)SAMPLE_UPLINK_RATE_HZ);
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_stop
+ *******************************************************************************
+ * Summary:
+ *  Stops sampling. Waits for a frame being sent, so that the connection can
+ *  be closed afterwards. Samples not yet sent are discarded.
+ *
+ *******************************************************************************/
+void sample_uplink_stop(void)
+{
+    cyhal_timer_stop(&uplink_timer);
+
+    cy_rtos_mutex_get(&uplink_mutex, CY_RTOS_NEVER_TIMEOUT);
+    uplink_stream = NULL;
+    __atomic_store_n(&uplink_tail, __atomic_load_n(&uplink_head, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+    cy_rtos_mutex_set(&uplink_mutex);
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_produce
+ *******************************************************************************
+ * Summary:
+ *  Reads one sample and puts it in the ring. Called from the timer interrupt
+ *  once per sample period. The sender is woken when a frame is full.
+ *
+ *******************************************************************************/
+void sample_uplink_produce(void)
+{
+    uint32_t head = uplink_head;
+    uint32_t tail = __atomic_load_n(&uplink_tail, __ATOMIC_ACQUIRE);
+    uint32_t sequence = uplink_sequence++;
+
+    if ((head - tail) == SAMPLE_UPLINK_RING_SIZE)
+    {
+        uplink_overruns++;
+        return;
+    }
+
+    uplink_ring[head & (SAMPLE_UPLINK_RING_SIZE - 1u)].sequence = sequence;
+    uplink_ring[head & (SAMPLE_UPLINK_RING_SIZE - 1u)].value = SAMPLE_UPLINK_SOURCE(sequence);
+    __atomic_store_n(&uplink_head, head + 1u, __ATOMIC_RELEASE);
+
+    if ((head + 1u - tail) == SAMPLE_FRAME_MAX_SAMPLES)
+    {
+        cy_rtos_semaphore_set(&uplink_ready);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_stub_source
+ *******************************************************************************
+ * Summary:
+ *  Synthetic sample source: a slow triangle wave with a little noise, like a
+ *  sensor reading. Replace it through SAMPLE_UPLINK_SOURCE.
+ *
+ * Parameters:
+ *  uint32_t sequence: Sequence number of the sample
+ *
+ * Return:
+ *  int32_t: Sample value
+ *
+ *******************************************************************************/
+int32_t sample_uplink_stub_source(uint32_t sequence)
+{
+    static uint32_t lfsr = 0xACE1u;
+    uint32_t phase = sequence % 2000u;
+
+    /* 16-bit Galois LFSR for the noise. */
+    lfsr = (lfsr >> 1) ^ ((0u - (lfsr & 1u)) & 0xB400u);
+
+    return ((phase < 1000u) ? (int32_t)phase : (int32_t)(2000u - phase)) - 500 +
+           (int32_t)(lfsr & 7u) - 4;
+}
+
+/*******************************************************************************
+ * Function Name: sample_timer_callback
+ *******************************************************************************
+ * Summary:
+ *  Interrupt callback of the sampler timer.
+ *
+ *******************************************************************************/
+static void sample_timer_callback(void *callback_arg, cyhal_timer_event_t event)
+{
+    sample_uplink_produce();
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_thread
+ *******************************************************************************
+ * Summary:
+ *  Sends the samples in the ring: full frames as soon as they are full, and
+ *  the rest once its oldest sample has waited SAMPLE_UPLINK_MAX_DELAY_MS.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void sample_uplink_thread(cy_thread_arg_t arg)
+{
+    uint32_t wait_ms = CY_RTOS_NEVER_TIMEOUT;
+    uint32_t available;
+    uint32_t age_ms;
+    cy_time_t now;
+
+    for (;;)
+    {
+        cy_rtos_semaphore_get(&uplink_ready, wait_ms);
+
+        cy_rtos_mutex_get(&uplink_mutex, CY_RTOS_NEVER_TIMEOUT);
+        if (uplink_stream == NULL)
+        {
+            cy_rtos_mutex_set(&uplink_mutex);
+            wait_ms = CY_RTOS_NEVER_TIMEOUT;
+            continue;
+        }
+
+        wait_ms = SAMPLE_UPLINK_MAX_DELAY_MS;
+        for (;;)
+        {
+            available = __atomic_load_n(&uplink_head, __ATOMIC_ACQUIRE) - uplink_tail;
+            if (available == 0)
+            {
+                break;
+            }
+
+            /* The sequence numbers count sample periods. */
+            age_ms = ((uplink_sequence - uplink_ring[uplink_tail & (SAMPLE_UPLINK_RING_SIZE - 1u)].sequence) *
+                      SAMPLE_UPLINK_PERIOD_US) / 1000u;
+            if ((available < SAMPLE_FRAME_MAX_SAMPLES) && (age_ms < SAMPLE_UPLINK_MAX_DELAY_MS))
+            {
+                wait_ms = SAMPLE_UPLINK_MAX_DELAY_MS - age_ms;
+                break;
+            }
+
+            if (age_ms > stats_max_latency_ms)
+            {
+                stats_max_latency_ms = age_ms;
+            }
+            sample_uplink_send(available);
+        }
+
+        cy_rtos_get_time(&now);
+        if ((uint32_t)(now - stats_start) >= SAMPLE_UPLINK_STATS_INTERVAL_MS)
+        {
+            sample_uplink_print_stats();
+            stats_start = now;
+        }
+        cy_rtos_mutex_set(&uplink_mutex);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_send
+ *******************************************************************************
+ * Summary:
+ *  Sends up to one frame of the oldest samples in the ring. A frame ends
+ *  early at a gap left by dropped samples, and a compact frame ends once
+ *  the next difference might not fit. The samples leave the ring even
+ *  if the send fails, as late samples are of no use. Returns the number of
+ *  samples taken out of the ring. Called with the mutex held.
+ *
+ *******************************************************************************/
+static uint32_t sample_uplink_send(uint32_t count)
+{
+    const uplink_sample_t *sample = &uplink_ring[uplink_tail & (SAMPLE_UPLINK_RING_SIZE - 1u)];
+    uint32_t first = sample->sequence;
+    uint32_t taken = 0;
+#if (SAMPLE_UPLINK_COMPACT)
+    sample_codec_t codec;
+    uint8_t type = CMD_FRAME_SAMPLES_COMPACT;
+    uint32_t length;
+
+    sample_codec_begin(&codec, uplink_frame, sizeof(uplink_frame), first, SAMPLE_UPLINK_PERIOD_US);
+    while ((taken < count) && (sample->sequence == (first + taken)) && sample_codec_add(&codec, sample->value))
+    {
+        taken++;
+        sample = &uplink_ring[(uplink_tail + taken) & (SAMPLE_UPLINK_RING_SIZE - 1u)];
+    }
+    length = codec.length;
+#else
+    uint8_t type = CMD_FRAME_SAMPLES;
+    uint32_t length = SAMPLE_FRAME_HEADER_SIZE;
+
+    if (count > SAMPLE_FRAME_MAX_SAMPLES)
+    {
+        count = SAMPLE_FRAME_MAX_SAMPLES;
+    }
+
+    put_be32(&uplink_frame[0], first);
+    put_be32(&uplink_frame[4], SAMPLE_UPLINK_PERIOD_US);
+
+    while ((taken < count) && (sample->sequence == (first + taken)))
+    {
+        put_be32(&uplink_frame[length], (uint32_t)sample->value);
+        length += 4u;
+        taken++;
+        sample = &uplink_ring[(uplink_tail + taken) & (SAMPLE_UPLINK_RING_SIZE - 1u)];
+    }
+#endif
+
+    __atomic_store_n(&uplink_tail, uplink_tail + taken, __ATOMIC_RELEASE);
+
+    if (cmd_stream_send_frame(uplink_stream, type, uplink_frame, length) == CY_RSLT_SUCCESS)
+    {
+        stats_samples += taken;
+        stats_frames++;
+        stats_bytes += CMD_FRAME_HEADER_SIZE + length;
+    }
+    else
+    {
+        stats_lost += taken;
+    }
+
+    return taken;
+}
+
+/*******************************************************************************
+ * Function Name: sample_uplink_print_stats
+ *******************************************************************************
+ * Summary:
+ *  Prints the sample and frame rates, the bytes sent per sample, the samples
+ *  lost, and the largest batching delay of the last interval.
+ *
+ *******************************************************************************/
+static void sample_uplink_print_stats(void)
+{
+    /* Hundredths of bytes per sample, frame headers included. */
+    uint32_t bytes_per_sample = (stats_samples != 0) ? ((stats_bytes * 100u) / stats_samples) : 0u;
+
+    printf("Sample uplink: %"PRIu32" samples in %"PRIu32" frames (%"PRIu32" per frame, "
+           "%"PRIu32".%02"PRIu32" bytes per sample), "
+           "%"PRIu32" overruns, %"PRIu32" lost, max delay %"PRIu32" ms\n",
+           stats_samples, stats_frames, (stats_frames != 0) ? (stats_samples / stats_frames) : 0u,
+           bytes_per_sample / 100u, bytes_per_sample % 100u,
+           uplink_overruns, stats_lost, stats_max_latency_ms);
+
+    stats_samples = 0;
+    stats_frames = 0;
+    stats_bytes = 0;
+    stats_lost = 0;
+    stats_max_latency_ms = 0;
+}
+
+#if !(SAMPLE_UPLINK_COMPACT)
+/*******************************************************************************
+ * Function Name: put_be32
+ *******************************************************************************
+ * Summary:
+ *  Writes a 32-bit value in network byte order.
+ *
+ *******************************************************************************/
+static void put_be32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)(value >> 24);
+    buffer[1] = (uint8_t)(value >> 16);
+    buffer[2] = (uint8_t)(value >> 8);
+    buffer[3] = (uint8_t)value;
+}
+#endif /* !(SAMPLE_UPLINK_COMPACT) */
+
+/* [] END OF FILE */
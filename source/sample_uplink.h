@@ -0,0 +1,118 @@
+/******************************************************************************
+* File Name:   sample_uplink.h
+*
+* Description: This file contains declarations of the periodic sample uplink:
+* a timer-driven sampler and a sender thread that batches the samples into
+* frames to the TCP server.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SAMPLE_UPLINK_H_
+#define SAMPLE_UPLINK_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include "cy_result.h"
+
+/* Command parser header file, for the stream that the samples are sent on. */
+#include "cmd_parser.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Sample rate of the sampler timer. */
+#ifndef SAMPLE_UPLINK_RATE_HZ
+#define SAMPLE_UPLINK_RATE_HZ                     (1000u)
+#endif
+
+/* Number of samples between the sampler and the sender. Must be a power of
+ * two. When the ring is full, new samples are dropped and counted.
+ */
+#ifndef SAMPLE_UPLINK_RING_SIZE
+#define SAMPLE_UPLINK_RING_SIZE                   (1024u)
+#endif
+
+/* Largest payload of a sample frame. With the frame header, a frame fills
+ * one TCP segment of the default MSS.
+ */
+#ifndef SAMPLE_UPLINK_FRAME_SIZE
+#define SAMPLE_UPLINK_FRAME_SIZE                  (1456u)
+#endif
+
+/* Encoding of the sample frames: 1 for the compact encoding of sample_codec.c,
+ * 0 for one 32-bit value per sample.
+ */
+#ifndef SAMPLE_UPLINK_COMPACT
+#define SAMPLE_UPLINK_COMPACT                     (1)
+#endif
+
+/* Longest time that a sample waits for its frame to fill before it is sent
+ * in a partly filled frame.
+ */
+#ifndef SAMPLE_UPLINK_MAX_DELAY_MS
+#define SAMPLE_UPLINK_MAX_DELAY_MS                (20u)
+#endif
+
+/* Interval of the statistics printed by the sender. */
+#ifndef SAMPLE_UPLINK_STATS_INTERVAL_MS
+#define SAMPLE_UPLINK_STATS_INTERVAL_MS           (10000u)
+#endif
+
+/* Stack size and priority of the sender thread. */
+#ifndef SAMPLE_UPLINK_THREAD_STACK_SIZE
+#define SAMPLE_UPLINK_THREAD_STACK_SIZE           (2u * 1024u)
+#endif
+#ifndef SAMPLE_UPLINK_THREAD_PRIORITY
+#define SAMPLE_UPLINK_THREAD_PRIORITY             (CY_RTOS_PRIORITY_NORMAL)
+#endif
+
+/* Function that reads one sample. It is called from the timer interrupt.
+ * Defaults to a synthetic source, so that the pipeline runs on any kit.
+ */
+#ifndef SAMPLE_UPLINK_SOURCE
+#define SAMPLE_UPLINK_SOURCE                      sample_uplink_stub_source
+#endif
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t sample_uplink_init(void);
+void sample_uplink_start(cmd_stream_t *stream);
+void sample_uplink_stop(void);
+void sample_uplink_produce(void);
+int32_t sample_uplink_stub_source(uint32_t sequence);
+
+#endif /* SAMPLE_UPLINK_H_ */
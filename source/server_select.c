@@ -0,0 +1,289 @@
+/******************************************************************************
+* File Name:   server_select.c
+*
+* Description: This file contains the TCP server selection policy. The
+* round-trip time of every server is smoothed over the probes, and servers are
+* ordered by health and round-trip time. Servers of nearly equal round-trip
+* time are ordered by a per-device seed to spread the load of a fleet.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* Server selection header file. */
+#include "server_select.h"
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Measurements of one server. */
+typedef struct
+{
+    uint32_t rtt_ms;                /* Smoothed round-trip time. */
+    uint32_t samples;               /* Number of successful probes. */
+    uint32_t failures;              /* Consecutive failed probes. */
+} server_select_stats_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static bool server_select_is_healthy(uint32_t server);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static server_select_stats_t select_stats[SERVER_SELECT_MAX_SERVERS];
+static uint32_t select_server_count;
+static uint32_t select_seed;
+
+/*******************************************************************************
+ * Function Name: server_select_init
+ *******************************************************************************
+ * Summary:
+ *  Clears the measurements when a new list of servers is configured.
+ *
+ * Parameters:
+ *  uint32_t server_count: Number of servers, at most SERVER_SELECT_MAX_SERVERS
+ *  uint32_t seed: Per-device value, for example derived from the IP address
+ *
+ *******************************************************************************/
+void server_select_init(uint32_t server_count, uint32_t seed)
+{
+    memset(select_stats, 0, sizeof(select_stats));
+    select_server_count = (server_count < SERVER_SELECT_MAX_SERVERS) ?
+                          server_count : SERVER_SELECT_MAX_SERVERS;
+    select_seed = seed;
+}
+
+/*******************************************************************************
+ * Function Name: server_select_record
+ *******************************************************************************
+ * Summary:
+ *  Records the result of a probe. The round-trip time is smoothed with a gain
+ *  of 1/4, as for the TCP smoothed RTT.
+ *
+ * Parameters:
+ *  uint32_t server: Index of the server
+ *  bool reachable: true if the probe succeeded
+ *  uint32_t rtt_ms: Measured round-trip time, used only if reachable
+ *
+ *******************************************************************************/
+void server_select_record(uint32_t server, bool reachable, uint32_t rtt_ms)
+{
+    server_select_stats_t *stats;
+
+    if (server >= select_server_count)
+    {
+        return;
+    }
+
+    stats = &select_stats[server];
+
+    if (!reachable)
+    {
+        stats->failures++;
+        return;
+    }
+
+    stats->failures = 0;
+    stats->rtt_ms = (stats->samples == 0) ? rtt_ms : ((3u * stats->rtt_ms) + rtt_ms) / 4u;
+    stats->samples++;
+}
+
+/*******************************************************************************
+ * Function Name: server_select_order
+ *******************************************************************************
+ * Summary:
+ *  Orders the servers by preference. Healthy measured servers come first,
+ *  sorted by round-trip time. Among those within SERVER_SELECT_RTT_MARGIN_MS
+ *  of the best, the seed selects which comes first. Servers that have not
+ *  been measured follow in list order, and unhealthy servers come last.
+ *
+ * Parameters:
+ *  uint32_t *order: Filled with the server indices, most preferred first
+ *
+ * Return:
+ *  uint32_t: Number of servers in the order.
+ *
+ *******************************************************************************/
+uint32_t server_select_order(uint32_t *order)
+{
+    uint32_t count = 0;
+    uint32_t measured;
+    uint32_t near_best;
+    uint32_t rotation;
+    uint32_t rotated[SERVER_SELECT_MAX_SERVERS];
+
+    /* Healthy measured servers, sorted by round-trip time (insertion sort). */
+    for (uint32_t server = 0; server < select_server_count; server++)
+    {
+        if (server_select_is_healthy(server) && (select_stats[server].samples != 0))
+        {
+            uint32_t pos = count;
+
+            while ((pos > 0) && (select_stats[order[pos - 1]].rtt_ms > select_stats[server].rtt_ms))
+            {
+                order[pos] = order[pos - 1];
+                pos--;
+            }
+            order[pos] = server;
+            count++;
+        }
+    }
+    measured = count;
+
+    /* Rotate the servers that are nearly as good as the best one. */
+    near_best = 0;
+    while ((near_best < measured) &&
+           (select_stats[order[near_best]].rtt_ms <=
+            (select_stats[order[0]].rtt_ms + SERVER_SELECT_RTT_MARGIN_MS)))
+    {
+        near_best++;
+    }
+
+    if (near_best > 1)
+    {
+        rotation = select_seed % near_best;
+        for (uint32_t i = 0; i < near_best; i++)
+        {
+            rotated[i] = order[(i + rotation) % near_best];
+        }
+        memcpy(order, rotated, near_best * sizeof(uint32_t));
+    }
+
+    /* Servers not measured yet, then unhealthy servers, in list order. */
+    for (uint32_t server = 0; server < select_server_count; server++)
+    {
+        if (server_select_is_healthy(server) && (select_stats[server].samples == 0))
+        {
+            order[count++] = server;
+        }
+    }
+
+    for (uint32_t server = 0; server < select_server_count; server++)
+    {
+        if (!server_select_is_healthy(server))
+        {
+            order[count++] = server;
+        }
+    }
+
+    return count;
+}
+
+/*******************************************************************************
+ * Function Name: server_select_should_switch
+ *******************************************************************************
+ * Summary:
+ *  Decides whether the client should move from its current server to the
+ *  most preferred one. It moves if the current server is unhealthy, or if its
+ *  round-trip time is worse by more than SERVER_SELECT_HYSTERESIS_MS.
+ *
+ * Parameters:
+ *  uint32_t current: Index of the current server
+ *  uint32_t *target: Server to move to, if the function returns true
+ *
+ * Return:
+ *  bool: true if the client should move to *target.
+ *
+ *******************************************************************************/
+bool server_select_should_switch(uint32_t current, uint32_t *target)
+{
+    uint32_t order[SERVER_SELECT_MAX_SERVERS];
+    uint32_t best;
+
+    if ((current >= select_server_count) || (server_select_order(order) == 0))
+    {
+        return false;
+    }
+
+    best = order[0];
+    if ((best == current) || !server_select_is_healthy(best) || (select_stats[best].samples == 0))
+    {
+        return false;
+    }
+
+    if (server_select_is_healthy(current) && (select_stats[current].samples != 0) &&
+        (select_stats[current].rtt_ms <= (select_stats[best].rtt_ms + SERVER_SELECT_HYSTERESIS_MS)))
+    {
+        return false;
+    }
+
+    /* Without a measurement, a healthy current server is kept. */
+    if (server_select_is_healthy(current) && (select_stats[current].samples == 0))
+    {
+        return false;
+    }
+
+    *target = best;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: server_select_print
+ *******************************************************************************
+ * Summary:
+ *  Prints the measurements of every server.
+ *
+ *******************************************************************************/
+void server_select_print(void)
+{
+    for (uint32_t server = 0; server < select_server_count; server++)
+    {
+        printf("Server %"PRIu32": RTT %"PRIu32" ms (%"PRIu32" probes), %s\n", server,
+               select_stats[server].rtt_ms, select_stats[server].samples,
+               server_select_is_healthy(server) ? "healthy" : "unhealthy");
+    }
+}
+
+/*******************************************************************************
+ * Function Name: server_select_is_healthy
+ *******************************************************************************
+ * Summary:
+ *  Returns true unless the last SERVER_SELECT_MAX_FAILURES probes failed.
+ *
+ *******************************************************************************/
+static bool server_select_is_healthy(uint32_t server)
+{
+    return (select_stats[server].failures < SERVER_SELECT_MAX_FAILURES);
+}
+
+
+/* [] END OF FILE */
@@ -0,0 +1,87 @@
+/******************************************************************************
+* File Name:   server_select.h
+*
+* Description: This file contains declarations of the TCP server selection
+* policy, which orders the configured TCP server endpoints by measured
+* round-trip time and health.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SERVER_SELECT_H_
+#define SERVER_SELECT_H_
+
+/* Header file includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Maximum number of servers tracked by the selection policy. */
+#ifndef SERVER_SELECT_MAX_SERVERS
+#define SERVER_SELECT_MAX_SERVERS                 (4u)
+#endif
+
+/* Servers whose round-trip time is within this margin of the best server are
+ * treated as equally good. The choice among them depends on the seed, so that
+ * a fleet of devices spreads across them.
+ */
+#ifndef SERVER_SELECT_RTT_MARGIN_MS
+#define SERVER_SELECT_RTT_MARGIN_MS               (10u)
+#endif
+
+/* The client moves to a better server only if the round-trip time of its
+ * current server exceeds that of the better server by more than this value.
+ */
+#ifndef SERVER_SELECT_HYSTERESIS_MS
+#define SERVER_SELECT_HYSTERESIS_MS               (30u)
+#endif
+
+/* Number of consecutive failed probes after which a server is unhealthy. */
+#ifndef SERVER_SELECT_MAX_FAILURES
+#define SERVER_SELECT_MAX_FAILURES                (2u)
+#endif
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+void server_select_init(uint32_t server_count, uint32_t seed);
+void server_select_record(uint32_t server, bool reachable, uint32_t rtt_ms);
+uint32_t server_select_order(uint32_t *order);
+bool server_select_should_switch(uint32_t current, uint32_t *target);
+void server_select_print(void);
+
+#endif /* SERVER_SELECT_H_ */
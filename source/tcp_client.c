@@ -64,12 +64,142 @@
 /* IP address related header files. */
 #include "cy_nw_helper.h"
 
+/* Command parser header file. */
+#include "cmd_parser.h"
+
+/* Telemetry buffer header file. */
+#include "telemetry_buffer.h"
+
+/* Flash download header file, for the kits with external flash. */
+#include "flash_download.h"
+
+/* Sample uplink header file. */
+#include "sample_uplink.h"
+
+/* CRC-32C header file. */
+#include "crc32c.h"
+
+/* UDP command channel header file. */
+#include "udp_command.h"
+
+/* Server selection header file. */
+#include "server_select.h"
+
+/* Zero-copy receive header file, available on FreeRTOS/lwIP builds only. */
+#if defined (COMPONENT_LWIP)
+#include "lwip_zero_copy_rx.h"
+#endif
+
 /* Standard C header files */
 #include <inttypes.h>
+#include <stdbool.h>
 
 /*******************************************************************************
 * Macros
 ********************************************************************************/
+/* To receive the TCP server commands straight from the lwIP pbufs instead of
+ * copying them out with cy_socket_recv, set this macro as '1'. Only used on
+ * FreeRTOS/lwIP builds.
+ */
+#define USE_ZERO_COPY_RX                         (0)
+
+#if defined (COMPONENT_LWIP) && (USE_ZERO_COPY_RX)
+#define ZERO_COPY_RX_ENABLED                     (1)
+#else
+#define ZERO_COPY_RX_ENABLED                     (0)
+#endif
+
+/* To keep an idle standby connection to a backup TCP server, and promote it
+ * as soon as the primary connection is lost, set this macro as '1'. Needs at
+ * least two TCP server endpoints. Not available with USE_ZERO_COPY_RX, which
+ * supports one connection only.
+ */
+#define USE_WARM_STANDBY                         (0)
+
+#if (USE_WARM_STANDBY) && !(ZERO_COPY_RX_ENABLED)
+#define WARM_STANDBY_ENABLED                     (1)
+#else
+#define WARM_STANDBY_ENABLED                     (0)
+#endif
+
+/* To probe the round-trip time of every TCP server endpoint periodically,
+ * connect to the fastest healthy one, and move to a faster one when the
+ * difference exceeds SERVER_SELECT_HYSTERESIS_MS, set this macro as '1'.
+ * Needs at least two TCP server endpoints. Not available with
+ * USE_ZERO_COPY_RX, which supports one connection only.
+ */
+#define USE_SERVER_SELECTION                     (0)
+
+#if (USE_SERVER_SELECTION) && !(ZERO_COPY_RX_ENABLED)
+#define SERVER_SELECTION_ENABLED                 (1)
+#else
+#define SERVER_SELECTION_ENABLED                 (0)
+#endif
+
+/* To detect a dead TCP server within TCP_HEARTBEAT_PERIOD_MS *
+ * TCP_HEARTBEAT_MAX_MISSES instead of waiting for the TCP keepalive, set this
+ * macro as '1'. The TCP server must answer heartbeat frames, as tcp_server.py
+ * does.
+ */
+#define USE_APP_HEARTBEAT                        (0)
+
+/* To open a session with the TCP server and resume it after a reconnect, so
+ * that the server resends only the commands that were not applied, set this
+ * macro as '1'. The TCP server must support sessions, as tcp_server.py does.
+ */
+#define USE_SESSION_RESUME                       (0)
+
+/* To open a second connection to the TCP server for the urgent commands, so
+ * that they never wait behind bulk data on the command connection, set this
+ * macro as '1'. The TCP server must listen on TCP_SERVER_CONTROL_PORT and
+ * send the urgent lane there, as tcp_server.py does. Needs
+ * USE_SESSION_RESUME. Not available with USE_ZERO_COPY_RX, which supports
+ * one connection only.
+ */
+#define USE_CONTROL_SOCKET                       (0)
+
+#if (USE_CONTROL_SOCKET) && (USE_SESSION_RESUME) && !(ZERO_COPY_RX_ENABLED)
+#define CONTROL_SOCKET_ENABLED                   (1)
+#else
+#define CONTROL_SOCKET_ENABLED                   (0)
+#endif
+
+/* To sample a periodic source at SAMPLE_UPLINK_RATE_HZ and send the samples
+ * to the TCP server in batches while connected, set this macro as '1'. The
+ * TCP server must accept sample frames, as tcp_server.py does.
+ */
+#define USE_SAMPLE_UPLINK                        (0)
+
+/* To offer LZ compression of the bulk downloads and uploads to the TCP server
+ * on every connection, set this macro as '1'. Compression is used only if the
+ * server enables it, as tcp_server.py does.
+ */
+#define USE_BULK_COMPRESSION                     (0)
+
+/* To check the bulk downloads and uploads end to end with a CRC-32C in every
+ * block and upload frame, on top of the TCP checksum, set this macro as '1'.
+ * The CRC is used only if the server enables it, as tcp_server.py does.
+ */
+#define USE_BULK_CRC                             (0)
+
+/* To receive the idempotent commands of the TCP server as UDP datagrams on
+ * UDP_COMMAND_PORT while connected, so that a lost segment of the command
+ * connection does not hold them back, set this macro as '1'. The server
+ * must send them over UDP, as tcp_server.py does; all other commands, and
+ * all commands while the UDP path fails, still arrive over TCP.
+ */
+#define USE_UDP_COMMANDS                         (0)
+
+/* To also receive the group commands that the TCP server multicasts to every
+ * client in UDP_COMMAND_GROUP_ADDRESS, set this macro as '1'. Needs
+ * USE_UDP_COMMANDS.
+ */
+#define USE_GROUP_COMMANDS                       (0)
+
+/* Features offered to the TCP server on every connection. */
+#define TCP_CLIENT_FEATURES                      (((USE_BULK_COMPRESSION) ? CMD_FEATURE_LZ : 0u) | \
+                                                 ((USE_BULK_CRC) ? CMD_FEATURE_CRC32C : 0u))
+
 /* To use the Wi-Fi device in AP interface mode, set this macro as '1' */
 #define USE_AP_INTERFACE                         (0)
 
@@ -111,54 +241,264 @@
      * in "cy_wcm.h" for more details.
      */
     #define WIFI_SECURITY_TYPE                    CY_WCM_SECURITY_WPA2_AES_PSK
-    /* Maximum number of connection retries to a Wi-Fi network. */
-    #define MAX_WIFI_CONN_RETRIES                 (10u)
-
     /* Wi-Fi re-connection time interval in milliseconds */
     #define WIFI_CONN_RETRY_INTERVAL_MSEC         (1000u)
+
+    /* Stack size and priority of the thread that joins the Wi-Fi AP. */
+    #define WIFI_JOIN_THREAD_STACK_SIZE           (4u * 1024u)
+    #define WIFI_JOIN_THREAD_PRIORITY             (CY_RTOS_PRIORITY_NORMAL)
 #endif /* USE_AP_INTERFACE */
 
 /* Maximum number of connection retries to the TCP server. */
 #define MAX_TCP_SERVER_CONN_RETRIES               (5u)
 
-/* Length of the TCP data packet. */
-#define MAX_TCP_DATA_PACKET_LENGTH                (20u)
+/* Deadline of one connection attempt to the TCP server. When it expires, the
+ * attempt is abandoned and counted as failed, even if the TCP/IP stack is
+ * still retrying the SYN. Set to 0 to wait for the stack to give up instead.
+ */
+#define TCP_SERVER_CONNECT_TIMEOUT_MS             (3000u)
+
+/* Maximum number of TCP server endpoints that can be entered. The client
+ * races connection attempts to all of them and keeps the first that succeeds.
+ */
+#define TCP_SERVER_MAX_ENDPOINTS                  (4u)
+
+/* Delay between the starts of the racing connection attempts. An attempt that
+ * fails starts the next one without waiting for the delay.
+ */
+#define TCP_CONNECT_STAGGER_MS                    (100u)
+
+/* Number of connection attempts that can be in progress at the same time,
+ * including abandoned attempts that the TCP/IP stack has not yet finished.
+ * The zero-copy receive path supports one connection only, so its attempts
+ * run one after the other.
+ */
+#if (ZERO_COPY_RX_ENABLED)
+#define TCP_CONNECT_ATTEMPT_SLOTS                 (1u)
+#else
+#define TCP_CONNECT_ATTEMPT_SLOTS                 (TCP_SERVER_MAX_ENDPOINTS + 2u)
+#endif
+
+/* Time to wait before retrying a failed or lost standby connection. */
+#define TCP_STANDBY_RETRY_MS                      (5000u)
+
+/* Time to wait before retrying a failed or lost control connection. */
+#define TCP_CONTROL_RETRY_MS                      (5000u)
+
+/* Interval between the round-trip time probes of the server selection. */
+#define TCP_SERVER_PROBE_INTERVAL_MS              (30000u)
+
+/* A heartbeat is sent when nothing has been received from the TCP server for
+ * TCP_HEARTBEAT_PERIOD_MS. The connection is considered lost after
+ * TCP_HEARTBEAT_MAX_MISSES periods without any data, heartbeat
+ * acknowledgments included.
+ */
+#define TCP_HEARTBEAT_PERIOD_MS                   (200u)
+#define TCP_HEARTBEAT_MAX_MISSES                  (3u)
+
+/* Stack size and priority of the threads that run the connection attempts. */
+#define TCP_CONNECT_THREAD_STACK_SIZE             (2u * 1024u)
+#define TCP_CONNECT_THREAD_PRIORITY               (CY_RTOS_PRIORITY_NORMAL)
+
+/* Time to wait before retrying the TCP server connection. The time is doubled
+ * after every failed attempt, up to TCP_SERVER_CONN_BACKOFF_MAX_MS.
+ */
+#define TCP_SERVER_CONN_BACKOFF_MIN_MS            (1000u)
+#define TCP_SERVER_CONN_BACKOFF_MAX_MS            (16000u)
+
+/* Number of events that can be queued for the TCP client task: the completion
+ * of every connection attempt and of the Wi-Fi join, the loss of every
+ * connection, and the notice of pending level events. Level events are kept
+ * as flags instead, so they need no room of their own.
+ */
+#define TCP_CLIENT_EVENT_QUEUE_LENGTH             ((2u * TCP_CONNECT_ATTEMPT_SLOTS) + 8u)
+
+/* Stack size and priority of the thread that reads the UART terminal. */
+#define UART_INPUT_THREAD_STACK_SIZE              (2u * 1024u)
+#define UART_INPUT_THREAD_PRIORITY                (CY_RTOS_PRIORITY_LOW)
+
+/* Length of the TCP data packet. A burst of commands is read at once, so that
+ * the command parser can coalesce it.
+ */
+#define MAX_TCP_DATA_PACKET_LENGTH                (64u)
+
+#if (MAX_TCP_DATA_PACKET_LENGTH > CMD_STREAM_HOLD_SIZE)
+#error "MAX_TCP_DATA_PACKET_LENGTH must not exceed CMD_STREAM_HOLD_SIZE"
+#endif
 
 /* TCP keep alive related macros. */
 #define TCP_KEEP_ALIVE_IDLE_TIME_MS               (10000u)
 #define TCP_KEEP_ALIVE_INTERVAL_MS                (1000u)
 #define TCP_KEEP_ALIVE_RETRY_COUNT                (2u)
 
-/* Length of the LED ON/OFF command issued from the TCP server. */
-#define TCP_LED_CMD_LEN                           (1u)
-#define LED_ON_CMD                                '1'
-#define LED_OFF_CMD                               '0'
-#define ACK_LED_ON                                "LED ON ACK"
-#define ACK_LED_OFF                               "LED OFF ACK"
-#define MSG_INVALID_CMD                           "Invalid command"
-
 #define TCP_SERVER_PORT                           (50007u)
+#define TCP_SERVER_CONTROL_PORT                   (50008u)
 #define ASCII_BACKSPACE                           (0x08)
 #define RTOS_TICK_TO_WAIT                         (50u)
 #define UART_INPUT_TIMEOUT_MS                     (1u)
 #define UART_BUFFER_SIZE                          (20u)
 
-#define SEMAPHORE_LIMIT                           (1u)
+/* Size of the UART input buffer: up to TCP_SERVER_MAX_ENDPOINTS IPv4
+ * addresses separated by spaces or commas.
+ */
+#define UART_INPUT_BUFFER_SIZE                    (TCP_SERVER_MAX_ENDPOINTS * 16u)
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* States of the TCP client connection. */
+typedef enum
+{
+    TCP_CLIENT_STATE_WIFI_DOWN,     /* Not connected to the Wi-Fi network. */
+    TCP_CLIENT_STATE_IDLE,          /* Waiting for the TCP server address. */
+    TCP_CLIENT_STATE_CONNECTING,    /* Connecting to the TCP server. */
+    TCP_CLIENT_STATE_CONNECTED,     /* Connected to the TCP server. */
+    TCP_CLIENT_STATE_BACKOFF        /* Waiting before the next connection attempt. */
+} tcp_client_state_t;
+
+/* Events handled by the TCP client task. */
+typedef enum
+{
+    TCP_CLIENT_EVENT_WIFI_UP,
+    TCP_CLIENT_EVENT_WIFI_DOWN,
+    TCP_CLIENT_EVENT_SERVER_ADDRESS, /* data: number of endpoints entered by the user */
+    TCP_CLIENT_EVENT_SERVER_LOST,    /* data: ID of the lost connection */
+    TCP_CLIENT_EVENT_TIMER,          /* data: generation of the expired timer */
+    TCP_CLIENT_EVENT_CONNECT_DONE,   /* data: attempt slot, result: connect result */
+    TCP_CLIENT_EVENT_PROBE_TIMER,    /* Time to probe the TCP server endpoints. */
+    TCP_CLIENT_EVENT_HEARTBEAT_TIMER, /* Time to check the connection for data. */
+    TCP_CLIENT_EVENT_TELEMETRY,      /* Telemetry records are waiting to be sent. */
+    TCP_CLIENT_EVENT_BULK_RESUME,    /* A flash download buffer is free again. */
+    TCP_CLIENT_EVENT_WIFI_JOIN_DONE, /* result: result of the Wi-Fi join */
+    TCP_CLIENT_EVENT_LEVEL,          /* Level events are pending; see tcp_client_level_events. */
+    TCP_CLIENT_EVENT_COUNT
+} tcp_client_event_id_t;
+
+/* Events that describe a condition rather than a single occurrence. They are
+ * kept as flags, with the data of the last one posted, so that they are never
+ * lost to a full queue. Wi-Fi up and down replace each other.
+ */
+#define TCP_CLIENT_LEVEL_EVENTS                   ((1u << TCP_CLIENT_EVENT_WIFI_UP) | \
+                                                   (1u << TCP_CLIENT_EVENT_WIFI_DOWN) | \
+                                                   (1u << TCP_CLIENT_EVENT_SERVER_ADDRESS) | \
+                                                   (1u << TCP_CLIENT_EVENT_TIMER) | \
+                                                   (1u << TCP_CLIENT_EVENT_PROBE_TIMER) | \
+                                                   (1u << TCP_CLIENT_EVENT_HEARTBEAT_TIMER) | \
+                                                   (1u << TCP_CLIENT_EVENT_TELEMETRY) | \
+                                                   (1u << TCP_CLIENT_EVENT_BULK_RESUME))
+
+/* Purpose of a connection attempt. */
+typedef enum
+{
+    TCP_ATTEMPT_ABANDONED,          /* No longer wanted; closed when finished. */
+    TCP_ATTEMPT_RACE,               /* Part of the race for the connection. */
+    TCP_ATTEMPT_STANDBY,            /* Opens the standby connection. */
+    TCP_ATTEMPT_PROBE,              /* Measures the round-trip time only. */
+    TCP_ATTEMPT_SWITCH,             /* Replaces the connection with a faster one. */
+    TCP_ATTEMPT_CONTROL             /* Opens the control connection. */
+} tcp_attempt_kind_t;
+
+typedef struct
+{
+    tcp_client_event_id_t id;
+    uint32_t data;
+    cy_rslt_t result;
+} tcp_client_event_t;
+
+/* Connection attempt to the TCP server, run in its own thread so that the
+ * TCP client task is not blocked by the connect call.
+ */
+typedef struct
+{
+    bool in_use;
+    tcp_attempt_kind_t kind;
+    uint32_t endpoint;              /* Index in tcp_server_endpoints. */
+    uint32_t rtt_ms;                /* Duration of the connect call. */
+    uint32_t connection_id;         /* Passed on to the socket callbacks. */
+    cmd_stream_t *stream;           /* Consumes the data received on the connection;
+                                     * NULL to discard it until the connection
+                                     * replaces the current one. */
+    cy_socket_t handle;
+    cy_socket_sockaddr_t address;
+    cy_thread_t thread;
+    cy_time_t start_time;
+} tcp_connect_attempt_t;
 
 
 /*******************************************************************************
 * Function Prototypes
 ********************************************************************************/
-cy_rslt_t create_tcp_client_socket();
+cy_rslt_t create_tcp_client_socket(cy_socket_t *handle, uint32_t connection_id,
+                                   cmd_stream_t *stream);
 cy_rslt_t tcp_client_recv_handler(cy_socket_t socket_handle, void *arg);
+static cy_rslt_t tcp_client_receive(cy_socket_t handle, cmd_stream_t *stream,
+                                    uint32_t *bytes_received);
+static cy_rslt_t set_receive_stream(cy_socket_t handle, cmd_stream_t *stream);
+static cy_rslt_t tcp_client_receive_all(cy_socket_t handle, cmd_stream_t *stream);
+static void tcp_client_drain(cy_socket_t handle, cmd_stream_t *stream);
+static void tcp_client_resume_receive(void);
+#if (FLASH_DOWNLOAD_SUPPORTED)
+static void tcp_client_bulk_resume(void *arg);
+#endif
 cy_rslt_t tcp_disconnection_handler(cy_socket_t socket_handle, void *arg);
-cy_rslt_t connect_to_tcp_server(cy_socket_sockaddr_t address);
+cy_rslt_t connect_to_tcp_server(tcp_connect_attempt_t *attempt);
 void read_uart_input(uint8_t* input_buffer_ptr);
+static cy_rslt_t send_to_tcp_server(const uint8_t *data, uint32_t length, void *arg);
+static void tcp_client_post_event(tcp_client_event_id_t id, uint32_t data);
+static void tcp_client_handle_event(const tcp_client_event_t *event);
+static void tcp_client_handle_level_events(void);
+static void tcp_client_telemetry_notify(void);
+static void tcp_client_set_state(tcp_client_state_t new_state);
+static void tcp_client_start_timer(uint32_t timeout_ms);
+static void tcp_client_timer_callback(cy_timer_callback_arg_t arg);
+static void tcp_client_start_connecting(void);
+static void tcp_client_race_step(void);
+static bool tcp_client_start_attempt(uint32_t endpoint, tcp_attempt_kind_t kind);
+static void tcp_client_abandon_attempts(void);
+static void tcp_client_connect_done(tcp_connect_attempt_t *attempt, cy_rslt_t result);
+static void tcp_client_connect_failed(void);
+static void tcp_client_start_backoff(void);
+static void tcp_connect_thread(cy_thread_arg_t arg);
+static void tcp_client_close_connection(void);
+#if (WARM_STANDBY_ENABLED)
+static void tcp_client_start_standby(void);
+static void tcp_client_promote_standby(void);
+static void tcp_client_close_standby(void);
+#endif
+#if (CONTROL_SOCKET_ENABLED)
+static void tcp_client_start_control(void);
+static void tcp_client_close_control(void);
+static cy_rslt_t send_to_control_socket(const uint8_t *data, uint32_t length, void *arg);
+#endif
+#if (WARM_STANDBY_ENABLED) || (SERVER_SELECTION_ENABLED)
+static void tcp_client_replace_connection(cy_socket_t handle, uint32_t connection_id,
+                                          uint32_t endpoint);
+#endif
+#if (SERVER_SELECTION_ENABLED)
+static void tcp_client_start_probes(void);
+static void tcp_client_evaluate_servers(void);
+static uint32_t tcp_client_selection_seed(void);
+static void tcp_probe_timer_callback(cy_timer_callback_arg_t arg);
+cy_rslt_t probe_tcp_server(tcp_connect_attempt_t *attempt);
+#endif
+#if (USE_APP_HEARTBEAT)
+static void tcp_client_check_heartbeat(void);
+static void tcp_heartbeat_timer_callback(cy_timer_callback_arg_t arg);
+#endif
+static void uart_input_thread(cy_thread_arg_t arg);
+static uint32_t parse_endpoint_list(char *input, cy_socket_sockaddr_t *endpoints);
+
+#if (ZERO_COPY_RX_ENABLED)
+    static void zero_copy_disconnection_handler(void *arg);
+#endif
 
 #if(USE_AP_INTERFACE)
     static cy_rslt_t softap_start(void);
 #else
     static cy_rslt_t connect_to_wifi_ap(void);
+    static void tcp_client_start_wifi_join(void);
+    static void wifi_join_thread(cy_thread_arg_t arg);
+    static void wifi_event_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data);
 #endif /* USE_AP_INTERFACE */
 
 /*******************************************************************************
@@ -167,18 +507,129 @@ void read_uart_input(uint8_t* input_buffer_ptr);
 /* TCP client socket handle */
 cy_socket_t client_handle;
 
-/* Binary semaphore handle to keep track of TCP server connection. */
-cy_semaphore_t connect_to_server;
+/* Queue of the events handled by the TCP client task, and the level events
+ * that are pending with their data.
+ */
+static cy_queue_t tcp_client_event_queue;
+static volatile uint32_t tcp_client_level_events;
+static uint32_t tcp_client_level_data[TCP_CLIENT_EVENT_COUNT];
+
+/* Current state of the TCP client connection. */
+static tcp_client_state_t tcp_client_state = TCP_CLIENT_STATE_WIFI_DOWN;
+
+/* Endpoints of the TCP server, in order of preference. The count is zero
+ * until the endpoints are entered by the user.
+ */
+static cy_socket_sockaddr_t tcp_server_endpoints[TCP_SERVER_MAX_ENDPOINTS];
+static uint32_t tcp_server_endpoint_count;
+
+/* Endpoints entered on the UART terminal, handed over to the TCP client task
+ * with a TCP_CLIENT_EVENT_SERVER_ADDRESS event.
+ */
+static cy_socket_sockaddr_t uart_endpoints[TCP_SERVER_MAX_ENDPOINTS];
+static cy_mutex_t uart_endpoints_mutex;
+
+/* ID of the current TCP server connection, used to discard the disconnection
+ * events of connections that are already closed. Zero when not connected.
+ */
+static uint32_t tcp_connection_id;
+static uint32_t tcp_next_connection_id;
+
+/* Endpoint of the current TCP server connection. */
+static uint32_t tcp_connection_endpoint;
+
+#if (WARM_STANDBY_ENABLED)
+/* Standby connection to a backup TCP server. The ID is zero when there is no
+ * standby connection.
+ */
+static cy_socket_t standby_handle;
+static uint32_t standby_connection_id;
+static uint32_t standby_endpoint;
+#endif
+
+#if (CONTROL_SOCKET_ENABLED)
+/* Control connection to the current TCP server, which carries the urgent
+ * commands. The ID is zero when there is no control connection.
+ */
+static cy_socket_t control_handle;
+static uint32_t control_connection_id;
+#endif
+
+/* Connection attempts in progress. Attempts that are abandoned keep their
+ * slot until the TCP/IP stack finishes them.
+ */
+static tcp_connect_attempt_t tcp_connect_attempts[TCP_CONNECT_ATTEMPT_SLOTS];
+
+/* Endpoints of the current race in the order they are tried, the next one
+ * to be tried, and the earliest time at which its attempt may start.
+ */
+static uint32_t tcp_race_order[TCP_SERVER_MAX_ENDPOINTS];
+static uint32_t tcp_race_next_endpoint;
+static cy_time_t tcp_race_next_start;
+
+#if (SERVER_SELECTION_ENABLED)
+/* Periodic timer of the round-trip time probes, and the number of probes of
+ * the current round that have not finished.
+ */
+static cy_timer_t tcp_probe_timer;
+static uint32_t tcp_probes_outstanding;
+#endif
+
+#if (USE_APP_HEARTBEAT)
+/* Periodic timer that checks the connection for data while connected. */
+static cy_timer_t tcp_heartbeat_timer;
+#endif
+
+/* Connection attempts since the last successful connection, and the time to
+ * wait before the next attempt.
+ */
+static uint32_t tcp_conn_attempts;
+static uint32_t tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MIN_MS;
+
+/* One-shot timer for the back-off and Wi-Fi retry delays. Expiry events that
+ * carry an older generation are discarded.
+ */
+static cy_timer_t tcp_client_timer;
+static uint32_t tcp_client_timer_generation;
+
+/* Thread that reads the TCP server address from the UART terminal. */
+static cy_thread_t uart_input_thread_handle;
+
+#if(!USE_AP_INTERFACE)
+/* Thread that joins the Wi-Fi AP, so that the TCP client task keeps handling
+ * events while the join takes its time. Set while the thread runs.
+ */
+static cy_thread_t wifi_join_thread_handle;
+static bool wifi_join_running;
+#endif
 
 /* Holds the IP address obtained for SoftAP using Wi-Fi Connection Manager (WCM). */
 cy_wcm_ip_address_t softap_ip_address;
 
+/* Parser for the commands received from the TCP server, and the streams of
+ * the command and control connections.
+ */
+static cmd_parser_t tcp_cmd_parser;
+static cmd_stream_t tcp_cmd_stream;
+#if (CONTROL_SOCKET_ENABLED)
+static cmd_stream_t tcp_control_stream;
+#endif
+
+/* Keeps the socket callbacks and the TCP client task from reading a
+ * connection at the same time, when the task resumes a stalled bulk download.
+ */
+static cy_mutex_t tcp_rx_mutex;
+
 /*******************************************************************************
  * Function Name: tcp_client_task
  *******************************************************************************
  * Summary:
  *  Task used to establish a connection to a remote TCP server and
  *  control the LED state (ON/OFF) based on the command received from TCP server.
+ *  The task runs the connection state machine: Wi-Fi events, the loss of the
+ *  TCP server, the TCP server address entered on the UART terminal, and timer
+ *  expiries are posted to the event queue of the task and handled one at a
+ *  time, so no event waits behind a blocking prompt or retry loop.
  *
  * Parameters:
  *  void *args : Task parameter defined during task creation (unused).
@@ -190,24 +641,50 @@ cy_wcm_ip_address_t softap_ip_address;
 void tcp_client_task(void *arg)
 {
     cy_rslt_t result ;
-    uint8_t uart_input[UART_BUFFER_SIZE];
+    tcp_client_event_t event;
 
     cy_wcm_config_t wifi_config = { .interface = WIFI_INTERFACE_TYPE };
 
-    /* IP address and TCP port number of the TCP server to which the TCP client
-     * connects to.
-     */
-    cy_socket_sockaddr_t tcp_server_address =
+    /* Create the event queue and the timer of the state machine. */
+    result = cy_rtos_queue_init(&tcp_client_event_queue, TCP_CLIENT_EVENT_QUEUE_LENGTH,
+                                sizeof(tcp_client_event_t));
+    if (result == CY_RSLT_SUCCESS)
     {
-        .ip_address.version = CY_SOCKET_IP_VER_V4,
-        .port = TCP_SERVER_PORT
-    };
+        result = cy_rtos_timer_init(&tcp_client_timer, CY_TIMER_TYPE_ONCE,
+                                    tcp_client_timer_callback, NULL);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_mutex_init(&uart_endpoints_mutex, false);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_mutex_init(&tcp_rx_mutex, false);
+    }
+#if (SERVER_SELECTION_ENABLED)
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_timer_init(&tcp_probe_timer, CY_TIMER_TYPE_PERIODIC,
+                                    tcp_probe_timer_callback, NULL);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_timer_start(&tcp_probe_timer, TCP_SERVER_PROBE_INTERVAL_MS);
+    }
+#endif
+#if (USE_APP_HEARTBEAT)
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_timer_init(&tcp_heartbeat_timer, CY_TIMER_TYPE_PERIODIC,
+                                    tcp_heartbeat_timer_callback, NULL);
+    }
+#endif
 
-    /* IP variable for network utility functions */
-    cy_nw_ip_address_t nw_ip_addr =
+    if (result != CY_RSLT_SUCCESS)
     {
-        .version = NW_IP_IPV4
-    };
+        printf("TCP client event queue initialization failed!\n");
+        CY_ASSERT(0);
+    }
 
     /* Initialize Wi-Fi connection manager. */
     result = cy_wcm_init(&wifi_config);
@@ -219,6 +696,71 @@ void tcp_client_task(void *arg)
     }
     printf("Wi-Fi Connection Manager initialized.\r\n");
 
+    /* Initialize the parser for the commands received from the TCP server. */
+    result = cmd_parser_init(&tcp_cmd_parser);
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cmd_stream_init(&tcp_cmd_stream, &tcp_cmd_parser, send_to_tcp_server, NULL);
+    }
+#if (CONTROL_SOCKET_ENABLED)
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cmd_stream_init(&tcp_control_stream, &tcp_cmd_parser, send_to_control_socket, NULL);
+    }
+#endif
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Command parser initialization failed!\n");
+        CY_ASSERT(0);
+    }
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    /* Reading stops while the flash download buffers are full. */
+    flash_download_set_resume_callback(tcp_client_bulk_resume, NULL);
+#endif
+
+    /* Initialize the buffer of the telemetry records reported to the server. */
+    result = telemetry_buffer_init(tcp_client_telemetry_notify);
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Telemetry buffer initialization failed!\n");
+        CY_ASSERT(0);
+    }
+
+    /* Use the CRC hardware for the CRC-32C, if the device has one. */
+    crc32c_init();
+
+#if (USE_SAMPLE_UPLINK)
+    result = sample_uplink_init();
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        CY_ASSERT(0);
+    }
+#endif
+
+#if (USE_UDP_COMMANDS)
+    result = udp_command_init();
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        CY_ASSERT(0);
+    }
+#endif
+
+    /* Initialize secure socket library. */
+    result = cy_socket_init();
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Secure Socket initialization failed!\n");
+        CY_ASSERT(0);
+    }
+    printf("Secure Socket initialized\n");
+
     #if(USE_AP_INTERFACE)
 
         /* Start the Wi-Fi device as a Soft AP interface. */
@@ -228,85 +770,1542 @@ void tcp_client_task(void *arg)
             printf("Failed to Start Soft AP! Error code: 0x%08"PRIx32"\n", (uint32_t)result);
             CY_ASSERT(0);
         }
+        tcp_client_post_event(TCP_CLIENT_EVENT_WIFI_UP, 0);
     #else
-        /* Connect to Wi-Fi AP */
-        result = connect_to_wifi_ap();
-        if(result!= CY_RSLT_SUCCESS )
+        /* Track the loss and recovery of the Wi-Fi connection. */
+        cy_wcm_register_event_callback(wifi_event_callback);
+
+        /* Join the Wi-Fi AP. If this fails, the state machine keeps retrying. */
+        tcp_client_start_timer(0);
+    #endif /* USE_AP_INTERFACE */
+
+    /* Start reading the TCP server address from the UART terminal. */
+    result = cy_rtos_thread_create(&uart_input_thread_handle, uart_input_thread,
+                                   "UART input", NULL, UART_INPUT_THREAD_STACK_SIZE,
+                                   UART_INPUT_THREAD_PRIORITY, NULL);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("UART input thread creation failed!\n");
+        CY_ASSERT(0);
+    }
+
+    for(;;)
+    {
+        if (cy_rtos_queue_get(&tcp_client_event_queue, &event, CY_RTOS_NEVER_TIMEOUT)
+            == CY_RSLT_SUCCESS)
         {
-            printf("\n Failed to connect to Wi-Fi AP! Error code: 0x%08"PRIx32"\n", (uint32_t)result);
-            CY_ASSERT(0);
+            if (event.id != TCP_CLIENT_EVENT_LEVEL)
+            {
+                tcp_client_handle_event(&event);
+            }
+            tcp_client_handle_level_events();
         }
-    #endif /* USE_AP_INTERFACE */
+    }
+ }
 
-    /* Create a binary semaphore to keep track of TCP server connection. */
-    cy_rtos_semaphore_init(&connect_to_server, SEMAPHORE_LIMIT, 0);
+/*******************************************************************************
+ * Function Name: tcp_client_post_event
+ *******************************************************************************
+ * Summary:
+ *  Posts an event to the TCP client task. The function does not block, so it
+ *  can be called from the Wi-Fi, socket, timer, and UART callbacks. A level
+ *  event only sets its flag, and the task is notified when the first flag is
+ *  set. The queue has room for all other events, so a full queue is a fault.
+ *
+ * Parameters:
+ *  tcp_client_event_id_t id: Event to be posted
+ *  uint32_t data: Data of the event
+ *
+ *******************************************************************************/
+static void tcp_client_post_event(tcp_client_event_id_t id, uint32_t data)
+{
+    tcp_client_event_t event = { .id = id, .data = data, .result = CY_RSLT_SUCCESS };
+    uint32_t critical_state;
+    uint32_t pending;
 
-    /* Give the semaphore so as to connect to TCP server.  */
-    cy_rtos_semaphore_set(&connect_to_server);
+    if (((1u << id) & TCP_CLIENT_LEVEL_EVENTS) != 0)
+    {
+        critical_state = cyhal_system_critical_section_enter();
+        pending = tcp_client_level_events;
+        if (id == TCP_CLIENT_EVENT_WIFI_UP)
+        {
+            pending &= ~(1u << TCP_CLIENT_EVENT_WIFI_DOWN);
+        }
+        else if (id == TCP_CLIENT_EVENT_WIFI_DOWN)
+        {
+            pending &= ~(1u << TCP_CLIENT_EVENT_WIFI_UP);
+        }
+        tcp_client_level_events = pending | (1u << id);
+        tcp_client_level_data[id] = data;
+        cyhal_system_critical_section_exit(critical_state);
 
-    /* Initialize secure socket library. */
-    result = cy_socket_init();
+        /* A notice is already queued, or the task is about to check the flags. */
+        if (pending != 0)
+        {
+            return;
+        }
+        event.id = TCP_CLIENT_EVENT_LEVEL;
+    }
 
-    if (result != CY_RSLT_SUCCESS)
+    if (cy_rtos_queue_put(&tcp_client_event_queue, &event, 0) != CY_RSLT_SUCCESS)
     {
-        printf("Secure Socket initialization failed!\n");
+        if (event.id == TCP_CLIENT_EVENT_LEVEL)
+        {
+            /* The task checks the flags after each queued event. */
+            return;
+        }
+        printf("TCP client event queue full, event %d lost!\n", (int)id);
         CY_ASSERT(0);
     }
-    printf("Secure Socket initialized\n");
+}
 
-    for(;;)
+/*******************************************************************************
+ * Function Name: tcp_client_handle_level_events
+ *******************************************************************************
+ * Summary:
+ *  Handles the pending level events, each once with the data it was last
+ *  posted with.
+ *
+ *******************************************************************************/
+static void tcp_client_handle_level_events(void)
+{
+    tcp_client_event_t event = { .result = CY_RSLT_SUCCESS };
+    uint32_t data[TCP_CLIENT_EVENT_COUNT];
+    uint32_t critical_state;
+    uint32_t pending;
+
+    critical_state = cyhal_system_critical_section_enter();
+    pending = tcp_client_level_events;
+    tcp_client_level_events = 0;
+    memcpy(data, tcp_client_level_data, sizeof(data));
+    cyhal_system_critical_section_exit(critical_state);
+
+    for (uint32_t id = 0; pending != 0; id++)
     {
-        /* Wait till semaphore is acquired so as to connect to a TCP server. */
-        cy_rtos_semaphore_get(&connect_to_server, CY_RTOS_NEVER_TIMEOUT);
+        if ((pending & (1u << id)) != 0)
+        {
+            pending &= ~(1u << id);
+            event.id = (tcp_client_event_id_t)id;
+            event.data = data[id];
+            tcp_client_handle_event(&event);
+        }
+    }
+}
 
-        printf("Connect to TCP server\n");
-        printf("Enter the IPv4 address of the TCP Server:\n");
+/*******************************************************************************
+ * Function Name: tcp_client_telemetry_notify
+ *******************************************************************************
+ * Summary:
+ *  Called by the telemetry buffer when a record is added to it while empty.
+ *  The records are sent by the TCP client task if it is connected, and on
+ *  the next connection otherwise.
+ *
+ *******************************************************************************/
+static void tcp_client_telemetry_notify(void)
+{
+    tcp_client_post_event(TCP_CLIENT_EVENT_TELEMETRY, 0);
+}
 
-        /* Prevent system from entering deep sleep mode
-         * when receiving data from UART.
-         */
-        cyhal_syspm_lock_deepsleep();
+/*******************************************************************************
+ * Function Name: tcp_client_handle_event
+ *******************************************************************************
+ * Summary:
+ *  Runs one step of the connection state machine for the given event. Events
+ *  that do not apply to the current state are ignored.
+ *
+ * Parameters:
+ *  const tcp_client_event_t *event: Event to be handled
+ *
+ *******************************************************************************/
+static void tcp_client_handle_event(const tcp_client_event_t *event)
+{
+    switch (event->id)
+    {
+        case TCP_CLIENT_EVENT_WIFI_UP:
+            if (tcp_client_state == TCP_CLIENT_STATE_WIFI_DOWN)
+            {
+                printf("Wi-Fi connection is up\n");
+                telemetry_buffer_add(TELEMETRY_RECORD_WIFI_UP, NULL, 0);
+                if (tcp_server_endpoint_count != 0)
+                {
+                    tcp_conn_attempts = 0;
+                    tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MIN_MS;
+                    tcp_client_start_connecting();
+                }
+                else
+                {
+                    tcp_client_set_state(TCP_CLIENT_STATE_IDLE);
+                }
+            }
+            break;
 
-        /* Clear the UART input buffer. */
-        memset(uart_input, 0, UART_BUFFER_SIZE);
+        case TCP_CLIENT_EVENT_WIFI_DOWN:
+            if (tcp_client_state != TCP_CLIENT_STATE_WIFI_DOWN)
+            {
+                printf("Wi-Fi connection lost\n");
+                telemetry_buffer_add(TELEMETRY_RECORD_WIFI_DOWN, NULL, 0);
+                tcp_client_close_connection();
+                tcp_client_set_state(TCP_CLIENT_STATE_WIFI_DOWN);
+            #if(!USE_AP_INTERFACE)
+                tcp_client_start_timer(WIFI_CONN_RETRY_INTERVAL_MSEC);
+            #endif
+            }
+            break;
 
-        /* Read the TCP server's IPv4 address from  the user via the
-         * UART terminal.
-         */
-        read_uart_input(uart_input);
+        case TCP_CLIENT_EVENT_SERVER_ADDRESS:
+            cy_rtos_mutex_get(&uart_endpoints_mutex, CY_RTOS_NEVER_TIMEOUT);
+            memcpy(tcp_server_endpoints, uart_endpoints, sizeof(tcp_server_endpoints));
+            tcp_server_endpoint_count = event->data;
+            cy_rtos_mutex_set(&uart_endpoints_mutex);
 
-        /* Allow system to enter deep sleep mode. */
-        cyhal_syspm_unlock_deepsleep();
+        #if (SERVER_SELECTION_ENABLED)
+            server_select_init(tcp_server_endpoint_count, tcp_client_selection_seed());
+        #endif
+
+            if (tcp_client_state == TCP_CLIENT_STATE_WIFI_DOWN)
+            {
+                printf("Connecting to the TCP server once Wi-Fi is up\n");
+            }
+            else
+            {
+                tcp_client_close_connection();
+                tcp_conn_attempts = 0;
+                tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MIN_MS;
+                tcp_client_start_connecting();
+            }
+            break;
 
-        cy_nw_str_to_ipv4((char *)uart_input, (cy_nw_ip_address_t *)&nw_ip_addr);
-        tcp_server_address.ip_address.ip.v4 = nw_ip_addr.ip.v4;
+        case TCP_CLIENT_EVENT_SERVER_LOST:
+            if ((tcp_client_state == TCP_CLIENT_STATE_CONNECTED) &&
+                (event->data == tcp_connection_id))
+            {
+                printf("Disconnected from the TCP server! \n");
+                telemetry_buffer_add_value(TELEMETRY_RECORD_SERVER_LOST, tcp_connection_endpoint);
 
-        /* Connect to the TCP server. If the connection fails, retry
-         * to connect to the server for MAX_TCP_SERVER_CONN_RETRIES times.
-         */
-        cy_nw_ntoa(&nw_ip_addr, (char *)&uart_input);
-        printf("Connecting to TCP Server (IP Address: %s, Port: %d)\n\n",
-                      uart_input, TCP_SERVER_PORT);
+            #if (SERVER_SELECTION_ENABLED)
+                server_select_record(tcp_connection_endpoint, false, 0);
+            #endif
+
+            #if (WARM_STANDBY_ENABLED)
+                if (standby_connection_id != 0)
+                {
+                    tcp_client_promote_standby();
+                    break;
+                }
+            #endif
+
+                tcp_client_close_connection();
+                tcp_conn_attempts = 0;
+                tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MIN_MS;
+
+                /* Fail over to the other endpoints right away. */
+                tcp_client_start_connecting();
+            }
+        #if (WARM_STANDBY_ENABLED)
+            else if ((tcp_client_state == TCP_CLIENT_STATE_CONNECTED) &&
+                     (event->data == standby_connection_id))
+            {
+                printf("Standby connection lost\n");
+                tcp_client_close_standby();
+                tcp_client_start_timer(TCP_STANDBY_RETRY_MS);
+            }
+        #endif
+        #if (CONTROL_SOCKET_ENABLED)
+            else if ((tcp_client_state == TCP_CLIENT_STATE_CONNECTED) &&
+                     (event->data == control_connection_id))
+            {
+                printf("Control connection lost\n");
+                tcp_client_close_control();
+                tcp_client_start_timer(TCP_CONTROL_RETRY_MS);
+            }
+        #endif
+            break;
+
+        case TCP_CLIENT_EVENT_TIMER:
+            if (event->data != tcp_client_timer_generation)
+            {
+                break;
+            }
 
-        result = connect_to_tcp_server(tcp_server_address);
+            if (tcp_client_state == TCP_CLIENT_STATE_BACKOFF)
+            {
+                tcp_client_start_connecting();
+            }
+            else if (tcp_client_state == TCP_CLIENT_STATE_CONNECTING)
+            {
+                /* An attempt is due to start or has reached its deadline. */
+                tcp_client_race_step();
+            }
+        #if (WARM_STANDBY_ENABLED) || (CONTROL_SOCKET_ENABLED)
+            else if (tcp_client_state == TCP_CLIENT_STATE_CONNECTED)
+            {
+                /* Retry the standby and control connections; each is only
+                 * opened if it is missing.
+                 */
+            #if (WARM_STANDBY_ENABLED)
+                tcp_client_start_standby();
+            #endif
+            #if (CONTROL_SOCKET_ENABLED)
+                tcp_client_start_control();
+            #endif
+            }
+        #endif
+        #if(!USE_AP_INTERFACE)
+            else if (tcp_client_state == TCP_CLIENT_STATE_WIFI_DOWN)
+            {
+                /* Join the Wi-Fi AP unless the connection manager has already
+                 * reconnected on its own, or a join is still running.
+                 */
+                if (cy_wcm_is_connected_to_ap())
+                {
+                    tcp_client_post_event(TCP_CLIENT_EVENT_WIFI_UP, 0);
+                }
+                else if (!wifi_join_running)
+                {
+                    tcp_client_start_wifi_join();
+                }
+            }
+        #endif
+            break;
+
+    #if(!USE_AP_INTERFACE)
+        case TCP_CLIENT_EVENT_WIFI_JOIN_DONE:
+            cy_rtos_thread_join(&wifi_join_thread_handle);
+            wifi_join_running = false;
+            if (tcp_client_state == TCP_CLIENT_STATE_WIFI_DOWN)
+            {
+                if (event->result == CY_RSLT_SUCCESS)
+                {
+                    tcp_client_post_event(TCP_CLIENT_EVENT_WIFI_UP, 0);
+                }
+                else
+                {
+                    tcp_client_start_timer(WIFI_CONN_RETRY_INTERVAL_MSEC);
+                }
+            }
+            break;
+    #endif
+
+        case TCP_CLIENT_EVENT_CONNECT_DONE:
+            tcp_client_connect_done(&tcp_connect_attempts[event->data], event->result);
+            break;
+
+    #if (USE_APP_HEARTBEAT)
+        case TCP_CLIENT_EVENT_HEARTBEAT_TIMER:
+            if (tcp_client_state == TCP_CLIENT_STATE_CONNECTED)
+            {
+                tcp_client_check_heartbeat();
+            }
+            break;
+    #endif
+
+    #if (SERVER_SELECTION_ENABLED)
+        case TCP_CLIENT_EVENT_PROBE_TIMER:
+            if (tcp_client_state == TCP_CLIENT_STATE_CONNECTED)
+            {
+                tcp_client_start_probes();
+            }
+            break;
+    #endif
+
+        case TCP_CLIENT_EVENT_TELEMETRY:
+            if (tcp_client_state == TCP_CLIENT_STATE_CONNECTED)
+            {
+                telemetry_buffer_flush(&tcp_cmd_stream);
+            }
+            break;
+
+        case TCP_CLIENT_EVENT_BULK_RESUME:
+            if (tcp_client_state == TCP_CLIENT_STATE_CONNECTED)
+            {
+                tcp_client_resume_receive();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_set_state
+ *******************************************************************************
+ * Summary:
+ *  Changes the state of the TCP client. Deep sleep is locked while the task
+ *  waits for the TCP server address, so that no UART input is lost.
+ *
+ * Parameters:
+ *  tcp_client_state_t new_state: State to be entered
+ *
+ *******************************************************************************/
+static void tcp_client_set_state(tcp_client_state_t new_state)
+{
+    if (new_state == tcp_client_state)
+    {
+        return;
+    }
+
+    if (tcp_client_state == TCP_CLIENT_STATE_IDLE)
+    {
+        /* Allow system to enter deep sleep mode. */
+        cyhal_syspm_unlock_deepsleep();
+    }
+
+#if (USE_APP_HEARTBEAT)
+    if (tcp_client_state == TCP_CLIENT_STATE_CONNECTED)
+    {
+        cy_rtos_timer_stop(&tcp_heartbeat_timer);
+    }
+    else if (new_state == TCP_CLIENT_STATE_CONNECTED)
+    {
+        /* The new connection has not been silent yet. */
+        cy_time_t now;
+
+        cy_rtos_get_time(&now);
+        tcp_cmd_stream.last_rx_time = now;
+        cy_rtos_timer_start(&tcp_heartbeat_timer, TCP_HEARTBEAT_PERIOD_MS);
+    }
+#endif
+
+    tcp_client_state = new_state;
+
+    if (new_state == TCP_CLIENT_STATE_IDLE)
+    {
+        /* Prevent system from entering deep sleep mode
+         * when receiving data from UART.
+         */
+        cyhal_syspm_lock_deepsleep();
+
+        printf("Connect to TCP server\n");
+        printf("Enter the IPv4 address of the TCP Server:\n");
+        printf("(Up to %d addresses of redundant servers can be entered, separated by spaces)\n",
+               TCP_SERVER_MAX_ENDPOINTS);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_start_timer
+ *******************************************************************************
+ * Summary:
+ *  Starts the one-shot timer of the state machine. A TCP_CLIENT_EVENT_TIMER
+ *  event is posted when it expires. Restarting the timer invalidates the
+ *  expiry event of the previous run, even if it is already queued.
+ *
+ * Parameters:
+ *  uint32_t timeout_ms: Time until the timer expires
+ *
+ *******************************************************************************/
+static void tcp_client_start_timer(uint32_t timeout_ms)
+{
+    cy_rtos_timer_stop(&tcp_client_timer);
+    tcp_client_timer_generation++;
+
+    if (timeout_ms == 0)
+    {
+        tcp_client_post_event(TCP_CLIENT_EVENT_TIMER, tcp_client_timer_generation);
+    }
+    else
+    {
+        cy_rtos_timer_start(&tcp_client_timer, timeout_ms);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_timer_callback
+ *******************************************************************************
+ * Summary:
+ *  Callback function of the state machine timer.
+ *
+ * Parameters:
+ *  cy_timer_callback_arg_t arg: Callback argument (unused)
+ *
+ *******************************************************************************/
+static void tcp_client_timer_callback(cy_timer_callback_arg_t arg)
+{
+    tcp_client_post_event(TCP_CLIENT_EVENT_TIMER, tcp_client_timer_generation);
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_start_connecting
+ *******************************************************************************
+ * Summary:
+ *  Starts a race of connection attempts to the TCP server endpoints. With
+ *  server selection, the endpoints are tried in order of preference. The
+ *  first endpoint is tried at once and the others TCP_CONNECT_STAGGER_MS
+ *  apart, or as soon as an earlier attempt fails. The first attempt that
+ *  succeeds is kept and the others are abandoned. The function returns
+ *  without waiting; the race is driven by the completion and timer events.
+ *
+ *******************************************************************************/
+static void tcp_client_start_connecting(void)
+{
+    tcp_client_set_state(TCP_CLIENT_STATE_CONNECTING);
+
+#if (SERVER_SELECTION_ENABLED)
+    /* Try the endpoints in order of preference. */
+    server_select_order(tcp_race_order);
+#else
+    for (uint32_t endpoint = 0; endpoint < tcp_server_endpoint_count; endpoint++)
+    {
+        tcp_race_order[endpoint] = endpoint;
+    }
+#endif
+
+    tcp_race_next_endpoint = 0;
+    cy_rtos_get_time(&tcp_race_next_start);
+
+    tcp_client_race_step();
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_race_step
+ *******************************************************************************
+ * Summary:
+ *  Advances the race of connection attempts: abandons the attempts that have
+ *  reached TCP_SERVER_CONNECT_TIMEOUT_MS, starts the next endpoint when it is
+ *  due, and re-arms the timer for the next start or deadline. The race fails
+ *  when every endpoint has been tried and no attempt is pending.
+ *
+ *******************************************************************************/
+static void tcp_client_race_step(void)
+{
+    cy_time_t now;
+    cy_time_t deadline;
+    cy_time_t next_wakeup = 0;
+    bool wakeup_needed = false;
+    bool attempts_pending = false;
+    bool slot_free = false;
+
+    cy_rtos_get_time(&now);
+
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        tcp_connect_attempt_t *attempt = &tcp_connect_attempts[slot];
+
+        if ((attempt->kind == TCP_ATTEMPT_RACE) && (TCP_SERVER_CONNECT_TIMEOUT_MS != 0) &&
+            ((now - attempt->start_time) >= TCP_SERVER_CONNECT_TIMEOUT_MS))
+        {
+            /* The deadline of the attempt has expired. */
+            printf("Connection attempt timed out after %d ms\n", TCP_SERVER_CONNECT_TIMEOUT_MS);
+            attempt->kind = TCP_ATTEMPT_ABANDONED;
+        #if (SERVER_SELECTION_ENABLED)
+            server_select_record(attempt->endpoint, false, 0);
+        #endif
+
+            /* Start the next endpoint without waiting for the stagger delay. */
+            tcp_race_next_start = now;
+        }
+    }
+
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (!tcp_connect_attempts[slot].in_use)
+        {
+            slot_free = true;
+        }
+    }
+
+    if ((tcp_race_next_endpoint < tcp_server_endpoint_count) && slot_free &&
+        ((int32_t)(now - tcp_race_next_start) >= 0))
+    {
+        /* An endpoint whose attempt cannot be started counts as failed. */
+        if (tcp_client_start_attempt(tcp_race_order[tcp_race_next_endpoint], TCP_ATTEMPT_RACE))
+        {
+            tcp_race_next_start = now + TCP_CONNECT_STAGGER_MS;
+        }
+        tcp_race_next_endpoint++;
+    }
+
+    /* Find the earliest deadline of the pending attempts. */
+    slot_free = false;
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        tcp_connect_attempt_t *attempt = &tcp_connect_attempts[slot];
+
+        if (!attempt->in_use)
+        {
+            slot_free = true;
+        }
+
+        if (attempt->kind == TCP_ATTEMPT_RACE)
+        {
+            attempts_pending = true;
+            deadline = attempt->start_time + TCP_SERVER_CONNECT_TIMEOUT_MS;
+            if ((TCP_SERVER_CONNECT_TIMEOUT_MS != 0) &&
+                (!wakeup_needed || ((int32_t)(deadline - next_wakeup) < 0)))
+            {
+                next_wakeup = deadline;
+                wakeup_needed = true;
+            }
+        }
+    }
+
+    if (tcp_race_next_endpoint < tcp_server_endpoint_count)
+    {
+        /* Without a free slot, the next start waits for an abandoned attempt
+         * to finish, which is signaled by its completion event.
+         */
+        if (slot_free && (!wakeup_needed || ((int32_t)(tcp_race_next_start - next_wakeup) < 0)))
+        {
+            next_wakeup = tcp_race_next_start;
+            wakeup_needed = true;
+        }
+    }
+    else if (!attempts_pending)
+    {
+        /* Every endpoint has been tried without success. */
+        tcp_client_connect_failed();
+        return;
+    }
+
+    if (wakeup_needed)
+    {
+        tcp_client_start_timer(((int32_t)(next_wakeup - now) > 0) ? (next_wakeup - now) : 1u);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_start_attempt
+ *******************************************************************************
+ * Summary:
+ *  Starts one connection attempt in its own thread. The result is delivered
+ *  by a TCP_CLIENT_EVENT_CONNECT_DONE event.
+ *
+ * Parameters:
+ *  uint32_t endpoint: Index of the endpoint in tcp_server_endpoints
+ *  tcp_attempt_kind_t kind: Purpose of the attempt
+ *
+ * Return:
+ *  bool: true if the attempt was started, false if no attempt slot is free
+ *  or the thread could not be created.
+ *
+ *******************************************************************************/
+static bool tcp_client_start_attempt(uint32_t endpoint, tcp_attempt_kind_t kind)
+{
+    const cy_socket_sockaddr_t *address = &tcp_server_endpoints[endpoint];
+    cy_rslt_t result;
+    char ip_addr_str[UART_BUFFER_SIZE];
+    tcp_connect_attempt_t *attempt = NULL;
+
+    /* IP variable for network utility functions */
+    cy_nw_ip_address_t nw_ip_addr =
+    {
+        .version = NW_IP_IPV4,
+        .ip.v4 = address->ip_address.ip.v4
+    };
+
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (!tcp_connect_attempts[slot].in_use)
+        {
+            attempt = &tcp_connect_attempts[slot];
+            break;
+        }
+    }
+
+    if (attempt == NULL)
+    {
+        return false;
+    }
+
+    cy_nw_ntoa(&nw_ip_addr, ip_addr_str);
+    if (kind != TCP_ATTEMPT_PROBE)
+    {
+        printf("Connecting to %sTCP Server (IP Address: %s, Port: %d)\n\n",
+                      (kind == TCP_ATTEMPT_STANDBY) ? "standby " :
+                      (kind == TCP_ATTEMPT_CONTROL) ? "control " : "", ip_addr_str,
+                      (kind == TCP_ATTEMPT_CONTROL) ? TCP_SERVER_CONTROL_PORT : address->port);
+    }
+
+    attempt->endpoint = endpoint;
+    attempt->connection_id = ++tcp_next_connection_id;
+    attempt->address = *address;
+    attempt->stream = &tcp_cmd_stream;
+    if ((kind == TCP_ATTEMPT_STANDBY) || (kind == TCP_ATTEMPT_SWITCH) ||
+        (kind == TCP_ATTEMPT_PROBE))
+    {
+        /* Whatever the other server sends before the connection is promoted
+         * is not part of the current command stream, and a probe is never
+         * promoted.
+         */
+        attempt->stream = NULL;
+    }
+#if (CONTROL_SOCKET_ENABLED)
+    if (kind == TCP_ATTEMPT_CONTROL)
+    {
+        attempt->address.port = TCP_SERVER_CONTROL_PORT;
+        attempt->stream = &tcp_control_stream;
+    }
+#endif
+    attempt->handle = NULL;
+    attempt->rtt_ms = 0;
+    cy_rtos_get_time(&attempt->start_time);
+
+    /* The thread runs at a higher priority than this task and reads the
+     * attempt as soon as it is created.
+     */
+    attempt->kind = kind;
+    attempt->in_use = true;
+
+    result = cy_rtos_thread_create(&attempt->thread, tcp_connect_thread, "TCP connect",
+                                   NULL, TCP_CONNECT_THREAD_STACK_SIZE,
+                                   TCP_CONNECT_THREAD_PRIORITY, attempt);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("TCP connect thread creation failed!\n");
+        attempt->in_use = false;
+        return false;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_abandon_attempts
+ *******************************************************************************
+ * Summary:
+ *  Stops waiting for the pending connection attempts, including the standby
+ *  and switch attempts. Their connections are closed when the attempts
+ *  finish. Probes are not affected; they close their connections themselves.
+ *
+ *******************************************************************************/
+static void tcp_client_abandon_attempts(void)
+{
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind != TCP_ATTEMPT_PROBE)
+        {
+            tcp_connect_attempts[slot].kind = TCP_ATTEMPT_ABANDONED;
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_connect_done
+ *******************************************************************************
+ * Summary:
+ *  Handles the completion of a connection attempt. The first attempt of the
+ *  race that succeeds becomes the connection to the TCP server and the other
+ *  attempts are abandoned. The connection of an attempt that has been
+ *  abandoned is closed again.
+ *
+ * Parameters:
+ *  tcp_connect_attempt_t *attempt: Completed attempt
+ *  cy_rslt_t result: Result of the connect call
+ *
+ *******************************************************************************/
+static void tcp_client_connect_done(tcp_connect_attempt_t *attempt, cy_rslt_t result)
+{
+    cy_time_t now;
+    tcp_attempt_kind_t kind = attempt->kind;
+
+    cy_rtos_get_time(&now);
+
+    /* The thread exits right after posting the event. */
+    cy_rtos_thread_join(&attempt->thread);
+    attempt->in_use = false;
+    attempt->kind = TCP_ATTEMPT_ABANDONED;
+
+    /* An attempt that no longer fits the state is treated as abandoned. */
+    if (((kind == TCP_ATTEMPT_RACE) && (tcp_client_state != TCP_CLIENT_STATE_CONNECTING)) ||
+        (((kind == TCP_ATTEMPT_STANDBY) || (kind == TCP_ATTEMPT_SWITCH) ||
+          (kind == TCP_ATTEMPT_CONTROL)) &&
+         (tcp_client_state != TCP_CLIENT_STATE_CONNECTED)))
+    {
+        kind = TCP_ATTEMPT_ABANDONED;
+    }
+
+#if (SERVER_SELECTION_ENABLED)
+    if (kind != TCP_ATTEMPT_ABANDONED)
+    {
+        server_select_record(attempt->endpoint, (result == CY_RSLT_SUCCESS), attempt->rtt_ms);
+    }
+
+    if (kind == TCP_ATTEMPT_PROBE)
+    {
+        /* The probe has closed its connection already. */
+        if ((tcp_probes_outstanding > 0) && (--tcp_probes_outstanding == 0))
+        {
+            tcp_client_evaluate_servers();
+        }
+        return;
+    }
+
+    if (kind == TCP_ATTEMPT_SWITCH)
+    {
+        if (result == CY_RSLT_SUCCESS)
+        {
+            printf("Moved to a faster TCP server in %"PRIu32" ms\n",
+                   (uint32_t)(now - attempt->start_time));
+            tcp_client_replace_connection(attempt->handle, attempt->connection_id,
+                                          attempt->endpoint);
+        }
+        return;
+    }
+#endif
+
+#if (WARM_STANDBY_ENABLED)
+    if (kind == TCP_ATTEMPT_STANDBY)
+    {
+        if (result == CY_RSLT_SUCCESS)
+        {
+            standby_handle = attempt->handle;
+            standby_connection_id = attempt->connection_id;
+            standby_endpoint = attempt->endpoint;
+            printf("Standby connection ready in %"PRIu32" ms\n",
+                   (uint32_t)(now - attempt->start_time));
+        }
+        else
+        {
+            printf("Standby connection failed. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
+            tcp_client_start_timer(TCP_STANDBY_RETRY_MS);
+        }
+        return;
+    }
+#endif
+
+#if (CONTROL_SOCKET_ENABLED)
+    if (kind == TCP_ATTEMPT_CONTROL)
+    {
+        if (result == CY_RSLT_SUCCESS)
+        {
+            control_handle = attempt->handle;
+            control_connection_id = attempt->connection_id;
+            printf("Control connection ready in %"PRIu32" ms\n",
+                   (uint32_t)(now - attempt->start_time));
+        }
+        else
+        {
+            printf("Control connection failed. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
+            tcp_client_start_timer(TCP_CONTROL_RETRY_MS);
+        }
+        return;
+    }
+#endif
+
+    if (kind != TCP_ATTEMPT_RACE)
+    {
+        if (result == CY_RSLT_SUCCESS)
+        {
+        #if (ZERO_COPY_RX_ENABLED)
+            lwip_zc_rx_disconnect();
+        #else
+            cy_socket_disconnect(attempt->handle, 0);
+            cy_socket_delete(attempt->handle);
+        #endif
+        }
+        printf("Abandoned connection attempt finished after %"PRIu32" ms\n",
+               (uint32_t)(now - attempt->start_time));
+    }
+    else if (result == CY_RSLT_SUCCESS)
+    {
+        tcp_client_abandon_attempts();
+        cy_rtos_timer_stop(&tcp_client_timer);
+
+        client_handle = attempt->handle;
+        tcp_connection_id = attempt->connection_id;
+        tcp_connection_endpoint = attempt->endpoint;
+        tcp_conn_attempts = 0;
+        tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MIN_MS;
+        tcp_client_set_state(TCP_CLIENT_STATE_CONNECTED);
+
+        printf("============================================================\n");
+        printf("Connected to TCP server in %"PRIu32" ms\n",
+               (uint32_t)(now - attempt->start_time));
+
+    #if (USE_SESSION_RESUME)
+        cmd_parser_start_session(&tcp_cmd_parser, &tcp_cmd_stream);
+    #endif
+
+    #if (TCP_CLIENT_FEATURES != 0)
+        cmd_stream_offer_features(&tcp_cmd_stream, TCP_CLIENT_FEATURES);
+    #endif
+
+        /* Send what was recorded while disconnected, in batches. */
+        telemetry_buffer_add_value(TELEMETRY_RECORD_CONNECTED, (uint32_t)(now - attempt->start_time));
+        telemetry_buffer_flush(&tcp_cmd_stream);
+
+    #if (USE_SAMPLE_UPLINK)
+        sample_uplink_start(&tcp_cmd_stream);
+    #endif
+
+    #if (USE_UDP_COMMANDS)
+        /* On failure, every command arrives over TCP. */
+        (void)udp_command_start(&tcp_server_endpoints[tcp_connection_endpoint],
+                                (USE_GROUP_COMMANDS) != 0);
+    #endif
+
+    #if (WARM_STANDBY_ENABLED)
+        tcp_client_start_standby();
+    #endif
+    #if (CONTROL_SOCKET_ENABLED)
+        tcp_client_start_control();
+    #endif
+        return;
+    }
+    else
+    {
+        printf("Could not connect to TCP server. Error code: 0x%08"PRIx32", failure detected after %"PRIu32" ms\n",
+               (uint32_t)result, (uint32_t)(now - attempt->start_time));
+        telemetry_buffer_add_value(TELEMETRY_RECORD_CONNECT_FAILED, (uint32_t)result);
+
+        /* Start the next endpoint without waiting for the stagger delay. */
+        tcp_race_next_start = now;
+    }
+
+    /* A finished attempt frees a slot or ends the race. */
+    if (tcp_client_state == TCP_CLIENT_STATE_CONNECTING)
+    {
+        tcp_client_race_step();
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_connect_failed
+ *******************************************************************************
+ * Summary:
+ *  Schedules the next race of connection attempts after the back-off time.
+ *  After MAX_TCP_SERVER_CONN_RETRIES failed races, the user is asked for the
+ *  TCP server endpoints again.
+ *
+ *******************************************************************************/
+static void tcp_client_connect_failed(void)
+{
+    tcp_conn_attempts++;
+    if (tcp_conn_attempts >= MAX_TCP_SERVER_CONN_RETRIES)
+    {
+        /* Stop retrying after maximum retry attempts. */
+        printf("Exceeded maximum connection attempts to the TCP server\n");
+        printf("Failed to connect to TCP server.\n");
+        tcp_conn_attempts = 0;
+        tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MIN_MS;
+        tcp_client_set_state(TCP_CLIENT_STATE_IDLE);
+        return;
+    }
+
+    printf("Trying to reconnect to TCP server... Please check if the server is listening\n");
+    tcp_client_start_backoff();
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_start_backoff
+ *******************************************************************************
+ * Summary:
+ *  Waits for the back-off time before the next connection attempt, and
+ *  doubles the back-off time for the attempt after that.
+ *
+ *******************************************************************************/
+static void tcp_client_start_backoff(void)
+{
+    tcp_client_set_state(TCP_CLIENT_STATE_BACKOFF);
+
+    printf("Next connection attempt in %"PRIu32" ms\n", tcp_conn_backoff_ms);
+    tcp_client_start_timer(tcp_conn_backoff_ms);
+
+    tcp_conn_backoff_ms *= 2u;
+    if (tcp_conn_backoff_ms > TCP_SERVER_CONN_BACKOFF_MAX_MS)
+    {
+        tcp_conn_backoff_ms = TCP_SERVER_CONN_BACKOFF_MAX_MS;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_close_connection
+ *******************************************************************************
+ * Summary:
+ *  Closes the connection to the TCP server, if any, and frees its resources.
+ *  Disconnection events still pending for this connection are discarded. The
+ *  connection attempts in progress, including those of the standby, control
+ *  and faster server connections, are abandoned; their connections are closed
+ *  when the attempts finish.
+ *
+ *******************************************************************************/
+static void tcp_client_close_connection(void)
+{
+    if (tcp_client_state == TCP_CLIENT_STATE_CONNECTING)
+    {
+        tcp_client_abandon_attempts();
+        return;
+    }
+
+    if (tcp_client_state != TCP_CLIENT_STATE_CONNECTED)
+    {
+        return;
+    }
+
+    /* Invalidate the pending disconnection events of this connection. */
+    tcp_connection_id = 0;
+
+#if (USE_SAMPLE_UPLINK)
+    /* Wait for a frame being sent before the socket is deleted. */
+    sample_uplink_stop();
+#endif
+
+#if (USE_UDP_COMMANDS)
+    udp_command_stop();
+#endif
+
+#if (WARM_STANDBY_ENABLED)
+    tcp_client_close_standby();
+#endif
+
+#if (CONTROL_SOCKET_ENABLED)
+    tcp_client_close_control();
+#endif
+
+#if (SERVER_SELECTION_ENABLED)
+    /* A move to a faster server must not replace a later connection. */
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind == TCP_ATTEMPT_SWITCH)
+        {
+            tcp_connect_attempts[slot].kind = TCP_ATTEMPT_ABANDONED;
+        }
+    }
+#endif
+
+#if (ZERO_COPY_RX_ENABLED)
+    lwip_zc_rx_disconnect();
+#else
+    /* Disconnect the TCP client. */
+    cy_socket_disconnect(client_handle, 0);
+
+    /* Free the resources allocated to the socket. */
+    cy_socket_delete(client_handle);
+#endif
+
+    cmd_stream_reset(&tcp_cmd_stream);
+}
+
+#if (WARM_STANDBY_ENABLED)
+/*******************************************************************************
+ * Function Name: tcp_client_start_standby
+ *******************************************************************************
+ * Summary:
+ *  Opens the standby connection to the endpoint that follows the endpoint of
+ *  the current connection in the list, unless a standby connection or attempt
+ *  already exists. The socket has its own TCP keepalive, so a dead backup
+ *  server is detected while the standby connection is idle.
+ *
+ *******************************************************************************/
+static void tcp_client_start_standby(void)
+{
+    if ((standby_connection_id != 0) || (tcp_server_endpoint_count < 2u))
+    {
+        return;
+    }
+
+    uint32_t endpoint;
+#if (SERVER_SELECTION_ENABLED)
+    uint32_t order[TCP_SERVER_MAX_ENDPOINTS];
+#endif
+
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind == TCP_ATTEMPT_STANDBY)
+        {
+            return;
+        }
+    }
+
+#if (SERVER_SELECTION_ENABLED)
+    /* Use the most preferred endpoint other than the current one. */
+    server_select_order(order);
+    endpoint = (order[0] != tcp_connection_endpoint) ? order[0] : order[1];
+#else
+    endpoint = (tcp_connection_endpoint + 1u) % tcp_server_endpoint_count;
+#endif
+
+    if (!tcp_client_start_attempt(endpoint, TCP_ATTEMPT_STANDBY))
+    {
+        tcp_client_start_timer(TCP_STANDBY_RETRY_MS);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_promote_standby
+ *******************************************************************************
+ * Summary:
+ *  Makes the standby connection the connection to the TCP server, after the
+ *  primary connection is lost or when server selection moves to the standby
+ *  server. The commands of the backup server are handled as soon as the
+ *  handles are swapped, without a new connect.
+ *
+ *******************************************************************************/
+static void tcp_client_promote_standby(void)
+{
+    cy_time_t start_time;
+    cy_time_t end_time;
+    uint32_t connection_id = standby_connection_id;
+
+    cy_rtos_get_time(&start_time);
+
+    standby_connection_id = 0;
+    tcp_client_replace_connection(standby_handle, connection_id, standby_endpoint);
+
+    cy_rtos_get_time(&end_time);
+    printf("Standby connection promoted in %"PRIu32" ms\n", (uint32_t)(end_time - start_time));
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_close_standby
+ *******************************************************************************
+ * Summary:
+ *  Closes the standby connection, if any, and abandons a standby attempt in
+ *  progress.
+ *
+ *******************************************************************************/
+static void tcp_client_close_standby(void)
+{
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind == TCP_ATTEMPT_STANDBY)
+        {
+            tcp_connect_attempts[slot].kind = TCP_ATTEMPT_ABANDONED;
+        }
+    }
+
+    if (standby_connection_id != 0)
+    {
+        standby_connection_id = 0;
+        cy_socket_disconnect(standby_handle, 0);
+        cy_socket_delete(standby_handle);
+    }
+}
+#endif /* WARM_STANDBY_ENABLED */
+
+#if (CONTROL_SOCKET_ENABLED)
+/*******************************************************************************
+ * Function Name: tcp_client_start_control
+ *******************************************************************************
+ * Summary:
+ *  Opens the control connection to the server of the current connection,
+ *  unless a control connection or attempt already exists.
+ *
+ *******************************************************************************/
+static void tcp_client_start_control(void)
+{
+    if (control_connection_id != 0)
+    {
+        return;
+    }
+
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind == TCP_ATTEMPT_CONTROL)
+        {
+            return;
+        }
+    }
+
+    if (!tcp_client_start_attempt(tcp_connection_endpoint, TCP_ATTEMPT_CONTROL))
+    {
+        tcp_client_start_timer(TCP_CONTROL_RETRY_MS);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_close_control
+ *******************************************************************************
+ * Summary:
+ *  Closes the control connection, if any, and abandons a control attempt in
+ *  progress. Urgent commands are then sent on the command connection.
+ *
+ *******************************************************************************/
+static void tcp_client_close_control(void)
+{
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind == TCP_ATTEMPT_CONTROL)
+        {
+            tcp_connect_attempts[slot].kind = TCP_ATTEMPT_ABANDONED;
+        }
+    }
+
+    if (control_connection_id != 0)
+    {
+        control_connection_id = 0;
+        cy_socket_disconnect(control_handle, 0);
+        cy_socket_delete(control_handle);
+        cmd_stream_reset(&tcp_control_stream);
+    }
+}
+#endif /* CONTROL_SOCKET_ENABLED */
+
+#if (WARM_STANDBY_ENABLED) || (SERVER_SELECTION_ENABLED)
+/*******************************************************************************
+ * Function Name: tcp_client_replace_connection
+ *******************************************************************************
+ * Summary:
+ *  Makes an already established connection the connection to the TCP server
+ *  and closes the previous one. The handles are swapped before the previous
+ *  socket is closed, so the command path is never without a connection. A
+ *  standby connection to the same endpoint is replaced by a new one.
+ *
+ * Parameters:
+ *  cy_socket_t handle: Socket of the new connection
+ *  uint32_t connection_id: ID of the new connection
+ *  uint32_t endpoint: Endpoint of the new connection
+ *
+ *******************************************************************************/
+static void tcp_client_replace_connection(cy_socket_t handle, uint32_t connection_id,
+                                          uint32_t endpoint)
+{
+    cy_socket_t previous_handle = client_handle;
+
+    /* The new connection has discarded its data so far; from now on it feeds
+     * the command stream, and the previous one no longer does.
+     */
+    cy_rtos_mutex_get(&tcp_rx_mutex, CY_RTOS_NEVER_TIMEOUT);
+    set_receive_stream(previous_handle, NULL);
+    client_handle = handle;
+    tcp_connection_id = connection_id;
+    tcp_connection_endpoint = endpoint;
+    cmd_stream_reset(&tcp_cmd_stream);
+    set_receive_stream(handle, &tcp_cmd_stream);
+    cy_rtos_mutex_set(&tcp_rx_mutex);
+
+    /* Free the resources allocated to the previous socket. */
+    cy_socket_disconnect(previous_handle, 0);
+    cy_socket_delete(previous_handle);
+
+#if (USE_SESSION_RESUME)
+    cmd_parser_start_session(&tcp_cmd_parser, &tcp_cmd_stream);
+#endif
+
+#if (TCP_CLIENT_FEATURES != 0)
+    cmd_stream_offer_features(&tcp_cmd_stream, TCP_CLIENT_FEATURES);
+#endif
+
+#if (USE_UDP_COMMANDS)
+    /* A new epoch for the new connection, possibly to another server. */
+    udp_command_stop();
+    (void)udp_command_start(&tcp_server_endpoints[endpoint], (USE_GROUP_COMMANDS) != 0);
+#endif
+
+#if (WARM_STANDBY_ENABLED)
+    if ((standby_connection_id != 0) && (standby_endpoint == endpoint))
+    {
+        tcp_client_close_standby();
+    }
+    tcp_client_start_standby();
+#endif
+
+#if (CONTROL_SOCKET_ENABLED)
+    /* The control connection follows the command connection. */
+    tcp_client_close_control();
+    tcp_client_start_control();
+#endif
+}
+#endif /* WARM_STANDBY_ENABLED || SERVER_SELECTION_ENABLED */
+
+#if (USE_APP_HEARTBEAT)
+/*******************************************************************************
+ * Function Name: tcp_client_check_heartbeat
+ *******************************************************************************
+ * Summary:
+ *  Checks how long the TCP server has been silent. Any received data proves
+ *  that the server is alive, so a heartbeat is sent only after a silent
+ *  period, and a busy connection never carries heartbeats. The connection is
+ *  treated as lost after TCP_HEARTBEAT_MAX_MISSES silent periods.
+ *
+ *******************************************************************************/
+static void tcp_client_check_heartbeat(void)
+{
+    cy_time_t now;
+    uint32_t silent_ms;
+    cy_rslt_t result;
+
+    cy_rtos_get_time(&now);
+    silent_ms = (uint32_t)(now - tcp_cmd_stream.last_rx_time);
+
+    if (silent_ms >= (TCP_HEARTBEAT_PERIOD_MS * TCP_HEARTBEAT_MAX_MISSES))
+    {
+        printf("No heartbeat from the TCP server for %"PRIu32" ms\n", silent_ms);
+        tcp_client_post_event(TCP_CLIENT_EVENT_SERVER_LOST, tcp_connection_id);
+    }
+    else if (silent_ms >= TCP_HEARTBEAT_PERIOD_MS)
+    {
+        result = cmd_stream_send_frame(&tcp_cmd_stream, CMD_FRAME_HEARTBEAT, NULL, 0);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            printf("Failed to send heartbeat. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_heartbeat_timer_callback
+ *******************************************************************************
+ * Summary:
+ *  Callback function of the periodic heartbeat timer.
+ *
+ * Parameters:
+ *  cy_timer_callback_arg_t arg: Callback argument (unused)
+ *
+ *******************************************************************************/
+static void tcp_heartbeat_timer_callback(cy_timer_callback_arg_t arg)
+{
+    tcp_client_post_event(TCP_CLIENT_EVENT_HEARTBEAT_TIMER, 0);
+}
+#endif /* USE_APP_HEARTBEAT */
+
+#if (SERVER_SELECTION_ENABLED)
+/*******************************************************************************
+ * Function Name: tcp_client_start_probes
+ *******************************************************************************
+ * Summary:
+ *  Starts a round of round-trip time probes, one short-lived connection to
+ *  every TCP server endpoint. The servers are evaluated when the last probe
+ *  of the round finishes.
+ *
+ *******************************************************************************/
+static void tcp_client_start_probes(void)
+{
+    if ((tcp_server_endpoint_count < 2u) || (tcp_probes_outstanding != 0))
+    {
+        return;
+    }
+
+    for (uint32_t endpoint = 0; endpoint < tcp_server_endpoint_count; endpoint++)
+    {
+        if (tcp_client_start_attempt(endpoint, TCP_ATTEMPT_PROBE))
+        {
+            tcp_probes_outstanding++;
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_evaluate_servers
+ *******************************************************************************
+ * Summary:
+ *  Moves the connection to the most preferred TCP server if the server
+ *  selection policy says so. The new connection is opened before the current
+ *  one is closed; a standby connection to that server is promoted instead.
+ *
+ *******************************************************************************/
+static void tcp_client_evaluate_servers(void)
+{
+    uint32_t target;
+
+    if (tcp_client_state != TCP_CLIENT_STATE_CONNECTED)
+    {
+        return;
+    }
+
+    server_select_print();
+
+    if (!server_select_should_switch(tcp_connection_endpoint, &target))
+    {
+        return;
+    }
+
+    for (uint32_t slot = 0; slot < TCP_CONNECT_ATTEMPT_SLOTS; slot++)
+    {
+        if (tcp_connect_attempts[slot].kind == TCP_ATTEMPT_SWITCH)
+        {
+            return;
+        }
+    }
+
+#if (WARM_STANDBY_ENABLED)
+    if ((standby_connection_id != 0) && (standby_endpoint == target))
+    {
+        tcp_client_promote_standby();
+        return;
+    }
+#endif
+
+    tcp_client_start_attempt(target, TCP_ATTEMPT_SWITCH);
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_selection_seed
+ *******************************************************************************
+ * Summary:
+ *  Returns a per-device seed for the server selection, derived from the MAC
+ *  address, so that devices spread across servers of equal round-trip time.
+ *
+ *******************************************************************************/
+static uint32_t tcp_client_selection_seed(void)
+{
+    cy_wcm_mac_t mac_addr = { 0 };
+
+    cy_wcm_get_mac_addr(WIFI_INTERFACE_TYPE, &mac_addr);
+
+    return (((uint32_t)mac_addr[2] << 24) | ((uint32_t)mac_addr[3] << 16) |
+            ((uint32_t)mac_addr[4] << 8) | (uint32_t)mac_addr[5]);
+}
+
+/*******************************************************************************
+ * Function Name: tcp_probe_timer_callback
+ *******************************************************************************
+ * Summary:
+ *  Callback function of the periodic probe timer.
+ *
+ * Parameters:
+ *  cy_timer_callback_arg_t arg: Callback argument (unused)
+ *
+ *******************************************************************************/
+static void tcp_probe_timer_callback(cy_timer_callback_arg_t arg)
+{
+    tcp_client_post_event(TCP_CLIENT_EVENT_PROBE_TIMER, 0);
+}
+#endif /* SERVER_SELECTION_ENABLED */
+
+/*******************************************************************************
+ * Function Name: tcp_connect_thread
+ *******************************************************************************
+ * Summary:
+ *  Runs one blocking connection attempt and posts its result to the TCP
+ *  client task.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Connection attempt (tcp_connect_attempt_t *)
+ *
+ *******************************************************************************/
+static void tcp_connect_thread(cy_thread_arg_t arg)
+{
+    tcp_connect_attempt_t *attempt = (tcp_connect_attempt_t *)arg;
+    tcp_client_event_t event =
+    {
+        .id = TCP_CLIENT_EVENT_CONNECT_DONE,
+        .data = (uint32_t)(attempt - tcp_connect_attempts)
+    };
+
+#if (SERVER_SELECTION_ENABLED)
+    if (attempt->kind == TCP_ATTEMPT_PROBE)
+    {
+        event.result = probe_tcp_server(attempt);
+    }
+    else
+#endif
+    {
+        event.result = connect_to_tcp_server(attempt);
+    }
+
+    /* The completion event must not be lost, or the slot is never freed. */
+    cy_rtos_queue_put(&tcp_client_event_queue, &event, CY_RTOS_NEVER_TIMEOUT);
+
+    cy_rtos_thread_exit();
+}
+
+/*******************************************************************************
+ * Function Name: uart_input_thread
+ *******************************************************************************
+ * Summary:
+ *  Reads the IPv4 addresses of the TCP server endpoints from the UART terminal
+ *  and hands them over to the TCP client task. New endpoints can be entered at
+ *  any time; the client then disconnects and connects to the new endpoints.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void uart_input_thread(cy_thread_arg_t arg)
+{
+    uint8_t uart_input[UART_INPUT_BUFFER_SIZE];
+    cy_socket_sockaddr_t endpoints[TCP_SERVER_MAX_ENDPOINTS];
+    uint32_t endpoint_count;
+
+    for(;;)
+    {
+        /* Clear the UART input buffer. */
+        memset(uart_input, 0, UART_INPUT_BUFFER_SIZE);
+
+        /* Read the TCP server's IPv4 addresses from  the user via the
+         * UART terminal.
+         */
+        read_uart_input(uart_input);
+
+        endpoint_count = parse_endpoint_list((char *)uart_input, endpoints);
+        if (endpoint_count == 0)
+        {
+            continue;
+        }
+
+        cy_rtos_mutex_get(&uart_endpoints_mutex, CY_RTOS_NEVER_TIMEOUT);
+        memcpy(uart_endpoints, endpoints, sizeof(uart_endpoints));
+        cy_rtos_mutex_set(&uart_endpoints_mutex);
+
+        tcp_client_post_event(TCP_CLIENT_EVENT_SERVER_ADDRESS, endpoint_count);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: parse_endpoint_list
+ *******************************************************************************
+ * Summary:
+ *  Parses a list of IPv4 addresses separated by spaces or commas. Every
+ *  endpoint uses TCP_SERVER_PORT.
+ *
+ * Parameters:
+ *  char *input: Null-terminated list, modified in place
+ *  cy_socket_sockaddr_t *endpoints: Array of TCP_SERVER_MAX_ENDPOINTS endpoints
+ *
+ * Return:
+ *  uint32_t: Number of endpoints parsed, 0 if the list is empty or invalid.
+ *
+ *******************************************************************************/
+static uint32_t parse_endpoint_list(char *input, cy_socket_sockaddr_t *endpoints)
+{
+    uint32_t count = 0;
+    char *token = input;
+    char *end;
+    bool last = false;
+
+    /* IP variable for network utility functions */
+    cy_nw_ip_address_t nw_ip_addr =
+    {
+        .version = NW_IP_IPV4
+    };
+
+    memset(endpoints, 0, TCP_SERVER_MAX_ENDPOINTS * sizeof(cy_socket_sockaddr_t));
+
+    while (!last)
+    {
+        /* Find the end of the token and terminate it. */
+        for (end = token; (*end != '\0') && (*end != ' ') && (*end != ','); end++)
+        {
+        }
+        last = (*end == '\0');
+        *end = '\0';
 
-        if(result != CY_RSLT_SUCCESS)
+        if (*token != '\0')
         {
-            printf("Failed to connect to TCP server.\n");
+            if (count == TCP_SERVER_MAX_ENDPOINTS)
+            {
+                printf("Only %d endpoints are supported\n", TCP_SERVER_MAX_ENDPOINTS);
+                return 0;
+            }
 
-            /* Give the semaphore so as to connect to TCP server.  */
-            cy_rtos_semaphore_set(&connect_to_server);
+            if (cy_nw_str_to_ipv4(token, &nw_ip_addr) != 0)
+            {
+                printf("Invalid IPv4 address: %s\n", token);
+                return 0;
+            }
+
+            endpoints[count].ip_address.version = CY_SOCKET_IP_VER_V4;
+            endpoints[count].ip_address.ip.v4 = nw_ip_addr.ip.v4;
+            endpoints[count].port = TCP_SERVER_PORT;
+            count++;
         }
+
+        token = end + 1;
     }
- }
+
+    return count;
+}
 
 #if(!USE_AP_INTERFACE)
 /*******************************************************************************
  * Function Name: connect_to_wifi_ap()
  *******************************************************************************
  * Summary:
- *  Connects to Wi-Fi AP using the user-configured credentials, retries up to a
- *  configured number of times until the connection succeeds.
+ *  Makes one attempt to connect to the Wi-Fi AP using the user-configured
+ *  credentials. The state machine retries every WIFI_CONN_RETRY_INTERVAL_MSEC
+ *  until the connection succeeds.
  *
  *******************************************************************************/
 cy_rslt_t connect_to_wifi_ap(void)
@@ -334,30 +2333,102 @@ cy_rslt_t connect_to_wifi_ap(void)
     printf("Connecting to Wi-Fi Network: %s\n", WIFI_SSID);
 
     /* Join the Wi-Fi AP. */
-    for(uint32_t conn_retries = 0; conn_retries < MAX_WIFI_CONN_RETRIES; conn_retries++ )
+    result = cy_wcm_connect_ap(&wifi_conn_param, &ip_address);
+
+    if(result == CY_RSLT_SUCCESS)
     {
-        result = cy_wcm_connect_ap(&wifi_conn_param, &ip_address);
+        printf("Successfully connected to Wi-Fi network '%s'.\n",
+                            wifi_conn_param.ap_credentials.SSID);
+        nw_ip_addr.ip.v4 = ip_address.ip.v4;
+        cy_nw_ntoa(&nw_ip_addr, ip_addr_str);
+        printf("IP Address Assigned: %s\n", ip_addr_str);
+        return result;
+    }
 
-        if(result == CY_RSLT_SUCCESS)
-        {
-            printf("Successfully connected to Wi-Fi network '%s'.\n",
-                                wifi_conn_param.ap_credentials.SSID);
-            nw_ip_addr.ip.v4 = ip_address.ip.v4;
-            cy_nw_ntoa(&nw_ip_addr, ip_addr_str);
-            printf("IP Address Assigned: %s\n", ip_addr_str);
-            return result;
-        }
+    printf("Connection to Wi-Fi network failed with error code %d."
+           "Retrying in %d ms...\n", (int)result, WIFI_CONN_RETRY_INTERVAL_MSEC);
+
+    return result;
+}
 
-        printf("Connection to Wi-Fi network failed with error code %d."
-               "Retrying in %d ms...\n", (int)result, WIFI_CONN_RETRY_INTERVAL_MSEC);
+/*******************************************************************************
+ * Function Name: tcp_client_start_wifi_join
+ *******************************************************************************
+ * Summary:
+ *  Starts a Wi-Fi join in its own thread. A TCP_CLIENT_EVENT_WIFI_JOIN_DONE
+ *  event is posted when it finishes.
+ *
+ *******************************************************************************/
+static void tcp_client_start_wifi_join(void)
+{
+    cy_rslt_t result;
 
-        cy_rtos_delay_milliseconds(WIFI_CONN_RETRY_INTERVAL_MSEC);
+    result = cy_rtos_thread_create(&wifi_join_thread_handle, wifi_join_thread, "Wi-Fi join",
+                                   NULL, WIFI_JOIN_THREAD_STACK_SIZE,
+                                   WIFI_JOIN_THREAD_PRIORITY, NULL);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Wi-Fi join thread creation failed. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
+        tcp_client_start_timer(WIFI_CONN_RETRY_INTERVAL_MSEC);
+        return;
     }
 
-    /* Stop retrying after maximum retry attempts. */
-    printf("Exceeded maximum Wi-Fi connection attempts\n");
+    wifi_join_running = true;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_join_thread
+ *******************************************************************************
+ * Summary:
+ *  Makes one attempt to join the Wi-Fi AP and reports the result to the TCP
+ *  client task.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void wifi_join_thread(cy_thread_arg_t arg)
+{
+    tcp_client_event_t event = { .id = TCP_CLIENT_EVENT_WIFI_JOIN_DONE, .data = 0 };
+
+    (void)arg;
 
-    return result;
+    event.result = connect_to_wifi_ap();
+
+    /* The completion event must not be lost, or no join is started again. */
+    cy_rtos_queue_put(&tcp_client_event_queue, &event, CY_RTOS_NEVER_TIMEOUT);
+
+    cy_rtos_thread_exit();
+}
+
+/*******************************************************************************
+ * Function Name: wifi_event_callback
+ *******************************************************************************
+ * Summary:
+ *  Callback function of the Wi-Fi connection manager. Posts the loss and the
+ *  recovery of the Wi-Fi connection to the TCP client task.
+ *
+ * Parameters:
+ *  cy_wcm_event_t event: Wi-Fi connection manager event
+ *  cy_wcm_event_data_t *event_data: Data of the event (unused)
+ *
+ *******************************************************************************/
+static void wifi_event_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data)
+{
+    switch (event)
+    {
+        case CY_WCM_EVENT_DISCONNECTED:
+            tcp_client_post_event(TCP_CLIENT_EVENT_WIFI_DOWN, 0);
+            break;
+
+        case CY_WCM_EVENT_RECONNECTED:
+        case CY_WCM_EVENT_IP_CHANGED:
+            tcp_client_post_event(TCP_CLIENT_EVENT_WIFI_UP, 0);
+            break;
+
+        default:
+            break;
+    }
 }
 #endif /* USE_AP_INTERFACE */
 
@@ -418,6 +2489,34 @@ static cy_rslt_t softap_start(void)
 }
 #endif /* USE_AP_INTERFACE */
 
+/*******************************************************************************
+ * Function Name: set_receive_stream
+ *******************************************************************************
+ * Summary:
+ *  Registers the receive callback of a socket with the command stream that
+ *  consumes its data. A standby connection is registered without a stream
+ *  until it is promoted.
+ *
+ * Parameters:
+ *  cy_socket_t handle: Socket of the connection
+ *  cmd_stream_t *stream: Command stream of the connection; NULL to discard
+ *                        the received data
+ *
+ * Return:
+ *  cy_result result: Result of the operation
+ *
+ *******************************************************************************/
+static cy_rslt_t set_receive_stream(cy_socket_t handle, cmd_stream_t *stream)
+{
+    cy_socket_opt_callback_t tcp_recv_option;
+
+    tcp_recv_option.callback = tcp_client_recv_handler;
+    tcp_recv_option.arg = stream;
+
+    return cy_socket_setsockopt(handle, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_RECEIVE_CALLBACK,
+                                &tcp_recv_option, sizeof(cy_socket_opt_callback_t));
+}
+
 /*******************************************************************************
  * Function Name: create_tcp_client_socket
  *******************************************************************************
@@ -426,8 +2525,15 @@ static cy_rslt_t softap_start(void)
  *  to set call back function for handling incoming messages, call back
  *  function to handle disconnection.
  *
+ * Parameters:
+ *  cy_socket_t *handle: Handle of the created socket
+ *  uint32_t connection_id: ID passed on to the disconnection callback
+ *  cmd_stream_t *stream: Stream passed on to the receive callback; NULL to
+ *                        discard the received data
+ *
  *******************************************************************************/
-cy_rslt_t create_tcp_client_socket()
+cy_rslt_t create_tcp_client_socket(cy_socket_t *handle, uint32_t connection_id,
+                                   cmd_stream_t *stream)
 {
     cy_rslt_t result;
 
@@ -440,12 +2546,11 @@ cy_rslt_t create_tcp_client_socket()
 #endif
 
     /* Variables used to set socket options. */
-    cy_socket_opt_callback_t tcp_recv_option;
     cy_socket_opt_callback_t tcp_disconnect_option;
 
     /* Create a new secure TCP socket. */
     result = cy_socket_create(CY_SOCKET_DOMAIN_AF_INET, CY_SOCKET_TYPE_STREAM,
-                              CY_SOCKET_IPPROTO_TCP, &client_handle);
+                              CY_SOCKET_IPPROTO_TCP, handle);
 
     if (result != CY_RSLT_SUCCESS)
     {
@@ -454,11 +2559,7 @@ cy_rslt_t create_tcp_client_socket()
     }
 
     /* Register the callback function to handle messages received from TCP server. */
-    tcp_recv_option.callback = tcp_client_recv_handler;
-    tcp_recv_option.arg = NULL;
-    result = cy_socket_setsockopt(client_handle, CY_SOCKET_SOL_SOCKET,
-                                  CY_SOCKET_SO_RECEIVE_CALLBACK,
-                                  &tcp_recv_option, sizeof(cy_socket_opt_callback_t));
+    result = set_receive_stream(*handle, stream);
     if (result != CY_RSLT_SUCCESS)
     {
         printf("Set socket option: CY_SOCKET_SO_RECEIVE_CALLBACK failed\n");
@@ -467,9 +2568,9 @@ cy_rslt_t create_tcp_client_socket()
 
     /* Register the callback function to handle disconnection. */
     tcp_disconnect_option.callback = tcp_disconnection_handler;
-    tcp_disconnect_option.arg = NULL;
+    tcp_disconnect_option.arg = (void *)(uintptr_t)connection_id;
 
-    result = cy_socket_setsockopt(client_handle, CY_SOCKET_SOL_SOCKET,
+    result = cy_socket_setsockopt(*handle, CY_SOCKET_SOL_SOCKET,
                                   CY_SOCKET_SO_DISCONNECT_CALLBACK,
                                   &tcp_disconnect_option, sizeof(cy_socket_opt_callback_t));
     if(result != CY_RSLT_SUCCESS)
@@ -479,7 +2580,7 @@ cy_rslt_t create_tcp_client_socket()
 
 #if defined (COMPONENT_LWIP)
     /* Set the TCP keep alive interval. */
-    result = cy_socket_setsockopt(client_handle, CY_SOCKET_SOL_TCP,
+    result = cy_socket_setsockopt(*handle, CY_SOCKET_SOL_TCP,
                                   CY_SOCKET_SO_TCP_KEEPALIVE_INTERVAL,
                                   &keep_alive_interval, sizeof(keep_alive_interval));
     if(result != CY_RSLT_SUCCESS)
@@ -489,7 +2590,7 @@ cy_rslt_t create_tcp_client_socket()
     }
 
     /* Set the retry count for TCP keep alive packet. */
-    result = cy_socket_setsockopt(client_handle, CY_SOCKET_SOL_TCP,
+    result = cy_socket_setsockopt(*handle, CY_SOCKET_SOL_TCP,
                                   CY_SOCKET_SO_TCP_KEEPALIVE_COUNT,
                                   &keep_alive_count, sizeof(keep_alive_count));
     if(result != CY_RSLT_SUCCESS)
@@ -499,7 +2600,7 @@ cy_rslt_t create_tcp_client_socket()
     }
 
     /* Set the network idle time before sending the TCP keep alive packet. */
-    result = cy_socket_setsockopt(client_handle, CY_SOCKET_SOL_TCP,
+    result = cy_socket_setsockopt(*handle, CY_SOCKET_SOL_TCP,
                                   CY_SOCKET_SO_TCP_KEEPALIVE_IDLE_TIME,
                                   &keep_alive_idle_time, sizeof(keep_alive_idle_time));
     if(result != CY_RSLT_SUCCESS)
@@ -510,7 +2611,7 @@ cy_rslt_t create_tcp_client_socket()
 #endif
 
     /* Enable TCP keep alive. */
-    result = cy_socket_setsockopt(client_handle, CY_SOCKET_SOL_SOCKET,
+    result = cy_socket_setsockopt(*handle, CY_SOCKET_SOL_SOCKET,
                                       CY_SOCKET_SO_TCP_KEEPALIVE_ENABLE,
                                           &keep_alive, sizeof(keep_alive));
     if(result != CY_RSLT_SUCCESS)
@@ -526,55 +2627,107 @@ cy_rslt_t create_tcp_client_socket()
  * Function Name: connect_to_tcp_server
  *******************************************************************************
  * Summary:
- *  Function to connect to TCP server.
+ *  Function to make one attempt to connect to TCP server. Called from the
+ *  thread of the connection attempt; the call blocks until the TCP/IP stack
+ *  completes or gives up.
  *
  * Parameters:
- *  cy_socket_sockaddr_t address: Address of TCP server socket
+ *  tcp_connect_attempt_t *attempt: Connection attempt
  *
  * Return:
  *  cy_result result: Result of the operation
  *
  *******************************************************************************/
-cy_rslt_t connect_to_tcp_server(cy_socket_sockaddr_t address)
+cy_rslt_t connect_to_tcp_server(tcp_connect_attempt_t *attempt)
 {
-    cy_rslt_t result = CY_RSLT_MODULE_SECURE_SOCKETS_TIMEOUT;
     cy_rslt_t conn_result;
 
-    for(uint32_t conn_retries = 0; conn_retries < MAX_TCP_SERVER_CONN_RETRIES; conn_retries++)
-    {
-        /* Create a TCP socket */
-        conn_result = create_tcp_client_socket();
-
-        if(conn_result != CY_RSLT_SUCCESS)
-        {
-            printf("Socket creation failed!\n");
-            CY_ASSERT(0);
-        }
-
-        conn_result = cy_socket_connect(client_handle, &address, sizeof(cy_socket_sockaddr_t));
+#if (ZERO_COPY_RX_ENABLED)
+    /* Connect a native lwIP connection whose pbufs are parsed in place. */
+    conn_result = lwip_zc_rx_connect(&attempt->address, attempt->stream,
+                                     zero_copy_disconnection_handler,
+                                     (void *)(uintptr_t)attempt->connection_id);
+#else
+    /* Create a TCP socket */
+    conn_result = create_tcp_client_socket(&attempt->handle, attempt->connection_id,
+                                           attempt->stream);
 
-        if (conn_result == CY_RSLT_SUCCESS)
-        {
-            printf("============================================================\n");
-            printf("Connected to TCP server\n");
+    if(conn_result == CY_RSLT_SUCCESS)
+    {
+        cy_time_t connect_start;
+        cy_time_t connect_end;
 
-            return conn_result;
-        }
+        cy_rtos_get_time(&connect_start);
+        conn_result = cy_socket_connect(attempt->handle, &attempt->address,
+                                        sizeof(cy_socket_sockaddr_t));
+        cy_rtos_get_time(&connect_end);
 
-        printf("Could not connect to TCP server. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
-        printf("Trying to reconnect to TCP server... Please check if the server is listening\n");
+        /* The connect call takes one round trip: SYN to SYN-ACK. */
+        attempt->rtt_ms = (uint32_t)(connect_end - connect_start);
+    }
+    else
+    {
+        printf("Socket creation failed!\n");
+    }
 
+    if ((conn_result != CY_RSLT_SUCCESS) && (attempt->handle != NULL))
+    {
         /* The resources allocated during the socket creation (cy_socket_create)
          * should be deleted.
          */
-        cy_socket_delete(client_handle);
+        cy_socket_delete(attempt->handle);
+    }
+#endif
+
+    return conn_result;
+}
+
+#if (SERVER_SELECTION_ENABLED)
+/*******************************************************************************
+ * Function Name: probe_tcp_server
+ *******************************************************************************
+ * Summary:
+ *  Measures the round-trip time to a TCP server with a short-lived connection.
+ *  The connect call takes one round trip (SYN to SYN-ACK), so it needs no
+ *  support from the server application. Called from the thread of the
+ *  attempt; the connection is closed before returning.
+ *
+ * Parameters:
+ *  tcp_connect_attempt_t *attempt: Probe attempt; rtt_ms is set on success
+ *
+ * Return:
+ *  cy_result result: Result of the operation
+ *
+ *******************************************************************************/
+cy_rslt_t probe_tcp_server(tcp_connect_attempt_t *attempt)
+{
+    cy_rslt_t result;
+    cy_socket_t handle;
+    cy_time_t connect_start;
+    cy_time_t connect_end;
+
+    result = cy_socket_create(CY_SOCKET_DOMAIN_AF_INET, CY_SOCKET_TYPE_STREAM,
+                              CY_SOCKET_IPPROTO_TCP, &handle);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    cy_rtos_get_time(&connect_start);
+    result = cy_socket_connect(handle, &attempt->address, sizeof(cy_socket_sockaddr_t));
+    cy_rtos_get_time(&connect_end);
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        attempt->rtt_ms = (uint32_t)(connect_end - connect_start);
+        cy_socket_disconnect(handle, 0);
     }
 
-     /* Stop retrying after maximum retry attempts. */
-     printf("Exceeded maximum connection attempts to the TCP server\n");
+    cy_socket_delete(handle);
 
-     return result;
+    return result;
 }
+#endif /* SERVER_SELECTION_ENABLED */
 
 /*******************************************************************************
  * Function Name: tcp_client_recv_handler
@@ -584,7 +2737,7 @@ cy_rslt_t connect_to_tcp_server(cy_socket_sockaddr_t address)
  *
  * Parameters:
  *  cy_socket_t socket_handle: Connection handle for the TCP client socket
- *  void *args : Parameter passed on to the function (unused)
+ *  void *args : Command stream of the connection; NULL to discard the data
  *
  * Return:
  *  cy_result result: Result of the operation
@@ -592,81 +2745,270 @@ cy_rslt_t connect_to_tcp_server(cy_socket_sockaddr_t address)
  *******************************************************************************/
 cy_rslt_t tcp_client_recv_handler(cy_socket_t socket_handle, void *arg)
 {
-    /* Variable to store number of bytes send to the TCP server. */
-    uint32_t bytes_sent = 0;
+    cy_rslt_t result ;
+    cmd_stream_t *stream = (cmd_stream_t *)arg;
 
-    /* Variable to store number of bytes received. */
-    uint32_t bytes_received = 0;
+    cy_rtos_mutex_get(&tcp_rx_mutex, CY_RTOS_NEVER_TIMEOUT);
+    result = tcp_client_receive_all(socket_handle, stream);
+    cy_rtos_mutex_set(&tcp_rx_mutex);
 
-    char message_buffer[MAX_TCP_DATA_PACKET_LENGTH];
-    cy_rslt_t result ;
+    return result;
+}
 
-    printf("============================================================\n");
-    result = cy_socket_recv(socket_handle, message_buffer, TCP_LED_CMD_LEN,
-                            CY_SOCKET_FLAGS_NONE, &bytes_received);
+/*******************************************************************************
+ * Function Name: tcp_client_receive
+ *******************************************************************************
+ * Summary:
+ *  Reads what is available on a connection, without waiting, and passes it
+ *  to its command stream. Nothing is read while the stream is stalled on a
+ *  full flash download buffer; the data stays in the socket, which closes
+ *  the receive window, until tcp_client_resume_receive.
+ *
+ * Parameters:
+ *  cy_socket_t handle: Socket of the connection
+ *  cmd_stream_t *stream: Command stream of the connection; NULL to discard
+ *                        the data
+ *  uint32_t *bytes_received: Set to the number of bytes read
+ *
+ * Return:
+ *  cy_rslt_t: Result of the operation
+ *
+ *******************************************************************************/
+static cy_rslt_t tcp_client_receive(cy_socket_t handle, cmd_stream_t *stream,
+                                    uint32_t *bytes_received)
+{
+    uint8_t message_buffer[MAX_TCP_DATA_PACKET_LENGTH];
+    cy_rslt_t result;
+    uint8_t *bulk_buffer;
+    uint32_t bulk_length;
 
-    if(message_buffer[0] == LED_ON_CMD)
+    *bytes_received = 0;
+    if (stream == NULL)
     {
-        /* Turn the LED ON. */
-        cyhal_gpio_write(CYBSP_USER_LED, CYBSP_LED_STATE_ON);
-        printf("LED turned ON\n");
-        sprintf(message_buffer, ACK_LED_ON);
+        /* A standby connection; read so that its receive window stays open. */
+        return cy_socket_recv(handle, message_buffer, MAX_TCP_DATA_PACKET_LENGTH,
+                              CY_SOCKET_FLAGS_DONTWAIT, bytes_received);
     }
-    else if(message_buffer[0] == LED_OFF_CMD)
+
+    if (stream->stalled)
     {
-        /* Turn the LED OFF. */
-        cyhal_gpio_write(CYBSP_USER_LED, CYBSP_LED_STATE_OFF);
-        printf("LED turned OFF\n");
-        sprintf(message_buffer, ACK_LED_OFF);
+        return CY_RSLT_SUCCESS;
     }
-    else
+
+    /* The image of a bulk download is received straight into the flash
+     * download buffer, as much as is available without waiting.
+     */
+    if (cmd_stream_get_bulk_buffer(stream, &bulk_buffer, &bulk_length))
     {
-        printf("Invalid command\n");
-        sprintf(message_buffer, MSG_INVALID_CMD);
+        if (bulk_length == 0)
+        {
+            return CY_RSLT_SUCCESS;
+        }
+
+        result = cy_socket_recv(handle, bulk_buffer, bulk_length,
+                                CY_SOCKET_FLAGS_DONTWAIT, bytes_received);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+
+        return cmd_stream_commit_bulk(stream, *bytes_received);
     }
 
-    /* Send acknowledgment to the TCP server in receipt of the message received. */
-    result = cy_socket_send(socket_handle, message_buffer, strlen(message_buffer),
-                            CY_SOCKET_FLAGS_NONE, &bytes_sent);
-    if(result == CY_RSLT_SUCCESS)
+    /* The data may have been read already by tcp_client_resume_receive. */
+    result = cy_socket_recv(handle, message_buffer, MAX_TCP_DATA_PACKET_LENGTH,
+                            CY_SOCKET_FLAGS_DONTWAIT, bytes_received);
+    if(result != CY_RSLT_SUCCESS)
     {
-        printf("Acknowledgment sent to TCP server\n");
+        return result;
     }
 
+    return cmd_stream_process(stream, message_buffer, *bytes_received);
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_receive_all
+ *******************************************************************************
+ * Summary:
+ *  Reads a connection until its socket is empty or its stream stalls. The
+ *  socket callback fires once per arriving segment, so data left after one
+ *  read would wait for the next segment, which may never come. Called with
+ *  tcp_rx_mutex held.
+ *
+ *******************************************************************************/
+static cy_rslt_t tcp_client_receive_all(cy_socket_t handle, cmd_stream_t *stream)
+{
+    uint32_t bytes_received;
+    cy_rslt_t result;
+
+    do
+    {
+        result = tcp_client_receive(handle, stream, &bytes_received);
+    } while ((result == CY_RSLT_SUCCESS) && (bytes_received > 0));
+
     return result;
 }
 
 /*******************************************************************************
- * Function Name: tcp_disconnection_handler
+ * Function Name: tcp_client_drain
+ *******************************************************************************
+ * Summary:
+ *  Continues a stalled command stream and reads the data left in its socket,
+ *  until the socket is empty or the stream stalls again.
+ *
+ *******************************************************************************/
+static void tcp_client_drain(cy_socket_t handle, cmd_stream_t *stream)
+{
+    cy_rtos_mutex_get(&tcp_rx_mutex, CY_RTOS_NEVER_TIMEOUT);
+
+    cmd_stream_resume(stream, 0);
+    (void)tcp_client_receive_all(handle, stream);
+
+    cy_rtos_mutex_set(&tcp_rx_mutex);
+}
+
+/*******************************************************************************
+ * Function Name: tcp_client_resume_receive
+ *******************************************************************************
+ * Summary:
+ *  Reads the connections again once a flash download buffer is free. The
+ *  socket callbacks fire only when new data arrives, which it does not while
+ *  the receive window is closed, so the data left in the sockets is read
+ *  here. The zero-copy receive thread waits for the buffer itself.
+ *
+ *******************************************************************************/
+static void tcp_client_resume_receive(void)
+{
+#if !(ZERO_COPY_RX_ENABLED)
+    if (tcp_cmd_stream.stalled)
+    {
+        tcp_client_drain(client_handle, &tcp_cmd_stream);
+    }
+#endif
+#if (CONTROL_SOCKET_ENABLED)
+    if ((control_connection_id != 0) && tcp_control_stream.stalled)
+    {
+        tcp_client_drain(control_handle, &tcp_control_stream);
+    }
+#endif
+}
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+/*******************************************************************************
+ * Function Name: tcp_client_bulk_resume
  *******************************************************************************
  * Summary:
- *  Callback function to handle TCP socket disconnection event.
+ *  Called by the flash download thread when it frees a buffer that a receive
+ *  callback found full.
+ *
+ *******************************************************************************/
+static void tcp_client_bulk_resume(void *arg)
+{
+    (void)arg;
+
+    tcp_client_post_event(TCP_CLIENT_EVENT_BULK_RESUME, 0);
+}
+#endif
+
+/*******************************************************************************
+ * Function Name: send_to_tcp_server
+ *******************************************************************************
+ * Summary:
+ *  Sends data, such as command acknowledgments, to the TCP server over the
+ *  active connection.
  *
  * Parameters:
- *  cy_socket_t socket_handle: Connection handle for the TCP client socket
- *  void *args : Parameter passed on to the function (unused)
+ *  const uint8_t *data: Data to be sent
+ *  uint32_t length: Number of bytes to be sent
+ *  void *arg : Parameter passed on to the function (unused)
  *
  * Return:
  *  cy_result result: Result of the operation
  *
  *******************************************************************************/
-cy_rslt_t tcp_disconnection_handler(cy_socket_t socket_handle, void *arg)
+static cy_rslt_t send_to_tcp_server(const uint8_t *data, uint32_t length, void *arg)
 {
-    cy_rslt_t result;
+#if (ZERO_COPY_RX_ENABLED)
+    return lwip_zc_rx_send(data, length);
+#else
+    /* Variable to store number of bytes send to the TCP server. */
+    uint32_t bytes_sent = 0;
 
-    /* Disconnect the TCP client. */
-    result = cy_socket_disconnect(socket_handle, 0);
+    return cy_socket_send(client_handle, data, length, CY_SOCKET_FLAGS_NONE, &bytes_sent);
+#endif
+}
 
-    /* Free the resources allocated to the socket. */
-    cy_socket_delete(socket_handle);
+#if (CONTROL_SOCKET_ENABLED)
+/*******************************************************************************
+ * Function Name: send_to_control_socket
+ *******************************************************************************
+ * Summary:
+ *  Sends data to the TCP server over the control connection. Commands can
+ *  arrive before the connection is ready for sending; their acknowledgments
+ *  are sent over the command connection, which the server accepts as well.
+ *
+ * Parameters:
+ *  const uint8_t *data: Data to be sent
+ *  uint32_t length: Number of bytes to be sent
+ *  void *arg : Parameter passed on to the function (unused)
+ *
+ * Return:
+ *  cy_result result: Result of the operation
+ *
+ *******************************************************************************/
+static cy_rslt_t send_to_control_socket(const uint8_t *data, uint32_t length, void *arg)
+{
+    /* Variable to store number of bytes send to the TCP server. */
+    uint32_t bytes_sent = 0;
 
-    printf("Disconnected from the TCP server! \n");
+    if (control_connection_id == 0)
+    {
+        return send_to_tcp_server(data, length, arg);
+    }
 
-    /* Give the semaphore so as to connect to TCP server. */
-    cy_rtos_semaphore_set(&connect_to_server);
+    return cy_socket_send(control_handle, data, length, CY_SOCKET_FLAGS_NONE, &bytes_sent);
+}
+#endif
 
-    return result;
+/*******************************************************************************
+ * Function Name: tcp_disconnection_handler
+ *******************************************************************************
+ * Summary:
+ *  Callback function to handle TCP socket disconnection event. The socket is
+ *  closed by the TCP client task.
+ *
+ * Parameters:
+ *  cy_socket_t socket_handle: Connection handle for the TCP client socket
+ *  void *args : ID of the connection
+ *
+ * Return:
+ *  cy_result result: Result of the operation
+ *
+ *******************************************************************************/
+cy_rslt_t tcp_disconnection_handler(cy_socket_t socket_handle, void *arg)
+{
+    tcp_client_post_event(TCP_CLIENT_EVENT_SERVER_LOST, (uint32_t)(uintptr_t)arg);
+
+    return CY_RSLT_SUCCESS;
+}
+
+#if (ZERO_COPY_RX_ENABLED)
+/*******************************************************************************
+ * Function Name: zero_copy_disconnection_handler
+ *******************************************************************************
+ * Summary:
+ *  Callback function to handle disconnection of the zero-copy lwIP connection.
+ *  The connection resources are already freed by the receive thread.
+ *
+ * Parameters:
+ *  void *args : ID of the connection
+ *
+ *******************************************************************************/
+static void zero_copy_disconnection_handler(void *arg)
+{
+    tcp_client_post_event(TCP_CLIENT_EVENT_SERVER_LOST, (uint32_t)(uintptr_t)arg);
 }
+#endif
 
 /*******************************************************************************
  * Function Name: read_uart_input
@@ -710,7 +3052,11 @@ void read_uart_input(uint8_t* input_buffer_ptr)
 
                     if (*ptr != '\b')
                     {
-                        ptr++;
+                        /* Keep room for the terminating NULL character. */
+                        if (ptr < (input_buffer_ptr + UART_INPUT_BUFFER_SIZE - 1))
+                        {
+                            ptr++;
+                        }
                     }
                     else if(ptr != input_buffer_ptr)
                     {
@@ -0,0 +1,532 @@
+/******************************************************************************
+* File Name:   telemetry_buffer.c
+*
+* Description: This file contains the RAM buffer of the telemetry records that
+* the client reports to the TCP server. Records are kept in a ring while the
+* client is disconnected, with the oldest dropped when the ring is full. Once
+* connected, the records are sent in batches of up to one TCP segment each
+* rather than one send per record.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* Telemetry buffer header file. */
+#include "telemetry_buffer.h"
+
+/* Flash download header file, for the kits with external flash. */
+#include "flash_download.h"
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+/* Event log header file. Records that overflow the RAM buffer are kept in the
+ * event log on the external flash.
+ */
+#include "event_log.h"
+
+#if (TELEMETRY_RECORD_DATA_SIZE > EVENT_LOG_RECORD_DATA_SIZE)
+#error "Telemetry records do not fit in the event log"
+#endif
+#endif
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Size of the count of dropped records at the start of a telemetry frame. */
+#define TELEMETRY_FRAME_HEADER_SIZE               (4u)
+
+/* Size of a record in a telemetry frame, without its data. */
+#define TELEMETRY_RECORD_HEADER_SIZE              (6u)
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+typedef struct
+{
+    uint32_t timestamp_ms;
+    uint8_t type;
+    uint8_t length;
+    uint8_t data[TELEMETRY_RECORD_DATA_SIZE];
+} telemetry_record_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static uint32_t encode_record(const telemetry_record_t *record, uint8_t *buffer);
+static void put_be32(uint8_t *buffer, uint32_t value);
+#if (FLASH_DOWNLOAD_SUPPORTED)
+static cy_rslt_t telemetry_spill_init(void);
+static void telemetry_spill_thread(cy_thread_arg_t arg);
+static cy_rslt_t replay_event_log(cmd_stream_t *stream);
+#endif
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static cy_mutex_t telemetry_mutex;
+static telemetry_notify_fn_t telemetry_notify;
+
+/* Ring of records. The counters run freely; the record of a counter value is
+ * at that value modulo TELEMETRY_BUFFER_RECORD_COUNT. Records from
+ * telemetry_tail up to telemetry_head are waiting to be sent.
+ */
+static telemetry_record_t telemetry_records[TELEMETRY_BUFFER_RECORD_COUNT];
+static uint32_t telemetry_head;
+static uint32_t telemetry_tail;
+static uint32_t telemetry_dropped;
+static uint32_t telemetry_peak;
+
+/* Telemetry frame being built. Only the flushing thread uses it. */
+static uint8_t telemetry_batch[TELEMETRY_BUFFER_BATCH_SIZE];
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+/* Whether records that overflow the RAM buffer go to the event log. They
+ * are queued for the spill thread, which appends them.
+ */
+static bool telemetry_spill;
+static cy_queue_t spill_queue;
+static cy_thread_t spill_thread;
+#endif
+
+/*******************************************************************************
+ * Function Name: telemetry_buffer_init
+ *******************************************************************************
+ * Summary:
+ *  Initializes the telemetry buffer, and the event log behind it on kits with
+ *  external flash.
+ *
+ * Parameters:
+ *  telemetry_notify_fn_t notify_fn: Called when a record is added to an
+ *  empty buffer, or NULL
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an RTOS error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t telemetry_buffer_init(telemetry_notify_fn_t notify_fn)
+{
+    cy_rslt_t result;
+
+    telemetry_notify = notify_fn;
+    telemetry_head = 0;
+    telemetry_tail = 0;
+    telemetry_dropped = 0;
+    telemetry_peak = 0;
+
+    result = cy_rtos_mutex_init(&telemetry_mutex, false);
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    telemetry_spill = (result == CY_RSLT_SUCCESS) && (event_log_init() == CY_RSLT_SUCCESS) &&
+                      (telemetry_spill_init() == CY_RSLT_SUCCESS);
+    if (!telemetry_spill)
+    {
+        printf("Event log not available, telemetry overflow is dropped\n");
+    }
+#endif
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_buffer_add
+ *******************************************************************************
+ * Summary:
+ *  Adds a timestamped record to the buffer. If the buffer is full, the oldest
+ *  record is queued for the event log, or is dropped if there is none or the
+ *  queue is full. Never waits for the flash. Data beyond
+ *  TELEMETRY_RECORD_DATA_SIZE is cut off.
+ *
+ * Parameters:
+ *  uint8_t type: Record type, one of TELEMETRY_RECORD_*
+ *  const uint8_t *data: Record data
+ *  uint32_t length: Length of the data
+ *
+ *******************************************************************************/
+void telemetry_buffer_add(uint8_t type, const uint8_t *data, uint32_t length)
+{
+    telemetry_record_t *record;
+    cy_time_t now;
+    bool was_empty;
+
+    if (length > TELEMETRY_RECORD_DATA_SIZE)
+    {
+        length = TELEMETRY_RECORD_DATA_SIZE;
+    }
+
+    cy_rtos_get_time(&now);
+
+    cy_rtos_mutex_get(&telemetry_mutex, CY_RTOS_NEVER_TIMEOUT);
+    was_empty = (telemetry_head == telemetry_tail);
+    if ((telemetry_head - telemetry_tail) == TELEMETRY_BUFFER_RECORD_COUNT)
+    {
+    #if (FLASH_DOWNLOAD_SUPPORTED)
+        record = &telemetry_records[telemetry_tail % TELEMETRY_BUFFER_RECORD_COUNT];
+        if (!telemetry_spill ||
+            (cy_rtos_queue_put(&spill_queue, record, 0) != CY_RSLT_SUCCESS))
+        {
+            telemetry_dropped++;
+        }
+    #else
+        telemetry_dropped++;
+    #endif
+        telemetry_tail++;
+    }
+
+    record = &telemetry_records[telemetry_head % TELEMETRY_BUFFER_RECORD_COUNT];
+    record->timestamp_ms = (uint32_t)now;
+    record->type = type;
+    record->length = (uint8_t)length;
+    if (length > 0)
+    {
+        memcpy(record->data, data, length);
+    }
+    telemetry_head++;
+
+    if ((telemetry_head - telemetry_tail) > telemetry_peak)
+    {
+        telemetry_peak = telemetry_head - telemetry_tail;
+    }
+    cy_rtos_mutex_set(&telemetry_mutex);
+
+    if (was_empty && (telemetry_notify != NULL))
+    {
+        telemetry_notify();
+    }
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_buffer_add_value
+ *******************************************************************************
+ * Summary:
+ *  Adds a record whose data is one 32-bit value.
+ *
+ * Parameters:
+ *  uint8_t type: Record type, one of TELEMETRY_RECORD_*
+ *  uint32_t value: Record data
+ *
+ *******************************************************************************/
+void telemetry_buffer_add_value(uint8_t type, uint32_t value)
+{
+    uint8_t data[4];
+
+    put_be32(data, value);
+    telemetry_buffer_add(type, data, sizeof(data));
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_buffer_flush
+ *******************************************************************************
+ * Summary:
+ *  Sends the buffered records in frames of up to TELEMETRY_BUFFER_BATCH_SIZE
+ *  bytes, those in the event log first as they are older. A record still
+ *  queued for the event log is sent with the next flush. Records leave the
+ *  buffer only once their frame is sent, so a failed send keeps them for the
+ *  next connection. The backlog and the flush throughput are printed.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream of the connection to the TCP server
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, the send error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t telemetry_buffer_flush(cmd_stream_t *stream)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t backlog;
+    uint32_t sequence;
+    uint32_t batch_length;
+    uint32_t record_length;
+    uint32_t batch_records;
+    uint32_t sent_records = 0;
+    uint32_t sent_bytes = 0;
+    uint32_t sent_frames = 0;
+    uint32_t elapsed_ms;
+    cy_time_t start_time;
+    cy_time_t end_time;
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+    result = replay_event_log(stream);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+#endif
+
+    cy_rtos_get_time(&start_time);
+
+    cy_rtos_mutex_get(&telemetry_mutex, CY_RTOS_NEVER_TIMEOUT);
+    backlog = telemetry_head - telemetry_tail;
+    cy_rtos_mutex_set(&telemetry_mutex);
+
+    for (;;)
+    {
+        /* Copy as many records as fit in one frame, oldest first. */
+        cy_rtos_mutex_get(&telemetry_mutex, CY_RTOS_NEVER_TIMEOUT);
+        put_be32(telemetry_batch, telemetry_dropped);
+        batch_length = TELEMETRY_FRAME_HEADER_SIZE;
+        for (sequence = telemetry_tail; sequence != telemetry_head; sequence++)
+        {
+            const telemetry_record_t *record =
+                &telemetry_records[sequence % TELEMETRY_BUFFER_RECORD_COUNT];
+
+            record_length = TELEMETRY_RECORD_HEADER_SIZE + record->length;
+            if ((batch_length + record_length) > TELEMETRY_BUFFER_BATCH_SIZE)
+            {
+                break;
+            }
+            batch_length += encode_record(record, &telemetry_batch[batch_length]);
+        }
+        batch_records = sequence - telemetry_tail;
+        cy_rtos_mutex_set(&telemetry_mutex);
+
+        if (batch_records == 0)
+        {
+            break;
+        }
+
+        result = cmd_stream_send_frame(stream, CMD_FRAME_TELEMETRY, telemetry_batch, batch_length);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            break;
+        }
+
+        /* Records dropped while the frame was sent are already gone. */
+        cy_rtos_mutex_get(&telemetry_mutex, CY_RTOS_NEVER_TIMEOUT);
+        if ((int32_t)(sequence - telemetry_tail) > 0)
+        {
+            telemetry_tail = sequence;
+        }
+        cy_rtos_mutex_set(&telemetry_mutex);
+
+        sent_records += batch_records;
+        sent_bytes += CMD_FRAME_HEADER_SIZE + batch_length;
+        sent_frames++;
+    }
+
+    if (sent_frames > 0)
+    {
+        cy_rtos_get_time(&end_time);
+        elapsed_ms = (uint32_t)(end_time - start_time);
+        if (elapsed_ms == 0)
+        {
+            elapsed_ms = 1;
+        }
+
+        /* Bytes per ms are kB/s. */
+        printf("Telemetry flushed: %"PRIu32" records, %"PRIu32" bytes in %"PRIu32" frames, "
+               "%"PRIu32" ms, %"PRIu32" kB/s (backlog %"PRIu32", peak %"PRIu32", dropped %"PRIu32")\n",
+               sent_records, sent_bytes, sent_frames, elapsed_ms, sent_bytes / elapsed_ms,
+               backlog, telemetry_peak, telemetry_dropped);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Telemetry flush failed! Error: 0x%08"PRIx32"\n", (uint32_t)result);
+    }
+
+    return result;
+}
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+/*******************************************************************************
+ * Function Name: telemetry_spill_init
+ *******************************************************************************
+ * Summary:
+ *  Creates the queue of the records that overflow the RAM buffer, and the
+ *  thread that appends them to the event log.
+ *
+ *******************************************************************************/
+static cy_rslt_t telemetry_spill_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_queue_init(&spill_queue, TELEMETRY_SPILL_QUEUE_LENGTH,
+                                sizeof(telemetry_record_t));
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_thread_create(&spill_thread, telemetry_spill_thread, "Telemetry spill",
+                                       NULL, TELEMETRY_SPILL_THREAD_STACK_SIZE,
+                                       TELEMETRY_SPILL_THREAD_PRIORITY, NULL);
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_spill_thread
+ *******************************************************************************
+ * Summary:
+ *  Appends the queued records to the event log. An append may erase a
+ *  segment, which takes far longer than the task adding records may wait.
+ *  A record that cannot be appended, for example while a download keeps the
+ *  log off the flash, is counted as dropped.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void telemetry_spill_thread(cy_thread_arg_t arg)
+{
+    telemetry_record_t record;
+
+    for (;;)
+    {
+        if (cy_rtos_queue_get(&spill_queue, &record, CY_RTOS_NEVER_TIMEOUT) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+
+        if (event_log_append(record.timestamp_ms, record.type, record.data,
+                             record.length) != CY_RSLT_SUCCESS)
+        {
+            cy_rtos_mutex_get(&telemetry_mutex, CY_RTOS_NEVER_TIMEOUT);
+            telemetry_dropped++;
+            cy_rtos_mutex_set(&telemetry_mutex);
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: replay_event_log
+ *******************************************************************************
+ * Summary:
+ *  Sends the records of the event log in telemetry frames, streaming the log
+ *  in order, and prints the replay throughput. Records are consumed only
+ *  once their frame is sent.
+ *
+ *******************************************************************************/
+static cy_rslt_t replay_event_log(cmd_stream_t *stream)
+{
+    event_log_position_t next;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t batch_length;
+    uint32_t batch_records;
+    uint32_t sent_records = 0;
+    uint32_t sent_bytes = 0;
+    uint32_t elapsed_ms;
+    cy_time_t start_time;
+    cy_time_t end_time;
+
+    if (!telemetry_spill)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    cy_rtos_get_time(&start_time);
+
+    for (;;)
+    {
+        put_be32(telemetry_batch, telemetry_dropped);
+        batch_length = TELEMETRY_FRAME_HEADER_SIZE +
+                       event_log_read(&telemetry_batch[TELEMETRY_FRAME_HEADER_SIZE],
+                                      TELEMETRY_BUFFER_BATCH_SIZE - TELEMETRY_FRAME_HEADER_SIZE,
+                                      &batch_records, &next);
+        if (batch_records == 0)
+        {
+            break;
+        }
+
+        result = cmd_stream_send_frame(stream, CMD_FRAME_TELEMETRY, telemetry_batch, batch_length);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            printf("Event log replay failed! Error: 0x%08"PRIx32"\n", (uint32_t)result);
+            break;
+        }
+
+        event_log_consume(&next);
+        sent_records += batch_records;
+        sent_bytes += CMD_FRAME_HEADER_SIZE + batch_length;
+    }
+
+    if (sent_records > 0)
+    {
+        cy_rtos_get_time(&end_time);
+        elapsed_ms = (uint32_t)(end_time - start_time);
+        if (elapsed_ms == 0)
+        {
+            elapsed_ms = 1;
+        }
+
+        /* Bytes per ms are kB/s. */
+        printf("Event log replayed: %"PRIu32" records, %"PRIu32" bytes, %"PRIu32" ms, %"PRIu32" kB/s\n",
+               sent_records, sent_bytes, elapsed_ms, sent_bytes / elapsed_ms);
+    }
+
+    return result;
+}
+#endif /* FLASH_DOWNLOAD_SUPPORTED */
+
+/*******************************************************************************
+ * Function Name: encode_record
+ *******************************************************************************
+ * Summary:
+ *  Writes a record in the format of the telemetry frame and returns its
+ *  length.
+ *
+ *******************************************************************************/
+static uint32_t encode_record(const telemetry_record_t *record, uint8_t *buffer)
+{
+    put_be32(buffer, record->timestamp_ms);
+    buffer[4] = record->type;
+    buffer[5] = record->length;
+    memcpy(&buffer[TELEMETRY_RECORD_HEADER_SIZE], record->data, record->length);
+
+    return TELEMETRY_RECORD_HEADER_SIZE + record->length;
+}
+
+/*******************************************************************************
+ * Function Name: put_be32
+ *******************************************************************************
+ * Summary:
+ *  Writes a 32-bit value in network byte order.
+ *
+ *******************************************************************************/
+static void put_be32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)(value >> 24);
+    buffer[1] = (uint8_t)(value >> 16);
+    buffer[2] = (uint8_t)(value >> 8);
+    buffer[3] = (uint8_t)value;
+}
+
+
+/* [] END OF FILE */
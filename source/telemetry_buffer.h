@@ -0,0 +1,108 @@
+/******************************************************************************
+* File Name:   telemetry_buffer.h
+*
+* Description: This file contains declarations of the RAM buffer of the
+* telemetry records that the client reports to the TCP server.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef TELEMETRY_BUFFER_H_
+#define TELEMETRY_BUFFER_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include "cy_result.h"
+
+/* Command parser header file, for the stream that the records are sent on. */
+#include "cmd_parser.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of records kept while the client cannot send them. When the buffer
+ * is full, the oldest record is dropped.
+ */
+#ifndef TELEMETRY_BUFFER_RECORD_COUNT
+#define TELEMETRY_BUFFER_RECORD_COUNT             (64u)
+#endif
+
+/* Largest data of a record. */
+#define TELEMETRY_RECORD_DATA_SIZE                (8u)
+
+/* Largest payload of a telemetry frame. With the frame header, a frame fills
+ * one TCP segment of the default MSS.
+ */
+#ifndef TELEMETRY_BUFFER_BATCH_SIZE
+#define TELEMETRY_BUFFER_BATCH_SIZE               (1456u)
+#endif
+
+/* Number of records on their way from the RAM buffer to the event log, and
+ * the stack size and priority of the thread that appends them. The thread
+ * keeps the flash erase of a full log segment off the task that adds the
+ * records.
+ */
+#ifndef TELEMETRY_SPILL_QUEUE_LENGTH
+#define TELEMETRY_SPILL_QUEUE_LENGTH              (8u)
+#endif
+#ifndef TELEMETRY_SPILL_THREAD_STACK_SIZE
+#define TELEMETRY_SPILL_THREAD_STACK_SIZE         (1024u)
+#endif
+#ifndef TELEMETRY_SPILL_THREAD_PRIORITY
+#define TELEMETRY_SPILL_THREAD_PRIORITY           (CY_RTOS_PRIORITY_BELOWNORMAL)
+#endif
+
+/* Record types. The data of each is given in brackets. */
+#define TELEMETRY_RECORD_WIFI_DOWN                (1u)    /* none */
+#define TELEMETRY_RECORD_WIFI_UP                  (2u)    /* none */
+#define TELEMETRY_RECORD_SERVER_LOST              (3u)    /* endpoint index */
+#define TELEMETRY_RECORD_CONNECT_FAILED           (4u)    /* result code */
+#define TELEMETRY_RECORD_CONNECTED                (5u)    /* connect time in ms */
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Called when a record is added to an empty buffer, so that it is sent. */
+typedef void (*telemetry_notify_fn_t)(void);
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t telemetry_buffer_init(telemetry_notify_fn_t notify_fn);
+void telemetry_buffer_add(uint8_t type, const uint8_t *data, uint32_t length);
+void telemetry_buffer_add_value(uint8_t type, uint32_t value);
+cy_rslt_t telemetry_buffer_flush(cmd_stream_t *stream);
+
+#endif /* TELEMETRY_BUFFER_H_ */
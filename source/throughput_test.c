@@ -0,0 +1,126 @@
+/******************************************************************************
+* File Name:   throughput_test.c
+*
+* Description: This file contains the TCP uplink throughput test. On request
+* from the TCP server, the client sends a fixed amount of data as fast as the
+* network stack accepts it and reports the achieved rate.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* Throughput test header file. */
+#include "throughput_test.h"
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Test pattern sent to the TCP server. */
+static uint8_t throughput_pattern[THROUGHPUT_TEST_CHUNK_SIZE];
+
+/*******************************************************************************
+ * Function Name: throughput_test_uplink
+ *******************************************************************************
+ * Summary:
+ *  Sends THROUGHPUT_TEST_BYTES to the TCP server and prints the elapsed time
+ *  and the achieved throughput.
+ *
+ * Parameters:
+ *  throughput_send_fn_t send_fn: Function used to send the test data
+ *  void *send_arg: Argument passed on to send_fn
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, the send error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t throughput_test_uplink(throughput_send_fn_t send_fn, void *send_arg)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    cy_time_t start_ms;
+    cy_time_t end_ms;
+    uint32_t sent = 0;
+    uint32_t chunk;
+    uint32_t elapsed_ms;
+
+    for (uint32_t index = 0; index < THROUGHPUT_TEST_CHUNK_SIZE; index++)
+    {
+        throughput_pattern[index] = (uint8_t)index;
+    }
+
+    printf("Uplink throughput test: sending %"PRIu32" bytes\n", (uint32_t)THROUGHPUT_TEST_BYTES);
+
+    cy_rtos_get_time(&start_ms);
+
+    while (sent < THROUGHPUT_TEST_BYTES)
+    {
+        chunk = THROUGHPUT_TEST_BYTES - sent;
+        if (chunk > THROUGHPUT_TEST_CHUNK_SIZE)
+        {
+            chunk = THROUGHPUT_TEST_CHUNK_SIZE;
+        }
+
+        result = send_fn(throughput_pattern, chunk, send_arg);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            printf("Uplink throughput test failed after %"PRIu32" bytes. Error code: 0x%08"PRIx32"\n",
+                   sent, (uint32_t)result);
+            return result;
+        }
+
+        sent += chunk;
+    }
+
+    cy_rtos_get_time(&end_ms);
+
+    elapsed_ms = (uint32_t)(end_ms - start_ms);
+    if (elapsed_ms == 0)
+    {
+        elapsed_ms = 1;
+    }
+
+    printf("Uplink throughput test: %"PRIu32" bytes in %"PRIu32" ms (%"PRIu32" kbit/s)\n",
+           sent, elapsed_ms, (uint32_t)(((uint64_t)sent * 8u) / elapsed_ms));
+
+    return result;
+}
+
+
+/* [] END OF FILE */
@@ -0,0 +1,75 @@
+/******************************************************************************
+* File Name:   throughput_test.h
+*
+* Description: This file contains declarations of the TCP uplink throughput
+* test used to compare network stack configuration profiles.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef THROUGHPUT_TEST_H_
+#define THROUGHPUT_TEST_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of bytes sent by one uplink test run. Must match the value used by
+ * tcp_throughput_server.py.
+ */
+#ifndef THROUGHPUT_TEST_BYTES
+#define THROUGHPUT_TEST_BYTES                     (1024u * 1024u)
+#endif
+
+/* Number of bytes passed to the network stack per send call. */
+#ifndef THROUGHPUT_TEST_CHUNK_SIZE
+#define THROUGHPUT_TEST_CHUNK_SIZE                (1460u)
+#endif
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Function used to send the test data to the TCP server. */
+typedef cy_rslt_t (*throughput_send_fn_t)(const uint8_t *data, uint32_t length, void *arg);
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t throughput_test_uplink(throughput_send_fn_t send_fn, void *send_arg);
+
+#endif /* THROUGHPUT_TEST_H_ */
@@ -0,0 +1,630 @@
+/******************************************************************************
+* File Name:   udp_command.c
+*
+* Description: This file contains the UDP command channel. A lost segment
+* on a TCP connection holds back every command behind it until it is
+* retransmitted. Over UDP each command is a datagram of its own, so a lost
+* datagram delays only its own command, which the server retransmits alone.
+* Only idempotent commands use this channel: a command that arrives twice
+* is applied once, and a command that arrives after a newer one is not
+* applied at all, since the newer one already set the state. All other
+* commands, and all commands while the UDP path is not working, go over the
+* TCP connection.
+* A client can also join a multicast group, so that the server reaches every
+* client with one datagram per command instead of one per client. Each
+* client acknowledges the group commands on its own, and reports the last
+* one it received in every open datagram, so that the server can repair a
+* loss with a datagram to that client alone.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* UDP command header file. */
+#include "udp_command.h"
+
+/* Command parser header file, for the frame format and the commands. */
+#include "cmd_parser.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Payload lengths of the UDP frames. */
+#define UDP_OPEN_LENGTH                           (4u)
+#define UDP_OPEN_GROUP_LENGTH                     (12u)
+#define UDP_COMMAND_LENGTH                        (9u)
+#define UDP_ACK_HEADER_LENGTH                     (12u)
+
+/* Largest datagram received or sent. */
+#define UDP_DATAGRAM_SIZE                         (CMD_FRAME_HEADER_SIZE + CMD_FRAME_MAX_PAYLOAD)
+
+/* Number of sequence numbers below the highest one that are remembered, one
+ * bit each.
+ */
+#define UDP_DEDUP_WINDOW                          (32u)
+
+/* Number of earlier group epochs that are remembered. A group command of one
+ * of them was delayed past the start of the current epoch and is dropped.
+ */
+#define UDP_GROUP_EPOCH_HISTORY                   (4u)
+
+/* Acknowledgments of the commands that are not applied: one received after
+ * a newer command, and one received before.
+ */
+#define ACK_SUPERSEDED                            "SUPERSEDED"
+#define ACK_DUPLICATE                             "DUPLICATE"
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+/* Sequence numbers received in an epoch: the highest one, and the ones below
+ * it in a bitmap where bit n stands for the highest number minus n.
+ */
+typedef struct
+{
+    uint32_t epoch;
+    uint32_t highest;
+    uint32_t window;
+} udp_sequence_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static cy_rslt_t udp_command_recv_handler(cy_socket_t socket_handle, void *arg);
+static void udp_command_receive(const uint8_t *datagram, uint32_t length,
+                                const cy_socket_sockaddr_t *source);
+static bool udp_command_group_epoch(uint32_t epoch);
+static const char *udp_command_accept(udp_sequence_t *sequence, uint32_t seq, uint8_t command);
+static cy_rslt_t udp_command_set_group(cy_socket_t handle, int option);
+static void udp_command_thread(cy_thread_arg_t arg);
+static cy_rslt_t udp_command_send(const uint8_t *datagram, uint32_t length,
+                                  const cy_socket_sockaddr_t *destination);
+static void put_frame_header(uint8_t *buffer, uint8_t type, uint32_t length);
+static void put_be32(uint8_t *buffer, uint32_t value);
+static uint32_t get_be32(const uint8_t *buffer);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Socket of the channel, or NULL while stopped. The mutex guards it and the
+ * state below.
+ */
+static cy_socket_t udp_socket;
+static cy_mutex_t udp_mutex;
+static cy_semaphore_t udp_wake;
+static cy_thread_t udp_thread;
+
+/* Address of the server, with the port of its UDP socket. */
+static cy_socket_sockaddr_t udp_server;
+
+/* Commands received in the epoch of the current connection, and group
+ * commands received in the epoch of the server. The group epoch is kept
+ * across connections, so that a repair after a reconnect is not applied
+ * again.
+ */
+static udp_sequence_t udp_unicast;
+static udp_sequence_t udp_group;
+static bool udp_group_joined;
+
+/* Group epochs before the current one, the oldest overwritten first. */
+static uint32_t udp_group_retired[UDP_GROUP_EPOCH_HISTORY];
+static uint32_t udp_group_retired_next;
+
+/*******************************************************************************
+ * Function Name: udp_command_init
+ *******************************************************************************
+ * Summary:
+ *  Creates the thread that keeps the UDP path open. The channel starts with
+ *  udp_command_start.
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an RTOS error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t udp_command_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_mutex_init(&udp_mutex, false);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_semaphore_init(&udp_wake, 1u, 0u);
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_thread_create(&udp_thread, udp_command_thread, "UDP command",
+                                       NULL, UDP_COMMAND_THREAD_STACK_SIZE,
+                                       UDP_COMMAND_THREAD_PRIORITY, NULL);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("UDP command channel initialization failed!\n");
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_start
+ *******************************************************************************
+ * Summary:
+ *  Opens the UDP socket for a new connection to the server, joins the
+ *  command group if asked to, and starts sending the open datagrams. A new
+ *  epoch is chosen, so that commands sent in an earlier connection are never
+ *  applied in this one. If the group cannot be joined, the channel works
+ *  for the commands sent to this client alone.
+ *
+ * Parameters:
+ *  const cy_socket_sockaddr_t *server: Address of the TCP server
+ *  bool join_group: true to join UDP_COMMAND_GROUP_ADDRESS
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, a secure sockets error code
+ *  otherwise. Commands then arrive over TCP only.
+ *
+ *******************************************************************************/
+cy_rslt_t udp_command_start(const cy_socket_sockaddr_t *server, bool join_group)
+{
+    cy_socket_opt_callback_t recv_option;
+    cy_socket_sockaddr_t local_address;
+    cy_socket_t handle = NULL;
+    cy_rslt_t result;
+    cy_time_t now;
+
+    memset(&local_address, 0, sizeof(local_address));
+    local_address.ip_address.version = CY_SOCKET_IP_VER_V4;
+    local_address.port = UDP_COMMAND_PORT;
+
+    result = cy_socket_create(CY_SOCKET_DOMAIN_AF_INET, CY_SOCKET_TYPE_DGRAM,
+                              CY_SOCKET_IPPROTO_UDP, &handle);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        recv_option.callback = udp_command_recv_handler;
+        recv_option.arg = NULL;
+        result = cy_socket_setsockopt(handle, CY_SOCKET_SOL_SOCKET,
+                                      CY_SOCKET_SO_RECEIVE_CALLBACK,
+                                      &recv_option, sizeof(cy_socket_opt_callback_t));
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_socket_bind(handle, &local_address, sizeof(cy_socket_sockaddr_t));
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("UDP command socket failed. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
+        if (handle != NULL)
+        {
+            cy_socket_delete(handle);
+        }
+        return result;
+    }
+
+    if (join_group)
+    {
+        result = udp_command_set_group(handle, CY_SOCKET_SO_IP_MEMBERSHIP_ADD);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            printf("UDP command group not joined. Error code: 0x%08"PRIx32"\n", (uint32_t)result);
+            join_group = false;
+        }
+    }
+
+    cy_rtos_get_time(&now);
+
+    cy_rtos_mutex_get(&udp_mutex, CY_RTOS_NEVER_TIMEOUT);
+    udp_server = *server;
+    udp_server.port = UDP_COMMAND_PORT;
+
+    /* The epochs increase, so that even two connections in the same
+     * millisecond have different ones.
+     */
+    udp_unicast.epoch = ((uint32_t)now > udp_unicast.epoch) ? (uint32_t)now : (udp_unicast.epoch + 1u);
+    udp_unicast.highest = 0;
+    udp_unicast.window = 0;
+    udp_group_joined = join_group;
+    udp_socket = handle;
+    cy_rtos_mutex_set(&udp_mutex);
+
+    /* Send the first open datagram now. */
+    cy_rtos_semaphore_set(&udp_wake);
+    printf("UDP command channel started, epoch 0x%08"PRIx32"%s\n", udp_unicast.epoch,
+           join_group ? ", in the command group" : "");
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_stop
+ *******************************************************************************
+ * Summary:
+ *  Leaves the command group and closes the UDP socket. Waits for a datagram
+ *  being handled. The server stops using the UDP path once the open
+ *  datagrams stop arriving.
+ *
+ *******************************************************************************/
+void udp_command_stop(void)
+{
+    cy_rtos_mutex_get(&udp_mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (udp_socket != NULL)
+    {
+        /* The group is left explicitly, so that reconnects do not use up
+         * the multicast groups of the network stack.
+         */
+        if (udp_group_joined)
+        {
+            (void)udp_command_set_group(udp_socket, CY_SOCKET_SO_IP_MEMBERSHIP_DROP);
+            udp_group_joined = false;
+        }
+        cy_socket_delete(udp_socket);
+        udp_socket = NULL;
+    }
+    cy_rtos_mutex_set(&udp_mutex);
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_recv_handler
+ *******************************************************************************
+ * Summary:
+ *  Callback function of the datagrams received on the UDP socket. Datagrams
+ *  from any address other than the server's are dropped.
+ *
+ * Parameters:
+ *  cy_socket_t socket_handle: UDP socket
+ *  void *arg: Unused
+ *
+ * Return:
+ *  cy_result result: Result of the operation
+ *
+ *******************************************************************************/
+static cy_rslt_t udp_command_recv_handler(cy_socket_t socket_handle, void *arg)
+{
+    uint8_t datagram[UDP_DATAGRAM_SIZE];
+    cy_socket_sockaddr_t source;
+    uint32_t source_length = sizeof(cy_socket_sockaddr_t);
+    uint32_t length = 0;
+    cy_rslt_t result;
+
+    cy_rtos_mutex_get(&udp_mutex, CY_RTOS_NEVER_TIMEOUT);
+
+    /* The socket may have been closed since the callback was queued. */
+    if (socket_handle != udp_socket)
+    {
+        cy_rtos_mutex_set(&udp_mutex);
+        return CY_RSLT_SUCCESS;
+    }
+
+    result = cy_socket_recvfrom(socket_handle, datagram, sizeof(datagram), CY_SOCKET_FLAGS_NONE,
+                                &source, &source_length, &length);
+    if ((result == CY_RSLT_SUCCESS) &&
+        (source.ip_address.ip.v4 == udp_server.ip_address.ip.v4))
+    {
+        udp_command_receive(datagram, length, &source);
+    }
+
+    cy_rtos_mutex_set(&udp_mutex);
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_receive
+ *******************************************************************************
+ * Summary:
+ *  Handles a command datagram of the server, sent to this client or to the
+ *  group, and acknowledges it to the sender with the highest sequence number
+ *  received, so that the server stops retransmitting every command below
+ *  it. Commands of another epoch than the connection's are dropped; a group
+ *  command of a new epoch starts that epoch, unless the epoch was already
+ *  superseded. Called with the mutex held.
+ *
+ *******************************************************************************/
+static void udp_command_receive(const uint8_t *datagram, uint32_t length,
+                                const cy_socket_sockaddr_t *source)
+{
+    const uint8_t *payload = &datagram[CMD_FRAME_HEADER_SIZE];
+    uint8_t ack[UDP_DATAGRAM_SIZE];
+    udp_sequence_t *sequence;
+    uint8_t ack_type;
+    const char *text;
+    uint32_t text_length;
+    uint32_t epoch;
+    uint32_t seq;
+
+    if ((length < (CMD_FRAME_HEADER_SIZE + UDP_COMMAND_LENGTH)) || (datagram[0] != CMD_FRAME_MAGIC))
+    {
+        return;
+    }
+
+    epoch = get_be32(payload);
+    if (datagram[1] == CMD_FRAME_UDP_COMMAND)
+    {
+        if (epoch != udp_unicast.epoch)
+        {
+            return;
+        }
+        sequence = &udp_unicast;
+        ack_type = CMD_FRAME_UDP_COMMAND_ACK;
+    }
+    else if ((datagram[1] == CMD_FRAME_UDP_GROUP_COMMAND) && udp_group_joined)
+    {
+        if (!udp_command_group_epoch(epoch))
+        {
+            return;
+        }
+        sequence = &udp_group;
+        ack_type = CMD_FRAME_UDP_GROUP_ACK;
+    }
+    else
+    {
+        return;
+    }
+
+    seq = get_be32(&payload[4]);
+    text = udp_command_accept(sequence, seq, payload[8]);
+
+    text_length = strlen(text);
+    if (text_length > (sizeof(ack) - CMD_FRAME_HEADER_SIZE - UDP_ACK_HEADER_LENGTH))
+    {
+        text_length = sizeof(ack) - CMD_FRAME_HEADER_SIZE - UDP_ACK_HEADER_LENGTH;
+    }
+
+    put_frame_header(ack, ack_type, UDP_ACK_HEADER_LENGTH + text_length);
+    put_be32(&ack[CMD_FRAME_HEADER_SIZE], epoch);
+    put_be32(&ack[CMD_FRAME_HEADER_SIZE + 4u], seq);
+    put_be32(&ack[CMD_FRAME_HEADER_SIZE + 8u], sequence->highest);
+    memcpy(&ack[CMD_FRAME_HEADER_SIZE + UDP_ACK_HEADER_LENGTH], text, text_length);
+
+    /* A lost acknowledgment is repaired by the retransmitted command. */
+    (void)udp_command_send(ack, CMD_FRAME_HEADER_SIZE + UDP_ACK_HEADER_LENGTH + text_length, source);
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_group_epoch
+ *******************************************************************************
+ * Summary:
+ *  Checks the epoch of a group command. A new epoch replaces the current
+ *  one, which is remembered, so that a command of an earlier epoch that was
+ *  delayed in the network does not start its epoch again and have every
+ *  command of it applied a second time. Returns false for such a command.
+ *
+ *******************************************************************************/
+static bool udp_command_group_epoch(uint32_t epoch)
+{
+    uint32_t index;
+
+    if (epoch == udp_group.epoch)
+    {
+        return true;
+    }
+
+    for (index = 0; index < UDP_GROUP_EPOCH_HISTORY; index++)
+    {
+        if (udp_group_retired[index] == epoch)
+        {
+            printf("UDP group command of superseded epoch 0x%08"PRIx32" dropped\n", epoch);
+            return false;
+        }
+    }
+
+    if (udp_group.epoch != 0)
+    {
+        udp_group_retired[udp_group_retired_next] = udp_group.epoch;
+        udp_group_retired_next = (udp_group_retired_next + 1u) % UDP_GROUP_EPOCH_HISTORY;
+    }
+    udp_group.epoch = epoch;
+    udp_group.highest = 0;
+    udp_group.window = 0;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_accept
+ *******************************************************************************
+ * Summary:
+ *  Applies a command if its sequence number is above the highest one
+ *  received in its epoch. Any other command is a duplicate, or was
+ *  superseded by a newer command, and is not applied. Returns the
+ *  acknowledgment text.
+ *
+ *******************************************************************************/
+static const char *udp_command_accept(udp_sequence_t *sequence, uint32_t seq, uint8_t command)
+{
+    const char *text;
+    uint32_t offset;
+
+    if (seq > sequence->highest)
+    {
+        offset = seq - sequence->highest;
+        sequence->window = (offset < UDP_DEDUP_WINDOW) ? ((sequence->window << offset) | 1u) : 1u;
+        sequence->highest = seq;
+        (void)cmd_parser_apply_idempotent(command, &text);
+        return text;
+    }
+
+    offset = sequence->highest - seq;
+    if (offset >= UDP_DEDUP_WINDOW)
+    {
+        /* Too old to tell; it is not applied either way. */
+        text = ACK_SUPERSEDED;
+    }
+    else if ((sequence->window & (1u << offset)) != 0)
+    {
+        text = ACK_DUPLICATE;
+    }
+    else
+    {
+        sequence->window |= (1u << offset);
+        text = ACK_SUPERSEDED;
+    }
+    printf("UDP command %"PRIu32" not applied: %s\n", seq, text);
+
+    return text;
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_set_group
+ *******************************************************************************
+ * Summary:
+ *  Joins or leaves UDP_COMMAND_GROUP_ADDRESS on every interface.
+ *
+ *******************************************************************************/
+static cy_rslt_t udp_command_set_group(cy_socket_t handle, int option)
+{
+    cy_socket_ip_mreq_t membership;
+
+    memset(&membership, 0, sizeof(membership));
+    membership.multi_addr.version = CY_SOCKET_IP_VER_V4;
+    membership.multi_addr.ip.v4 = UDP_COMMAND_GROUP_ADDRESS;
+    membership.if_addr.version = CY_SOCKET_IP_VER_V4;
+
+    return cy_socket_setsockopt(handle, CY_SOCKET_SOL_IP, option,
+                                &membership, sizeof(cy_socket_ip_mreq_t));
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_thread
+ *******************************************************************************
+ * Summary:
+ *  Sends an open datagram with the epoch to the server every
+ *  UDP_COMMAND_OPEN_INTERVAL_MS while the channel is started. It tells the
+ *  server where to send the commands and that the path still works, and
+ *  keeps the path open through NATs and firewalls. In the command group, it
+ *  also reports the last group command received.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void udp_command_thread(cy_thread_arg_t arg)
+{
+    uint32_t wait_ms = CY_RTOS_NEVER_TIMEOUT;
+    uint8_t open[CMD_FRAME_HEADER_SIZE + UDP_OPEN_GROUP_LENGTH];
+    uint32_t length;
+
+    for (;;)
+    {
+        cy_rtos_semaphore_get(&udp_wake, wait_ms);
+
+        cy_rtos_mutex_get(&udp_mutex, CY_RTOS_NEVER_TIMEOUT);
+        if (udp_socket == NULL)
+        {
+            wait_ms = CY_RTOS_NEVER_TIMEOUT;
+        }
+        else
+        {
+            length = udp_group_joined ? UDP_OPEN_GROUP_LENGTH : UDP_OPEN_LENGTH;
+            put_frame_header(open, CMD_FRAME_UDP_OPEN, length);
+            put_be32(&open[CMD_FRAME_HEADER_SIZE], udp_unicast.epoch);
+            put_be32(&open[CMD_FRAME_HEADER_SIZE + 4u], udp_group.epoch);
+            put_be32(&open[CMD_FRAME_HEADER_SIZE + 8u], udp_group.highest);
+            (void)udp_command_send(open, CMD_FRAME_HEADER_SIZE + length, &udp_server);
+            wait_ms = UDP_COMMAND_OPEN_INTERVAL_MS;
+        }
+        cy_rtos_mutex_set(&udp_mutex);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: udp_command_send
+ *******************************************************************************
+ * Summary:
+ *  Sends one datagram on the UDP socket. Called with the mutex held.
+ *
+ *******************************************************************************/
+static cy_rslt_t udp_command_send(const uint8_t *datagram, uint32_t length,
+                                  const cy_socket_sockaddr_t *destination)
+{
+    uint32_t bytes_sent = 0;
+
+    return cy_socket_sendto(udp_socket, datagram, length, CY_SOCKET_FLAGS_NONE,
+                            destination, sizeof(cy_socket_sockaddr_t), &bytes_sent);
+}
+
+/*******************************************************************************
+ * Function Name: put_frame_header
+ *******************************************************************************
+ * Summary:
+ *  Writes the header of a frame with the given type and payload length.
+ *
+ *******************************************************************************/
+static void put_frame_header(uint8_t *buffer, uint8_t type, uint32_t length)
+{
+    buffer[0] = CMD_FRAME_MAGIC;
+    buffer[1] = type;
+    buffer[2] = (uint8_t)(length >> 8);
+    buffer[3] = (uint8_t)length;
+}
+
+/*******************************************************************************
+ * Function Name: put_be32
+ *******************************************************************************
+ * Summary:
+ *  Writes a 32-bit value in big-endian byte order.
+ *
+ *******************************************************************************/
+static void put_be32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)(value >> 24);
+    buffer[1] = (uint8_t)(value >> 16);
+    buffer[2] = (uint8_t)(value >> 8);
+    buffer[3] = (uint8_t)value;
+}
+
+/*******************************************************************************
+ * Function Name: get_be32
+ *******************************************************************************
+ * Summary:
+ *  Reads a 32-bit value in big-endian byte order.
+ *
+ *******************************************************************************/
+static uint32_t get_be32(const uint8_t *buffer)
+{
+    return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) |
+           ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+
+/* [] END OF FILE */
@@ -0,0 +1,89 @@
+/******************************************************************************
+* File Name:   udp_command.h
+*
+* Description: This file contains declarations of the UDP command channel,
+* which receives the idempotent commands of the TCP server as datagrams,
+* sent to this client alone or multicast to a group of clients.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef UDP_COMMAND_H_
+#define UDP_COMMAND_H_
+
+/* Header file includes. */
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_secure_sockets.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* UDP port of the client and of the server. */
+#ifndef UDP_COMMAND_PORT
+#define UDP_COMMAND_PORT                          (50009u)
+#endif
+
+/* Interval of the open datagrams sent to the server while connected. The
+ * server stops using the UDP path when they stop arriving.
+ */
+#ifndef UDP_COMMAND_OPEN_INTERVAL_MS
+#define UDP_COMMAND_OPEN_INTERVAL_MS              (1000u)
+#endif
+
+/* Multicast group of the group commands, 239.255.0.50, in the byte order of
+ * cy_socket_ip_address_t. Each client uses one of the NX_MAX_MULTICAST_GROUPS
+ * of NetX Duo, or one IGMP group of lwIP.
+ */
+#ifndef UDP_COMMAND_GROUP_ADDRESS
+#define UDP_COMMAND_GROUP_ADDRESS                 ((50u << 24) | (0u << 16) | (255u << 8) | 239u)
+#endif
+
+/* Stack size and priority of the thread that sends the open datagrams. */
+#ifndef UDP_COMMAND_THREAD_STACK_SIZE
+#define UDP_COMMAND_THREAD_STACK_SIZE             (1024u)
+#endif
+#ifndef UDP_COMMAND_THREAD_PRIORITY
+#define UDP_COMMAND_THREAD_PRIORITY               (CY_RTOS_PRIORITY_NORMAL)
+#endif
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t udp_command_init(void);
+cy_rslt_t udp_command_start(const cy_socket_sockaddr_t *server, bool join_group);
+void udp_command_stop(void);
+
+#endif /* UDP_COMMAND_H_ */
@@ -0,0 +1,402 @@
+/******************************************************************************
+* File Name:   xip_upload.c
+*
+* Description: This file contains the upload of a range of the download region
+* of the external flash to the TCP server. The flash is mapped into memory
+* (XIP) for the upload, and each data frame is sent from its mapped address,
+* so the upload needs no buffer of its own however large the range is. When
+* the connection has compression enabled, the compressor reads the mapping
+* instead, and the frames are sent from its output.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes. */
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* RTOS header file. */
+#include "cyabs_rtos.h"
+
+/* HAL header file, for the XIP base address. */
+#include "cyhal.h"
+
+/* Flash download, event log and XIP upload header files. */
+#include "flash_download.h"
+#include "event_log.h"
+#include "xip_upload.h"
+
+/* LZ stream header file, for compressed uploads. */
+#include "lz_stream.h"
+
+#if (FLASH_DOWNLOAD_SUPPORTED)
+
+/* Serial flash library header file. */
+#include "cy_serial_flash_qspi.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Length of the text of the final upload acknowledgement. */
+#define XIP_UPLOAD_REPORT_LENGTH                  (CMD_FRAME_MAX_PAYLOAD - 1u)
+
+/* Text of the acknowledgement when the flash cannot be mapped. */
+#define XIP_UPLOAD_XIP_FAILED                     "UPLOAD FAILED: XIP"
+
+/*******************************************************************************
+* Structures
+********************************************************************************/
+typedef struct
+{
+    cmd_stream_t *stream;
+    uint32_t address;               /* Offset of the range in the flash. */
+    uint32_t length;
+} upload_request_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+static cy_rslt_t xip_upload_init(void);
+static void xip_upload_thread(cy_thread_arg_t arg);
+static cy_rslt_t xip_upload_send(const upload_request_t *request);
+static cy_rslt_t send_upload_ack(cmd_stream_t *stream, uint8_t status,
+                                 const uint8_t *data, uint32_t length);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static cy_queue_t upload_requests;
+static cy_thread_t upload_thread;
+static bool upload_initialized;
+
+/* Stream of the upload in progress, and whether it has been cancelled. */
+static cmd_stream_t *volatile upload_stream;
+static volatile bool upload_cancelled;
+
+/* Compressor of a compressed upload, and the frame it fills. */
+static lz_stream_encoder_t upload_encoder;
+static uint8_t upload_frame[XIP_UPLOAD_CHUNK_SIZE];
+
+/*******************************************************************************
+ * Function Name: xip_upload_request
+ *******************************************************************************
+ * Summary:
+ *  Queues the upload of a range of the download region for the upload
+ *  thread. The region is claimed until the upload ends, so that no download
+ *  writes to the flash while it is read through XIP.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream that the request was received on
+ *  uint32_t offset: Offset of the range in the download region
+ *  uint32_t length: Length of the range in bytes
+ *
+ * Return:
+ *  cy_rslt_t: CY_RSLT_SUCCESS on success, an error code otherwise.
+ *
+ *******************************************************************************/
+cy_rslt_t xip_upload_request(cmd_stream_t *stream, uint32_t offset, uint32_t length)
+{
+    upload_request_t request;
+    uint32_t region_offset;
+    uint32_t region_size;
+    cy_rslt_t result;
+
+    if (!upload_initialized)
+    {
+        result = xip_upload_init();
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        upload_initialized = true;
+    }
+
+    if (!flash_download_claim_region(&region_offset, &region_size))
+    {
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    if ((length == 0) || (offset > region_size) || (length > (region_size - offset)))
+    {
+        flash_download_release_region();
+        return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+    }
+
+    request.stream = stream;
+    request.address = region_offset + offset;
+    request.length = length;
+
+    upload_cancelled = false;
+    upload_stream = stream;
+    result = cy_rtos_queue_put(&upload_requests, &request, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        upload_stream = NULL;
+        flash_download_release_region();
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: xip_upload_cancel
+ *******************************************************************************
+ * Summary:
+ *  Stops the upload in progress on a stream, for example when its connection
+ *  is lost, so that the rest of the range is not sent on the next connection.
+ *
+ * Parameters:
+ *  cmd_stream_t *stream: Stream context
+ *
+ *******************************************************************************/
+void xip_upload_cancel(cmd_stream_t *stream)
+{
+    if (upload_stream == stream)
+    {
+        upload_cancelled = true;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: xip_upload_init
+ *******************************************************************************
+ * Summary:
+ *  Creates the request queue and the upload thread on the first upload.
+ *
+ *******************************************************************************/
+static cy_rslt_t xip_upload_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_queue_init(&upload_requests, 1u, sizeof(upload_request_t));
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_thread_create(&upload_thread, xip_upload_thread, "XIP upload",
+                                       NULL, XIP_UPLOAD_THREAD_STACK_SIZE,
+                                       XIP_UPLOAD_THREAD_PRIORITY, NULL);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("XIP upload initialization failed!\n");
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: xip_upload_thread
+ *******************************************************************************
+ * Summary:
+ *  Sends the queued uploads one at a time, and releases the region after
+ *  each. The event log is kept off the flash while an upload reads it.
+ *
+ * Parameters:
+ *  cy_thread_arg_t arg: Thread argument (unused)
+ *
+ *******************************************************************************/
+static void xip_upload_thread(cy_thread_arg_t arg)
+{
+    upload_request_t request;
+    cy_rslt_t result;
+
+    for (;;)
+    {
+        if (cy_rtos_queue_get(&upload_requests, &request, CY_RTOS_NEVER_TIMEOUT) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+
+        /* XIP stays enabled for the Wi-Fi firmware; see main.c. */
+        event_log_suspend();
+        result = cy_serial_flash_qspi_enable_xip(true);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = xip_upload_send(&request);
+        }
+        else
+        {
+            printf("Enabling XIP failed! Error: 0x%08"PRIx32"\n", (uint32_t)result);
+            send_upload_ack(request.stream, CMD_DOWNLOAD_FAILED, (const uint8_t *)XIP_UPLOAD_XIP_FAILED,
+                            sizeof(XIP_UPLOAD_XIP_FAILED) - 1u);
+        }
+
+        event_log_resume();
+        upload_stream = NULL;
+        flash_download_release_region();
+    }
+}
+
+/*******************************************************************************
+ * Function Name: xip_upload_send
+ *******************************************************************************
+ * Summary:
+ *  Sends one range: the acknowledgement with its length and encoding, the
+ *  data frames pointing straight into the XIP mapping or holding the output
+ *  of the compressor, and the final acknowledgement with the throughput. A
+ *  data frame with a CRC carries that much less data, so that it still fits
+ *  one TCP segment.
+ *
+ *******************************************************************************/
+static cy_rslt_t xip_upload_send(const upload_request_t *request)
+{
+    const uint8_t *mapped = (const uint8_t *)(CY_XIP_BASE + request->address);
+    const uint8_t *data;
+    bool compressed = ((request->stream->features & CMD_FEATURE_LZ) != 0);
+    uint32_t frame_size = ((request->stream->features & CMD_FEATURE_CRC32C) != 0) ?
+                          (XIP_UPLOAD_CHUNK_SIZE - CMD_CRC_SIZE) : XIP_UPLOAD_CHUNK_SIZE;
+    bool done = false;
+    char report[XIP_UPLOAD_REPORT_LENGTH];
+    uint8_t ready[5];
+    uint32_t remaining = request->length;
+    uint32_t sent = 0;
+    uint32_t chunk;
+    uint32_t elapsed_ms;
+    uint32_t rate;
+    cy_time_t start_time;
+    cy_time_t end_time;
+    cy_rslt_t result;
+    int report_length;
+
+    printf("Uploading %"PRIu32" bytes from the external flash at 0x%08"PRIx32"\n",
+           request->length, request->address);
+
+    ready[0] = (uint8_t)(request->length >> 24);
+    ready[1] = (uint8_t)(request->length >> 16);
+    ready[2] = (uint8_t)(request->length >> 8);
+    ready[3] = (uint8_t)request->length;
+    ready[4] = compressed ? CMD_UPLOAD_ENCODING_LZ : CMD_UPLOAD_ENCODING_RAW;
+
+    if (compressed)
+    {
+        lz_stream_encoder_init(&upload_encoder);
+    }
+
+    cy_rtos_get_time(&start_time);
+    result = send_upload_ack(request->stream, CMD_DOWNLOAD_READY, ready, sizeof(ready));
+
+    while ((result == CY_RSLT_SUCCESS) && !done)
+    {
+        if (upload_cancelled)
+        {
+            printf("Upload cancelled after %"PRIu32" bytes\n", sent);
+            return CY_RSLT_SERIAL_FLASH_ERR_BAD_PARAM;
+        }
+
+        if (compressed)
+        {
+            /* Less output than a frame means that the stream is complete. */
+            chunk = lz_stream_encode(&upload_encoder, &mapped, &remaining,
+                                     upload_frame, frame_size, true);
+            data = upload_frame;
+            done = (chunk < frame_size);
+        }
+        else
+        {
+            chunk = (remaining < frame_size) ? remaining : frame_size;
+            data = mapped;
+            mapped += chunk;
+            remaining -= chunk;
+            done = (remaining == 0);
+        }
+
+        if (chunk > 0)
+        {
+            result = cmd_stream_send_data_frame(request->stream, CMD_FRAME_UPLOAD_DATA, data, chunk);
+        }
+        sent += chunk;
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("Upload failed! Error: 0x%08"PRIx32"\n", (uint32_t)result);
+        return result;
+    }
+
+    cy_rtos_get_time(&end_time);
+    elapsed_ms = (uint32_t)(end_time - start_time);
+    if (elapsed_ms == 0)
+    {
+        elapsed_ms = 1;
+    }
+
+    /* Hundredths of MB/s: bytes per ms are thousands of bytes per s. */
+    rate = (uint32_t)(((uint64_t)request->length * 100u) / ((uint64_t)elapsed_ms * 1000u));
+    if (compressed)
+    {
+        report_length = snprintf(report, sizeof(report),
+                                 "UPLOAD DONE %"PRIu32" bytes (%"PRIu32" compressed) %"PRIu32".%02"PRIu32" MB/s",
+                                 request->length, sent, rate / 100u, rate % 100u);
+    }
+    else
+    {
+        report_length = snprintf(report, sizeof(report), "UPLOAD DONE %"PRIu32" bytes %"PRIu32".%02"PRIu32" MB/s",
+                                 request->length, rate / 100u, rate % 100u);
+    }
+    printf("%s (%"PRIu32" ms)\n", report, elapsed_ms);
+
+    return send_upload_ack(request->stream, CMD_DOWNLOAD_DONE,
+                           (const uint8_t *)report, (uint32_t)report_length);
+}
+
+/*******************************************************************************
+ * Function Name: send_upload_ack
+ *******************************************************************************
+ * Summary:
+ *  Sends an upload acknowledgement: a status followed by data.
+ *
+ *******************************************************************************/
+static cy_rslt_t send_upload_ack(cmd_stream_t *stream, uint8_t status,
+                                 const uint8_t *data, uint32_t length)
+{
+    uint8_t payload[CMD_FRAME_MAX_PAYLOAD];
+
+    if (length > (CMD_FRAME_MAX_PAYLOAD - 1u))
+    {
+        length = CMD_FRAME_MAX_PAYLOAD - 1u;
+    }
+
+    payload[0] = status;
+    memcpy(&payload[1], data, length);
+
+    return cmd_stream_send_frame(stream, CMD_FRAME_UPLOAD_ACK, payload, 1u + length);
+}
+
+#endif /* FLASH_DOWNLOAD_SUPPORTED */
+
+
+/* [] END OF FILE */
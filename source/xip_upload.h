@@ -0,0 +1,78 @@
+/******************************************************************************
+* File Name:   xip_upload.h
+*
+* Description: This file contains declarations of the upload of a range of the
+* external flash to the TCP server straight from its XIP mapping.
+*
+* Related Document: See README.md
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef XIP_UPLOAD_H_
+#define XIP_UPLOAD_H_
+
+/* Header file includes. */
+#include <stdint.h>
+#include "cy_result.h"
+
+/* Command parser header file, for the stream that answers the request. */
+#include "cmd_parser.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Payload of each upload data frame. With the frame header, a frame fills
+ * one TCP segment of the default MSS.
+ */
+#ifndef XIP_UPLOAD_CHUNK_SIZE
+#define XIP_UPLOAD_CHUNK_SIZE                     (1456u)
+#endif
+
+/* Stack size and priority of the thread that sends the upload. It runs below
+ * the command workers so that commands are not held up by a long upload.
+ */
+#ifndef XIP_UPLOAD_THREAD_STACK_SIZE
+#define XIP_UPLOAD_THREAD_STACK_SIZE              (2u * 1024u)
+#endif
+#ifndef XIP_UPLOAD_THREAD_PRIORITY
+#define XIP_UPLOAD_THREAD_PRIORITY                (CY_RTOS_PRIORITY_BELOWNORMAL)
+#endif
+
+/*******************************************************************************
+* Function Prototype
+********************************************************************************/
+cy_rslt_t xip_upload_request(cmd_stream_t *stream, uint32_t offset, uint32_t length);
+void xip_upload_cancel(cmd_stream_t *stream);
+
+#endif /* XIP_UPLOAD_H_ */
@@ -42,16 +42,197 @@
 #!/usr/bin/python
 
 import socket
+import os
 import optparse
 import time
 import sys
 import threading
+import hashlib
 
 host = socket.gethostbyname(socket.gethostname())  # IP address of the TCP server
 port = 50007                                       # Arbitrary non-privileged port
+control_port = 50008                               # Port of the control connection
 RECV_BUFF_SIZE = 4096                              # Receive buffer size
 DEFAULT_KEEP_ALIVE = 1                             # TCP Keep Alive: 1 - Enable, 0 - Disable
 
+# Frames sent by the TCP client: magic byte, frame type, payload length
+# (16-bit, big-endian), payload. Anything outside a frame is acknowledgment text.
+FRAME_MAGIC = 0xA5
+FRAME_HEADER_SIZE = 4
+FRAME_HEARTBEAT = ord('H')
+FRAME_HEARTBEAT_ACK = ord('h')
+FRAME_SESSION = ord('S')
+FRAME_SESSION_ACK = ord('s')
+FRAME_COMMAND = ord('C')
+FRAME_COMMAND_ACK = ord('c')
+FRAME_COMMAND_NACK = ord('n')
+FRAME_CREDIT = ord('K')
+
+# Priority lanes of the commands. Each lane has its own sequence numbers and
+# credits. Urgent commands are sent on the control connection when the client
+# has opened one, so that they never wait behind normal commands.
+LANE_URGENT = 0
+LANE_NORMAL = 1
+LANE_COUNT = 2
+URGENT_COMMANDS = b'!'
+
+# Idempotent commands are sent to the client as UDP datagrams while the client
+# keeps the UDP path open with an open datagram every second, so that a lost
+# segment of the command connection does not hold them back. Each command has
+# a sequence number of the epoch chosen by the client for the connection. A
+# command not acknowledged in UDP_RETRANSMIT_TIMEOUT is sent again on its own;
+# after UDP_MAX_TRANSMISSIONS, it and every other command not acknowledged go
+# over TCP, and UDP is not used for UDP_SUSPEND_TIME. The client applies a
+# command only if it is newer than every command it has received.
+FRAME_UDP_OPEN = ord('O')
+FRAME_UDP_COMMAND = ord('Q')
+FRAME_UDP_COMMAND_ACK = ord('q')
+UDP_COMMAND_PORT = 50009
+UDP_COMMANDS = b'10!'
+UDP_OPEN_TIMEOUT = 3.0
+UDP_RETRANSMIT_TIMEOUT = 0.05
+UDP_MAX_TRANSMISSIONS = 4
+UDP_SUSPEND_TIME = 10.0
+
+# Group commands are multicast to UDP_GROUP_ADDRESS, so that one datagram
+# reaches every client in the group. Enter "group <commands>" to send them.
+# The clients in the group report the last group command they received in
+# their open datagrams and acknowledge every group command. A command not
+# acknowledged by every member in UDP_RETRANSMIT_TIMEOUT is multicast again,
+# or sent to the member alone if only one is missing. A member that reports
+# an older command than the last one, such as one that just joined, is sent
+# the last one.
+FRAME_UDP_GROUP_COMMAND = ord('X')
+FRAME_UDP_GROUP_ACK = ord('x')
+UDP_GROUP_ADDRESS = '239.255.0.50'
+GROUP_COMMAND = "group"
+
+# Features offered by the client once per connection; the server answers with
+# those it enables on the connection. With LZ compression, images are sent
+# compressed and uploads arrive compressed. Enter "lz [file]" to benchmark the
+# compressor and decompressor of this script on a file. With CRC-32C, images
+# are sent in blocks of DOWNLOAD_BLOCK_SIZE bytes, each followed by its CRC,
+# and every upload data frame ends with the CRC of its data.
+FRAME_FEATURES = ord('F')
+FRAME_FEATURES_ACK = ord('f')
+FEATURE_LZ = 0x01
+FEATURE_CRC32C = 0x02
+SERVER_FEATURES = FEATURE_LZ | FEATURE_CRC32C
+LZ_COMMAND = "lz"
+DOWNLOAD_BLOCK_SIZE = 4096
+CRC_SIZE = 4
+
+# CRC-32C (Castagnoli), reflected, initial value and final XOR 0xFFFFFFFF.
+CRC32C_POLYNOMIAL = 0x82F63B78
+CRC32C_TABLE = []
+for _byte in range(256):
+    _crc = _byte
+    for _bit in range(8):
+        _crc = (_crc >> 1) ^ (CRC32C_POLYNOMIAL if _crc & 1 else 0)
+    CRC32C_TABLE.append(_crc)
+
+# Streaming LZ format of the bulk transfers: groups of one flag byte and up to
+# eight items, the first in the least significant bit. A literal is one byte;
+# a match is the length minus 3 (5 bits) and the distance minus 1 (11 bits),
+# with one more length byte if the length field is 31.
+LZ_WINDOW_SIZE = 2048
+LZ_MIN_MATCH = 3
+LZ_MAX_MATCH = LZ_MIN_MATCH + 31 + 255
+UPLOAD_ENCODING_LZ = 1
+
+# Bulk download of an image to the external flash of the client. The server
+# announces the image with its size and SHA-256 digest, sends it as raw bytes
+# once the client is ready, and prints the outcome reported by the client.
+FRAME_DOWNLOAD = ord('D')
+FRAME_DOWNLOAD_ACK = ord('d')
+DOWNLOAD_READY = 0
+DOWNLOAD_DONE = 1
+DOWNLOAD_FAILED = 2
+DOWNLOAD_PREFIX = "download "
+
+# Upload of a range of the downloaded image back from the client, which sends
+# it straight from its memory-mapped flash. The client acknowledges the
+# request with the length, sends the data in upload data frames, and reports
+# the throughput. The upload is checked against the last downloaded image.
+FRAME_UPLOAD = ord('G')
+FRAME_UPLOAD_ACK = ord('g')
+FRAME_UPLOAD_DATA = ord('B')
+UPLOAD_COMMAND = "upload"
+UPLOAD_FILE = "upload.bin"
+
+# Telemetry records of the client, sent in batches: the number of records
+# dropped so far, then records of timestamp, type, length and data. Records
+# made while the client was disconnected arrive together after a reconnect.
+FRAME_TELEMETRY = ord('T')
+TELEMETRY_RECORDS = {1: "Wi-Fi down", 2: "Wi-Fi up", 3: "server lost (endpoint)",
+                     4: "connect failed (result)", 5: "connected (ms)"}
+
+# Periodic samples of the client, sent in batches: the sequence number of the
+# first sample, the sample period in microseconds, then one 32-bit value per
+# sample. The rates and the gaps in the sequence numbers are printed every
+# SAMPLE_STATS_INTERVAL seconds.
+FRAME_SAMPLES = ord('M')
+SAMPLE_STATS_INTERVAL = 10
+
+# Compact sample frames: the first sequence number and the period as varints,
+# then the difference of each value from the one before it, zigzag-mapped and
+# varint-encoded. Enter "codec" at the prompt to benchmark this decoder and the
+# matching encoder on a synthetic signal, in batches of CODEC_BENCHMARK_BATCH.
+FRAME_SAMPLES_COMPACT = ord('m')
+CODEC_COMMAND = "codec"
+CODEC_BENCHMARK_SAMPLES = 100000
+CODEC_BENCHMARK_BATCH = 20
+sample_stats = {'next': None, 'samples': 0, 'frames': 0, 'bytes': 0, 'gaps': 0, 'start': 0}
+
+# Commands sent in a session but not yet acknowledged are kept for replay
+# after a reconnect. No new command is sent while the window is full.
+REPLAY_WINDOW = 16
+
+# Sessions by session ID, each holding one state per lane: next sequence
+# number, unacknowledged commands, next command to be sent, and the credit
+# limit (highest sequence number the client can take). A session outlives its
+# connections; the client resumes it after reconnecting. Commands beyond the
+# credit limit wait until the client grants more credits.
+sessions = {}
+current_session = None
+session_lock = threading.Lock()
+
+# Connection that carries the urgent lane, if the client has opened one.
+control_conn = None
+
+# Image announced to the client and not yet sent, and the time its sending
+# started. Nothing else is sent on the command connection while the image is
+# sent, so frames wait for send_lock.
+download_image = None
+download_start = 0
+send_lock = threading.Lock()
+
+# Last image verified by the client, and the upload being received.
+last_image = None
+announced_image = None
+upload_data = None
+upload_start = 0
+upload_decoder = None
+upload_received = 0
+upload_crc_errors = 0
+
+# Features enabled on the current command connection.
+conn_features = 0
+
+# UDP path of the client: address, epoch, time of the last open datagram,
+# next sequence number, and the commands not yet acknowledged with the time
+# they were last sent and the number of transmissions.
+udp_path = None
+udp_suspended_until = 0
+udp_lock = threading.Lock()
+
+# Group state: epoch of this server, next sequence number, last command sent,
+# the members by IP address with their address, the time of their last open
+# datagram and the last command they received, and the command being
+# delivered with the members that have not acknowledged it.
+group = {'epoch': int.from_bytes(os.urandom(4), 'big') or 1, 'next_seq': 1, 'last': None,
+         'members': {}, 'pending': None}
+
 print("==========================")
 print("TCP Server")
 print("==========================")
@@ -79,19 +260,762 @@ class KeyboardThread(threading.Thread):
 
 def read_user_data(inp):
     #evaluate the keyboard input
-    if(is_client_connected == True):
+    if(inp.strip() == CODEC_COMMAND):
+        benchmark_codec()
+    elif(inp.split()[:1] == [LZ_COMMAND]):
+        benchmark_lz(inp.split()[1:])
+    elif(inp.split()[:1] == [GROUP_COMMAND]):
+        send_group_commands(''.join(inp.split()[1:]).encode())
+    elif(is_client_connected == True):
         if(inp == ""):
             print("No option entered!")
             print("Enter your option: '1' to turn ON LED, 0 to turn"\
                             " OFF LED and Press the 'Enter' key: ")
+        elif inp.startswith(DOWNLOAD_PREFIX):
+            start_download(inp[len(DOWNLOAD_PREFIX):].strip())
+        elif inp.split()[:1] == [UPLOAD_COMMAND]:
+            start_upload(inp.split()[1:])
         else:
-            conn.send(inp.encode())
+            tcp_commands = b''
+            for command in inp.encode():
+                if command not in UDP_COMMANDS or not send_udp_command(command):
+                    tcp_commands += bytes([command])
+            if any(command in UDP_COMMANDS for command in tcp_commands):
+                # Commands still unacknowledged over UDP go first, so that
+                # the last command sent is the one left applied.
+                tcp_commands = take_udp_commands() + tcp_commands
+            if tcp_commands:
+                send_tcp_commands(tcp_commands)
     else:
         print("No active client connection. Command not send")
 
+def send_tcp_commands(commands):
+    with session_lock:
+        if current_session is None:
+            with send_lock:
+                conn.send(commands)
+        else:
+            for command in commands:
+                lane = LANE_URGENT if command in URGENT_COMMANDS else LANE_NORMAL
+                send_command(current_session, lane, bytes([command]))
+
+def send_udp_command(command):
+    # Sends an idempotent command over UDP. Returns False if the client has
+    # not kept the UDP path open or UDP is suspended; the command must then
+    # go over TCP.
+    now = time.time()
+    with udp_lock:
+        if (udp_path is None or now - udp_path['last_open'] > UDP_OPEN_TIMEOUT
+                or now < udp_suspended_until):
+            return False
+        seq = udp_path['next_seq']
+        udp_path['next_seq'] += 1
+        udp_path['unacked'][seq] = {'command': command, 'first': now, 'sent': now, 'count': 1}
+        send_udp_frame(FRAME_UDP_COMMAND, udp_path['epoch'], seq, command, udp_path['addr'])
+    return True
+
+def send_udp_frame(frame_type, epoch, seq, command, destination):
+    payload = epoch.to_bytes(4, 'big') + seq.to_bytes(4, 'big') + bytes([command])
+    udp_sock.sendto(bytes([FRAME_MAGIC, frame_type, 0, len(payload)]) + payload, destination)
+
+def send_group_commands(commands):
+    # Multicasts the commands to the group. Each command supersedes the one
+    # before it, as the group commands all set the same state.
+    if not commands or any(command not in UDP_COMMANDS for command in commands):
+        print("Enter group followed by the commands to send: %s"%(UDP_COMMANDS.decode()))
+        return
+    now = time.time()
+    with udp_lock:
+        members = [ip for ip, member in group['members'].items()
+                   if now - member['last_open'] <= UDP_OPEN_TIMEOUT]
+        for command in commands:
+            seq = group['next_seq']
+            group['next_seq'] += 1
+            group['last'] = (seq, command)
+            send_udp_frame(FRAME_UDP_GROUP_COMMAND, group['epoch'], seq, command,
+                           (UDP_GROUP_ADDRESS, UDP_COMMAND_PORT))
+        group['pending'] = {'seq': seq, 'command': command, 'first': now, 'sent': now,
+                            'count': 1, 'waiting': set(members), 'members': len(members)}
+    print("Group command %d multicast to %d member(s)"%(seq, len(members)))
+
+def retransmit_group_command():
+    # Sends the group command again if a member has not acknowledged it in
+    # time: to the group, or to the member alone if only one is missing.
+    # After UDP_MAX_TRANSMISSIONS, the members still missing it are repaired
+    # once they report.
+    now = time.time()
+    with udp_lock:
+        pending = group['pending']
+        if pending is None or not pending['waiting'] or now - pending['sent'] < UDP_RETRANSMIT_TIMEOUT:
+            return
+        if pending['count'] >= UDP_MAX_TRANSMISSIONS:
+            print("Group command %d not acknowledged by %s"
+                  %(pending['seq'], ", ".join(sorted(pending['waiting']))))
+            group['pending'] = None
+            return
+        if len(pending['waiting']) == 1:
+            destination = group['members'][next(iter(pending['waiting']))]['addr']
+        else:
+            destination = (UDP_GROUP_ADDRESS, UDP_COMMAND_PORT)
+        send_udp_frame(FRAME_UDP_GROUP_COMMAND, group['epoch'], pending['seq'], pending['command'],
+                       destination)
+        pending['sent'] = now
+        pending['count'] += 1
+
+def report_group_member(source, payload):
+    # Records the group state reported in an open datagram, and sends the
+    # last group command to a member that does not have it. Called with
+    # udp_lock held.
+    member = group['members'].get(source[0])
+    if member is None:
+        member = group['members'][source[0]] = {'highest': 0}
+        print("Group member %s joined"%(source[0]))
+    member['addr'] = source
+    member['last_open'] = time.time()
+    if int.from_bytes(payload[4:8], 'big') == group['epoch']:
+        member['highest'] = int.from_bytes(payload[8:12], 'big')
+    else:
+        member['highest'] = 0
+    last = group['last']
+    pending = group['pending']
+    if (last is not None and member['highest'] < last[0]
+            and not (pending is not None and source[0] in pending['waiting'])):
+        send_udp_frame(FRAME_UDP_GROUP_COMMAND, group['epoch'], last[0], last[1], source)
+        print("Group command %d repaired for %s"%(last[0], source[0]))
+
+def group_command_acked(source, seq, highest):
+    # Records the acknowledgment of a group command by a member. Returns the
+    # command if it is now acknowledged by every member. Called with
+    # udp_lock held.
+    member = group['members'].get(source[0])
+    if member is not None:
+        member['highest'] = max(member['highest'], highest)
+    pending = group['pending']
+    if pending is None or highest < pending['seq'] or source[0] not in pending['waiting']:
+        return None
+    pending['waiting'].discard(source[0])
+    if pending['waiting']:
+        return None
+    group['pending'] = None
+    return pending
+
+def take_udp_commands():
+    # Returns the commands not acknowledged over UDP, in order, and stops
+    # retransmitting them.
+    with udp_lock:
+        if udp_path is None:
+            return b''
+        commands = bytes(udp_path['unacked'][seq]['command'] for seq in sorted(udp_path['unacked']))
+        udp_path['unacked'].clear()
+    return commands
+
+def retransmit_udp_commands():
+    # Sends again the commands whose acknowledgment is late. Returns the
+    # commands to be sent over TCP instead, if one was sent too often.
+    global udp_suspended_until
+    now = time.time()
+    with udp_lock:
+        if udp_path is None:
+            return b''
+        for seq in sorted(udp_path['unacked']):
+            entry = udp_path['unacked'][seq]
+            if now - entry['sent'] < UDP_RETRANSMIT_TIMEOUT:
+                continue
+            if entry['count'] >= UDP_MAX_TRANSMISSIONS:
+                print("UDP command %d not acknowledged after %d transmissions. UDP suspended for %d s"
+                      %(seq, entry['count'], UDP_SUSPEND_TIME))
+                udp_suspended_until = now + UDP_SUSPEND_TIME
+                break
+            send_udp_frame(FRAME_UDP_COMMAND, udp_path['epoch'], seq, entry['command'], udp_path['addr'])
+            entry['sent'] = now
+            entry['count'] += 1
+        else:
+            return b''
+    return take_udp_commands()
+
+def receive_udp(data, source):
+    # Handles the open datagrams and the acknowledgments of the clients. The
+    # UDP path is opened only from the address of the command connection;
+    # group members can be any client.
+    global udp_path
+    if len(data) < FRAME_HEADER_SIZE + 4 or data[0] != FRAME_MAGIC:
+        return
+    payload = data[FRAME_HEADER_SIZE:]
+    epoch = int.from_bytes(payload[0:4], 'big')
+    acked = None
+    group_acked = None
+    with udp_lock:
+        if data[1] == FRAME_UDP_OPEN:
+            if len(payload) >= 12:
+                report_group_member(source, payload)
+            if not is_client_connected or source[0] != addr[0]:
+                return
+            if udp_path is None or udp_path['epoch'] != epoch:
+                udp_path = {'addr': source, 'epoch': epoch, 'next_seq': 1, 'unacked': {}}
+                print("UDP command path opened by %s:%d, epoch 0x%08x"%(source[0], source[1], epoch))
+            udp_path['addr'] = source
+            udp_path['last_open'] = time.time()
+        elif (data[1] == FRAME_UDP_COMMAND_ACK and len(payload) >= 12 and udp_path is not None
+                and epoch == udp_path['epoch']):
+            # The client never applies a command at or below the highest
+            # sequence number, so none of them is sent again.
+            seq = int.from_bytes(payload[4:8], 'big')
+            highest = int.from_bytes(payload[8:12], 'big')
+            unacked = udp_path['unacked']
+            acked = unacked.get(seq)
+            for done in [done for done in unacked if done <= highest or done == seq]:
+                del unacked[done]
+        elif data[1] == FRAME_UDP_GROUP_ACK and len(payload) >= 12 and epoch == group['epoch']:
+            group_acked = group_command_acked(source, int.from_bytes(payload[4:8], 'big'),
+                                              int.from_bytes(payload[8:12], 'big'))
+    if group_acked is not None:
+        print("Group command %d acknowledged by all %d member(s) in %.1f ms after %d transmission(s)"
+              %(group_acked['seq'], group_acked['members'], (time.time() - group_acked['first']) * 1000,
+                group_acked['count']))
+    if acked is not None:
+        print("Acknowledgement from TCP Client over UDP in %.1f ms after %d transmission(s):"
+              %((time.time() - acked['first']) * 1000, acked['count']),
+              payload[12:].decode('utf-8', 'replace'))
+        print("")
+        print("Enter your option: '1' to turn ON LED, 0 to turn"\
+                    " OFF LED and Press the 'Enter' key: ")
+
+def send_frame(sock, frame_type, payload = b''):
+    with send_lock:
+        sock.sendall(bytes([FRAME_MAGIC, frame_type, len(payload) >> 8, len(payload) & 0xFF]) + payload)
+
+def start_download(path):
+    # Announces an image to the client; it is sent once the client is ready.
+    global download_image, announced_image
+    try:
+        with open(path, 'rb') as image_file:
+            image = image_file.read()
+    except OSError as msg:
+        print("ERROR: ", msg)
+        return
+    if not image:
+        print("ERROR: empty image")
+        return
+    announced_image = image
+    print("Announcing %d bytes, SHA-256 %s"%(len(image), hashlib.sha256(image).hexdigest()))
+    payload = len(image).to_bytes(4, 'big') + hashlib.sha256(image).digest()
+    if conn_features & FEATURE_LZ:
+        start = time.perf_counter()
+        compressed = lz_compress(image)
+        print("Compressed to %d bytes (%.1f %%) in %.2f s"%(len(compressed),
+              100.0 * len(compressed) / len(image), time.perf_counter() - start))
+        # Data that does not compress is sent as it is.
+        if len(compressed) < len(image):
+            image = compressed
+            payload += len(image).to_bytes(4, 'big')
+    if conn_features & FEATURE_CRC32C:
+        image = add_block_crcs(image)
+    download_image = image
+    send_frame(conn, FRAME_DOWNLOAD, payload)
+
+def start_upload(args):
+    # Asks the client for the start of its download region; by default as
+    # many bytes as the last image it verified.
+    global upload_start
+    try:
+        length = int(args[0], 0) if args else len(last_image)
+    except (ValueError, TypeError):
+        print("Usage: upload [length]; the default length needs a downloaded image")
+        return
+    upload_start = time.time()
+    send_frame(conn, FRAME_UPLOAD, (0).to_bytes(4, 'big') + length.to_bytes(4, 'big'))
+
+def upload_done():
+    # Checks and saves the uploaded data.
+    elapsed = time.time() - upload_start
+    digest = hashlib.sha256(upload_data).hexdigest()
+    print("Uploaded %d bytes in %.3f s (%.2f MB/s), SHA-256 %s"%(len(upload_data), elapsed,
+          len(upload_data) / elapsed / 1e6 if elapsed > 0 else 0, digest))
+    if upload_decoder is not None:
+        print("Received %d compressed bytes (%.1f %%)"%(upload_received,
+              100.0 * upload_received / max(len(upload_data), 1)))
+    if conn_features & FEATURE_CRC32C:
+        print("Upload frames with a CRC error: %d"%(upload_crc_errors))
+    if last_image is not None:
+        print("Upload %s the last downloaded image"%
+              ("matches" if upload_data == last_image[:len(upload_data)] else "DOES NOT match"))
+    with open(UPLOAD_FILE, 'wb') as upload_file:
+        upload_file.write(upload_data)
+    print("Saved to", UPLOAD_FILE)
+
+def crc32c(data, crc = 0):
+    # Continues the CRC-32C of the data before, 0 for none, over the data.
+    crc ^= 0xFFFFFFFF
+    for byte in data:
+        crc = CRC32C_TABLE[(crc ^ byte) & 0xFF] ^ (crc >> 8)
+    return crc ^ 0xFFFFFFFF
+
+def add_block_crcs(image):
+    # Follows each block of the image with its CRC-32C, as the client checks
+    # them when the feature is enabled.
+    out = bytearray()
+    for start in range(0, len(image), DOWNLOAD_BLOCK_SIZE):
+        block = image[start:start + DOWNLOAD_BLOCK_SIZE]
+        out += block + crc32c(block).to_bytes(CRC_SIZE, 'big')
+    return bytes(out)
+
+def lz_compress(data):
+    # Compresses a whole image. Any match within the window is valid, so this
+    # finds its matches in its own way; the client only has to decompress.
+    out = bytearray()
+    last = {}
+    group = bytearray(1)
+    items = 0
+    position = 0
+    while position < len(data):
+        length = 0
+        if position + LZ_MIN_MATCH <= len(data):
+            key = data[position:position + LZ_MIN_MATCH]
+            candidate = last.get(key)
+            last[key] = position
+            if candidate is not None and position - candidate <= LZ_WINDOW_SIZE:
+                limit = min(LZ_MAX_MATCH, len(data) - position)
+                length = LZ_MIN_MATCH
+                while length < limit and data[candidate + length] == data[position + length]:
+                    length += 1
+        if length >= LZ_MIN_MATCH:
+            distance = position - candidate - 1
+            code = length - LZ_MIN_MATCH
+            group[0] |= 1 << items
+            group += bytes([(min(code, 31) << 3) | (distance >> 8), distance & 0xFF])
+            if code >= 31:
+                group.append(code - 31)
+            for index in range(position + 1, min(position + length, len(data) - LZ_MIN_MATCH + 1)):
+                last[data[index:index + LZ_MIN_MATCH]] = index
+            position += length
+        else:
+            group.append(data[position])
+            position += 1
+        items += 1
+        if items == 8:
+            out += group
+            group = bytearray(1)
+            items = 0
+    if items:
+        out += group
+    return bytes(out)
+
+class LzDecoder:
+    # Decompresses a stream that arrives in pieces cut anywhere.
+    def __init__(self):
+        self.out = bytearray()
+        self.state = 0
+        self.flags = 0
+        self.items = 0
+        self.token = 0
+
+    def copy(self, distance, length):
+        out = self.out
+        if distance >= length:
+            start = len(out) - distance
+            out += out[start:start + length]
+        else:
+            for _ in range(length):
+                out.append(out[-distance])
+
+    def decode(self, data):
+        # Returns the bytes that the new data stands for.
+        start = len(self.out)
+        for byte in data:
+            if self.state == 0:
+                self.flags = byte
+                self.items = 8
+                self.state = 1
+                continue
+            if self.state == 1:
+                if self.flags & 1:
+                    self.token = byte
+                    self.state = 2
+                    continue
+                self.out.append(byte)
+            elif self.state == 2:
+                self.distance = (((self.token & 7) << 8) | byte) + 1
+                if self.token >> 3 == 31:
+                    self.state = 3
+                    continue
+                self.copy(self.distance, (self.token >> 3) + LZ_MIN_MATCH)
+            else:
+                self.copy(self.distance, LZ_MIN_MATCH + 31 + byte)
+            self.flags >>= 1
+            self.items -= 1
+            self.state = 1 if self.items else 0
+        return bytes(self.out[start:])
+
+def benchmark_lz(args):
+    # Compresses and decompresses a file, by default this script, in pieces
+    # of one TCP segment, and prints the ratio and both throughputs.
+    path = args[0] if args else __file__
+    try:
+        with open(path, 'rb') as data_file:
+            data = data_file.read()
+    except OSError as msg:
+        print("ERROR: ", msg)
+        return
+    start = time.perf_counter()
+    compressed = lz_compress(data)
+    compress_time = time.perf_counter() - start
+    decoder = LzDecoder()
+    start = time.perf_counter()
+    for offset in range(0, len(compressed), 1460):
+        decoder.decode(compressed[offset:offset + 1460])
+    decompress_time = time.perf_counter() - start
+    if bytes(decoder.out) != data:
+        print("LZ benchmark: data does not round-trip")
+        return
+    print("LZ %s: %d -> %d bytes (%.1f %%), compress %.0f kB/s, decompress %.0f kB/s"%(
+          path, len(data), len(compressed), 100.0 * len(compressed) / max(len(data), 1),
+          len(data) / max(compress_time, 1e-9) / 1000, len(data) / max(decompress_time, 1e-9) / 1000))
+
+def print_telemetry(payload):
+    # Prints the records of a telemetry frame.
+    dropped = int.from_bytes(payload[0:4], 'big')
+    records = []
+    offset = 4
+    while offset + 6 <= len(payload):
+        length = payload[offset + 5]
+        records.append((int.from_bytes(payload[offset:offset + 4], 'big'), payload[offset + 4],
+                        payload[offset + 6:offset + 6 + length]))
+        offset += 6 + length
+    print("Telemetry: %d records, %d dropped by the client so far"%(len(records), dropped))
+    for timestamp, record_type, data in records:
+        name = TELEMETRY_RECORDS.get(record_type, "type %d"%record_type)
+        if len(data) == 4:
+            print("  %10d ms  %s %d"%(timestamp, name, int.from_bytes(data, 'big')))
+        else:
+            print("  %10d ms  %s %s"%(timestamp, name, data.hex()))
+
+def put_varint(out, value):
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+def get_varint(payload, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = payload[offset]
+        value |= (byte & 0x7F) << shift
+        offset += 1
+        if byte < 0x80:
+            return value, offset
+        shift += 7
+        if shift >= 35:
+            raise ValueError("varint too long")
+
+def encode_samples(first, period_us, values):
+    # Encodes a compact sample frame, as the client does.
+    out = bytearray()
+    put_varint(out, first)
+    put_varint(out, period_us)
+    previous = 0
+    for value in values:
+        delta = (value - previous) & 0xFFFFFFFF
+        put_varint(out, ((delta << 1) ^ (0xFFFFFFFF if delta >> 31 else 0)) & 0xFFFFFFFF)
+        previous = value
+    return bytes(out)
+
+def decode_samples(payload):
+    # Decodes a compact sample frame into the first sequence number, the period
+    # and the values. Raises IndexError or ValueError on a malformed frame.
+    first, offset = get_varint(payload, 0)
+    period_us, offset = get_varint(payload, offset)
+    values = []
+    previous = 0
+    while offset < len(payload):
+        zigzag, offset = get_varint(payload, offset)
+        previous = (previous + ((zigzag >> 1) ^ -(zigzag & 1))) & 0xFFFFFFFF
+        values.append(previous - (1 << 32) if previous & 0x80000000 else previous)
+    return first, period_us, values
+
+def benchmark_codec():
+    # Encodes and decodes a triangle wave with a little noise, like the stub
+    # source of the client, and compares the size with fixed-width frames.
+    values = [(i % 2000 if i % 2000 < 1000 else 2000 - i % 2000) - 500 + (i * 7919) % 8 - 4
+              for i in range(CODEC_BENCHMARK_SAMPLES)]
+    batches = range(0, len(values), CODEC_BENCHMARK_BATCH)
+    start = time.perf_counter()
+    frames = [encode_samples(first, 1000, values[first:first + CODEC_BENCHMARK_BATCH]) for first in batches]
+    encode_time = time.perf_counter() - start
+    start = time.perf_counter()
+    decoded = [decode_samples(frame) for frame in frames]
+    decode_time = time.perf_counter() - start
+    if [value for frame in decoded for value in frame[2]] != values:
+        print("Codec benchmark: samples do not round-trip")
+        return
+    fixed_bytes = len(frames) * (FRAME_HEADER_SIZE + 8) + 4 * len(values)
+    compact_bytes = len(frames) * FRAME_HEADER_SIZE + sum(len(frame) for frame in frames)
+    print("Codec: %d samples in batches of %d: fixed %.2f bytes/sample, compact %.2f bytes/sample (%.2fx smaller)"%(
+          len(values), CODEC_BENCHMARK_BATCH, fixed_bytes / len(values), compact_bytes / len(values),
+          fixed_bytes / compact_bytes))
+    print("Codec: encode %.0f ksamples/s, decode %.0f ksamples/s"%(
+          len(values) / encode_time / 1000, len(values) / decode_time / 1000))
+
+def receive_samples(payload, compact):
+    # Counts the samples of a sample frame and prints the statistics.
+    if compact:
+        try:
+            first, _, values = decode_samples(payload)
+        except (IndexError, ValueError):
+            print("Malformed compact sample frame")
+            return
+        count = len(values)
+    else:
+        first = int.from_bytes(payload[0:4], 'big')
+        count = (len(payload) - 8) // 4
+    if sample_stats['next'] is None:
+        sample_stats['start'] = time.time()
+    elif first != sample_stats['next']:
+        sample_stats['gaps'] += 1
+    sample_stats['next'] = first + count
+    sample_stats['samples'] += count
+    sample_stats['frames'] += 1
+    sample_stats['bytes'] += FRAME_HEADER_SIZE + len(payload)
+    elapsed = time.time() - sample_stats['start']
+    if elapsed >= SAMPLE_STATS_INTERVAL:
+        print("Samples: %.0f/s in %.1f frames/s, %.1f per frame, %.2f bytes per sample, %d gaps"%(
+              sample_stats['samples'] / elapsed, sample_stats['frames'] / elapsed,
+              sample_stats['samples'] / sample_stats['frames'],
+              sample_stats['bytes'] / max(sample_stats['samples'], 1), sample_stats['gaps']))
+        sample_stats.update({'samples': 0, 'frames': 0, 'bytes': 0, 'gaps': 0, 'start': time.time()})
+
+def send_image(sock, image):
+    global download_start
+    download_start = time.time()
+    with send_lock:
+        sock.sendall(image)
+    print("Image sent in %.3f s, waiting for the client to program it"%(time.time() - download_start))
+
+def new_lane():
+    return {'next_seq': 1, 'unacked': {}, 'next_send': 1, 'limit': 0}
+
+def send_command(session, lane_id, command):
+    lane = session['lanes'][lane_id]
+    if len(lane['unacked']) >= REPLAY_WINDOW:
+        print("Replay window full. Command not send")
+        return
+    seq = lane['next_seq']
+    lane['next_seq'] += 1
+    lane['unacked'][seq] = command
+    send_pending_commands(session, lane_id)
+
+def send_pending_commands(session, lane_id):
+    # Sends the commands of the lane not yet sent, within the credits.
+    lane = session['lanes'][lane_id]
+    sock = conn
+    if lane_id == LANE_URGENT and control_conn is not None:
+        sock = control_conn
+    while lane['next_send'] in lane['unacked'] and lane['next_send'] <= lane['limit']:
+        seq = lane['next_send']
+        send_frame(sock, FRAME_COMMAND,
+                   bytes([lane_id]) + seq.to_bytes(4, 'big') + lane['unacked'][seq])
+        lane['next_send'] += 1
+    if lane['next_send'] in lane['unacked']:
+        print("Waiting for credits from the client: %d command(s) queued"
+              %(lane['next_seq'] - lane['next_send']))
+
+def open_session(sock, payload):
+    # Resumes the session of the client, or opens a new one if the server does
+    # not know it. Only the commands the client has not received are resent,
+    # once the client grants credits for them. Commands the client received
+    # but has not yet applied are acknowledged later.
+    global current_session
+    session_id = int.from_bytes(payload[0:4], 'big')
+    with session_lock:
+        if session_id in sessions:
+            current_session = sessions[session_id]
+            for lane_id, lane in enumerate(current_session['lanes']):
+                last_received = int.from_bytes(payload[4 + 4 * lane_id:8 + 4 * lane_id], 'big')
+                lane['next_send'] = last_received + 1
+                lane['limit'] = last_received
+                print("Session 0x%08x lane %d resumed, client received up to %d, %d command(s) to resend"
+                      %(session_id, lane_id, last_received, lane['next_seq'] - last_received - 1))
+        else:
+            session_id = int.from_bytes(os.urandom(4), 'big') or 1
+            current_session = {'lanes': [new_lane() for lane_id in range(LANE_COUNT)]}
+            sessions[session_id] = current_session
+            print("Session 0x%08x opened"%(session_id))
+        send_frame(sock, FRAME_SESSION_ACK, session_id.to_bytes(4, 'big'))
+
+def process_client_data(sock, data):
+    # Answers the frames in the received data and prints the text around them.
+    # Returns the bytes of an incomplete frame, to be completed by the next recv.
+    global download_image, last_image, upload_data, upload_decoder, upload_received, conn_features
+    global upload_crc_errors
+    text = b''
+    while data:
+        start = data.find(bytes([FRAME_MAGIC]))
+        if start < 0:
+            text += data
+            data = b''
+            break
+        text += data[:start]
+        data = data[start:]
+        if len(data) < FRAME_HEADER_SIZE:
+            break
+        length = (data[2] << 8) | data[3]
+        if len(data) < FRAME_HEADER_SIZE + length:
+            break
+        payload = data[FRAME_HEADER_SIZE:FRAME_HEADER_SIZE + length]
+        if data[1] == FRAME_HEARTBEAT:
+            send_frame(sock, FRAME_HEARTBEAT_ACK)
+        elif data[1] == FRAME_SESSION and length >= 4 + 4 * LANE_COUNT:
+            open_session(sock, payload)
+        elif data[1] == FRAME_FEATURES and length >= 1 and sock is conn:
+            conn_features = payload[0] & SERVER_FEATURES
+            send_frame(sock, FRAME_FEATURES_ACK, bytes([conn_features]))
+            print("Client features 0x%02x, enabled 0x%02x"%(payload[0], conn_features))
+        elif data[1] == FRAME_COMMAND_ACK and length >= 5 and payload[0] < LANE_COUNT:
+            # The acknowledgment covers every command of the lane up to its
+            # sequence number, as the client coalesces LED commands received
+            # together.
+            seq = int.from_bytes(payload[1:5], 'big')
+            with session_lock:
+                if current_session is not None:
+                    unacked = current_session['lanes'][payload[0]]['unacked']
+                    for acked in [acked for acked in unacked if acked <= seq]:
+                        del unacked[acked]
+            text += payload[5:]
+        elif data[1] == FRAME_COMMAND_NACK and length >= 5 and payload[0] < LANE_COUNT:
+            # The client queues the commands of a lane only in order. It
+            # refused a command after a gap, or with a full queue, and names
+            # the last command it received; the ones after it are sent again.
+            last_received = int.from_bytes(payload[1:5], 'big')
+            with session_lock:
+                if current_session is not None:
+                    lane = current_session['lanes'][payload[0]]
+                    resend = [seq for seq in lane['unacked'] if seq > last_received]
+                    if resend:
+                        lane['next_send'] = min(lane['next_send'], min(resend))
+                        print("Lane %d: client received up to %d, resending from %d"
+                              %(payload[0], last_received, lane['next_send']))
+                        send_pending_commands(current_session, payload[0])
+        elif data[1] == FRAME_DOWNLOAD_ACK and length >= 1:
+            if payload[0] == DOWNLOAD_READY and download_image is not None:
+                # Send from another thread, so that this one keeps reading.
+                threading.Thread(target=send_image, args=(sock, download_image), daemon=True).start()
+                download_image = None
+            else:
+                if payload[0] == DOWNLOAD_DONE:
+                    print("Download verified by the client in %.3f s"%(time.time() - download_start))
+                    last_image = announced_image
+                download_image = None
+                text += payload[1:]
+        elif data[1] == FRAME_UPLOAD_ACK and length >= 1:
+            if payload[0] == DOWNLOAD_READY:
+                upload_data = bytearray()
+                upload_received = 0
+                upload_crc_errors = 0
+                compressed = length >= 6 and payload[5] == UPLOAD_ENCODING_LZ
+                upload_decoder = LzDecoder() if compressed else None
+            else:
+                if payload[0] == DOWNLOAD_DONE and upload_data is not None:
+                    upload_done()
+                upload_data = None
+                text += payload[1:]
+        elif data[1] == FRAME_TELEMETRY and length >= 4:
+            print_telemetry(payload)
+        elif data[1] == FRAME_SAMPLES and length >= 8:
+            receive_samples(payload, False)
+        elif data[1] == FRAME_SAMPLES_COMPACT:
+            receive_samples(payload, True)
+        elif data[1] == FRAME_UPLOAD_DATA:
+            if upload_data is not None and conn_features & FEATURE_CRC32C:
+                # The data is kept even if its CRC is wrong, so that the
+                # comparison with the image shows the damage.
+                crc = int.from_bytes(payload[-CRC_SIZE:], 'big')
+                if length < CRC_SIZE or crc32c(payload[:-CRC_SIZE]) != crc:
+                    upload_crc_errors += 1
+                    print("CRC error in the upload frame after %d bytes"%(upload_received))
+                payload = payload[:-CRC_SIZE]
+            if upload_data is not None:
+                upload_received += len(payload)
+                upload_data += upload_decoder.decode(payload) if upload_decoder is not None else payload
+        elif data[1] == FRAME_CREDIT and length >= 5 and payload[0] < LANE_COUNT:
+            with session_lock:
+                if current_session is not None:
+                    lane = current_session['lanes'][payload[0]]
+                    lane['limit'] = max(lane['limit'], int.from_bytes(payload[1:5], 'big'))
+                    send_pending_commands(current_session, payload[0])
+        data = data[FRAME_HEADER_SIZE + length:]
+    if text:
+        print("Acknowledgement from TCP Client:", text.decode('utf-8', 'replace'))
+        print("")
+        print("Enter your option: '1' to turn ON LED, 0 to turn"\
+                    " OFF LED and Press the 'Enter' key: ")
+    return data
+
+def control_server():
+    # Accepts the control connections of the client. The urgent commands not
+    # yet acknowledged when a control connection is lost are sent again on the
+    # command connection; the client ignores the ones it already has.
+    global control_conn
+    cs = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    cs.setsockopt(socket.SOL_SOCKET, socket.SO_KEEPALIVE, DEFAULT_KEEP_ALIVE)
+    cs.bind((host, control_port))
+    cs.listen(1)
+    while True:
+        sock, addr = cs.accept()
+        print('Control connection accepted: ', addr)
+        with session_lock:
+            control_conn = sock
+        pending = b''
+        while True:
+            try:
+                data = sock.recv(RECV_BUFF_SIZE)
+                if not data: break
+                pending = process_client_data(sock, pending + data)
+            except socket.error:
+                break
+        print("Control connection closed")
+        with session_lock:
+            if control_conn is sock:
+                control_conn = None
+                if current_session is not None and is_client_connected:
+                    lane = current_session['lanes'][LANE_URGENT]
+                    if lane['unacked']:
+                        lane['next_send'] = min(lane['next_send'], min(lane['unacked']))
+                    send_pending_commands(current_session, LANE_URGENT)
+        sock.close()
+
+def udp_server():
+    # Receives the datagrams of the client and retransmits the commands not
+    # acknowledged in time. Commands sent too often go over TCP.
+    udp_sock.settimeout(UDP_RETRANSMIT_TIMEOUT / 2)
+    while True:
+        try:
+            data, source = udp_sock.recvfrom(RECV_BUFF_SIZE)
+            receive_udp(data, source)
+        except socket.timeout:
+            pass
+        retransmit_group_command()
+        commands = retransmit_udp_commands()
+        if commands and is_client_connected:
+            try:
+                send_tcp_commands(commands)
+            except socket.error:
+                print("Commands not sent over TCP either: connection lost")
+
 #start the Keyboard thread
 kthread = KeyboardThread(read_user_data)
 
+#start the control connection thread
+cthread = threading.Thread(target=control_server, name='control-thread', daemon=True)
+cthread.start()
+
+#start the UDP command thread
+udp_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+udp_sock.bind((host, UDP_COMMAND_PORT))
+udp_sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+udp_sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(host))
+uthread = threading.Thread(target=udp_server, name='udp-thread', daemon=True)
+uthread.start()
+
 # Bind the socket to host IP address and port
 try:
     s.bind((host, port))
@@ -107,6 +1031,10 @@ if s is None:
 while True:    
     try:
         is_client_connected = False;
+        current_session = None
+        conn_features = 0
+        with udp_lock:
+            udp_path = None
         print("Listening on: IPv4 Address: %s Port: %d"%(host, port))
         conn, addr = s.accept()
         is_client_connected = True
@@ -118,16 +1046,15 @@ while True:
         sys.exit(1)
 
     print('Incoming connection accepted: ', addr)
+    print("Enter your option: '1' to turn ON LED, 0 to turn"\
+                " OFF LED and Press the 'Enter' key: ")
+    pending = b''
 
     while True:
         try:
-            print("Enter your option: '1' to turn ON LED, 0 to turn"\
-                        " OFF LED and Press the 'Enter' key: ")
-            
             data = conn.recv(RECV_BUFF_SIZE)
             if not data: break
-            print("Acknowledgement from TCP Client:", data.decode('utf-8'))
-            print("")
+            pending = process_client_data(conn, pending + data)
             
         except socket.error:
             print("Timeout Error! TCP Client connection closed")
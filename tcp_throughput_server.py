@@ -0,0 +1,124 @@
+#******************************************************************************
+# File Name:   tcp_throughput_server.py
+#
+# Description: A TCP server for measuring the uplink throughput of the TCP
+# client. The server requests the uplink test, receives the test data and
+# reports the achieved throughput. The client must be built with
+# USE_UPLINK_TEST set to 1 (see cmd_parser.h).
+#
+#
+#******************************************************************************
+# Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+# an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+#
+# This software, including source code, documentation and related
+# materials ("Software") is owned by Cypress Semiconductor Corporation
+# or one of its affiliates ("Cypress") and is protected by and subject to
+# worldwide patent protection (United States and foreign),
+# United States copyright laws and international treaty provisions.
+# Therefore, you may use this Software only as provided in the license
+# agreement accompanying the software package from which you
+# obtained this Software ("EULA").
+# If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+# non-transferable license to copy, modify, and compile the Software
+# source code solely for use in connection with Cypress's
+# integrated circuit products.  Any reproduction, modification, translation,
+# compilation, or representation of this Software except as specified
+# above is prohibited without the express written permission of Cypress.
+#
+# Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+# reserves the right to make changes to the Software without notice. Cypress
+# does not assume any liability arising out of the application or use of the
+# Software or any product or circuit described in the Software. Cypress does
+# not authorize its products for use in any products where a malfunction or
+# failure of the Cypress product may reasonably be expected to result in
+# significant property damage, injury or death ("High Risk Product"). By
+# including Cypress's product in a High Risk Product, the manufacturer
+# of such system or application assumes all risk of such use and in doing
+# so agrees to indemnify Cypress against all liability.
+#******************************************************************************
+
+#!/usr/bin/python
+
+import socket
+import optparse
+import time
+import sys
+
+port = 50007                                       # Port used by the TCP client
+UPLINK_TEST_CMD = b'U'                             # Uplink throughput test command
+UPLINK_TEST_ACK = b'UPLINK DONE'                   # Sent by the client after the test data
+DEFAULT_TEST_BYTES = 1024 * 1024                   # Must match THROUGHPUT_TEST_BYTES
+RECV_BUFF_SIZE = 65536                             # Receive buffer size
+
+def recv_exact(conn, length):
+    #receive exactly 'length' bytes from the connection
+    received = bytearray()
+    while len(received) < length:
+        data = conn.recv(min(RECV_BUFF_SIZE, length - len(received)))
+        if not data:
+            raise socket.error("Connection closed by the TCP client")
+        received.extend(data)
+    return bytes(received)
+
+def run_uplink_test(conn, test_bytes):
+    #request one uplink test run and return the throughput in kbit/s
+    conn.sendall(UPLINK_TEST_CMD)
+    first = recv_exact(conn, 1)
+    start = time.perf_counter()
+    recv_exact(conn, test_bytes - len(first))
+    elapsed = time.perf_counter() - start
+    ack = recv_exact(conn, len(UPLINK_TEST_ACK))
+    if ack != UPLINK_TEST_ACK:
+        print("Unexpected acknowledgement from TCP Client:", ack)
+    return (test_bytes * 8) / (elapsed * 1000)
+
+parser = optparse.OptionParser()
+parser.add_option("-b", "--bytes", dest="test_bytes", type="int", default=DEFAULT_TEST_BYTES,
+                  help="bytes sent by the client per run (THROUGHPUT_TEST_BYTES)")
+parser.add_option("-r", "--runs", dest="runs", type="int", default=5,
+                  help="number of test runs")
+(options, args) = parser.parse_args()
+
+host = socket.gethostbyname(socket.gethostname())  # IP address of the TCP server
+
+print("==========================")
+print("TCP Throughput Server")
+print("==========================")
+s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, RECV_BUFF_SIZE)
+
+try:
+    s.bind((host, port))
+    s.listen(1)
+except socket.error as msg:
+    print("ERROR: ", msg)
+    s.close()
+    sys.exit(1)
+
+print("Listening on: IPv4 Address: %s Port: %d"%(host, port))
+conn, addr = s.accept()
+print('Incoming connection accepted: ', addr)
+
+results = []
+try:
+    for run in range(options.runs):
+        rate = run_uplink_test(conn, options.test_bytes)
+        results.append(rate)
+        print("Run %d: %d bytes, %.0f kbit/s"%(run + 1, options.test_bytes, rate))
+except socket.error as msg:
+    print("ERROR: ", msg)
+except KeyboardInterrupt:
+    print("Closing Connection")
+
+if results:
+    results.sort()
+    print("Uplink throughput over %d runs: min %.0f, median %.0f, max %.0f kbit/s"
+          %(len(results), results[0], results[len(results) // 2], results[-1]))
+
+conn.close()
+s.close()
+
+# [] END OF FILE